@@ -8,6 +8,8 @@ extern "C" {
 
 #include "SeqLib/BamRecord.h"
 #include "SeqLib/UnalignedSequence.h"
+#include "SeqLib/ReadArena.h"
+#include "SeqLib/PhaseStats.h"
 
 namespace SeqLib {
 
@@ -35,6 +37,11 @@ namespace SeqLib {
       sum_k = 0;
       tot_len = 0;
       m_seqs_size = 0;
+      m_mem_budget = 0;
+      m_track_phases = false;
+      m_reset_peak = false;
+      m_mode = 0;
+      m_frozen = false;
     }
 
     ~BFC() {
@@ -95,18 +102,118 @@ namespace SeqLib {
     /** Return the calculated kcov */
     float GetKCov() const { return kcov; }
 
-    /** Return the calculated kcov */
+    /** Return the k-mer size, as set or as picked from the reads by the first training */
     int GetKMer() const { return kmer; }
 
+    /** Return the k-mer size used for the last training. Less than
+     * GetKMer if a memory budget lowered it for that training
+     */
+    int GetTrainedKMer() const { return bfc_opt.k; }
+
     /** Return the number of sequences controlled by this */
     int NumSequences() const { return n_seqs; } 
 
+    /** Set the number of threads used to count k-mers and correct (default 1)
+     * @exception Throws an invalid_argument if n < 1
+     */
+    void SetNumThreads(int n);
+
+    /** Return the number of threads used to count k-mers and correct */
+    int GetNumThreads() const { return bfc_opt.n_threads; }
+
+    /** Set a target size in bytes for the k-mer count tables (default 0, no target)
+     *
+     * The count tables are split into 2^l tables by the first l bits of
+     * each k-mer. Each table has a fixed cost, so with a budget, training
+     * picks the longest prefix whose tables take no more than an eighth
+     * of it. Shorter prefixes leave fewer bits for the prefix to absorb,
+     * so the k-mer size used may be lowered (not below 15) to fit. The
+     * k-mer size set stays as it is (see GetTrainedKMer). The space
+     * for the k-mers themselves grows with the number of distinct k-mers
+     * and can't be traded away.
+     */
+    void SetMemoryBudget(size_t bytes) { m_mem_budget = bytes; }
+
+    /** Return the k-mer prefix length used for the last training */
+    int GetPrefixLength() const { return bfc_opt.l_pre; }
+
+    /** Record the wall time and memory of training ("count") and correction ("correct") (default off)
+     * @param on Whether to record the phases
+     * @param reset_peak Reset the process's peak memory at the start of each
+     * phase. Off by default (see FermiAssembler::SetPhaseStats)
+     * @note See PhaseStats for how memory is measured.
+     */
+    void SetPhaseStats(bool on, bool reset_peak = false) { m_track_phases = on; m_reset_peak = reset_peak; }
+
+    /** Return the phases run so far */
+    const PhaseStatsVector& GetPhaseStats() const { return m_phases; }
+
+    /** Add reads to the training set, to be counted by FreezeCorrection
+     *
+     * For correcting a large set of reads in batches: add a sample of
+     * them (possibly over several calls), freeze, then call CorrectBatch
+     * on each batch. The reads are copied, so brv can be reused.
+     */
+    void AddTrainingReads(const BamRecordVector& brv);
+
+    /** Add sequences (with or without qualities) to the training set */
+    void AddTrainingReads(const UnalignedSequenceVector& v);
+
+    /** Count the k-mers of the training set, and fix the correction parameters
+     *
+     * Replaces any table from earlier training. Adding more training
+     * reads and freezing again counts the whole set again, as fermi-lite
+     * can't add to a table once counted.
+     * @exception Throws a runtime_error if there are no training reads
+     */
+    void FreezeCorrection();
+
+    /** Return true if the table was counted from the current training set */
+    bool IsFrozen() const { return m_frozen; }
+
+    /** Return true if there is a table to correct against (from Train, FreezeCorrection or LoadCorrection) */
+    bool HasTable() const { return ch != NULL; }
+
+    /** Drop the training set (the table stays) */
+    void ClearTraining();
+
+    /** Write the frozen training set and parameters to a file
+     *
+     * fermi-lite's count table can't be read back out, so the file holds
+     * what it was counted from: the k-mer size, quality cutoff and the
+     * training bases, one byte each (base and whether it passes the
+     * cutoff). LoadCorrection counts them again.
+     * @return False if not frozen or the file can't be written
+     */
+    bool SaveCorrection(const std::string& file) const;
+
+    /** Replace the training set and table with those written by SaveCorrection
+     * @return False if the file can't be read or is not valid
+     */
+    bool LoadCorrection(const std::string& file);
+
+    /** Correct a batch of reads in place against the table
+     *
+     * Does not change this object, so several threads can correct
+     * different batches against the same table at once. Each call also
+     * uses GetNumThreads threads of its own.
+     * @exception Throws a runtime_error if no table has been trained or loaded
+     */
+    void CorrectBatch(UnalignedSequenceVector& v) const;
+
+    /** Correct the sequences of a batch of aligned reads in place
+     * @note As for ErrorCorrectInPlace, the new sequences are set with SetSequence
+     * @exception Throws a runtime_error if no table has been trained or loaded
+     */
+    void CorrectBatch(BamRecordVector& brv) const;
+
   private:
 
     // the amount of memory allocated
     size_t m_seqs_size;
 
-    void learn_correct();
+    // count the k-mers of seqs into ch
+    void learn_correct(size_t n, fseq1_t* seqs);
 
     bfc_opt_t bfc_opt;
 
@@ -135,9 +242,16 @@ namespace SeqLib {
     // fermi lite options
     fml_opt_t fml_opt;
 
-    // vector of names
+    // names of the reads. The seq and qual of each read are malloc'd
+    // on their own, as filtering frees the reads it drops
+    ReadArena m_name_arena;
+
+    // vector of names (in m_name_arena)
     std::vector<char*> m_names;
 
+    // make room in m_seqs for n more reads
+    bool reserve(size_t n);
+
     // assign names, qualities and seq to m_seqs
     void allocate_sequences_from_reads(const BamRecordVector& brv);
 
@@ -147,6 +261,33 @@ namespace SeqLib {
     // do the actual read correction
     void correct_reads();
 
+    // set the coverage cutoffs and m_mode from the histogram of ch
+    void set_coverage();
+
+    // correct seqs against ch, without changing this object
+    void correct_batch(std::vector<fseq1_t>& seqs) const;
+
+    // training set for FreezeCorrection, in m_train_arena
+    ReadArena m_train_arena;
+    std::vector<fseq1_t> m_train;
+
+    // ch was counted from m_train
+    bool m_frozen;
+
+    // peak of the k-mer histogram of ch
+    int m_mode;
+
+    // target bytes for the count tables, 0 for none
+    size_t m_mem_budget;
+
+    // per-phase time and memory, if m_track_phases
+    bool m_track_phases;
+    bool m_reset_peak;
+    PhaseStatsVector m_phases;
+
+    // choose the prefix length (and maybe k) to fit m_mem_budget
+    void fit_memory_budget();
+
     // 0 turns off filter uniq
     int flt_uniq; // from fml_correct call
     
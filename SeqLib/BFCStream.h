@@ -0,0 +1,120 @@
+#ifndef SEQLIB_BFC_STREAM_H__
+#define SEQLIB_BFC_STREAM_H__
+
+#include <iostream>
+#include <stdint.h>
+
+#include "SeqLib/BFC.h"
+#include "SeqLib/BamReader.h"
+#include "SeqLib/BamWriter.h"
+#include "SeqLib/FastqReader.h"
+
+namespace SeqLib {
+
+  /** Throughput and queue statistics for a BFCStream run
+   *
+   * Stage times are the wall time each stage spent doing work (not
+   * waiting on a queue). For the correct stage this is summed over all
+   * of the correction threads.
+   */
+  struct BFCStreamStats {
+
+    BFCStreamStats() : reads_in(0), reads_out(0), chunks(0), max_chunks_in_flight(0), read_time(0),
+      correct_time(0), write_time(0), wall_time(0), correct_queue_max(0), correct_queue_mean(0) {}
+
+    uint64_t reads_in; ///< Number of reads decoded
+    uint64_t reads_out; ///< Number of reads written
+    uint64_t chunks; ///< Number of chunks processed
+    size_t max_chunks_in_flight; ///< Most chunks held in memory at once
+
+    double read_time; ///< Seconds spent decoding
+    double correct_time; ///< Seconds spent correcting (summed over threads)
+    double write_time; ///< Seconds spent writing
+    double wall_time; ///< Total wall-clock seconds for the run
+
+    size_t correct_queue_max; ///< Max number of chunks waiting to be corrected
+    double correct_queue_mean; ///< Mean number of chunks waiting to be corrected
+
+    /** Print the per-stage throughput and queue occupancy */
+    friend std::ostream& operator<<(std::ostream& out, const BFCStreamStats& s);
+
+  };
+
+  /** Streaming error correction of reads against a pre-trained BFC table
+   *
+   * BFC::ErrorCorrect needs every read in memory at once. BFCStream
+   * instead reads the input in fixed-size chunks on one thread, corrects
+   * the chunks on a pool of threads with BFC::CorrectBatch, and writes
+   * them out on the calling thread in the input order. At most
+   * 2 * queue size + threads chunks are alive at once, so memory is
+   * bounded by the chunk size, not by the size of the input.
+   *
+   * The table has to be trained first, e.g. with AddTrainingReads on a
+   * sample of the input and FreezeCorrection, or with LoadCorrection.
+   * It is only read during the run, and must outlive the BFCStream.
+   */
+  class BFCStream {
+
+  public:
+
+    /** Construct a stream that corrects against a trained table, with one thread
+     * @param table Trained BFC table. Each correction thread also uses its GetNumThreads threads.
+     */
+    explicit BFCStream(const BFC& table) : m_bfc(&table), m_threads(1), m_chunk_size(10000), m_queue_size(4) {}
+
+    /** Set the number of correction threads (default 1)
+     * @exception Throws an invalid_argument if n < 1
+     */
+    void SetNumThreads(int n);
+
+    /** Set the number of reads per chunk (default 10000)
+     * @exception Throws an invalid_argument if n == 0
+     */
+    void SetChunkSize(size_t n);
+
+    /** Set the maximum number of chunks waiting to be corrected (default 4)
+     * @exception Throws an invalid_argument if n == 0
+     */
+    void SetQueueSize(size_t n);
+
+    /** Correct all reads from the reader and write them to the writer
+     *
+     * Reads keep their alignments; the corrected sequences are set with
+     * BamRecord::SetSequence, as for BFC::ErrorCorrectInPlace.
+     * @param r Open reader. Any regions set on the reader are respected.
+     * @param w Open writer. The header should already have been written.
+     * @return false if a record could not be written
+     * @exception Throws a runtime_error if the table has not been trained or loaded,
+     * or a thread cannot be created
+     */
+    bool Run(BamReader& r, BamWriter& w);
+
+    /** Correct all sequences from a FASTA/FASTQ and write them to a stream
+     *
+     * Sequences with qualities are written as FASTQ, the others as FASTA.
+     * @return false if the stream went bad
+     * @exception Throws a runtime_error if the table has not been trained or loaded,
+     * or a thread cannot be created
+     */
+    bool Run(FastqReader& r, std::ostream& out);
+
+    /** Return the statistics from the last call to Run */
+    const BFCStreamStats& Stats() const { return m_stats; }
+
+  private:
+
+    const BFC* m_bfc;
+
+    int m_threads;
+
+    size_t m_chunk_size;
+
+    size_t m_queue_size;
+
+    BFCStreamStats m_stats;
+
+  };
+
+}
+
+#endif
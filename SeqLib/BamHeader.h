@@ -102,6 +102,13 @@ namespace SeqLib {
      */
     int Name2ID(const std::string& name) const;
 
+    /** Get the numeric ID associated with a sequence name, without making a string
+     * @param name Start of the name (need not be NUL-terminated)
+     * @param len Length of the name
+     * @return ID of named sequence, or -1 if not in dictionary
+     */
+    int Name2ID(const char* name, size_t len) const;
+
     /** Return the reference sequences as vector of HeaderSequence objects */
     HeaderSequenceVector GetHeaderSequenceVector() const;
 
@@ -116,8 +123,14 @@ namespace SeqLib {
     // replaces part of bam_name2id that makes the hash table
     void ConstructName2IDTable();
 
-    // hash table for name to id
-    SeqPointer<SeqHashMap<std::string, int> > n2i;
+    // open-addressing hash table for name to id. Slots hold the
+    // hash and the id (-1 if empty), and names are compared
+    // against the header itself, so lookups don't allocate
+    struct NameSlot {
+      uint32_t hash;
+      int32_t id;
+    };
+    SeqPointer<std::vector<NameSlot> > n2i;
 
     // adapted from sam_hdr_read
     bam_hdr_t* sam_hdr_read2(const std::string& hdr) const;
@@ -108,6 +108,12 @@ class CigarField {
 
  public:
 
+   /** Construct an empty CIGAR */
+   Cigar() {}
+
+   /** Construct from raw sam.h ops (first 4 bits op, last 28 len), eg StripedSmithWaterman::Alignment::cigar */
+   explicit Cigar(const std::vector<uint32_t>& raw) : m_data(raw.begin(), raw.end()) {}
+
    typedef std::vector<CigarField>::iterator iterator; ///< Iterator for move between CigarField ops
    typedef std::vector<CigarField>::const_iterator const_iterator; ///< Iterator (const) for move between CigarField ops
    iterator begin() { return m_data.begin(); } ///< Iterator (aka std::vector<CigarField>.begin()
@@ -436,6 +442,16 @@ class BamRecord {
   /** Set the cigar field explicitly */
   void SetCigar(const Cigar& c);
 
+  /** Set the cigar field from raw BAM-encoded operations
+   *
+   * The rest of the record is shifted in place, and the data buffer
+   * only grows when the new cigar does not fit, so a recycled record
+   * is not reallocated from one call to the next.
+   * @param cigar Operations, each length << BAM_CIGAR_SHIFT | op
+   * @param n Number of operations
+   */
+  void SetCigar(const uint32_t* cigar, size_t n);
+
   /** Print a SAM-lite record for this alignment */
   friend std::ostream& operator<<(std::ostream& out, const BamRecord &r);
 
@@ -530,6 +546,11 @@ class BamRecord {
   /** Get the sequence of this read as a string */
   /*inline */std::string Sequence() const;
 
+  /** Decode the read sequence into a caller-provided buffer, without allocating
+   * @param out Buffer of at least Length() + 1 chars. Filled as Sequence() would be, NUL-terminated
+   */
+  void SequenceTo(char* out) const;
+
   /** Return the mean phred score 
    */
   double MeanPhred() const;
@@ -554,6 +575,23 @@ class BamRecord {
     return out;
   }
 
+  /** Decode the quality scores into a caller-provided buffer, without allocating
+   * @param out Buffer of at least Length() + 1 chars. Filled as Qualities() would be, NUL-terminated
+   * @param offset Encoding offset for phred quality scores. Default 33
+   * @return False (and out set to "") if the read has no quality scores
+   */
+  inline bool QualitiesTo(char* out, int offset = 33) const {
+    uint8_t * p = bam_get_qual(b);
+    if (!p || !p[0]) {
+      out[0] = '\0';
+      return false;
+    }
+    for (int32_t i = 0; i < b->core.l_qseq; ++i)
+      out[i] = (char)(p[i] + offset);
+    out[b->core.l_qseq] = '\0';
+    return true;
+  }
+
   /** Get the start of the alignment on the read, by removing soft-clips
    * Do this in the reverse orientation though.
    */
@@ -834,6 +872,23 @@ class BamRecord {
      }
    };
 
+   /** @brief Sort reads by position, in the order of ByReadPosition
+    *
+    * Pulls each read's chromosome and position into a packed key once,
+    * then radix sorts the keys, so no read is touched during the sort.
+    * Much faster than std::sort with ByReadPosition on large batches.
+    * The sort is stable.
+    * @param reads Reads to sort in place
+    * @param num_threads Number of threads to pull keys and sort with
+    */
+   void SortByPosition(BamRecordVector& reads, int num_threads = 1);
+
+   /** @brief Sort reads by mate position, in the order of ByMatePosition
+    * @param reads Reads to sort in place. The sort is stable.
+    * @param num_threads Number of threads to pull keys and sort with
+    */
+   void SortByMatePosition(BamRecordVector& reads, int num_threads = 1);
+
 }
 
 }
@@ -6,6 +6,8 @@
 #include <iostream>
 
 #include "SeqLib/BamRecord.h"
+#include "SeqLib/ReadArena.h"
+#include "SeqLib/PhaseStats.h"
 
 extern "C" 
 {
@@ -31,8 +33,9 @@ namespace SeqLib {
     /** Provide a set of reads to be assembled 
      * @param Reads with or without quality scores
      * @note This will copy the reads and quality scores
-     * into this object. Deallocation is automatic with object
-     * destruction, or with ClearReads.
+     * into this object, decoding them straight from the BAM
+     * records into blocks of memory held by the assembler.
+     * Deallocation is automatic with object destruction, or with ClearReads.
      */ 
     void AddReads(const BamRecordVector& brv);
 
@@ -91,15 +94,44 @@ namespace SeqLib {
     /** Return the number of sequences that are controlled by this assembler */
     size_t NumSequences() const { return n_seqs; }
 
+    /** Set the number of threads fermi-lite uses to correct and assemble (default 1)
+     * @exception Throws an invalid_argument if n < 1
+     */
+    void SetNumThreads(int n);
+
+    /** Return the number of threads used to correct and assemble */
+    int GetNumThreads() const { return opt.n_threads; }
+
+    /** Record the wall time and memory of each phase (default off)
+     *
+     * The phases are "correct" (k-mer counting and correction, which
+     * fermi-lite does in one call), "filter" (dropping reads with unique
+     * k-mers), "index" (building the FM-index) and "graph" (building and
+     * cleaning the string graph, and emitting unitigs).
+     * @param on Whether to record the phases
+     * @param reset_peak Reset the process's peak memory at the start of
+     * each phase, so each peak is the phase's own. Off by default, as
+     * this changes state for the whole process (see ResetPeakResidentBytes).
+     * @note See PhaseStats for how memory is measured.
+     */
+    void SetPhaseStats(bool on, bool reset_peak = false) { m_track_phases = on; m_reset_peak = reset_peak; }
+
+    /** Return the phases run since the reads were last cleared */
+    const PhaseStatsVector& GetPhaseStats() const { return m_phases; }
+
   private:
 
-    // reads to assemble
+    // reads to assemble. fermi-lite frees the reads it filters out and
+    // indexes, so each seq and qual is malloc'd on its own
     fseq1_t *m_seqs;
   
     // size of m_seqs
     size_t m;
+
+    // names of the reads
+    ReadArena m_name_arena;
   
-    std::vector<std::string> m_names;
+    std::vector<const char*> m_names;
 
     // number of base-pairs
     uint64_t size;
@@ -116,6 +148,14 @@ namespace SeqLib {
     // the unitigs
     fml_utg_t *m_utgs;
 
+    // per-phase time and memory, if m_track_phases
+    bool m_track_phases;
+    bool m_reset_peak;
+    PhaseStatsVector m_phases;
+
+    // make room in m_seqs for n more reads
+    void reserve(size_t n);
+
   };
   
 
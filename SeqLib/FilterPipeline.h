@@ -0,0 +1,113 @@
+#ifndef SEQLIB_FILTER_PIPELINE_H__
+#define SEQLIB_FILTER_PIPELINE_H__
+
+#include <iostream>
+#include <stdint.h>
+
+#include "SeqLib/BamReader.h"
+#include "SeqLib/BamWriter.h"
+#include "SeqLib/ReadFilter.h"
+
+namespace SeqLib {
+
+  /** Throughput and queue statistics for a FilterPipeline run
+   *
+   * Stage times are the wall time each stage spent doing work (not
+   * waiting on a queue). For the filter stage this is summed over all
+   * of the filter threads.
+   */
+  struct FilterPipelineStats {
+
+    FilterPipelineStats() : reads_in(0), reads_out(0), batches(0), read_time(0), filter_time(0),
+      write_time(0), wall_time(0), filter_queue_max(0), filter_queue_mean(0),
+      write_queue_max(0), write_queue_mean(0) {}
+
+    uint64_t reads_in; ///< Number of records decoded
+    uint64_t reads_out; ///< Number of records that passed the filter and were written
+    uint64_t batches; ///< Number of record batches processed
+
+    double read_time; ///< Seconds spent decoding
+    double filter_time; ///< Seconds spent filtering (summed over threads)
+    double write_time; ///< Seconds spent writing
+    double wall_time; ///< Total wall-clock seconds for the run
+
+    size_t filter_queue_max; ///< Max number of batches waiting to be filtered
+    double filter_queue_mean; ///< Mean number of batches waiting to be filtered
+    size_t write_queue_max; ///< Max number of batches waiting to be written
+    double write_queue_mean; ///< Mean number of batches waiting to be written
+
+    /** Print the per-stage throughput and queue occupancy */
+    friend std::ostream& operator<<(std::ostream& out, const FilterPipelineStats& s);
+
+  };
+
+  /** Multi-threaded read -> filter -> write driver
+   *
+   * Runs the usual GetNextRecord / ReadFilterCollection::isValid / WriteRecord
+   * loop as three stages connected by bounded queues. Records are decoded
+   * on one thread, grouped into batches, filtered by a pool of worker
+   * threads (each with its own copy of the ReadFilterCollection) and
+   * written on one thread in the original input order. The pass counts
+   * of the copies are added to the pipeline's filter (see GetFilter)
+   * after each Run.
+   */
+  class FilterPipeline {
+
+  public:
+
+    /** Construct a pipeline that passes all reads, with one filter thread */
+    FilterPipeline() : m_threads(1), m_batch_size(1000), m_queue_size(8) {}
+
+    /** Set the filter to apply to each read
+     * @param rfc Filter collection. A copy is made for each filter thread.
+     */
+    void SetFilter(const Filter::ReadFilterCollection& rfc) { m_filter = rfc; }
+
+    /** Return the filter, with the pass counts of every Run so far added to
+     * those of the collection given to SetFilter (eg ReadFilterCollection::NumPassed)
+     */
+    const Filter::ReadFilterCollection& GetFilter() const { return m_filter; }
+
+    /** Set the number of filter threads (default 1)
+     * @exception Throws an invalid_argument if n < 1
+     */
+    void SetNumThreads(int n);
+
+    /** Set the number of reads per batch (default 1000)
+     * @exception Throws an invalid_argument if n == 0
+     */
+    void SetBatchSize(size_t n);
+
+    /** Set the maximum number of batches held in each queue (default 8)
+     * @exception Throws an invalid_argument if n == 0
+     */
+    void SetQueueSize(size_t n);
+
+    /** Stream all reads from the reader to the writer, keeping those that pass the filter
+     * @param r Open reader. Any regions set on the reader are respected.
+     * @param w Open writer. The header should already have been written.
+     * @return false if a record could not be written
+     * @exception Throws a runtime_error if a thread cannot be created
+     */
+    bool Run(BamReader& r, BamWriter& w);
+
+    /** Return the statistics from the last call to Run */
+    const FilterPipelineStats& Stats() const { return m_stats; }
+
+  private:
+
+    int m_threads;
+
+    size_t m_batch_size;
+
+    size_t m_queue_size;
+
+    Filter::ReadFilterCollection m_filter;
+
+    FilterPipelineStats m_stats;
+
+  };
+
+}
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef SEQLIB_GENOMIC_MASK_H__
+#define SEQLIB_GENOMIC_MASK_H__
+
+#include <vector>
+#include <stdint.h>
+
+#include "SeqLib/GenomicRegionCollection.h"
+
+namespace SeqLib {
+
+  /** Fast membership tests against a fixed set of genomic regions
+   *
+   * For when all that is needed is whether a position or range touches
+   * a target set, not which regions it hits. The regions are merged
+   * into sorted runs per chromosome, with a coarse bin index giving the
+   * first run at or past each 16 kb of the chromosome, so a lookup is a
+   * short binary search inside one bin. Optionally a dense bitmask (one
+   * bit per base, about 400 MB for a full human genome) answers point
+   * tests in constant time.
+   *
+   * Queries are const, allocate nothing, and can be made from any
+   * number of threads. Ranges are closed, as for GenomicRegion.
+   */
+  class GenomicMask {
+
+  public:
+
+    /** Construct an empty mask, which contains nothing */
+    GenomicMask() : m_bases(0) {}
+
+    /** Build a mask covering a set of regions
+     * @param g Regions to cover. Need not be sorted or disjoint.
+     * @param dense Also build a bitmask per chromosome, for constant-time point tests
+     */
+    explicit GenomicMask(const GRC& g, bool dense = false);
+
+    /** Return true if the position is covered */
+    bool Contains(int32_t chr, int32_t pos) const;
+
+    /** Return true if any base of [pos1, pos2] is covered */
+    bool Overlaps(int32_t chr, int32_t pos1, int32_t pos2) const;
+
+    /** Return true if any base of the region is covered (strand is ignored) */
+    bool Overlaps(const GenomicRegion& gr) const { return Overlaps(gr.chr, gr.pos1, gr.pos2); }
+
+    /** Return true if the mask covers nothing */
+    bool IsEmpty() const { return m_bases == 0; }
+
+    /** Return the number of bases covered */
+    int64_t CoveredBases() const { return m_bases; }
+
+    /** Return the number of disjoint runs the regions merged into */
+    size_t NumRuns() const;
+
+    /** Return the bytes of memory held by the mask */
+    size_t bytes() const;
+
+  private:
+
+    struct ChrMask {
+      std::vector<int32_t> start; // sorted, disjoint runs
+      std::vector<int32_t> end;
+      std::vector<uint32_t> bins; // first run ending at or after each bin start
+      std::vector<uint64_t> bits; // optional dense mask, bit i is base i
+    };
+
+    std::vector<ChrMask> m_chr;
+
+    int64_t m_bases;
+
+    // index of the first run on c ending at or after pos, or c.end.size()
+    size_t first_run(const ChrMask& c, int32_t pos) const;
+
+  };
+
+}
+
+#endif
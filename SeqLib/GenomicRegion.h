@@ -53,6 +53,7 @@ class GenomicRegion {
    * This calls the samtools-like parser, which accepts in form "chr7:10,000-11,100".
    * Note that this requires that a BamHeader be provided as well 
    * to convert the text representation of the chr to the id number.
+   * A region with no end (e.g. "1" or "1:1,000") runs to the end of the chromosome.
    * @param reg Samtools-style string (e.g. "1:1,000,000-2,000,000") or single chr
    * @param h Pointer to BAM header that will be used to convert chr string to ref id
    * @exception throws an invalid_argument exception if cannot parse correctly
@@ -163,6 +164,18 @@ class GenomicRegion {
 
 typedef std::vector<GenomicRegion> GenomicRegionVector;
 
+/** Parse many samtools-style region strings at once
+ *
+ * Same rules as the GenomicRegion(reg, hdr) constructor. Chromosome
+ * names are looked up in place in the header's name table, and runs of
+ * regions on the same chromosome only look the name up once.
+ * @param regions Region strings (e.g. "1:1,000,000-2,000,000" or "1")
+ * @param hdr Header to convert chromosome names to IDs
+ * @exception Throws an invalid_argument if the header is empty, or a
+ * region's chromosome is not in the header
+ */
+GenomicRegionVector ParseRegions(const std::vector<std::string>& regions, const BamHeader& hdr);
+
 }
 
 
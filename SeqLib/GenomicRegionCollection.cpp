@@ -1,15 +1,26 @@
 #include "SeqLib/GenomicRegionCollection.h"
+#include "SeqLib/SeqLibThreads.h"
+#include "SeqLib/RadixSort.h"
+#include "SeqLib/OverlapSweep.h"
 
 #include <iostream>
 #include <sstream>
 #include <fstream>
 #include <cassert>
+#include <cstdio>
+#include <cstring>
 #include <set>
 #include <stdexcept>
 #include <algorithm>
 #include <zlib.h>
 
-#define GZBUFFER 4096
+// collections smaller than this are sorted with std::sort
+#define GRC_RADIX_MIN 4096
+
+// binary format written by Save
+#define GRC_FILE_MAGIC "SEQLIBGR"
+#define GRC_FILE_VERSION 1
+#define GRC_FILE_BYTE_ORDER 0x01020304u
 
 //#define DEBUG_OVERLAPS 1
 
@@ -64,18 +75,84 @@ namespace SeqLib {
     }
   }
 
+  // orders two indices into a region vector by pos2
+  template<class T>
+  struct _EndLess {
+    _EndLess(const std::vector<T>& r) : regions(r) {}
+    bool operator()(uint32_t a, uint32_t b) const { return regions[a].pos2 < regions[b].pos2; }
+    const std::vector<T>& regions;
+  };
+
+  // true if T is ordered by GenomicRegion::operator<, so a radix sort on
+  // chr, pos1 and pos2 gives the same order as std::sort. A type that
+  // declares its own operator< hides the base one and fails the match
   template<class T>
-  void GenomicRegionCollection<T>::CoordinateSort() {
+  struct _UsesRegionOrder {
+    static char test(bool (GenomicRegion::*)(const GenomicRegion&) const);
+    static long test(...);
+    enum { value = sizeof(test(&T::operator<)) == sizeof(char) };
+  };
+
+  template<class T>
+  void GenomicRegionCollection<T>::CoordinateSort(int num_threads) {
     
-    if (m_grv) {
+    if (!m_grv)
+      return;
+
+    const size_t n = m_grv->size();
+    if (!_UsesRegionOrder<T>::value || n < GRC_RADIX_MIN || n > 0xFFFFFFFFul) {
       std::sort(m_grv->begin(), m_grv->end());
-      m_sorted = true;
+    } else {
+      // radix sort on chr and pos1, pulled out once, then order ties by pos2
+      std::vector<uint64_t> keys(n);
+      std::vector<uint32_t> order(n);
+      for (size_t i = 0; i < n; ++i) {
+	keys[i] = CoordinateKey((*m_grv)[i].chr, (*m_grv)[i].pos1);
+	order[i] = i;
+      }
+      RadixSort(keys, order, num_threads);
+      _EndLess<T> less(*m_grv);
+      SortTies(keys, order, less);
+      std::vector<uint64_t>().swap(keys);
+
+      // apply the order in place, one cycle at a time, pointing each
+      // filled slot at itself
+      std::vector<T>& v = *m_grv;
+      for (size_t i = 0; i < n; ++i) {
+	if (order[i] == i)
+	  continue;
+	T first = v[i];
+	size_t j = i;
+	while (order[j] != i) {
+	  const size_t next = order[j];
+	  v[j] = v[next];
+	  order[j] = j;
+	  j = next;
+	}
+	v[j] = first;
+	order[j] = j;
+      }
     }
+
+    *m_sorted = true;
+    if (m_dynamic)
+      build_tree();
+  }
+
+  template<class T>
+  void GenomicRegionCollection<T>::SetDynamicTree(bool on) {
+    if (on)
+      CreateTreeMap();
+    m_dynamic = on;
   }
   
   template<class T>
   void GenomicRegionCollection<T>::Shuffle() {
     std::random_shuffle ( m_grv->begin(), m_grv->end() );
+    // the tree holds positions in the old order, and needs a sorted collection to rebuild
+    *m_sorted = false;
+    m_tree->clear();
+    m_dynamic = false;
   }
 
   template<class T>
@@ -95,6 +172,11 @@ namespace SeqLib {
     if (max > 0)
       m_grv->back().pos2 = max;
 
+    // moving the ends can put regions with the same start out of order
+    for (size_t i = 1; i < m_grv->size() && *m_sorted; ++i)
+      if (m_grv->at(i) < m_grv->at(i-1))
+	*m_sorted = false;
+
   }
 
   template<class T>
@@ -114,6 +196,11 @@ namespace SeqLib {
     for (size_t i = 1; i < m_grv->size(); ++i) 
       m_grv->at(i).pos1 = m_grv->at(i-1).pos2 + 1;
 
+    // a region contained in the one before it is moved past the next one
+    for (size_t i = 1; i < m_grv->size() && *m_sorted; ++i)
+      if (m_grv->at(i) < m_grv->at(i-1))
+	*m_sorted = false;
+
   }
 
   /*template<class T>
@@ -164,134 +251,273 @@ bool GenomicRegionCollection<T>::ReadMuTect(const std::string &file, const BamHe
   */
 
 template<class T>
-bool GenomicRegionCollection<T>::ReadBED(const std::string & file, const BamHeader& hdr) {
+bool GenomicRegionCollection<T>::read_regions(RegionFileReader& reader) {
 
-  m_sorted = false;
+  *m_sorted = false;
   idx = 0;
 
-  gzFile fp = NULL;
-  fp = strcmp(file.c_str(), "-")? gzopen(file.c_str(), "r") : gzdopen(fileno(stdin), "r");
-  
-  if (file.empty() || !fp) {
+  GenomicRegion gr;
+  while (reader.GetNextRegion(gr))
+    add(T(gr.chr, gr.pos1, gr.pos2));
+
+  if (reader.Failed())
+    throw std::runtime_error("GenomicRegionCollection - " + reader.Error());
+
+  return true;
+}
+
+template<class T>
+bool GenomicRegionCollection<T>::ReadBED(const std::string & file, const BamHeader& hdr, int num_threads) {
+
+  RegionFileReader reader;
+  reader.SetThreads(num_threads);
+  if (!reader.OpenBED(file, hdr)) {
     std::cerr << "BED file not readable: " << file << std::endl;
     return false;
   }
+  return read_regions(reader);
+}
 
-  // http://www.lemoda.net/c/gzfile-read/
-  size_t c = 0;
-  while (1) {
+template<class T>
+bool GenomicRegionCollection<T>::ReadVCF(const std::string & file, const BamHeader& hdr, int num_threads) {
 
-    int err;                    
-    char buffer[GZBUFFER];
-    gzgets(fp, buffer, GZBUFFER);
-    int bytes_read = strlen(buffer);
+  RegionFileReader reader;
+  reader.SetThreads(num_threads);
+  if (!reader.OpenVCF(file, hdr)) {
+    std::cerr << "VCF file not readable: " << file << std::endl;
+    return false;
+  }
+  return read_regions(reader);
+}
 
-    // get one line
-    if (bytes_read < GZBUFFER - 1) {
-      if (gzeof (fp)) break;
-      else {
-	const char * error_string;
-	error_string = gzerror (fp, &err);
-	if (err) {
-	  fprintf (stderr, "Error: %s.\n", error_string);
-	  exit (EXIT_FAILURE);
-	}
-      }
-    }
+template<class T>
+bool GenomicRegionCollection<T>::ReadBEDRegion(const std::string & file, const GenomicRegion& gr, const BamHeader& hdr) {
 
-    // prepare to loop through each field of BED line
-    size_t counter = 0;
-    std::string chr, pos1, pos2;
-    std::string line(buffer);
-    std::istringstream iss_line(line);
-    std::string val;
-    if (line.find("#") != std::string::npos) 
-      continue;
-    
-    // loop BED lines
-    while(std::getline(iss_line, val, '\t')) {
-      switch (counter) { 
-      case 0 : chr = val; break; 
-      case 1 : pos1 = val; break;
-      case 2 : pos2 = val; break;
-      }
-      if (counter >= 2)
-	break;
-      ++counter;
-    }
-    
-    // construct the GenomicRegion
-    T gr(chr, pos1, pos2, hdr);
-    
-    if (gr.chr >= 0)
-      m_grv->push_back(gr);
+  RegionFileReader reader;
+  if (!reader.OpenBED(file, hdr)) {
+    std::cerr << "BED file not readable: " << file << std::endl;
+    return false;
   }
+  if (!reader.SetRegion(gr)) {
+    std::cerr << "BED file has no tabix index: " << file << std::endl;
+    return false;
+  }
+  return read_regions(reader);
+}
 
-  return true;
+template<class T>
+bool GenomicRegionCollection<T>::ReadVCFRegion(const std::string & file, const GenomicRegion& gr, const BamHeader& hdr) {
+
+  RegionFileReader reader;
+  if (!reader.OpenVCF(file, hdr)) {
+    std::cerr << "VCF file not readable: " << file << std::endl;
+    return false;
+  }
+  if (!reader.SetRegion(gr)) {
+    std::cerr << "VCF file has no tabix index: " << file << std::endl;
+    return false;
+  }
+  return read_regions(reader);
 }
 
+  // layout of a file written by Save. All fields are in the byte order
+  // of the writer, and every section starts 8-byte aligned
+  struct _GRCFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order; // GRC_FILE_BYTE_ORDER as written
+    uint64_t num_regions;
+    uint64_t num_nodes;
+    uint32_t num_chr;
+    uint32_t reserved;
+  };
+
+  struct _GRCFileRegion {
+    int32_t chr;
+    int32_t pos1;
+    int32_t pos2;
+    int32_t strand;
+  };
+
+  // the index nodes of one chromosome
+  struct _GRCFileChr {
+    int32_t chr;
+    int32_t height;
+    uint64_t offset;
+    uint64_t count;
+  };
+
+  // orders two indices into a region vector by the regions
+  template<class T>
+  struct _RegionIndexLess {
+    _RegionIndexLess(const std::vector<T>& r) : regions(r) {}
+    bool operator()(size_t a, size_t b) const { return regions[a] < regions[b]; }
+    const std::vector<T>& regions;
+  };
+
 template<class T>
-bool GenomicRegionCollection<T>::ReadVCF(const std::string & file, const BamHeader& hdr) {
+bool GenomicRegionCollection<T>::Save(const std::string& file) const {
+
+  typedef GenomicIntervalTree::level Index;
+  const size_t n = m_grv->size();
+
+  // write in coordinate order, as CreateTreeMap leaves it
+  std::vector<size_t> order(n);
+  for (size_t i = 0; i < n; ++i)
+    order[i] = i;
+  if (!*m_sorted)
+    std::stable_sort(order.begin(), order.end(), _RegionIndexLess<T>(*m_grv));
+
+  std::vector<_GRCFileRegion> regions(n);
+  for (size_t i = 0; i < n; ++i) {
+    const T& g = (*m_grv)[order[i]];
+    regions[i].chr = g.chr;
+    regions[i].pos1 = g.pos1;
+    regions[i].pos2 = g.pos2;
+    regions[i].strand = g.strand;
+  }
 
-  m_sorted = false;
-  idx = 0;
+  // one index per chromosome, as built by CreateTreeMap
+  std::vector<_GRCFileChr> chrs;
+  std::vector<Index::node> nodes;
+  nodes.reserve(n);
+  size_t i = 0;
+  while (i < n) {
+    size_t e = i;
+    while (e < n && regions[e].chr == regions[i].chr)
+      ++e;
+    Index index;
+    index.reserve(e - i);
+    for (size_t j = i; j < e; ++j)
+      index.add(regions[j].pos1, regions[j].pos2, j);
+    index.index();
+    _GRCFileChr c;
+    c.chr = regions[i].chr;
+    c.height = index.height();
+    c.offset = nodes.size();
+    c.count = index.size();
+    chrs.push_back(c);
+    nodes.insert(nodes.end(), index.data(), index.data() + index.size());
+    i = e;
+  }
 
-  gzFile fp = NULL;
-  fp = strcmp(file.c_str(), "-")? gzopen(file.c_str(), "r") : gzdopen(fileno(stdin), "r");
-  
-  if (file.empty() || !fp) {
-    std::cerr << "VCF file not readable: " << file << std::endl;
+  _GRCFileHeader h;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, GRC_FILE_MAGIC, 8);
+  h.version = GRC_FILE_VERSION;
+  h.byte_order = GRC_FILE_BYTE_ORDER;
+  h.num_regions = n;
+  h.num_nodes = nodes.size();
+  h.num_chr = chrs.size();
+
+  // write to the side and move into place, so processes that have the
+  // old file mapped keep a consistent copy
+  const std::string tmp = file + ".tmp";
+  FILE* fp = fopen(tmp.c_str(), "wb");
+  if (!fp) {
+    std::cerr << "Region file not writable: " << file << std::endl;
     return false;
   }
+  bool ok = fwrite(&h, sizeof(h), 1, fp) == 1;
+  if (ok && n)
+    ok = fwrite(&regions[0], sizeof(_GRCFileRegion), n, fp) == n;
+  if (ok && !chrs.empty())
+    ok = fwrite(&chrs[0], sizeof(_GRCFileChr), chrs.size(), fp) == chrs.size();
+  if (ok && !nodes.empty())
+    ok = fwrite(&nodes[0], sizeof(Index::node), nodes.size(), fp) == nodes.size();
+  ok = (fclose(fp) == 0) && ok;
+  if (ok)
+    ok = rename(tmp.c_str(), file.c_str()) == 0;
+  if (!ok) {
+    remove(tmp.c_str());
+    std::cerr << "Region file not writable: " << file << std::endl;
+  }
+  return ok;
+}
 
-  // http://www.lemoda.net/c/gzfile-read/
-  size_t c = 0;
-  while (1) {
+template<class T>
+bool GenomicRegionCollection<T>::Load(const std::string& file) {
 
-    int err;                    
-    char buffer[GZBUFFER];
-    gzgets(fp, buffer, GZBUFFER);
-    int bytes_read = strlen(buffer);
+  typedef GenomicIntervalTree::level Index;
 
-    // get one line
-    if (bytes_read < GZBUFFER - 1) {
-      if (gzeof (fp)) break;
-      else {
-	const char * error_string;
-	error_string = gzerror (fp, &err);
-	if (err) {
-	  fprintf (stderr, "Error: %s.\n", error_string);
-	  exit (EXIT_FAILURE);
-	}
-      }
-    }
+  SeqPointer<MappedFile> map(new MappedFile());
+  if (!map->Open(file)) {
+    std::cerr << "Region file not readable: " << file << std::endl;
+    return false;
+  }
 
-    // prepare to loop through each field of BED line
-    size_t counter = 0;
-    std::string chr, pos;
-    std::string line(buffer);
-    std::istringstream iss_line(line);
-    std::string val;
-    if (line.empty() || line.at(0) == '#')
-      continue;
-    
-    // loop VCF lines
-    while(std::getline(iss_line, val, '\t')) {
-      switch (counter) { 
-      case 0 : chr = val; break; 
-      case 1 : pos = val; break;
+  // check the whole layout before touching the collection
+  const char* d = map->data();
+  const size_t sz = map->size();
+  _GRCFileHeader h;
+  bool ok = sz >= sizeof(h);
+  if (ok) {
+    memcpy(&h, d, sizeof(h));
+    ok = !memcmp(h.magic, GRC_FILE_MAGIC, 8) && h.version == GRC_FILE_VERSION &&
+      h.byte_order == GRC_FILE_BYTE_ORDER && h.num_regions <= sz && h.num_nodes <= sz && h.num_chr <= sz;
+  }
+  if (ok)
+    ok = sizeof(h) + h.num_regions * sizeof(_GRCFileRegion) + h.num_chr * sizeof(_GRCFileChr) +
+      h.num_nodes * sizeof(Index::node) == sz;
+  const _GRCFileRegion* regions = NULL;
+  const _GRCFileChr* chrs = NULL;
+  const Index::node* nodes = NULL;
+  if (ok) {
+    regions = reinterpret_cast<const _GRCFileRegion*>(d + sizeof(h));
+    chrs = reinterpret_cast<const _GRCFileChr*>(regions + h.num_regions);
+    nodes = reinterpret_cast<const Index::node*>(chrs + h.num_chr);
+    for (size_t c = 0; ok && c < h.num_chr; ++c)
+      ok = chrs[c].count && chrs[c].offset <= h.num_nodes && chrs[c].count <= h.num_nodes - chrs[c].offset &&
+	chrs[c].height >= 0 && chrs[c].height < 64;
+  }
+
+  // each index must be the one Save builds over its chromosome's
+  // regions, as queries trust the node values, maxima and tree height
+  for (size_t c = 0; ok && c < h.num_chr; ++c) {
+    const Index::node* a = nodes + chrs[c].offset;
+    const uint64_t count = chrs[c].count;
+    int height = 0;
+    while ((2ull << height) <= count)
+      ++height;
+    ok = chrs[c].height == height;
+    int32_t max_end = a[0].stop;
+    for (uint64_t j = 0; ok && j < count; ++j) {
+      ok = a[j].value >= 0 && (uint64_t)a[j].value < h.num_regions;
+      if (ok) {
+	const _GRCFileRegion& r = regions[a[j].value];
+	ok = r.chr == chrs[c].chr && a[j].start == r.pos1 && a[j].stop == r.pos2 &&
+	  (j == 0 || a[j-1].start <= a[j].start);
+	max_end = std::max(max_end, a[j].stop);
       }
-      if (counter >= 2)
-	break;
-      ++counter;
     }
-    
-    // construct the GenomicRegion
-    T gr(chr, pos, pos, hdr);
-    if (gr.chr >= 0) 
-      m_grv->push_back(gr);
+    for (uint64_t j = 0; ok && j < count; ++j)
+      ok = a[j].max >= a[j].stop && a[j].max <= max_end;
+  }
+  if (!ok) {
+    std::cerr << "Not a valid region file: " << file << std::endl;
+    return false;
+  }
+
+  const bool dynamic = m_dynamic;
+  allocate_grc();
+  idx = 0;
+
+  // the regions are copied out (the one O(n) copy in Load), the index
+  // is used where it is
+  m_grv->resize(h.num_regions);
+  for (size_t i = 0; i < h.num_regions; ++i) {
+    T& g = (*m_grv)[i];
+    g.chr = regions[i].chr;
+    g.pos1 = regions[i].pos1;
+    g.pos2 = regions[i].pos2;
+    g.strand = regions[i].strand;
   }
+  for (size_t c = 0; c < h.num_chr; ++c)
+    (*m_tree)[chrs[c].chr].attach(nodes + chrs[c].offset, chrs[c].count, chrs[c].height);
 
+  m_map = map;
+  *m_sorted = true;
+  m_dynamic = dynamic;
   return true;
 }
 
@@ -328,43 +554,33 @@ GenomicRegionCollection<T>::GenomicRegionCollection(const std::string &file, con
 template <class T>
 void GenomicRegionCollection<T>::MergeOverlappingIntervals() {
 
-  // make the list
-  std::list<T> intervals(m_grv->begin(), m_grv->end());
-
-  intervals.sort();
-  typename std::list<T>::iterator inext(intervals.begin());
-  ++inext;
-  for (typename std::list<T>::iterator i(intervals.begin()), iend(intervals.end()); inext != iend;) {
-    if((i->pos2 >= inext->pos1) && (i->chr == inext->chr)) // change >= to > to not overlap touching intervals (eg [4,5][5,6])
-      {
-	if(i->pos2 >= inext->pos2) intervals.erase(inext++);
-	else if(i->pos2 < inext->pos2)
-	  { i->pos2 = inext->pos2; intervals.erase(inext++); }
-      }
-    else { ++i; ++inext; }
-  }
-
-  // move it over to a grv
-  m_grv->clear(); // clear the old data 
-
-  // c++11
-  //std::vector<T> v{ std::make_move_iterator(std::begin(intervals)), 
-  //    std::make_move_iterator(std::end(intervals)) };
-  //m_grv->insert(m_grv->end(), v.begin(), v.end());
+  // sort in place, skipping the sort if already in order
+  for (size_t i = 1; i < m_grv->size(); ++i)
+    if ((*m_grv)[i] < (*m_grv)[i-1]) {
+      std::sort(m_grv->begin(), m_grv->end());
+      break;
+    }
 
-  // non c++11
-  //std::vector<T> v;
-  // v.push_back(std::make_move_iterator(std::begin(intervals)));
-  //v.push_back(std::make_move_iterator(std::end(intervals)));
-  //std::vector<T> v{ std::make_move_iterator(std::begin(intervals)), 
-  //    std::make_move_iterator(std::end(intervals)) };
-  //m_grv->insert(m_grv->end(), v.begin(), v.end());
-  //m_grv->reserve(intervals.size());
-  //m_grv->append(intervals.begin(), intervals.end());
-  m_grv->insert(m_grv->end(), intervals.begin(), intervals.end());
+  // fold each interval into the last kept one, compacting to the front
+  size_t k = 0;
+  for (size_t i = 1; i < m_grv->size(); ++i) {
+    T& last = (*m_grv)[k];
+    const T& next = (*m_grv)[i];
+    if (last.pos2 >= next.pos1 && last.chr == next.chr) { // change >= to > to not overlap touching intervals (eg [4,5][5,6])
+      if (next.pos2 > last.pos2)
+	last.pos2 = next.pos2;
+    } else if (++k != i) {
+      (*m_grv)[k] = next;
+    }
+  }
+  if (!m_grv->empty())
+    m_grv->erase(m_grv->begin() + k + 1, m_grv->end());
+  *m_sorted = true;
 
   // clear the old interval tree
   m_tree->clear();
+  if (m_dynamic)
+    build_tree();
 }
 
 template <class T>
@@ -382,24 +598,32 @@ void GenomicRegionCollection<T>::CreateTreeMap() {
     return;
 
   // sort the genomic intervals
-  if (!m_sorted)
-    CoordinateSort();
-
-  // loop through and make the intervals for each chromosome
-  GenomicIntervalMap map;
-  for (size_t i = 0; i < m_grv->size(); ++i) {
-    map[m_grv->at(i).chr].push_back(GenomicInterval(m_grv->at(i).pos1, m_grv->at(i).pos2, i));
+  if (!*m_sorted) {
+    std::sort(m_grv->begin(), m_grv->end());
+    *m_sorted = true;
   }
 
-  // for each chr, make the tree from the intervals
-  //for (auto it : map) {
-  for (GenomicIntervalMap::iterator it = map.begin(); it != map.end(); ++it) {
-    GenomicIntervalTreeMap::iterator ff = m_tree->find(it->first);
-    if (ff != m_tree->end())
-      ff->second = GenomicIntervalTree(it->second);
-    else
-      m_tree->insert(std::pair<int, GenomicIntervalTree>(it->first, GenomicIntervalTree(it->second)));
-    //old //m_tree[it.first] = GenomicIntervalTree(it.second);
+  build_tree();
+}
+
+template <class T>
+void GenomicRegionCollection<T>::build_tree() {
+
+  m_tree->clear();
+
+  // collection is sorted, so each chromosome is one contiguous run
+  // and the intervals are added to its index already in start order
+  size_t i = 0;
+  while (i < m_grv->size()) {
+    const int32_t chr = m_grv->at(i).chr;
+    size_t e = i;
+    while (e < m_grv->size() && m_grv->at(e).chr == chr)
+      ++e;
+    GenomicIntervalTree& tree = (*m_tree)[chr];
+    tree.reserve(e - i);
+    for (; i < e; ++i)
+      tree.add(m_grv->at(i).pos1, m_grv->at(i).pos2, i);
+    tree.index();
   }
 
 }
@@ -452,7 +676,7 @@ GenomicRegionCollection<T>::GenomicRegionCollection(int width, int ovlp, const T
     m_grv->push_back(T(gr.chr, start, end));
   }
 
-  m_sorted = true;
+  *m_sorted = true;
 
 }
 
@@ -465,13 +689,10 @@ size_t GenomicRegionCollection<T>::CountOverlaps(const T &gr) const {
       return 0;
     }
 
-  GenomicIntervalVector giv;
-
   GenomicIntervalTreeMap::const_iterator ff = m_tree->find(gr.chr);
   if (ff == m_tree->end())
     return 0;
-  ff->second.findOverlapping(gr.pos1, gr.pos2, giv);
-  return (giv.size());
+  return ff->second.countOverlapping(gr.pos1, gr.pos2);
 }
 
   template<class T>
@@ -539,8 +760,12 @@ void GenomicRegionCollection<T>::Concat(const GenomicRegionCollection<T>& g)
 {
   if (!g.size())
     return;
-  m_sorted = false;
+  *m_sorted = false;
+  size_t n = m_grv->size();
   m_grv->insert(m_grv->end(), g.m_grv->begin(), g.m_grv->end());
+  if (m_dynamic)
+    for (; n < m_grv->size(); ++n)
+      (*m_tree)[m_grv->at(n).chr].insert(m_grv->at(n).pos1, m_grv->at(n).pos2, n);
 }
 
 template<class T>
@@ -556,7 +781,8 @@ GenomicRegionCollection<T>::~GenomicRegionCollection() {
 
 template<class T>
 void GenomicRegionCollection<T>::allocate_grc() {
-  m_sorted = false;
+  m_sorted = SeqPointer<bool>(new bool(false));
+  m_dynamic = false;
   m_grv =  SeqPointer<std::vector<T> >(new std::vector<T>()) ;
   m_tree = SeqPointer<GenomicIntervalTreeMap>(new GenomicIntervalTreeMap()) ;
 }
@@ -634,9 +860,7 @@ GenomicRegionCollection<GenomicRegion> GenomicRegionCollection<T>::FindOverlaps(
   ff->second.findOverlapping(gr.pos1, gr.pos2, giv);
   
 #ifdef DEBUG_OVERLAPS
-  std::cerr << "ff->second.intervals.size() " << ff->second.intervals.size() << std::endl;
-  for (auto& k : ff->second.intervals)
-    std::cerr << " intervals " << k.start << " to " << k.stop << " value " << k.value << std::endl;
+  std::cerr << "ff->second.size() " << ff->second.size() << std::endl;
   std::cerr << "GIV NUMBER OF HITS " << giv.size() << " for query " << gr << std::endl;
 #endif
 
@@ -658,83 +882,277 @@ GenomicRegionCollection<GenomicRegion> GenomicRegionCollection<T>::FindOverlaps(
   // this is query
   template<class T>
   template<class K>
-GenomicRegionCollection<GenomicRegion> GenomicRegionCollection<T>::FindOverlaps(GenomicRegionCollection<K>& subject, std::vector<int32_t>& query_id, std::vector<int32_t>& subject_id, bool ignore_strand) const
+GenomicRegionCollection<GenomicRegion> GenomicRegionCollection<T>::FindOverlaps(GenomicRegionCollection<K>& subject, std::vector<int32_t>& query_id, std::vector<int32_t>& subject_id, bool ignore_strand, int num_threads) const
 {  
 
   GenomicRegionCollection<GenomicRegion> output;
-  if (subject.NumTree() == 0 && subject.size() != 0) {
-    std::cerr << "!!!!!! findOverlaps: WARNING: Trying to find overlaps on empty tree. Need to run this->createTreeMap() somewhere " << std::endl;
-    return output;
-  }
-
-  // we loop through query, so want it to be smaller
-  if (subject.size() < m_grv->size() && m_grv->size() - subject.size() > 20) 
-    std::cerr << "findOverlaps warning: Suggest switching query and subject for efficiency." << std::endl;
 
-#ifdef DEBUG_OVERLAPS
-  std::cerr << "OVERLAP SUBJECT: " << std::endl;
-  for (auto& i : subject)
-    std::cerr << i << std::endl;
-#endif
+  // sorted inputs are joined in one sweep, without the tree
+  if (!*m_sorted || !subject.IsSorted()) {
 
-  // loop through the query GRanges (this) and overlap with subject
-  for (size_t i = 0; i < m_grv->size(); ++i) 
-    {
-      // which chr (if any) are common between query and subject
-      GenomicIntervalTreeMap::const_iterator ff = subject.GetTree()->find(m_grv->at(i).chr);
+    if (subject.NumTree() == 0 && subject.size() != 0) {
+      std::cerr << "!!!!!! findOverlaps: WARNING: Trying to find overlaps on empty tree. Need to run this->createTreeMap() somewhere " << std::endl;
+      return output;
+    }
+    
+    // we loop through query, so want it to be smaller
+    if (subject.size() < m_grv->size() && m_grv->size() - subject.size() > 20) 
+      std::cerr << "findOverlaps warning: Suggest switching query and subject for efficiency." << std::endl;
+  }
 
-      GenomicIntervalVector giv;
+  std::vector<OverlapResult> ov = FindOverlapPairs(subject, ignore_strand, num_threads);
 
-#ifdef DEBUG_OVERLAPS
-      std::cerr << "TRYING OVERLAP ON QUERY " << m_grv->at(i) << std::endl;
-#endif
-      //must as least share a chromosome
-      if (ff != m_tree->end())
-	{
-	  // get the subject hits
-	  ff->second.findOverlapping(m_grv->at(i).pos1, m_grv->at(i).pos2, giv);
+  query_id.reserve(query_id.size() + ov.size());
+  subject_id.reserve(subject_id.size() + ov.size());
 
-#ifdef DEBUG_OVERLAPS
-	  std::cerr << "ff->second.intervals.size() " << ff->second.intervals.size() << std::endl;
-	  for (auto& k : ff->second.intervals)
-	    std::cerr << " intervals " << k.start << " to " << k.stop << " value " << k.value << std::endl;
-	  std::cerr << "GIV NUMBER OF HITS " << giv.size() << " for query " << m_grv->at(i) << std::endl;
-#endif
-	  // loop through the hits and define the GenomicRegion
-	  for (GenomicIntervalVector::const_iterator j = giv.begin(); j != giv.end(); ++j) {
-	    //for (auto& j : giv) { // giv points to positions on subject
-	    if (ignore_strand || (subject.at(j->value).strand == m_grv->at(i).strand) )
-	      {
-		query_id.push_back(i);
-		subject_id.push_back(j->value);
-#ifdef DEBUG_OVERLAPS
-		std::cerr << "find overlaps hit " << j->start << " " << j->stop << " -- " << j->value << std::endl;
-#endif
-		output.add(GenomicRegion(m_grv->at(i).chr, std::max(static_cast<int32_t>(j->start), m_grv->at(i).pos1), std::min(static_cast<int32_t>(j->stop), m_grv->at(i).pos2)));
-	      }
-	  }
-	}
-    }
+  // trim each hit to the query
+  for (std::vector<OverlapResult>::const_iterator j = ov.begin(); j != ov.end(); ++j) {
+    const T& q = (*m_grv)[j->first];
+    const K& r = static_cast<const GenomicRegionCollection<K>&>(subject)[j->second];
+    query_id.push_back(j->first);
+    subject_id.push_back(j->second);
+    output.add(GenomicRegion(q.chr, std::max(r.pos1, q.pos1), std::min(r.pos2, q.pos2)));
+  }
 
   return output;
   
 }
 
-
 template<class T>
 GenomicRegionCollection<T>::GenomicRegionCollection(const T& gr)
 {
-  m_sorted = true;
   idx = 0;
   allocate_grc();
+  *m_sorted = true;
   m_grv->push_back(gr);
 }
 
+  // collect the subject hits for one query, in subject order
+  template<class T, class K>
+  struct _PairCollector {
+    _PairCollector(std::vector<OverlapResult>& o, const T& s, size_t q, typename std::vector<K>::const_iterator sub, bool ig) 
+      : out(o), query(s), query_id(q), subject(sub), ignore_strand(ig) {}
+    void operator()(const GenomicIntervalTree::node& n) {
+      if (ignore_strand || subject[n.value].strand == query.strand)
+	out.push_back(OverlapResult(query_id, n.value));
+    }
+    std::vector<OverlapResult>& out;
+    const T& query;
+    size_t query_id;
+    typename std::vector<K>::const_iterator subject;
+    bool ignore_strand;
+  };
+
+  // orders regions by chromosome only, to find where a chromosome starts
+  struct _ChrLess {
+    template<class K>
+    bool operator()(const K& r, int32_t chr) const { return r.chr < chr; }
+  };
+
+  // find the overlaps of query[qb, qe) against subject
+  template<class T, class K>
+  void _overlap_pairs(typename std::vector<T>::const_iterator query, size_t qb, size_t qe, bool sweep,
+		      const GenomicRegionCollection<K>& subject, bool ignore_strand, std::vector<OverlapResult>& out) {
+
+    typename std::vector<K>::const_iterator sub = subject.begin();
+    const size_t ns = subject.size();
+
+    if (!sweep) {
+      for (size_t i = qb; i < qe; ++i) {
+	GenomicIntervalTreeMap::const_iterator ff = subject.GetTree()->find(query[i].chr);
+	if (ff == subject.GetTree()->end())
+	  continue;
+	size_t b = out.size();
+	_PairCollector<T, K> c(out, query[i], i, sub, ignore_strand);
+	ff->second.visitOverlapping(query[i].pos1, query[i].pos2, c);
+	// hits from a dynamic tree may not be in subject order
+	for (size_t j = b + 1; j < out.size(); ++j)
+	  if (out[j] < out[j-1]) {
+	    std::sort(out.begin() + b, out.end());
+	    break;
+	  }
+      }
+      return;
+    }
+
+    // sweep: query starts only increase within a chromosome, so a subject
+    // that ends before the current query start can be dropped for good.
+    // active holds the subjects that have started and may still overlap,
+    // in subject order
+    std::vector<size_t> active;
+    size_t next = ns; // next subject not yet looked at
+    int32_t chr = 0;
+    for (size_t i = qb; i < qe; ++i) {
+
+      const T& q = query[i];
+      if (q.chr != chr || i == qb) {
+	chr = q.chr;
+	active.clear();
+	next = std::lower_bound(sub, sub + ns, chr, _ChrLess()) - sub;
+      }
+
+      for (; next < ns && sub[next].chr == chr && sub[next].pos1 <= q.pos2; ++next)
+	if (sub[next].pos2 >= q.pos1)
+	  active.push_back(next);
+
+      size_t k = 0;
+      for (size_t a = 0; a < active.size(); ++a) {
+	const K& r = sub[active[a]];
+	if (r.pos2 < q.pos1)
+	  continue;
+	active[k++] = active[a];
+	if (r.pos1 <= q.pos2 && (ignore_strand || r.strand == q.strand))
+	  out.push_back(OverlapResult(i, active[a]));
+      }
+      active.resize(k);
+    }
+  }
+
+  // one block of queries, for running on its own thread
+  template<class T, class K>
+  struct _OverlapTask {
+    typename std::vector<T>::const_iterator query;
+    size_t qb, qe;
+    bool sweep;
+    const GenomicRegionCollection<K>* subject;
+    bool ignore_strand;
+    std::vector<OverlapResult> out;
+    void operator()() { _overlap_pairs<T, K>(query, qb, qe, sweep, *subject, ignore_strand, out); }
+  };
+
+  template<class T>
+  template<class K>
+  std::vector<OverlapResult> GenomicRegionCollection<T>::FindOverlapPairs(const GenomicRegionCollection<K>& subject, bool ignore_strand, int num_threads) const
+  {
+    if (num_threads < 1)
+      throw std::invalid_argument("GenomicRegionCollection::FindOverlapPairs - num_threads must be >= 1");
+
+    const bool sweep = *m_sorted && subject.IsSorted();
+    if (!sweep && subject.NumTree() == 0 && subject.size() != 0) 
+      throw std::logic_error("GenomicRegionCollection::FindOverlapPairs - unsorted input needs CreateTreeMap on subject before doing range queries");
+
+    std::vector<OverlapResult> out;
+    const size_t nq = m_grv->size();
+    if (nq < 2 * static_cast<size_t>(num_threads))
+      num_threads = 1;
+
+    if (num_threads == 1) {
+      _overlap_pairs<T, K>(m_grv->begin(), 0, nq, sweep, subject, ignore_strand, out);
+      return out;
+    }
+
+    // split the queries into equal contiguous blocks. Small chromosomes share
+    // a block and large ones are split; a block starting mid-chromosome
+    // skips ahead to its first subject with a binary search.
+    std::vector<_OverlapTask<T, K> > tasks(num_threads);
+    for (int t = 0; t < num_threads; ++t) {
+      tasks[t].query = m_grv->begin();
+      tasks[t].qb = nq * t / num_threads;
+      tasks[t].qe = nq * (t + 1) / num_threads;
+      tasks[t].sweep = sweep;
+      tasks[t].subject = &subject;
+      tasks[t].ignore_strand = ignore_strand;
+    }
+    RunThreads(tasks);
+
+    // blocks are in query order, so concatenating matches the serial result
+    size_t n = 0;
+    for (size_t t = 0; t < tasks.size(); ++t)
+      n += tasks[t].out.size();
+    out.reserve(n);
+    for (size_t t = 0; t < tasks.size(); ++t)
+      out.insert(out.end(), tasks[t].out.begin(), tasks[t].out.end());
+    return out;
+  }
+
+  // the chromosomes (as pairs of region run, query run) for one thread
+  struct _CountTask {
+    const _ChrColumns* regions;
+    const _ChrColumns* queries;
+    uint32_t* counts;
+    std::vector<std::pair<size_t, size_t> > runs;
+    void operator()() {
+      _CountSweep sweep;
+      for (size_t i = 0; i < runs.size(); ++i) {
+	const size_t r = runs[i].first, q = runs[i].second;
+	const size_t rb = regions->run[r];
+	sweep.Reset(&regions->start[rb], &regions->end[rb], &regions->id[rb], regions->run[r+1] - rb, counts);
+	for (size_t j = queries->run[q]; j < queries->run[q+1]; ++j)
+	  sweep.Add(queries->start[j], queries->end[j]);
+      }
+    }
+  };
+
+  // orders (region run, query run) pairs by decreasing work
+  struct _RunPairMore {
+    _RunPairMore(const _ChrColumns& r, const _ChrColumns& q) : regions(r), queries(q) {}
+    size_t work(const std::pair<size_t, size_t>& p) const {
+      return regions.run[p.first+1] - regions.run[p.first] + queries.run[p.second+1] - queries.run[p.second];
+    }
+    bool operator()(const std::pair<size_t, size_t>& a, const std::pair<size_t, size_t>& b) const { return work(a) > work(b); }
+    const _ChrColumns& regions;
+    const _ChrColumns& queries;
+  };
+
+  template<class T>
+  template<class K>
+  std::vector<uint32_t> GenomicRegionCollection<T>::CountOverlapsBatch(const GenomicRegionCollection<K>& query, int num_threads) const
+  {
+    if (num_threads < 1)
+      throw std::invalid_argument("GenomicRegionCollection::CountOverlapsBatch - num_threads must be >= 1");
+    if (m_grv->size() > 0xFFFFFFFFul || query.size() > 0xFFFFFFFFul)
+      throw std::length_error("GenomicRegionCollection::CountOverlapsBatch - too many regions");
+
+    std::vector<uint32_t> counts(m_grv->size(), 0);
+    if (counts.empty() || query.IsEmpty())
+      return counts;
+
+    _ChrColumns regions, queries;
+    regions.fill<T>(m_grv->begin(), m_grv->size(), *m_sorted, num_threads);
+    queries.fill<K>(query.begin(), query.size(), query.IsSorted(), num_threads);
+
+    // pair up the chromosomes. Both lists are in chromosome order
+    std::vector<std::pair<size_t, size_t> > runs;
+    for (size_t r = 0, q = 0; r < regions.chr.size() && q < queries.chr.size(); ) {
+      if (regions.chr[r] < queries.chr[q])
+	++r;
+      else if (queries.chr[q] < regions.chr[r])
+	++q;
+      else {
+	if (regions.chr[r] >= 0)
+	  runs.push_back(std::make_pair(r, q));
+	++r, ++q;
+      }
+    }
+
+    // biggest chromosomes first, each to the thread with the least work
+    const size_t nt = std::min(runs.size(), static_cast<size_t>(num_threads));
+    if (!nt)
+      return counts;
+    _RunPairMore more(regions, queries);
+    std::sort(runs.begin(), runs.end(), more);
+    std::vector<_CountTask> tasks(nt);
+    std::vector<size_t> load(nt, 0);
+    for (size_t t = 0; t < nt; ++t) {
+      tasks[t].regions = &regions;
+      tasks[t].queries = &queries;
+      tasks[t].counts = &counts[0];
+    }
+    for (size_t i = 0; i < runs.size(); ++i) {
+      const size_t t = std::min_element(load.begin(), load.end()) - load.begin();
+      tasks[t].runs.push_back(runs[i]);
+      load[t] += more.work(runs[i]);
+    }
+    RunThreads(tasks);
+
+    return counts;
+  }
+
 template<class T>
-GRC GenomicRegionCollection<T>::Intersection(GRC& subject, bool ignore_strand) const
+GRC GenomicRegionCollection<T>::Intersection(GRC& subject, bool ignore_strand, int num_threads) const
 {
   std::vector<int32_t> sub, que;
-  GRC out = this->FindOverlaps(subject, que, sub, ignore_strand);
+  GRC out = this->FindOverlaps(subject, que, sub, ignore_strand, num_threads);
   return out;
 }
 
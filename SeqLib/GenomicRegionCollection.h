@@ -7,8 +7,11 @@
 #include <list>
 
 #include "SeqLib/IntervalTree.h"
+#include "SeqLib/IntervalIndex.h"
 #include "SeqLib/GenomicRegionCollection.h"
 #include "SeqLib/BamRecord.h"
+#include "SeqLib/RegionFileReader.h"
+#include "SeqLib/MappedFile.h"
 
 namespace SeqLib {
 
@@ -17,9 +20,9 @@ namespace SeqLib {
   typedef std::pair<size_t, size_t> OverlapResult;
 
 /** Class to store vector of intervals on the genome */
-typedef TInterval<int32_t> GenomicInterval;
+typedef TInterval<int32_t, int32_t> GenomicInterval;
 typedef SeqHashMap<int, std::vector<GenomicInterval> > GenomicIntervalMap;
-typedef TIntervalTree<int32_t> GenomicIntervalTree;
+typedef TDynamicIntervalIndex<int32_t, int32_t> GenomicIntervalTree;
 typedef SeqHashMap<int, GenomicIntervalTree> GenomicIntervalTreeMap;
 typedef std::vector<GenomicInterval> GenomicIntervalVector;
 
@@ -81,17 +84,80 @@ class GenomicRegionCollection {
    //bool ReadMuTect(const std::string &file, const SeqLib::BamHeader& hdr);
 
   /** Read in a BED file and adds to GenomicRegionCollection object
+   *
+   * The file can be plain text, gzipped or bgzipped. Lines containing
+   * a '#' are skipped, as are regions on chromosomes not in the header.
    * @param file Path to BED file
+   * @param num_threads Number of threads to decompress a bgzipped file with
    * @return True if file was succesfully read
+   * @exception Throws an invalid_argument if a line has fewer than 3 columns, a bad position
+   * or an end before its start, and a runtime_error if the file can't be decompressed
    */
-   bool ReadBED(const std::string &file, const SeqLib::BamHeader& hdr);
+   bool ReadBED(const std::string &file, const SeqLib::BamHeader& hdr, int num_threads = 1);
 
   /** Read in a VCF file and adds to GenomicRegionCollection object
-   * @param file Path to VCF file. All elements will be width = 1 (just read start point)
+   * @param file Path to VCF file (plain, gzipped or bgzipped). All elements will be width = 1 (just read start point)
+   * @param num_threads Number of threads to decompress a bgzipped file with
+   * @exception Throws an invalid_argument if a line has a bad position, and a
+   * runtime_error if the file can't be decompressed
+   */
+  bool ReadVCF(const std::string &file, const SeqLib::BamHeader& hdr, int num_threads = 1);
+
+  /** Read in only the BED records overlapping a region, using a tabix index
+   *
+   * The file must be bgzipped with a .tbi or .csi index next to it.
+   * Only the index and the blocks holding the region are read. To walk
+   * a large file without loading it, use a RegionFileReader.
+   * @param file Path to bgzipped BED file
+   * @param gr Region to load the overlapping records of
+   * @return False if the file can't be read or has no index
+   * @exception Throws an invalid_argument if a line has fewer than 3 columns, a bad position
+   * or an end before its start, and a runtime_error if a block can't be decompressed
+   */
+  bool ReadBEDRegion(const std::string &file, const GenomicRegion& gr, const SeqLib::BamHeader& hdr);
+
+  /** Read in only the VCF records overlapping a region, using a tabix index
+   * @param file Path to bgzipped VCF file, with a .tbi or .csi index
+   * @param gr Region to load the overlapping records of
+   * @return False if the file can't be read or has no index
+   * @exception Throws an invalid_argument if a line has a bad position, and a
+   * runtime_error if a block can't be decompressed
+   */
+  bool ReadVCFRegion(const std::string &file, const GenomicRegion& gr, const SeqLib::BamHeader& hdr);
+
+  /** Write the collection and its interval index to a binary file
+   *
+   * The regions are written in coordinate order, followed by the
+   * index CreateTreeMap would build for them, so Load has nothing to
+   * parse or build. The file is written next to the target and then
+   * renamed over it, so processes with the old file loaded are not
+   * disturbed. Only the GenomicRegion fields of T are saved.
+   * @param file Path to write to
+   * @return False if the file can't be written
+   */
+  bool Save(const std::string& file) const;
+
+  /** Replace the collection with one written by Save
+   *
+   * The file is mapped into memory (see MappedFile). The regions are
+   * copied out into the collection, and every index node is read once
+   * to check it, so Load is linear in the number of regions, but with
+   * no parsing, sorting or tree building. The index itself is queried
+   * where it lies in the mapping, so processes loading the same file
+   * share its pages. The collection is sorted and ready for range
+   * queries; a change that rebuilds the index makes its own copy.
+   * Copies of the collection keep the file mapped.
+   * @param file Path to a file written by Save on a machine of the same byte order
+   * @return False, leaving the collection unchanged, if the file can't
+   * be read or is not a valid region file of this version
    */
-  bool ReadVCF(const std::string &file, const SeqLib::BamHeader& hdr);
+  bool Load(const std::string& file);
 
-  /** Shuffle the order of the intervals */
+  /** Shuffle the order of the intervals
+   * @note The collection is no longer sorted (see IsSorted). This clears the
+   * interval tree and turns off the dynamic tree, as the tree can only be
+   * built on a sorted collection.
+   */
  void Shuffle();
 
   /** Read in a text file (can be gzipped) and construct a GenomicRegionCollection
@@ -109,14 +175,18 @@ class GenomicRegionCollection {
   /** Create the set of interval trees (one per chromosome) 
    *
    * A GenomicIntervalTreeMap is an unordered_map of GenomicIntervalTrees for 
-   * each chromosome. A GenomicIntervalTree is an interval tree on the ranges
+   * each chromosome. A GenomicIntervalTree is an interval index on the ranges
    * defined by the genomic interval, with cargo set at the same GenomicRegion object.
+   * The index is a flat, start-sorted array (see TIntervalIndex), built in a single
+   * pass over the sorted collection.
    */
   void CreateTreeMap();
   
   /** Reduces the GenomicRegion objects to minimal set by merging overlapping intervals
+   * The merge is done in place, without copying the collection. To merge
+   * more intervals than fit in memory, stream them through a GenomicRegionMerger.
    * @note This will merge intervals that touch. eg [4,6] and [6,8]
-   * @note This will also call CreateTreeMap() at end to re-create the interval tree
+   * @note This clears the interval tree, unless the dynamic tree is on (see SetDynamicTree)
    */
   void MergeOverlappingIntervals();
 
@@ -126,7 +196,38 @@ class GenomicRegionCollection {
 
   /** Add a new GenomicRegion to end
    */
- void add(const T& g) { m_grv->push_back(g); /*createTreeMap();*/ }
+ void add(const T& g) { 
+   // stays sorted if regions are added in order
+   if (*m_sorted && !m_grv->empty() && g < m_grv->back())
+     *m_sorted = false;
+   m_grv->push_back(g); 
+   if (m_dynamic)
+     (*m_tree)[g.chr].insert(g.pos1, g.pos2, m_grv->size() - 1);
+ }
+
+  /** Keep the interval tree up to date as regions are added
+   *
+   * When on, add() and Concat() insert the new regions into the interval
+   * tree (amortized O(log n) each), so range queries can be interleaved
+   * with adds without calling CreateTreeMap. New regions are not sorted
+   * into place, so their IDs are their positions at the end of the
+   * collection. CoordinateSort and MergeOverlappingIntervals rebuild the
+   * tree. Other functions that move or resize regions still need CreateTreeMap.
+   * 
+   * Turning this on calls CreateTreeMap.
+   * @param on Whether the tree should be maintained on add
+   */
+  void SetDynamicTree(bool on);
+
+  /** Return true if the collection is known to be coordinate sorted
+   * (eg after CoordinateSort, and no out-of-order regions added since)
+   *
+   * Getting a region or iterator through the non-const operator[], begin()
+   * or end() clears this, as the region may be moved through it. Use a
+   * const reference to read a sorted collection, or CoordinateSort again
+   * after changing it.
+   */
+  bool IsSorted() const { return *m_sorted; }
 
   /** Is this object empty?
    */
@@ -176,6 +277,23 @@ class GenomicRegionCollection {
    */
  size_t CountOverlaps(const T &gr) const;
 
+ /** Count, for every region in the collection, the query regions overlapping it
+  *
+  * All of the queries are counted in one merge pass per chromosome
+  * over the regions and queries in start order, rather than one index
+  * search per query as with CountOverlaps, and no interval tree is
+  * needed. Strand is ignored, as are regions with a negative chr.
+  * For per-target read counts (e.g. exome QC), build the queries with
+  * GenomicRegionCollection(const BamRecordVector&), or stream the
+  * reads through an OverlapCounter.
+  * @param query Regions to count. Unsorted queries are sorted first (on a copy of their coordinates)
+  * @param num_threads Number of threads to split the chromosomes over
+  * @return Element i is the number of queries overlapping region i of this collection
+  * @exception Throws an invalid_argument if num_threads < 1
+  */
+ template<class K>
+ std::vector<uint32_t> CountOverlapsBatch(const GenomicRegionCollection<K>& query, int num_threads = 1) const;
+
  /** Test if two intervals overlap the same element in the collection
   */
  template<class K>
@@ -191,9 +309,33 @@ class GenomicRegionCollection {
   * @exception Throws a logic_error if this tree is non-empty, but the interval tree has not been made with 
   * CreateTreeMap
   * inside the query collection
+  * @note If both collections are sorted (see IsSorted), this uses the sweep-line join
+  * from FindOverlapPairs and the subject interval tree is not needed.
+  * @param num_threads Number of threads to split the query collection over (see FindOverlapPairs)
+  */
+ template<class K>
+ GenomicRegionCollection<GenomicRegion> FindOverlaps(GenomicRegionCollection<K> &subject, std::vector<int32_t>& query_id, std::vector<int32_t>& subject_id, bool ignore_strand, int num_threads = 1) const;
+
+ /** Return the (query, subject) index pairs of all overlaps between this collection and subject
+  *
+  * If both collections are coordinate sorted, this is a single linear sweep
+  * over the two collections and no interval tree is used. Otherwise, each
+  * region in this collection is queried against the interval tree of subject.
+  * Pairs are ordered by query index, then by subject index.
+  * 
+  * With num_threads > 1, this collection is split into equal contiguous blocks
+  * that are joined concurrently (large chromosomes span several blocks, small
+  * ones share a block). The result is the same as with one thread.
+  * @param subject Collection to overlap against
+  * @param ignore_strand If true, won't exclude overlap if on different strand
+  * @param num_threads Number of threads to use
+  * @return Pairs of (index in this collection, index in subject)
+  * @exception Throws a logic_error if the inputs are not both sorted and the
+  * subject interval tree has not been made with CreateTreeMap
+  * @exception Throws an invalid_argument if num_threads < 1
   */
  template<class K>
- GenomicRegionCollection<GenomicRegion> FindOverlaps(GenomicRegionCollection<K> &subject, std::vector<int32_t>& query_id, std::vector<int32_t>& subject_id, bool ignore_strand) const;
+ std::vector<OverlapResult> FindOverlapPairs(const GenomicRegionCollection<K>& subject, bool ignore_strand, int num_threads = 1) const;
 
  /** Return the overlaps between the collection and the query interval
   * @param gr Query region 
@@ -214,8 +356,11 @@ class GenomicRegionCollection {
   */
  void Pad(int v);
 
- /** Set the i'th GenomicRegion */
- T& operator[](size_t i) { return m_grv->at(i); }
+ /** Set the i'th GenomicRegion
+  * @note Clears IsSorted, as the region may be moved. Call CoordinateSort again
+  * after changing coordinates, or use the const version to read.
+  */
+ T& operator[](size_t i) { *m_sorted = false; return m_grv->at(i); }
  
  /** Retreive the i'th GenomicRegion */
  const T& operator[](size_t i) const { return m_grv->at(i); }
@@ -230,8 +375,17 @@ class GenomicRegionCollection {
    */
   std::string AsBEDString(const BamHeader& h) const;
 
- /** Coordinate sort the interval collection */
-  void CoordinateSort();
+ /** Coordinate sort the interval collection
+  *
+  * Large collections are radix sorted on chromosome and start, with
+  * the keys pulled out in one pass, then ties are ordered by end. This
+  * takes about 24 bytes per region while sorting. A T that declares
+  * its own operator< is always sorted with std::sort and that operator.
+  * (An operator< for T that is not a member is not detected, so
+  * declare it as a member.)
+  * @param num_threads Number of threads for the radix sort
+  */
+  void CoordinateSort(int num_threads = 1);
 
  /** Expand all the elements so they are sorted and become adjacent 
   * by stretching them to the right up to max 
@@ -253,9 +407,16 @@ class GenomicRegionCollection {
  /** Return elements as an STL vector of GenomicRegion objects */
  GenomicRegionVector AsGenomicRegionVector() const;
  
- typename std::vector<T>::iterator begin() { return m_grv->begin(); } 
+ /** Return an iterator to the first GenomicRegion
+  * @note Clears IsSorted, as regions may be moved through the iterator. Call
+  * CoordinateSort again after changing coordinates, or use the const version to read.
+  */
+ typename std::vector<T>::iterator begin() { *m_sorted = false; return m_grv->begin(); } 
  
- typename std::vector<T>::iterator end() { return m_grv->end(); } 
+ /** Return an iterator past the last GenomicRegion
+  * @note Clears IsSorted, as for begin()
+  */
+ typename std::vector<T>::iterator end() { *m_sorted = false; return m_grv->end(); } 
  
  typename std::vector<T>::const_iterator begin() const { return m_grv->begin(); } 
  
@@ -274,18 +435,26 @@ class GenomicRegionCollection {
 
   /** Shortcut to FindOverlaps that just returns the intersecting regions
    * without keeping track of the query / subject ids
+   * @param num_threads Number of threads to split the query collection over
    */
-  GenomicRegionCollection<GenomicRegion> Intersection(GenomicRegionCollection<GenomicRegion>& subject, bool ignore_strand) const;
+  GenomicRegionCollection<GenomicRegion> Intersection(GenomicRegionCollection<GenomicRegion>& subject, bool ignore_strand, int num_threads = 1) const;
  
  private:
 
- bool m_sorted;
+ // whether m_grv is sorted. Shared with m_grv, since copies share the regions
+ SeqPointer<bool> m_sorted;
+
+ // update the tree on add
+ bool m_dynamic;
  
  // always construct this object any time m_grv is modifed
  SeqPointer<GenomicIntervalTreeMap> m_tree;
  
  // hold the genomic regions
  SeqPointer<std::vector<T> > m_grv; 
+
+ // file holding the index, if made by Load
+ SeqPointer<MappedFile> m_map;
  
  // index for current GenomicRegion
  size_t idx;
@@ -293,6 +462,12 @@ class GenomicRegionCollection {
  // open the memory
  void allocate_grc();
 
+ // build the interval tree for the current order of m_grv
+ void build_tree();
+
+ // add every record left in an opened reader
+ bool read_regions(RegionFileReader& reader);
+
 };
 
 typedef GenomicRegionCollection<GenomicRegion> GRC;
@@ -0,0 +1,145 @@
+#ifndef SEQLIB_GENOMIC_REGION_COLUMNS_H__
+#define SEQLIB_GENOMIC_REGION_COLUMNS_H__
+
+#include <vector>
+#include <stdint.h>
+
+#include "SeqLib/GenomicRegionCollection.h"
+
+namespace SeqLib {
+
+  /** Column-wise storage for very large sets of genomic intervals
+   *
+   * Holds the same data as a GenomicRegionCollection, but as separate
+   * chr, pos1, pos2 and strand arrays rather than an array of
+   * GenomicRegion (16 bytes each with padding). CoordinateSort is a
+   * radix sort over the columns, and TotalWidth and Pad are plain
+   * loops over them.
+   *
+   * This is a separate container, not a storage backend for
+   * GenomicRegionCollection, and has only the whole-collection
+   * operations above. Convert with the GenomicRegionCollection
+   * constructor and AsGRC.
+   *
+   * Compact() packs the columns further, for collections that are
+   * built once and then read: the chromosome column is stored as one
+   * entry per run of the same chromosome, ends are stored as 16-bit
+   * widths when they fit, and the strand column is dropped when every
+   * strand is '*'. A sorted collection of short intervals then takes
+   * 6 bytes per interval. Any call that changes the collection unpacks
+   * it first.
+   *
+   * Regions are returned by value, as GenomicRegion. Use AsGRC to get
+   * a GenomicRegionCollection for overlap queries.
+   */
+  class GenomicRegionColumns {
+
+  public:
+
+    /** Construct an empty collection */
+    GenomicRegionColumns() : m_sorted(true), m_compact(false) {}
+
+    /** Construct from a GenomicRegionCollection */
+    template<class T>
+    explicit GenomicRegionColumns(const GenomicRegionCollection<T>& grc) : m_sorted(true), m_compact(false) {
+      reserve(grc.size());
+      for (size_t i = 0; i < grc.size(); ++i)
+	add(grc[i]);
+    }
+
+    /** Return the number of regions */
+    size_t size() const { return m_pos1.size(); }
+
+    /** Return true if there are no regions */
+    bool IsEmpty() const { return m_pos1.empty(); }
+
+    /** Return true if the regions are in coordinate order */
+    bool IsSorted() const { return m_sorted; }
+
+    /** Return true if the columns are packed (see Compact) */
+    bool IsCompact() const { return m_compact; }
+
+    /** Reserve space for n regions */
+    void reserve(size_t n);
+
+    /** Remove all regions */
+    void clear();
+
+    /** Add a region to the end */
+    void add(const GenomicRegion& gr);
+
+    /** Return the region at index i
+     * @exception Throws an out_of_range if i >= size()
+     */
+    GenomicRegion operator[](size_t i) const;
+
+    /** Return the region at index i
+     * @exception Throws an out_of_range if i >= size()
+     */
+    GenomicRegion at(size_t i) const { return (*this)[i]; }
+
+    /** Return the chromosome of region i */
+    int32_t chr(size_t i) const;
+
+    /** Return the start of region i */
+    int32_t pos1(size_t i) const { return m_pos1[i]; }
+
+    /** Return the end of region i */
+    int32_t pos2(size_t i) const { return m_pos2.empty() ? m_pos1[i] + m_width[i] : m_pos2[i]; }
+
+    /** Sort by chromosome, then start, then end (same order as GenomicRegion::operator<)
+     * @param num_threads Number of threads for the radix sort
+     */
+    void CoordinateSort(int num_threads = 1);
+
+    /** Reduce to the minimal set of regions by merging overlapping and touching intervals
+     *
+     * Same result as GenomicRegionCollection::MergeOverlappingIntervals.
+     * Merged regions keep the strand of their first region.
+     */
+    void MergeOverlappingIntervals();
+
+    /** Return the total width of all regions, counting overlaps more than once */
+    int64_t TotalWidth() const;
+
+    /** Increase the left and right ends of each region by v
+     * @exception Throws an out_of_range if a negative v would remove
+     * a region. The collection is left unchanged.
+     */
+    void Pad(int32_t v);
+
+    /** Pack the columns to save memory. Best called once the collection is sorted */
+    void Compact();
+
+    /** Return the bytes of memory held by the columns */
+    size_t bytes() const;
+
+    /** Copy the regions to a GenomicRegionCollection */
+    GenomicRegionCollection<GenomicRegion> AsGRC() const;
+
+  private:
+
+    bool m_sorted;
+
+    bool m_compact;
+
+    // unpacked columns
+    std::vector<int32_t> m_chr;
+    std::vector<int32_t> m_pos1;
+    std::vector<int32_t> m_pos2;
+    std::vector<char> m_strand;
+
+    // packed columns. m_pos1 is shared. Runs of chromosomes are given
+    // as chr id and index of first region
+    std::vector<int32_t> m_run_chr;
+    std::vector<size_t> m_run_start;
+    std::vector<uint16_t> m_width;
+
+    // go back to the unpacked columns before a change
+    void expand();
+
+  };
+
+}
+
+#endif
@@ -0,0 +1,135 @@
+#ifndef SEQLIB_GENOMIC_REGION_MERGER_H__
+#define SEQLIB_GENOMIC_REGION_MERGER_H__
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <cstdio>
+
+#include "SeqLib/GenomicRegion.h"
+
+namespace SeqLib {
+
+  /** Merge a stream of intervals into the minimal overlapping set, in bounded memory
+   *
+   * Same result as GenomicRegionCollection::MergeOverlappingIntervals
+   * (touching intervals are merged, strand is ignored), but the input
+   * never has to be held in memory at once. Intervals with chr < 0
+   * (unplaced, eg unmapped reads) are skipped.
+   *
+   * If the input is coordinate sorted (see SetSortedInput), each merged
+   * interval is ready as soon as an interval starting past its end is
+   * added, and only the open interval is held. Otherwise intervals are
+   * buffered, and each full buffer is sorted, merged and spilled to a
+   * temporary file as a sorted run. Finish merges the runs back together
+   * as they are read out.
+   *
+   * Typical use:
+   * @code
+   * GenomicRegionMerger m;
+   * while (reader.GetNextRecord(r))
+   *   m.Add(r.AsGenomicRegion());
+   * m.Finish();
+   * GenomicRegion gr;
+   * while (m.GetNextRegion(gr))
+   *   ...
+   * @endcode
+   */
+  class GenomicRegionMerger {
+
+  public:
+
+    /** Create an empty merger, expecting unsorted input */
+    GenomicRegionMerger();
+
+    /** Close and remove any spilled runs */
+    ~GenomicRegionMerger();
+
+    /** Declare the input to be coordinate sorted (default false)
+     *
+     * Sorted means ordered by chr then start, as in a sorted BAM or BED;
+     * the ends can be in any order. Merged intervals can then be taken
+     * with GetNextRegion between calls to Add, and nothing is spilled.
+     * @exception Throws a logic_error if intervals have already been added
+     */
+    void SetSortedInput(bool sorted);
+
+    /** Set the number of intervals buffered before a sorted run is spilled (default 4,000,000)
+     * @exception Throws an invalid_argument if n == 0
+     */
+    void SetMaxBuffer(size_t n);
+
+    /** Set the directory that sorted runs are spilled to (default $TMPDIR, or /tmp) */
+    void SetTempDir(const std::string& dir) { m_tmp_dir = dir; }
+
+    /** Add an interval. Intervals with chr < 0 are skipped
+     * @exception Throws an invalid_argument if the input was declared
+     * sorted and gr starts before the last interval, a logic_error if
+     * called after Finish, and a runtime_error if a run can't be spilled
+     */
+    void Add(const GenomicRegion& gr);
+
+    /** Mark the end of the input. Must be called before the last intervals can be read out */
+    void Finish();
+
+    /** Get the next merged interval, in coordinate order
+     * @param gr Set to the next interval, with strand '*'
+     * @return false if no interval is ready yet, or all have been read
+     * @exception Throws a runtime_error if a spilled run can't be read back
+     */
+    bool GetNextRegion(GenomicRegion& gr);
+
+    /** Return the number of sorted runs spilled to disk */
+    size_t NumRuns() const { return m_runs.size(); }
+
+    /** Clear all state, removing any spilled runs. Settings are kept */
+    void Clear();
+
+  private:
+
+    // an unlinked temporary file holding a sorted, merged run
+    struct Run {
+      FILE* fp;
+      std::vector<int32_t> buf; // chr, pos1, pos2 triples read back
+      size_t pos; // next triple in buf
+    };
+
+    bool m_sorted_input;
+
+    size_t m_max_buffer;
+
+    std::string m_tmp_dir;
+
+    bool m_finished;
+
+    // unsorted input waiting to be spilled
+    std::vector<GenomicRegion> m_buffer;
+
+    std::vector<Run> m_runs;
+
+    // heap of (interval, run) for the final merge of the runs
+    std::vector<std::pair<GenomicRegion, size_t> > m_heap;
+
+    // interval being extended, and the last one added for the order check
+    GenomicRegion m_open;
+    bool m_has_open;
+    GenomicRegion m_last;
+
+    // merged intervals ready to hand out
+    std::deque<GenomicRegion> m_out;
+
+    // fold an interval into the open one, emitting the open one if disjoint
+    void push(const GenomicRegion& gr);
+
+    void spill();
+
+    bool read_run(Run& r, GenomicRegion& gr);
+
+    GenomicRegionMerger(const GenomicRegionMerger&);
+    GenomicRegionMerger& operator=(const GenomicRegionMerger&);
+
+  };
+
+}
+
+#endif
@@ -0,0 +1,456 @@
+#ifndef SEQLIB_INTERVAL_INDEX_H__
+#define SEQLIB_INTERVAL_INDEX_H__
+
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
+
+#include "SeqLib/IntervalTree.h"
+
+namespace SeqLib {
+
+  /** @brief Static interval index stored as a single flat array
+   *
+   * Intervals are sorted by start and laid out in one contiguous array.
+   * The array is treated as an implicit binary search tree (the node at
+   * index i on level k has children i -/+ 2^(k-1)), with each node augmented
+   * by the maximum stop position of its subtree. This is the layout used by
+   * Heng Li's cgranges (https://github.com/lh3/cgranges). Compared to
+   * TIntervalTree it needs no heap nodes or per-level copies of the
+   * intervals, and queries walk a handful of cache-friendly array ranges.
+   *
+   * Intervals are closed, so [start, stop] overlaps [qstart, qstop] if
+   * start <= qstop and stop >= qstart (same as TIntervalTree).
+   */
+  template <class T, typename K = std::size_t>
+  class TIntervalIndex {
+
+  public:
+
+    typedef TInterval<T,K> interval;
+    typedef std::vector<interval> intervalVector;
+
+    /** One element of the flat array */
+    struct node {
+      K start; ///< Start of the interval
+      K stop; ///< End of the interval (inclusive)
+      K max; ///< Max stop position of the subtree rooted here
+      T value; ///< Cargo (e.g. index into a GenomicRegionCollection)
+    };
+
+    /** Construct an empty index */
+    TIntervalIndex() : m_max_level(-1), m_ext(NULL), m_ext_n(0) {}
+
+    /** Construct an index from a set of intervals (need not be sorted) */
+    TIntervalIndex(const intervalVector& ivals) : m_max_level(-1), m_ext(NULL), m_ext_n(0) {
+      m_nodes.reserve(ivals.size());
+      for (typename intervalVector::const_iterator i = ivals.begin(); i != ivals.end(); ++i)
+	add(i->start, i->stop, i->value);
+      index();
+    }
+
+    /** Append an interval. Call index() before querying. */
+    void add(K start, K stop, const T& value) {
+      own();
+      node n;
+      n.start = start;
+      n.stop = stop;
+      n.max = stop;
+      n.value = value;
+      m_nodes.push_back(n);
+      m_max_level = -1;
+    }
+
+    /** Reserve space for n intervals */
+    void reserve(size_t n) { own(); m_nodes.reserve(n); }
+
+    /** Sort the intervals and compute the augmented subtree maxima */
+    void index() {
+      own();
+      if (!is_sorted_nodes())
+	std::stable_sort(m_nodes.begin(), m_nodes.end(), start_less);
+      m_max_level = build_max();
+    }
+
+    /** Merge another indexed set of intervals into this one, in linear time.
+     * Both indexes must have been built with index().
+     */
+    void merge(const TIntervalIndex& other) {
+      own();
+      std::vector<node> merged(m_nodes.size() + other.size());
+      std::merge(m_nodes.begin(), m_nodes.end(), other.data(), other.data() + other.size(),
+		 merged.begin(), start_less);
+      m_nodes.swap(merged);
+      m_max_level = build_max();
+    }
+
+    /** Swap contents with another index */
+    void swap(TIntervalIndex& other) {
+      m_nodes.swap(other.m_nodes);
+      std::swap(m_max_level, other.m_max_level);
+      std::swap(m_ext, other.m_ext);
+      std::swap(m_ext_n, other.m_ext_n);
+    }
+
+    /** Query an indexed array held elsewhere (e.g. in a mapped file) without copying it
+     *
+     * The array must stay valid while the index uses it. Any change to
+     * the index (add, index, merge) first copies it.
+     * @param a Nodes as laid out by index(). See data()
+     * @param n Number of nodes
+     * @param height Height of the implicit tree, as returned by height()
+     */
+    void attach(const node* a, size_t n, int height) {
+      std::vector<node>().swap(m_nodes);
+      m_ext = n ? a : NULL;
+      m_ext_n = n;
+      m_max_level = n ? height : -1;
+    }
+
+    /** Return the flat array of nodes, for saving an index to disk */
+    const node* data() const { return m_ext ? m_ext : (m_nodes.empty() ? NULL : &m_nodes[0]); }
+
+    /** Return the height of the implicit tree, or -1 if not indexed */
+    int height() const { return m_max_level; }
+
+    /** Number of intervals in the index */
+    size_t size() const { return m_ext ? m_ext_n : m_nodes.size(); }
+
+    /** Return true if the index holds no intervals */
+    bool empty() const { return !size(); }
+
+    /** Approximate number of bytes used by this index (not counting an attached array) */
+    size_t bytes() const { return m_nodes.capacity() * sizeof(node) + sizeof(*this); }
+
+    /** Access the i'th interval (in start-sorted order) */
+    const node& operator[](size_t i) const { return data()[i]; }
+
+    /** Call f(node) on every interval overlapping [start, stop] */
+    template<class F>
+    void visitOverlapping(K start, K stop, F& f) const {
+
+      if (m_max_level < 0)
+	return;
+
+      const int64_t n = size();
+      const node* a = data();
+
+      // explicit stack of (level, node, left-child-done)
+      struct frame { int k; int64_t x; int w; } stack[64];
+      int t = 0;
+      stack[t].k = m_max_level, stack[t].x = (1LL << m_max_level) - 1, stack[t++].w = 0;
+
+      while (t) {
+	frame z = stack[--t];
+	if (z.k <= 3) { // small subtree, scan it linearly
+	  int64_t i0 = z.x >> z.k << z.k, i1 = i0 + (1LL << (z.k + 1)) - 1;
+	  if (i1 >= n) i1 = n;
+	  for (int64_t i = i0; i < i1 && a[i].start <= stop; ++i)
+	    if (a[i].stop >= start)
+	      f(a[i]);
+	} else if (z.w == 0) { // descend left first
+	  int64_t y = z.x - (1LL << (z.k - 1));
+	  stack[t].k = z.k, stack[t].x = z.x, stack[t++].w = 1;
+	  if (y >= n || a[y].max >= start)
+	    stack[t].k = z.k - 1, stack[t].x = y, stack[t++].w = 0;
+	} else if (z.x < n && a[z.x].start <= stop) { // this node, then right
+	  if (a[z.x].stop >= start)
+	    f(a[z.x]);
+	  stack[t].k = z.k - 1, stack[t].x = z.x + (1LL << (z.k - 1)), stack[t++].w = 0;
+	}
+      }
+    }
+
+    /** Return the intervals overlapping [start, stop] */
+    intervalVector findOverlapping(K start, K stop) const {
+      intervalVector ov;
+      findOverlapping(start, stop, ov);
+      return ov;
+    }
+
+    /** Append the intervals overlapping [start, stop] to overlapping */
+    void findOverlapping(K start, K stop, intervalVector& overlapping) const {
+      collector c(overlapping, start, stop, false);
+      visitOverlapping(start, stop, c);
+    }
+
+    /** Return the intervals contained in [start, stop] */
+    intervalVector findContained(K start, K stop) const {
+      intervalVector contained;
+      findContained(start, stop, contained);
+      return contained;
+    }
+
+    /** Append the intervals contained in [start, stop] to contained */
+    void findContained(K start, K stop, intervalVector& contained) const {
+      collector c(contained, start, stop, true);
+      visitOverlapping(start, stop, c);
+    }
+
+    /** Count the intervals overlapping [start, stop], without allocating */
+    size_t countOverlapping(K start, K stop) const {
+      counter c;
+      visitOverlapping(start, stop, c);
+      return c.n;
+    }
+
+  private:
+
+    std::vector<node> m_nodes;
+
+    // height of the implicit tree, -1 if not indexed
+    int m_max_level;
+
+    // attached array, used in place of m_nodes if set
+    const node* m_ext;
+    size_t m_ext_n;
+
+    // copy an attached array before changing it
+    void own() {
+      if (m_ext) {
+	m_nodes.assign(m_ext, m_ext + m_ext_n);
+	m_ext = NULL;
+	m_ext_n = 0;
+      }
+    }
+
+    static bool start_less(const node& a, const node& b) { return a.start < b.start; }
+
+    // C++98 stand-in for std::is_sorted
+    bool is_sorted_nodes() const {
+      for (size_t i = 1; i < m_nodes.size(); ++i)
+	if (m_nodes[i].start < m_nodes[i-1].start)
+	  return false;
+      return true;
+    }
+
+    struct counter {
+      counter() : n(0) {}
+      void operator()(const node&) { ++n; }
+      size_t n;
+    };
+
+    struct collector {
+      collector(intervalVector& o, K s, K e, bool c) : out(o), start(s), stop(e), contained(c) {}
+      void operator()(const node& nd) {
+	if (!contained || (nd.start >= start && nd.stop <= stop))
+	  out.push_back(interval(nd.start, nd.stop, nd.value));
+      }
+      intervalVector& out;
+      K start, stop;
+      bool contained;
+    };
+
+    // fill in the subtree max for each internal node (bottom up).
+    // returns the height of the tree
+    int build_max() {
+
+      const int64_t n = m_nodes.size();
+      if (n <= 0)
+	return -1;
+
+      node* a = &m_nodes[0];
+      int64_t i, last_i = 0;
+      K last = K();
+      int k;
+      for (i = 0; i < n; i += 2) // leaves
+	last_i = i, last = a[i].max = a[i].stop;
+      for (k = 1; 1LL << k <= n; ++k) {
+	int64_t x = 1LL << (k - 1), i0 = (x << 1) - 1, step = x << 2;
+	for (i = i0; i < n; i += step) {
+	  K el = a[i - x].max;
+	  K er = i + x < n ? a[i + x].max : last;
+	  K e = a[i].stop;
+	  e = e > el ? e : el;
+	  e = e > er ? e : er;
+	  a[i].max = e;
+	}
+	last_i = last_i >> k & 1 ? last_i - x : last_i + x; // parent of last_i
+	if (last_i < n && a[last_i].max > last)
+	  last = a[last_i].max;
+      }
+      return k - 1;
+    }
+
+  };
+
+  /** @brief Interval index that supports inserts interleaved with queries
+   *
+   * Holds a short unsorted buffer plus a stack of static TIntervalIndex levels
+   * of decreasing size (the "logarithmic method" of Bentley and Saxe). A
+   * full buffer becomes a new level, which is merged into the level below
+   * while that level is no more than twice its size. Each interval is merged O(log n) times,
+   * so insert is amortized O(log n), and a query searches O(log n) levels
+   * for O(log^2 n) total.
+   *
+   * A bulk load (add() then index()) produces a single level and queries
+   * as fast as a plain TIntervalIndex.
+   */
+  template <class T, typename K = std::size_t>
+  class TDynamicIntervalIndex {
+
+  public:
+
+    typedef TIntervalIndex<T,K> level;
+    typedef typename level::node node;
+    typedef typename level::interval interval;
+    typedef typename level::intervalVector intervalVector;
+
+    /** Construct an empty index */
+    TDynamicIntervalIndex() : m_size(0) {}
+
+    /** Construct an index from a set of intervals (need not be sorted) */
+    TDynamicIntervalIndex(const intervalVector& ivals) : m_size(0) {
+      reserve(ivals.size());
+      for (typename intervalVector::const_iterator i = ivals.begin(); i != ivals.end(); ++i)
+	add(i->start, i->stop, i->value);
+      index();
+    }
+
+    /** Append an interval for a bulk load. It can be queried right away, 
+     * but call index() after adding many intervals this way.
+     */
+    void add(K start, K stop, const T& value) {
+      node n;
+      n.start = start;
+      n.stop = stop;
+      n.max = stop;
+      n.value = value;
+      m_buffer.push_back(n);
+      ++m_size;
+    }
+
+    /** Add an interval and keep the index ready for queries.
+     * Amortized O(log n).
+     */
+    void insert(K start, K stop, const T& value) {
+      add(start, stop, value);
+      if (m_buffer.size() >= BUFFER_SIZE)
+	flush(false);
+    }
+
+    /** Reserve space for a bulk load of n intervals */
+    void reserve(size_t n) { m_buffer.reserve(n); }
+
+    /** Replace the contents with an indexed array held elsewhere (see TIntervalIndex::attach) */
+    void attach(const node* a, size_t n, int height) {
+      std::vector<node>().swap(m_buffer);
+      m_levels.clear();
+      if (n) {
+	m_levels.push_back(level());
+	m_levels.back().attach(a, n, height);
+      }
+      m_size = n;
+    }
+
+    /** Index everything into a single static level */
+    void index() { flush(true); }
+
+    /** Number of intervals in the index */
+    size_t size() const { return m_size; }
+
+    /** Return true if the index holds no intervals */
+    bool empty() const { return !m_size; }
+
+    /** Number of static levels (not counting the insert buffer) */
+    size_t levels() const { return m_levels.size(); }
+
+    /** Approximate number of bytes used by this index */
+    size_t bytes() const {
+      size_t b = sizeof(*this) + m_buffer.capacity() * sizeof(node);
+      for (typename std::vector<level>::const_iterator l = m_levels.begin(); l != m_levels.end(); ++l)
+	b += l->bytes();
+      return b;
+    }
+
+    /** Call f(node) on every interval overlapping [start, stop].
+     * Hits are in start order within a level, but not across levels.
+     */
+    template<class F>
+    void visitOverlapping(K start, K stop, F& f) const {
+      for (typename std::vector<level>::const_iterator l = m_levels.begin(); l != m_levels.end(); ++l)
+	l->visitOverlapping(start, stop, f);
+      for (typename std::vector<node>::const_iterator n = m_buffer.begin(); n != m_buffer.end(); ++n)
+	if (n->start <= stop && n->stop >= start)
+	  f(*n);
+    }
+
+    /** Return the intervals overlapping [start, stop] */
+    intervalVector findOverlapping(K start, K stop) const {
+      intervalVector ov;
+      findOverlapping(start, stop, ov);
+      return ov;
+    }
+
+    /** Append the intervals overlapping [start, stop] to overlapping */
+    void findOverlapping(K start, K stop, intervalVector& overlapping) const {
+      for (typename std::vector<level>::const_iterator l = m_levels.begin(); l != m_levels.end(); ++l)
+	l->findOverlapping(start, stop, overlapping);
+      for (typename std::vector<node>::const_iterator n = m_buffer.begin(); n != m_buffer.end(); ++n)
+	if (n->start <= stop && n->stop >= start)
+	  overlapping.push_back(interval(n->start, n->stop, n->value));
+    }
+
+    /** Return the intervals contained in [start, stop] */
+    intervalVector findContained(K start, K stop) const {
+      intervalVector contained;
+      findContained(start, stop, contained);
+      return contained;
+    }
+
+    /** Append the intervals contained in [start, stop] to contained */
+    void findContained(K start, K stop, intervalVector& contained) const {
+      for (typename std::vector<level>::const_iterator l = m_levels.begin(); l != m_levels.end(); ++l)
+	l->findContained(start, stop, contained);
+      for (typename std::vector<node>::const_iterator n = m_buffer.begin(); n != m_buffer.end(); ++n)
+	if (n->start >= start && n->stop <= stop)
+	  contained.push_back(interval(n->start, n->stop, n->value));
+    }
+
+    /** Count the intervals overlapping [start, stop], without allocating */
+    size_t countOverlapping(K start, K stop) const {
+      size_t c = 0;
+      for (typename std::vector<level>::const_iterator l = m_levels.begin(); l != m_levels.end(); ++l)
+	c += l->countOverlapping(start, stop);
+      for (typename std::vector<node>::const_iterator n = m_buffer.begin(); n != m_buffer.end(); ++n)
+	if (n->start <= stop && n->stop >= start)
+	  ++c;
+      return c;
+    }
+
+  private:
+
+    // inserts are scanned linearly until there are this many
+    static const size_t BUFFER_SIZE = 64;
+
+    std::vector<node> m_buffer;
+
+    // static levels, largest first
+    std::vector<level> m_levels;
+
+    size_t m_size;
+
+    // turn the buffer into a level and merge down. If all, merge
+    // everything into one level
+    void flush(bool all) {
+      if (!m_buffer.empty()) {
+	m_levels.push_back(level());
+	level& l = m_levels.back();
+	l.reserve(m_buffer.size());
+	for (typename std::vector<node>::const_iterator n = m_buffer.begin(); n != m_buffer.end(); ++n)
+	  l.add(n->start, n->stop, n->value);
+	l.index();
+	std::vector<node>().swap(m_buffer);
+      }
+      while (m_levels.size() > 1 && 
+	     (all || m_levels[m_levels.size() - 2].size() <= 2 * m_levels.back().size())) {
+	m_levels[m_levels.size() - 2].merge(m_levels.back());
+	m_levels.pop_back();
+      }
+    }
+
+  };
+
+}
+
+#endif
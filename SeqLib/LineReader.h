@@ -0,0 +1,126 @@
+#ifndef SEQLIB_LINE_READER_H__
+#define SEQLIB_LINE_READER_H__
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <stdint.h>
+#include <zlib.h>
+
+namespace SeqLib {
+
+  /** Fast line-by-line reader for plain, gzipped or bgzipped text files
+   *
+   * Decompresses large blocks into one buffer and hands out each line
+   * in place, so no copy or allocation is made per line. BGZF input is
+   * split into its independent blocks, which can be inflated on
+   * several threads. Used by GenomicRegionCollection to load BED and
+   * VCF files.
+   */
+  class LineReader {
+
+  public:
+
+    /** Create an unopened reader */
+    LineReader();
+
+    /** Close the file and free the buffers */
+    ~LineReader();
+
+    /** Open a file for reading
+     * @param file Path to a plain, gzip or BGZF file, or "-" for stdin
+     * @return false if the file can't be opened or read
+     */
+    bool Open(const std::string& file);
+
+    /** Set the number of threads used to inflate BGZF blocks (default 1)
+     * @exception Throws an invalid_argument if n < 1
+     */
+    void SetThreads(int n);
+
+    /** Get the next line, without its line ending
+     *
+     * The line is NUL-terminated and may be modified in place, but is
+     * only valid until the next call.
+     * @param line Set to the start of the line
+     * @param len Set to the length of the line
+     * @return false at end of file, or on a read error (see Failed)
+     */
+    bool GetLine(char*& line, size_t& len);
+
+    /** Close the file */
+    void Close();
+
+    /** Return true if the input is BGZF compressed */
+    bool IsBGZF() const { return m_mode == BGZF_MODE; }
+
+    /** Return true if reading stopped because of a read or decompression error */
+    bool Failed() const { return !m_error.empty(); }
+
+    /** Return a description of the last error */
+    const std::string& Error() const { return m_error; }
+
+  private:
+
+    enum { PLAIN_MODE, GZIP_MODE, BGZF_MODE };
+
+    FILE* m_fp;
+
+    int m_mode;
+
+    int m_threads;
+
+    bool m_eof; // no more raw input
+
+    std::string m_error;
+
+    // decompressed text. Lines are handed out from [m_pos, m_end)
+    std::vector<char> m_buf;
+    size_t m_pos;
+    size_t m_end;
+
+    // compressed input not yet inflated, in [m_raw_pos, m_raw_end)
+    std::vector<char> m_raw;
+    size_t m_raw_pos;
+    size_t m_raw_end;
+
+    // stream state for non-BGZF gzip input
+    z_stream m_zs;
+    bool m_zs_open;
+
+    // read more raw bytes, keeping unread ones. false if none were added
+    bool read_raw();
+
+    // add more text to the end of the buffer. false if none was added
+    bool fill();
+
+    bool fill_plain();
+    bool fill_gzip();
+    bool fill_bgzf();
+
+    LineReader(const LineReader&);
+    LineReader& operator=(const LineReader&);
+
+  };
+
+  /** Split a tab-delimited line in place into at most n fields
+   * @param line Start of the line
+   * @param len Length of the line
+   * @param fields Set to the start of each field found
+   * @param lens Set to the length of each field found
+   * @param n Most fields to split off. Anything after the n'th is ignored
+   * @return Number of fields found
+   */
+  size_t SplitTabs(char* line, size_t len, char** fields, size_t* lens, size_t n);
+
+  /** Parse a base-10 integer from the start of a field, as strtol does
+   * @param s Start of the field
+   * @param v Set to the value on success
+   * @return 0 on success, EINVAL if s does not start with a number,
+   * or ERANGE if the number does not fit in 32 bits
+   */
+  int ParseInt32(const char* s, int32_t& v);
+
+}
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef SEQLIB_MAPPED_FILE_H__
+#define SEQLIB_MAPPED_FILE_H__
+
+#include <string>
+#include <cstddef>
+
+namespace SeqLib {
+
+  /** Read-only view of a whole file in memory
+   *
+   * The file is mapped with mmap, so opening it costs next to nothing,
+   * pages are only read as they are touched, and processes mapping the
+   * same file share one copy in the page cache. If the file can't be
+   * mapped (e.g. a pipe), it is read into memory instead.
+   */
+  class MappedFile {
+
+  public:
+
+    /** Create an unopened file */
+    MappedFile() : m_data(NULL), m_size(0), m_mapped(false) {}
+
+    /** Unmap the file */
+    ~MappedFile() { Close(); }
+
+    /** Map a file
+     * @param file Path to the file
+     * @return false if the file can't be opened or read
+     */
+    bool Open(const std::string& file);
+
+    /** Unmap the file. Pointers from data() are then invalid */
+    void Close();
+
+    /** Return the start of the file contents */
+    const char* data() const { return m_data; }
+
+    /** Return the size of the file in bytes */
+    size_t size() const { return m_size; }
+
+  private:
+
+    char* m_data;
+
+    size_t m_size;
+
+    bool m_mapped; // else m_data is from malloc
+
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+
+  };
+
+}
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef SEQLIB_OVERLAP_COUNTER_H__
+#define SEQLIB_OVERLAP_COUNTER_H__
+
+#include <vector>
+#include <stdint.h>
+
+#include "SeqLib/GenomicRegionCollection.h"
+#include "SeqLib/BamRecord.h"
+#include "SeqLib/OverlapSweep.h"
+
+namespace SeqLib {
+
+  /** Per-target overlap counts over a coordinate-sorted stream
+   *
+   * The streaming form of GenomicRegionCollection::CountOverlapsBatch,
+   * for inputs too large to hold, such as every read in a BAM: feed the
+   * reads in as they are read and collect one count per target at the
+   * end. Each chromosome is a single merge pass over its targets, so
+   * the cost per read is a few comparisons and nothing is allocated.
+   *
+   * Input must be grouped by chromosome (in any chromosome order) and
+   * sorted by start within each, as in a coordinate-sorted BAM.
+   */
+  class OverlapCounter {
+
+  public:
+
+    /** Set up counts for a set of targets
+     * @param targets Regions to count overlaps of. Need not be sorted.
+     * Counts are in the same order.
+     * @exception Throws a length_error if there are 2^32 targets or more
+     */
+    explicit OverlapCounter(const GRC& targets);
+
+    /** Count a range against the targets. Ranges with chr < 0 are skipped
+     * @exception Throws an invalid_argument if the range is out of order
+     */
+    void Add(int32_t chr, int32_t pos1, int32_t pos2);
+
+    /** Count a region against the targets (strand is ignored) */
+    void Add(const GenomicRegion& gr) { Add(gr.chr, gr.pos1, gr.pos2); }
+
+    /** Count the aligned span of a read. Unmapped reads are skipped */
+    void Add(const BamRecord& r);
+
+    /** Return the count for each target, in the order they were given */
+    const std::vector<uint32_t>& Counts() const { return m_counts; }
+
+    /** Return the number of ranges counted (not including skipped ones) */
+    uint64_t NumAdded() const { return m_added; }
+
+    /** Set all of the counts back to zero, to count a new stream */
+    void Reset();
+
+  private:
+
+    // targets in coordinate order
+    std::vector<int32_t> m_start;
+    std::vector<int32_t> m_end;
+    std::vector<uint32_t> m_id;
+
+    // range of each chromosome's targets, indexed by chr id
+    std::vector<size_t> m_chr_begin;
+    std::vector<size_t> m_chr_end;
+
+    std::vector<uint32_t> m_counts;
+
+    // chromosomes already finished, to catch unsorted input
+    std::vector<bool> m_chr_done;
+
+    int32_t m_chr; // current chromosome, -1 before the first
+
+    int32_t m_last_pos;
+
+    uint64_t m_added;
+
+    _CountSweep m_sweep;
+
+    // move the sweep to a new chromosome
+    void start_chr(int32_t chr);
+
+  };
+
+}
+
+#endif
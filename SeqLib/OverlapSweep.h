@@ -0,0 +1,95 @@
+#ifndef SEQLIB_OVERLAP_SWEEP_H__
+#define SEQLIB_OVERLAP_SWEEP_H__
+
+#include <vector>
+#include <cstddef>
+#include <stdint.h>
+
+#include "SeqLib/RadixSort.h"
+
+// Internal to SeqLib: the column layout and counting sweep shared by
+// GenomicRegionCollection::CountOverlapsBatch and OverlapCounter
+
+namespace SeqLib {
+
+  // coordinates of a set of regions in (chr, pos1) order, as separate
+  // columns, with where each chromosome starts
+  struct _ChrColumns {
+
+    std::vector<int32_t> start;
+    std::vector<int32_t> end;
+    std::vector<uint32_t> id; // index in the original collection
+    std::vector<int32_t> chr; // chromosome of each run
+    std::vector<size_t> run; // first index of each run, then the total
+
+    template<class K>
+    void fill(typename std::vector<K>::const_iterator b, size_t n, bool sorted, int num_threads) {
+      id.resize(n);
+      for (size_t i = 0; i < n; ++i)
+	id[i] = i;
+      if (!sorted) {
+	std::vector<uint64_t> keys(n);
+	for (size_t i = 0; i < n; ++i)
+	  keys[i] = CoordinateKey(b[i].chr, b[i].pos1);
+	RadixSort(keys, id, num_threads);
+      }
+      start.resize(n);
+      end.resize(n);
+      for (size_t i = 0; i < n; ++i) {
+	const K& g = b[id[i]];
+	start[i] = g.pos1;
+	end[i] = g.pos2;
+	if (!i || g.chr != chr.back()) {
+	  chr.push_back(g.chr);
+	  run.push_back(i);
+	}
+      }
+      run.push_back(n);
+    }
+  };
+
+  // counts queries, added in start order, against the regions of one
+  // chromosome in start order. Same sweep as _overlap_pairs: a region
+  // that ends before the current query start is dropped for good
+  struct _CountSweep {
+
+    _CountSweep() : start(NULL), end(NULL), id(NULL), n(0), next(0), counts(NULL) {}
+
+    void Reset(const int32_t* s, const int32_t* e, const uint32_t* i, size_t num, uint32_t* c) {
+      start = s;
+      end = e;
+      id = i;
+      n = num;
+      next = 0;
+      counts = c;
+      active.clear();
+    }
+
+    void Add(int32_t qs, int32_t qe) {
+      for (; next < n && start[next] <= qe; ++next)
+	if (end[next] >= qs)
+	  active.push_back(next);
+      size_t k = 0;
+      for (size_t a = 0; a < active.size(); ++a) {
+	const size_t r = active[a];
+	if (end[r] < qs)
+	  continue;
+	active[k++] = r;
+	if (start[r] <= qe)
+	  ++counts[id[r]];
+      }
+      active.resize(k);
+    }
+
+    const int32_t* start;
+    const int32_t* end;
+    const uint32_t* id;
+    size_t n;
+    size_t next; // next region not yet looked at
+    uint32_t* counts;
+    std::vector<size_t> active; // regions started and not yet ended
+  };
+
+}
+
+#endif
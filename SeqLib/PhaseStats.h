@@ -0,0 +1,83 @@
+#ifndef SEQLIB_PHASE_STATS_H__
+#define SEQLIB_PHASE_STATS_H__
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <cstddef>
+
+namespace SeqLib {
+
+  /** Wall time and memory use of one phase of a computation
+   *
+   * Memory is that of the whole process, read from /proc on Linux (0
+   * elsewhere). By default the peak is that of the process so far.
+   * PhaseTimer can instead reset it at the start of each phase, but
+   * that resets it for the whole process, so it is off unless asked for. With several phases
+   * running at once on different threads, the memory figures cover
+   * all of them.
+   */
+  struct PhaseStats {
+
+    PhaseStats() : wall_time(0), peak_bytes(0), resident_bytes(0) {}
+
+    std::string name; ///< Name of the phase
+    double wall_time; ///< Wall-clock seconds
+    size_t peak_bytes; ///< Peak resident memory during the phase
+    size_t resident_bytes; ///< Resident memory at the end of the phase
+
+    /** Print the phase as name, seconds and memory */
+    friend std::ostream& operator<<(std::ostream& out, const PhaseStats& p);
+
+  };
+
+  typedef std::vector<PhaseStats> PhaseStatsVector;
+
+  /** Return the resident memory of this process in bytes, or 0 if unknown */
+  size_t ResidentBytes();
+
+  /** Return the peak resident memory of this process in bytes, or 0 if unknown */
+  size_t PeakResidentBytes();
+
+  /** Start measuring a new peak resident memory for this process
+   *
+   * Writes to /proc/self/clear_refs, so the peak is reset for the whole
+   * process, including for any other code watching it.
+   * @return False if the peak can't be reset (it then stays the peak since the process started)
+   */
+  bool ResetPeakResidentBytes();
+
+  /** Time one phase, from construction until Stop (or destruction) */
+  class PhaseTimer {
+
+  public:
+
+    /** Start timing a phase
+     * @param name Name of the phase
+     * @param v Where to add the phase when it stops. NULL turns the timer off.
+     * @param reset_peak Reset the process's peak memory first (see ResetPeakResidentBytes)
+     */
+    PhaseTimer(const std::string& name, PhaseStatsVector* v, bool reset_peak = false);
+
+    /** Stop the timer, if still running */
+    ~PhaseTimer() { Stop(); }
+
+    /** Stop timing, and add the phase to the vector */
+    void Stop();
+
+  private:
+
+    PhaseStatsVector* m_out;
+
+    PhaseStats m_stats;
+
+    double m_start;
+
+    PhaseTimer(const PhaseTimer&);
+    PhaseTimer& operator=(const PhaseTimer&);
+
+  };
+
+}
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef SEQLIB_RADIX_SORT_H__
+#define SEQLIB_RADIX_SORT_H__
+
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
+
+namespace SeqLib {
+
+  /** Pack a chromosome and position into one key that sorts in coordinate order
+   *
+   * The chromosome is in the high 32 bits and the position in the low
+   * 32, each with the sign bit flipped so negative values (e.g. -1 for
+   * unmapped) sort first.
+   */
+  inline uint64_t CoordinateKey(int32_t chr, int32_t pos) {
+    return ((uint64_t)((uint32_t)chr ^ 0x80000000u) << 32) | ((uint32_t)pos ^ 0x80000000u);
+  }
+
+  /** Pack a signed 32-bit value into a key that sorts in signed order */
+  inline uint64_t SignedKey(int32_t v) {
+    return (uint32_t)v ^ 0x80000000u;
+  }
+
+  /** Stable LSD radix sort of an index array by 64-bit keys
+   *
+   * Sorts the keys, applying the same moves to order, so that order
+   * ends up listing the original positions in key order. Sorts eight
+   * bits per pass and skips passes where every key has the same byte,
+   * so small keys (e.g. 32-bit positions) only cost the passes they use.
+   * Being stable, a sort on a secondary key followed by one on the
+   * primary key gives a sort on both.
+   *
+   * With more than one thread, each pass splits the keys into one
+   * contiguous chunk per thread, which are counted and then scattered
+   * in parallel. Small inputs use fewer threads.
+   * @param keys Keys to sort. Sorted on return.
+   * @param order Values to carry with the keys, usually 0..n-1 on the first call
+   * @param num_threads Number of threads to sort with
+   * @exception Throws an invalid_argument if keys and order differ in
+   * size, or num_threads < 1
+   */
+  void RadixSort(std::vector<uint64_t>& keys, std::vector<uint32_t>& order, int num_threads = 1);
+
+  /** Order each run of equal keys by a further comparison
+   *
+   * For sorts on more than 64 bits of key: radix sort on the leading
+   * fields, then break the (usually few, short) ties with this.
+   * @param keys Sorted keys
+   * @param order Original indices, as returned by RadixSort
+   * @param less Comparison on two original indices
+   */
+  template<class Less>
+  void SortTies(const std::vector<uint64_t>& keys, std::vector<uint32_t>& order, Less less) {
+    const size_t n = keys.size();
+    size_t i = 0;
+    while (i < n) {
+      size_t j = i + 1;
+      while (j < n && keys[j] == keys[i])
+	++j;
+      if (j - i > 1)
+	std::stable_sort(order.begin() + i, order.begin() + j, less);
+      i = j;
+    }
+  }
+
+}
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef SEQLIB_READ_ARENA_H__
+#define SEQLIB_READ_ARENA_H__
+
+#include <vector>
+#include <cstring>
+#include <cstddef>
+
+namespace SeqLib {
+
+  /** Block allocator for the strings of many reads
+   *
+   * Hands out space from large malloc'd blocks, so storing a read costs
+   * a pointer bump rather than a malloc, and the reads of a set lie
+   * together in memory. Blocks never move, so pointers stay valid
+   * until Clear. Nothing is freed one string at a time: Clear makes all
+   * of the space available again (keeping the blocks, to reuse for the
+   * next set of reads) and Release gives it back.
+   *
+   * Used by FermiAssembler and BFC for read names, and by BFC for its
+   * training reads and the batches it corrects. Reads handed to
+   * fermi-lite calls that free them must be malloc'd one by one instead.
+   */
+  class ReadArena {
+
+  public:
+
+    /** Create an empty arena
+     * @param block_size Bytes to malloc at a time. Larger requests get a block of their own.
+     */
+    explicit ReadArena(size_t block_size = 1 << 20) : m_cur(0), m_used(0), m_block_size(block_size ? block_size : 1) {}
+
+    /** Free all of the blocks */
+    ~ReadArena() { Release(); }
+
+    /** Return space for n bytes
+     * @exception Throws a bad_alloc if a new block can't be allocated
+     */
+    char* Alloc(size_t n);
+
+    /** Copy n characters and add a NUL */
+    char* Copy(const char* s, size_t n) {
+      char* p = Alloc(n + 1);
+      memcpy(p, s, n);
+      p[n] = '\0';
+      return p;
+    }
+
+    /** Copy a NUL-terminated string */
+    char* Copy(const char* s) { return Copy(s, strlen(s)); }
+
+    /** Make all of the space available again. Pointers already handed out are invalid */
+    void Clear() { m_cur = 0; m_used = 0; }
+
+    /** Free all of the blocks */
+    void Release();
+
+    /** Return the bytes held in blocks */
+    size_t Capacity() const;
+
+  private:
+
+    struct Block {
+      char* data;
+      size_t size;
+    };
+
+    std::vector<Block> m_blocks;
+
+    size_t m_cur; // block being filled
+
+    size_t m_used; // bytes used in m_blocks[m_cur]
+
+    size_t m_block_size;
+
+    ReadArena(const ReadArena&);
+    ReadArena& operator=(const ReadArena&);
+
+  };
+
+}
+
+#endif
@@ -10,6 +10,7 @@
 #include "json/json.h"
 
 #include "SeqLib/GenomicRegionCollection.h"
+#include "SeqLib/GenomicMask.h"
 #include "SeqLib/BamRecord.h"
 
 #ifdef HAVE_C11
@@ -68,6 +69,12 @@ namespace SeqLib {
      */
     int QueryText(const std::string& t) const;
 
+    /** Construct the trie now, rather than lazily on the first query.
+     * @note Lazy construction is not thread-safe, so this must be
+     * called before the trie is queried from multiple threads.
+     */
+    void Build() const { if (count) QueryText(std::string()); }
+
 #ifdef HAVE_C11
     SeqPointer<aho_corasick::trie> aho_trie; ///< The trie for the Aho-Corasick search
 #endif
@@ -461,6 +468,12 @@ class ReadFilter {
   // how many reads pass this MiniRule
   size_t m_count;
 
+  // flattened copy of m_grv for fast overlap tests. Shared between copies
+  SeqPointer<GenomicMask> m_mask;
+
+  // build (or drop) m_mask from the current regions
+  void build_mask(bool on);
+
 };
 
 /** A full set of rules across any number of regions
@@ -477,7 +490,7 @@ class ReadFilterCollection {
   /** Construct an empty ReadFilterCollection 
    * that will pass all reads.
    */
- ReadFilterCollection() : m_count(0), m_count_seen(0) {}
+ ReadFilterCollection() : m_count(0), m_count_seen(0), m_use_mask(false) {}
 
   /** Create a new filter collection directly from a JSON 
    * @param script A JSON file or directly as JSON formatted string
@@ -502,6 +515,40 @@ class ReadFilterCollection {
   /** Query a read to see if it passes any one of the
    * filters contained in this collection */
   bool isValid(const BamRecord &r);
+
+  /** Build any lazily-constructed state (e.g. motif tries) up front.
+   * 
+   * Copies of a ReadFilterCollection share their motif tries. Call this
+   * before handing copies to separate threads.
+   */
+  void BuildTries() const;
+
+  /** Return the number of reads tested with isValid */
+  size_t NumSeen() const { return m_count_seen; }
+
+  /** Return the number of reads that passed isValid */
+  size_t NumPassed() const { return m_count; }
+
+  /** Set the pass counts of this collection and its filters and rules to zero */
+  void ResetCounts();
+
+  /** Add the pass counts of another copy of this collection (eg one used
+   * on another thread) to the counts of this one
+   * @param rfc A copy of this collection, with the same filters and rules
+   * @exception Throws an invalid_argument if rfc has different filters or rules
+   */
+  void AddCounts(const ReadFilterCollection& rfc);
+
+  /** Test reads against the filter regions with a GenomicMask
+   *
+   * By default each filter finds overlapping regions with an interval
+   * tree. When only the yes/no answer is needed, as here, a GenomicMask
+   * gives it without allocating and in fewer steps, which matters for
+   * filters over many (e.g. exome) regions. Applies to the current
+   * filters and any added later.
+   * @param on Use the mask if true, the interval tree if false
+   */
+  void SetRegionMask(bool on);
   
   /** Print some basic information about this object */
   friend std::ostream& operator<<(std::ostream& out, const ReadFilterCollection &mr);
@@ -543,6 +590,8 @@ class ReadFilterCollection {
   size_t m_count; // passed
   size_t m_count_seen; // tested
 
+  bool m_use_mask; // filters test regions with a GenomicMask
+
   // store all of the individual filters
   std::vector<ReadFilter> m_regions;
 
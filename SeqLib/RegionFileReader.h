@@ -0,0 +1,131 @@
+#ifndef SEQLIB_REGION_FILE_READER_H__
+#define SEQLIB_REGION_FILE_READER_H__
+
+#include <string>
+
+#include "SeqLib/GenomicRegion.h"
+#include "SeqLib/BamHeader.h"
+#include "SeqLib/LineReader.h"
+
+extern "C" {
+#include "htslib/tbx.h"
+#include "htslib/kstring.h"
+}
+
+namespace SeqLib {
+
+  /** Stream the records of a BED or VCF file one GenomicRegion at a time
+   *
+   * Only one record is held in memory at a time, so files of any size
+   * can be walked. With no region set the whole file is read (plain,
+   * gzipped or bgzipped). If the file is bgzipped and has a tabix
+   * index (.tbi or .csi), SetRegion restricts the records to those
+   * overlapping a region, seeking straight to them through the index.
+   *
+   * BED records give the start and end columns as read. VCF records
+   * are width 1, at the POS column. Records on chromosomes not in the
+   * header are skipped.
+   */
+  class RegionFileReader {
+
+  public:
+
+    /** Create an unopened reader */
+    RegionFileReader();
+
+    /** Close the file and free the index */
+    ~RegionFileReader();
+
+    /** Open a BED or VCF file, using the name to tell which (.vcf is VCF, anything else BED)
+     * @param file Path to the file
+     * @param hdr Header to convert chromosome names to IDs with
+     * @return false if the file can't be opened
+     */
+    bool Open(const std::string& file, const BamHeader& hdr);
+
+    /** Open a BED file. Lines containing a '#' are skipped. */
+    bool OpenBED(const std::string& file, const BamHeader& hdr);
+
+    /** Open a VCF file. Lines starting with a '#' are skipped. */
+    bool OpenVCF(const std::string& file, const BamHeader& hdr);
+
+    /** Set the number of threads used to decompress a bgzipped file (default 1)
+     * @note Only used when reading the whole file
+     * @exception Throws an invalid_argument if n < 1
+     */
+    void SetThreads(int n);
+
+    /** Only return records overlapping a region, using the tabix index
+     *
+     * Can be called again to move to another region. Overlaps are
+     * closed on both ends, as for GenomicRegion.
+     * @param gr Region to jump to. A chromosome with no records in the index yields no records.
+     * @return false if the file has no tabix index
+     */
+    bool SetRegion(const GenomicRegion& gr);
+
+    /** Get the next record
+     * @param gr Set to the next record
+     * @return false at the end of the file (or region), or on a read error (see Failed)
+     * @exception Throws an invalid_argument if a line has too few columns, a bad position
+     * or an end before its start, and an out_of_range if a position does not fit in 32 bits
+     */
+    bool GetNextRegion(GenomicRegion& gr);
+
+    /** Close the file */
+    void Close();
+
+    /** Return true if reading stopped because of a read or decompression error */
+    bool Failed() const { return !m_error.empty(); }
+
+    /** Return a description of the last error */
+    const std::string& Error() const { return m_error; }
+
+  private:
+
+    std::string m_file;
+
+    BamHeader m_hdr;
+
+    bool m_vcf;
+
+    std::string m_error;
+
+    // whole-file streaming
+    LineReader m_reader;
+    int m_threads;
+
+    // tabix region streaming
+    htsFile* m_hts;
+    tbx_t* m_tbx;
+    hts_itr_t* m_itr;
+    kstring_t m_str;
+    GenomicRegion m_region;
+    bool m_region_set;
+
+    // records seen, for error messages
+    size_t m_line_num;
+
+    // last chromosome looked up. Files usually come in runs on the same one
+    std::string m_last_chr;
+    int32_t m_last_id;
+
+    bool open(const std::string& file, const BamHeader& hdr, bool vcf);
+
+    // parse one line in place. false if it is skipped
+    bool parse(char* line, size_t len, GenomicRegion& gr);
+
+    int32_t chr_id(const char* name, size_t len);
+
+    int32_t parse_pos(const char* s) const;
+
+    std::string where() const;
+
+    RegionFileReader(const RegionFileReader&);
+    RegionFileReader& operator=(const RegionFileReader&);
+
+  };
+
+}
+
+#endif
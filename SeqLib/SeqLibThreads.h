@@ -0,0 +1,473 @@
+#ifndef SEQLIB_THREADS_H__
+#define SEQLIB_THREADS_H__
+
+#include <pthread.h>
+#include <sys/time.h>
+#include <stdint.h>
+#include <deque>
+#include <map>
+#include <utility>
+#include <algorithm>
+#include <vector>
+#include <stdexcept>
+
+namespace SeqLib {
+
+  /** Return the wall-clock time in seconds (for stage timings) */
+  inline double WallTime() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1e-6;
+  }
+
+  /** Return n per second over t seconds, or 0 for a stage too short to time */
+  inline double PerSecond(uint64_t n, double t) {
+    return t > 0 ? n / t : 0;
+  }
+
+  /** Lock a pthread mutex for the lifetime of this object */
+  class ScopedLock {
+
+  public:
+
+    /** Lock the mutex */
+    explicit ScopedLock(pthread_mutex_t* m) : m_mutex(m) { pthread_mutex_lock(m_mutex); }
+
+    /** Unlock the mutex */
+    ~ScopedLock() { pthread_mutex_unlock(m_mutex); }
+
+  private:
+
+    pthread_mutex_t* m_mutex;
+
+    ScopedLock(const ScopedLock&);
+    ScopedLock& operator=(const ScopedLock&);
+
+  };
+
+  /** Thread-safe FIFO queue with a maximum capacity.
+   *
+   * Push blocks while the queue is full and Pop blocks while it is
+   * empty. Once Close is called, Push fails and Pop drains the
+   * remaining items before returning false. The queue also keeps track
+   * of its occupancy (sampled on each Push) so that pipeline
+   * stalls can be diagnosed.
+   */
+  template<typename T>
+  class BoundedQueue {
+
+  public:
+
+    /** Create an empty queue
+     * @param capacity Maximum number of items held at once (min 1)
+     */
+    explicit BoundedQueue(size_t capacity) : m_capacity(capacity ? capacity : 1), m_closed(false),
+      m_max_occupancy(0), m_sum_occupancy(0), m_num_push(0) {
+      pthread_mutex_init(&m_mutex, NULL);
+      pthread_cond_init(&m_not_full, NULL);
+      pthread_cond_init(&m_not_empty, NULL);
+    }
+
+    ~BoundedQueue() {
+      pthread_cond_destroy(&m_not_empty);
+      pthread_cond_destroy(&m_not_full);
+      pthread_mutex_destroy(&m_mutex);
+    }
+
+    /** Add an item, waiting for space if the queue is full
+     * @return false if the queue has been closed
+     */
+    bool Push(const T& t) {
+      ScopedLock lock(&m_mutex);
+      while (m_queue.size() >= m_capacity && !m_closed)
+	pthread_cond_wait(&m_not_full, &m_mutex);
+      if (m_closed)
+	return false;
+      m_queue.push_back(t);
+      m_max_occupancy = std::max(m_max_occupancy, m_queue.size());
+      m_sum_occupancy += m_queue.size();
+      ++m_num_push;
+      pthread_cond_signal(&m_not_empty);
+      return true;
+    }
+
+    /** Remove the item at the front, waiting for one if the queue is empty
+     * @return false if the queue is closed and has been drained
+     */
+    bool Pop(T& t) {
+      ScopedLock lock(&m_mutex);
+      while (m_queue.empty() && !m_closed)
+	pthread_cond_wait(&m_not_empty, &m_mutex);
+      if (m_queue.empty())
+	return false;
+      t = m_queue.front();
+      m_queue.pop_front();
+      pthread_cond_signal(&m_not_full);
+      return true;
+    }
+
+    /** Stop accepting new items and wake all waiting threads */
+    void Close() {
+      ScopedLock lock(&m_mutex);
+      m_closed = true;
+      pthread_cond_broadcast(&m_not_empty);
+      pthread_cond_broadcast(&m_not_full);
+    }
+
+    /** Return the maximum number of items held at once */
+    size_t Capacity() const { return m_capacity; }
+
+    /** Return the highest number of items that were queued at once */
+    size_t MaxOccupancy() const { ScopedLock lock(&m_mutex); return m_max_occupancy; }
+
+    /** Return the mean number of queued items, sampled on each Push */
+    double MeanOccupancy() const {
+      ScopedLock lock(&m_mutex);
+      return m_num_push ? (double)m_sum_occupancy / m_num_push : 0;
+    }
+
+  private:
+
+    std::deque<T> m_queue;
+
+    size_t m_capacity;
+
+    bool m_closed;
+
+    // occupancy tracking
+    size_t m_max_occupancy;
+    size_t m_sum_occupancy;
+    size_t m_num_push;
+
+    mutable pthread_mutex_t m_mutex;
+    pthread_cond_t m_not_full;
+    pthread_cond_t m_not_empty;
+
+    BoundedQueue(const BoundedQueue&);
+    BoundedQueue& operator=(const BoundedQueue&);
+
+  };
+
+  // pthread entry point to call T::operator()
+  template<typename T>
+  void* _run_task(void* arg) {
+    (*static_cast<T*>(arg))();
+    return NULL;
+  }
+
+  /** Run each task in its own thread and wait for all of them to finish.
+   *
+   * Each element of tasks must be callable as task(). If there is only
+   * one task, it is run on the calling thread.
+   * @param tasks Tasks to run concurrently
+   * @exception Throws a runtime_error if a thread cannot be created
+   */
+  template<typename T>
+  void RunThreads(std::vector<T>& tasks) {
+
+    if (tasks.size() == 1) {
+      tasks[0]();
+      return;
+    }
+
+    std::vector<pthread_t> threads(tasks.size());
+    size_t started = 0;
+    for (; started < tasks.size(); ++started)
+      if (pthread_create(&threads[started], NULL, _run_task<T>, &tasks[started]))
+	break;
+
+    for (size_t i = 0; i < started; ++i)
+      pthread_join(threads[i], NULL);
+
+    if (started != tasks.size())
+      throw std::runtime_error("RunThreads - failed to create thread");
+  }
+
+  /** Reader thread -> pool of worker threads -> jobs back in input order
+   *
+   * One thread makes jobs with stages.Read(), a pool of threads each run
+   * stages.Work(job, thread) on the jobs as they come, and the calling
+   * thread takes the finished jobs back with Next in the order they were
+   * read. Jobs that finish early wait for the ones before them, so the
+   * number of jobs alive at once (read, queued, working, waiting or
+   * held by the caller) is capped to bound memory.
+   *
+   * Stages must provide
+   * - Job* Read(): make the next job, or return NULL at the end. Only
+   *   called on the reader thread.
+   * - void Work(Job* job, int thread): process a job. Called on the
+   *   worker threads, thread running from 0 to num_threads - 1.
+   *
+   * Jobs are made with new and deleted by the pipeline.
+   */
+  template<class Job, class Stages>
+  class OrderedPipeline {
+
+  public:
+
+    /** Set up a pipeline. No threads are started until Start
+     * @param stages Reader and worker functions. Must outlive the pipeline.
+     * @param num_threads Number of worker threads (min 1)
+     * @param queue_size Maximum number of jobs in each queue (min 1)
+     */
+    OrderedPipeline(Stages& stages, int num_threads, size_t queue_size)
+      : m_stages(stages), m_threads(num_threads > 0 ? num_threads : 1), m_to_work(queue_size),
+	m_to_out(queue_size), m_max_in_flight(2 * m_to_work.Capacity() + m_threads), m_in_flight(0),
+	m_peak_in_flight(0), m_live_workers(0), m_stop(false), m_started(false), m_next(0),
+	m_current(NULL), m_read_time(0), m_work_time(0) {
+      pthread_mutex_init(&m_mutex, NULL);
+      pthread_cond_init(&m_released, NULL);
+    }
+
+    /** Stop the threads, if still running */
+    ~OrderedPipeline() {
+      Stop();
+      pthread_cond_destroy(&m_released);
+      pthread_mutex_destroy(&m_mutex);
+    }
+
+    /** Start the reader and worker threads
+     * @exception Throws a runtime_error if a thread cannot be created. Any
+     * threads already started are stopped first.
+     */
+    void Start() {
+
+      m_live_workers = m_threads;
+      if (pthread_create(&m_reader, NULL, read_thread, this))
+	throw std::runtime_error("OrderedPipeline::Start - failed to create reader thread");
+      m_started = true;
+
+      m_args.resize(m_threads);
+      m_workers.resize(m_threads);
+      size_t started = 0;
+      for (; started < m_workers.size(); ++started) {
+	m_args[started].pipeline = this;
+	m_args[started].thread = started;
+	if (pthread_create(&m_workers[started], NULL, work_thread, &m_args[started]))
+	  break;
+      }
+
+      // shut down the threads that did start, then give up
+      if (started != m_workers.size()) {
+	m_workers.resize(started);
+	Stop();
+	throw std::runtime_error("OrderedPipeline::Start - failed to create worker thread");
+      }
+    }
+
+    /** Get the next job, in the order they were read
+     *
+     * Waits for the job to finish if it is not done yet. The job is
+     * freed on the next call to Next or Stop.
+     * @param job Set to the next job
+     * @return False once every job has been returned
+     */
+    bool Next(Job*& job) {
+
+      release_current();
+      if (!m_started)
+	return false;
+
+      for (;;) {
+	typename std::map<size_t, Job*>::iterator it = m_pending.find(m_next);
+	if (it != m_pending.end()) {
+	  job = m_current = it->second;
+	  m_pending.erase(it);
+	  ++m_next;
+	  return true;
+	}
+
+	Item item;
+	if (!m_to_out.Pop(item)) {
+	  Stop();
+	  return false;
+	}
+	m_pending[item.first] = item.second;
+      }
+    }
+
+    /** Stop reading, let the threads drain out and free any jobs left */
+    void Stop() {
+
+      release_current();
+      if (!m_started)
+	return;
+
+      {
+	ScopedLock lock(&m_mutex);
+	m_stop = true;
+	pthread_cond_broadcast(&m_released);
+      }
+      m_to_work.Close();
+      m_to_out.Close();
+
+      pthread_join(m_reader, NULL);
+      for (size_t i = 0; i < m_workers.size(); ++i)
+	pthread_join(m_workers[i], NULL);
+      m_started = false;
+
+      Item item;
+      while (m_to_work.Pop(item))
+	delete item.second;
+      while (m_to_out.Pop(item))
+	delete item.second;
+      for (typename std::map<size_t, Job*>::iterator it = m_pending.begin(); it != m_pending.end(); ++it)
+	delete it->second;
+      m_pending.clear();
+    }
+
+    /** Return the seconds spent in Read. Complete once the pipeline has stopped */
+    double ReadTime() const { return m_read_time; }
+
+    /** Return the seconds spent in Work, summed over the worker threads.
+     * Complete once the pipeline has stopped
+     */
+    double WorkTime() const { return m_work_time; }
+
+    /** Return the highest number of jobs alive at once */
+    size_t PeakInFlight() const { ScopedLock lock(&m_mutex); return m_peak_in_flight; }
+
+    /** Return the jobs waiting for a worker thread */
+    const BoundedQueue<std::pair<size_t, Job*> >& WorkQueue() const { return m_to_work; }
+
+    /** Return the finished jobs waiting to be taken by Next */
+    const BoundedQueue<std::pair<size_t, Job*> >& OutputQueue() const { return m_to_out; }
+
+  private:
+
+    // a job and its position in the input
+    typedef std::pair<size_t, Job*> Item;
+
+    // argument to a worker thread
+    struct WorkerArg {
+      OrderedPipeline* pipeline;
+      int thread;
+    };
+
+    Stages& m_stages;
+
+    int m_threads;
+
+    BoundedQueue<Item> m_to_work;
+    BoundedQueue<Item> m_to_out;
+
+    pthread_t m_reader;
+    std::vector<pthread_t> m_workers;
+    std::vector<WorkerArg> m_args;
+
+    mutable pthread_mutex_t m_mutex;
+    pthread_cond_t m_released; // a job has been freed
+    size_t m_max_in_flight;
+    size_t m_in_flight;
+    size_t m_peak_in_flight;
+
+    int m_live_workers; // worker threads not yet finished
+    bool m_stop; // the run is being abandoned
+    bool m_started; // threads are running, or finished but not joined
+
+    // finished jobs waiting on an earlier one
+    std::map<size_t, Job*> m_pending;
+    size_t m_next;
+
+    // job last returned by Next
+    Job* m_current;
+
+    double m_read_time;
+    double m_work_time;
+
+    // wait for room for another job. false if the run is being abandoned
+    bool acquire() {
+      ScopedLock lock(&m_mutex);
+      while (m_in_flight >= m_max_in_flight && !m_stop)
+	pthread_cond_wait(&m_released, &m_mutex);
+      if (m_stop)
+	return false;
+      ++m_in_flight;
+      m_peak_in_flight = std::max(m_peak_in_flight, m_in_flight);
+      return true;
+    }
+
+    // a job has been freed
+    void release() {
+      ScopedLock lock(&m_mutex);
+      --m_in_flight;
+      pthread_cond_signal(&m_released);
+    }
+
+    bool stopping() {
+      ScopedLock lock(&m_mutex);
+      return m_stop;
+    }
+
+    void release_current() {
+      if (!m_current)
+	return;
+      delete m_current;
+      m_current = NULL;
+      release();
+    }
+
+    static void* read_thread(void* arg) {
+
+      OrderedPipeline* p = static_cast<OrderedPipeline*>(arg);
+
+      for (size_t id = 0; p->acquire(); ++id) {
+
+	double t0 = WallTime();
+	Job* job = p->m_stages.Read();
+	p->m_read_time += WallTime() - t0;
+
+	// closed if the pipeline is being shut down
+	if (!job || !p->m_to_work.Push(Item(id, job))) {
+	  delete job;
+	  p->release();
+	  break;
+	}
+      }
+
+      p->m_to_work.Close();
+      return NULL;
+    }
+
+    static void* work_thread(void* arg) {
+
+      WorkerArg* w = static_cast<WorkerArg*>(arg);
+      OrderedPipeline* p = w->pipeline;
+
+      double busy = 0;
+      Item item;
+      while (p->m_to_work.Pop(item)) {
+
+	// don't spend time on jobs that will be thrown away
+	if (p->stopping()) {
+	  delete item.second;
+	  p->release();
+	  continue;
+	}
+
+	double t0 = WallTime();
+	p->m_stages.Work(item.second, w->thread);
+	busy += WallTime() - t0;
+
+	if (!p->m_to_out.Push(item)) {
+	  delete item.second;
+	  p->release();
+	}
+      }
+
+      // last worker out closes the output queue
+      ScopedLock lock(&p->m_mutex);
+      p->m_work_time += busy;
+      if (--p->m_live_workers == 0)
+	p->m_to_out.Close();
+      return NULL;
+    }
+
+    OrderedPipeline(const OrderedPipeline&);
+    OrderedPipeline& operator=(const OrderedPipeline&);
+
+  };
+
+}
+
+#endif
@@ -0,0 +1,121 @@
+#ifndef SEQLIB_TILE_GENERATOR_H__
+#define SEQLIB_TILE_GENERATOR_H__
+
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include <stdint.h>
+
+#include "SeqLib/BamHeader.h"
+#include "SeqLib/GenomicRegion.h"
+
+namespace SeqLib {
+
+  /** Hands out tiles across a genome one at a time, for splitting up work
+   *
+   * Gives the same tiles as GenomicRegionCollection(int, int, const HeaderSequenceVector&),
+   * plus a last tile clipped to the end of each sequence, without making
+   * them all up front: only the position of the next tile is stored.
+   *
+   * By default tiles are a fixed width. After BalanceByIndex (or
+   * BalanceByWeights) tile widths instead follow an estimate of the
+   * data in each part of the genome, so that each tile is about the
+   * same amount of work: short tiles where coverage is deep, long
+   * ones where it is thin.
+   *
+   * GetNextTile can be called from any number of threads, so a pool of
+   * workers can each take the next tile when they are done with the last.
+   */
+  class TileGenerator {
+
+  public:
+
+    /** Set up fixed-width tiles
+     * @param width Width of each tile
+     * @param ovlp Amount of overlap between neighboring tiles
+     * @param h Sequences to tile, in chromosome id order
+     * @exception Throws an invalid_argument if width <= ovlp or ovlp < 0
+     */
+    TileGenerator(int width, int ovlp, const HeaderSequenceVector& h);
+
+    ~TileGenerator();
+
+    /** Size the tiles by the data in an indexed BAM
+     *
+     * The index gives, for each 64 kb window, the file offset of the
+     * first reads overlapping it. The compressed bytes between windows
+     * are the weights for BalanceByWeights. Sequences with no mapped
+     * reads (from hts_idx_get_stat) become one tile. Only reads the
+     * index, not the reads. Starts again from the first tile.
+     * @param file Path to a BAM file with a .bai or .csi index
+     * @param num_tiles About how many tiles to split the genome into
+     * @return False if the file is not an indexed BAM
+     */
+    bool BalanceByIndex(const std::string& file, size_t num_tiles);
+
+    /** Size the tiles by a per-window estimate of work
+     *
+     * Each tile covers consecutive windows until their weights add up
+     * to the genome total over num_tiles, or the sequence ends. Tiles
+     * keep the overlap given to the constructor. Starts again from the
+     * first tile.
+     * @param weights weights[chr][i] is the work in [i * window, (i + 1) * window)
+     * of that sequence. Missing entries count as 0.
+     * @param window Width of each window
+     * @param num_tiles About how many tiles to split the genome into
+     * @exception Throws an invalid_argument if window or num_tiles is 0
+     */
+    void BalanceByWeights(const std::vector<std::vector<uint64_t> >& weights, int window, size_t num_tiles);
+
+    /** Get the next tile. Safe to call from several threads
+     * @param gr Set to the next tile
+     * @return False once every tile has been handed out
+     */
+    bool GetNextTile(GenomicRegion& gr);
+
+    /** Get the next tile and its number, counting from 0 in genome order
+     *
+     * Workers can use the number to put their results back in order.
+     */
+    bool GetNextTile(GenomicRegion& gr, size_t& num);
+
+    /** Start again from the first tile */
+    void Reset();
+
+    /** Return the number of tiles handed out since the last Reset */
+    size_t NumServed() const { return m_served; }
+
+  private:
+
+    int m_width;
+
+    int m_ovlp;
+
+    std::vector<uint32_t> m_lengths;
+
+    // per-window weights, empty for fixed-width tiles
+    std::vector<std::vector<uint64_t> > m_weights;
+    int m_window;
+    uint64_t m_target; // weight per tile
+
+    // where the next tile starts, and where the last one ended. Balanced
+    // tiles take windows from the last end, so each ends past the last
+    size_t m_chr;
+    int32_t m_pos;
+    int32_t m_end;
+
+    size_t m_served;
+
+    pthread_mutex_t m_mutex;
+
+    // make the next tile. false if there are none left
+    bool next_tile(GenomicRegion& gr);
+
+    TileGenerator(const TileGenerator&);
+    TileGenerator& operator=(const TileGenerator&);
+
+  };
+
+}
+
+#endif
@@ -0,0 +1,172 @@
+#ifndef SEQLIB_WINDOW_ASSEMBLER_H__
+#define SEQLIB_WINDOW_ASSEMBLER_H__
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <stdint.h>
+
+#include "SeqLib/BamReader.h"
+#include "SeqLib/GenomicRegionCollection.h"
+
+namespace SeqLib {
+
+  /** Contigs assembled from the reads of one window */
+  struct WindowContigs {
+
+    WindowContigs() : id(0), num_reads(0), skipped(false) {}
+
+    size_t id; ///< Position of the window in the collection given to SetWindows
+    GenomicRegion window; ///< The window
+    size_t num_reads; ///< Number of reads overlapping the window
+    bool skipped; ///< True if the window had more reads than the SetMaxReads limit, and was not assembled
+    std::vector<std::string> contigs; ///< Assembled contigs
+
+  };
+
+  /** Throughput and queue statistics for a WindowAssembler run
+   *
+   * The assembly time is summed over all of the assembly threads.
+   */
+  struct WindowAssemblerStats {
+
+    WindowAssemblerStats() : windows(0), skipped(0), reads(0), contigs(0), read_time(0),
+      assemble_time(0), wall_time(0), assemble_queue_max(0), assemble_queue_mean(0) {}
+
+    uint64_t windows; ///< Number of windows returned
+    uint64_t skipped; ///< Number of windows with too many reads to assemble
+    uint64_t reads; ///< Number of reads fetched
+    uint64_t contigs; ///< Number of contigs returned
+
+    double read_time; ///< Seconds spent fetching reads
+    double assemble_time; ///< Seconds spent correcting and assembling (summed over threads)
+    double wall_time; ///< Wall-clock seconds from the first window requested to the last returned
+
+    size_t assemble_queue_max; ///< Max number of windows waiting to be assembled
+    double assemble_queue_mean; ///< Mean number of windows waiting to be assembled
+
+    /** Print the throughput and queue occupancy */
+    friend std::ostream& operator<<(std::ostream& out, const WindowAssemblerStats& s);
+
+  };
+
+  // threads and queues of a run in progress (defined in WindowAssembler.cpp)
+  struct _WindowRun;
+
+  /** Local assembly of many genomic windows on a pool of threads
+   *
+   * Each window is assembled on its own with a FermiAssembler, from the
+   * reads overlapping it. One thread fetches the reads for each window
+   * in turn, a pool of threads error-corrects and assembles the windows
+   * concurrently, and GetNextWindow hands back the contigs in the order
+   * of the windows. Only a bounded number of windows are held in memory
+   * at once, so the windows can cover a whole genome.
+   *
+   * The threads start with the first call to GetNextWindow.
+   */
+  class WindowAssembler {
+
+  public:
+
+    /** Construct an assembler with one assembly thread and no windows */
+    WindowAssembler() : m_threads(1), m_queue_size(8), m_max_reads(0), m_correct(true),
+      m_min_overlap(0), m_run(NULL), m_done(false) {}
+
+    /** Stop any run in progress */
+    ~WindowAssembler();
+
+    /** Open an indexed BAM/CRAM to fetch reads from
+     * @return True if open was successful
+     */
+    bool Open(const std::string& bam);
+
+    /** Open a set of indexed BAM/CRAMs to fetch reads from.
+     * The reads of each window are pooled across files.
+     * @return True if open was successful
+     */
+    bool Open(const std::vector<std::string>& bams);
+
+    /** Set the windows to assemble, and start again from the first */
+    void SetWindows(const GRC& windows);
+
+    /** Set the number of assembly threads (default 1)
+     * @exception Throws an invalid_argument if n < 1
+     */
+    void SetNumThreads(int n);
+
+    /** Set the maximum number of windows waiting to be assembled (default 8)
+     * @exception Throws an invalid_argument if n == 0
+     */
+    void SetQueueSize(size_t n);
+
+    /** Skip assembly of windows with more than n reads (default 0, no limit)
+     *
+     * Very deep windows (e.g. centromeres) are slow to assemble and
+     * rarely useful. Skipped windows are still returned, with no contigs.
+     */
+    void SetMaxReads(size_t n) { m_max_reads = n; }
+
+    /** Turn error correction of the reads before assembly on or off (default on) */
+    void SetErrorCorrection(bool c) { m_correct = c; }
+
+    /** Set the minimum overlap between reads during string graph construction.
+     * 0 (the default) keeps the FermiAssembler default.
+     */
+    void SetMinOverlap(uint32_t m) { m_min_overlap = m; }
+
+    /** Get the contigs of the next window, in the order the windows were given
+     *
+     * Starts the threads on the first call, and waits for the window to be
+     * assembled if it is not done yet.
+     * @param w Set to the next window and its contigs
+     * @return False once every window has been returned
+     * @exception Throws a runtime_error if a thread cannot be created
+     */
+    bool GetNextWindow(WindowContigs& w);
+
+    /** Stop assembling, and start again from the first window */
+    void Reset();
+
+    /** Return the statistics of the current or last run.
+     * Counts are updated as windows are returned, times once the run ends.
+     */
+    const WindowAssemblerStats& Stats() const { return m_stats; }
+
+  private:
+
+    BamReader m_reader;
+
+    GRC m_windows;
+
+    int m_threads;
+
+    size_t m_queue_size;
+
+    size_t m_max_reads;
+
+    bool m_correct;
+
+    uint32_t m_min_overlap;
+
+    // run in progress, or NULL
+    _WindowRun* m_run;
+
+    // every window of the last run has been returned
+    bool m_done;
+
+    WindowAssemblerStats m_stats;
+
+    // start the threads
+    void start();
+
+    // join the threads and free the run. Windows not yet returned are dropped
+    void stop();
+
+    WindowAssembler(const WindowAssembler&);
+    WindowAssembler& operator=(const WindowAssembler&);
+
+  };
+
+}
+
+#endif
@@ -129,6 +129,23 @@ s_align* ssw_align (const s_profile* prof,
 */
 void align_destroy (s_align* a);
 
+/*!	@abstract	Instruction sets of the Smith-Waterman kernels	*/
+#define SSW_SIMD_AUTO -1	/* the widest set the CPU supports */
+#define SSW_SIMD_SSE2 0	/* 16 x 8-bit / 8 x 16-bit lanes */
+#define SSW_SIMD_AVX2 1	/* 32 x 8-bit / 16 x 16-bit lanes */
+
+/*!	@function	Choose the kernels used by query profiles built from now on.
+	@param	level	SSW_SIMD_AUTO, SSW_SIMD_SSE2 or SSW_SIMD_AVX2
+	@return	the level now in use; a level the CPU (or compiler) can't run falls back to SSE2
+	@note	Profiles keep the kernels they were built with, and every level gives the same
+			alignments. Alignments with gap open <= gap extension always run on SSE2.
+			The default is SSW_SIMD_AUTO. Set the level before starting threads.
+*/
+int ssw_set_simd (int level);
+
+/*!	@function	Return the kernels used by query profiles built from now on (SSW_SIMD_SSE2 or SSW_SIMD_AVX2)	*/
+int ssw_get_simd (void);
+
 /*!	@function		Produce CIGAR 32-bit unsigned integer from CIGAR operation and CIGAR length
 	@param	length		length of CIGAR
 	@param	op_letter	CIGAR operation character ('M', 'I', etc)
@@ -4,6 +4,13 @@
 #include <stdint.h>
 #include <string>
 #include <vector>
+#include <utility>
+
+struct _profile;
+
+namespace SeqLib {
+class BamRecord;
+}
 
 namespace StripedSmithWaterman {
 
@@ -44,6 +51,8 @@ struct Filter {
                                  //   If it is not set, ref_begin and query_begin are -1.
   bool report_cigar;             // Give cigar_string and cigar.
                                  //   report_begin_position is automatically TRUE.
+  bool report_cigar_string;      // Also give cigar_string; if not set, only cigar
+                                 //   is given and no string is built.
 
   // When *report_cigar* is true and alignment passes these two filters,
   //   cigar_string and cigar will be given.
@@ -54,18 +63,65 @@ struct Filter {
   Filter()
     : report_begin_position(true)
     , report_cigar(true)
+    , report_cigar_string(true)
     , score_filter(0)
     , distance_filter(32767)
   {};
 
-  Filter(const bool& pos, const bool& cigar, const uint16_t& score, const uint16_t& dis)
+  Filter(const bool& pos, const bool& cigar, const uint16_t& score, const uint16_t& dis,
+         const bool& cigar_string = true)
     : report_begin_position(pos)
     , report_cigar(cigar)
+    , report_cigar_string(cigar_string)
     , score_filter(score)
     , distance_filter(dis)
     {};
 };
 
+class Aligner;
+struct BatchWorker;
+
+// (query index, reference index) of one alignment in Aligner::AlignBatch
+typedef std::pair<int, int> AlignPair;
+
+// Modes of Aligner::AlignBanded
+enum BandedMode {
+  kGlocal, // the whole query against part of the reference
+  kGlobal  // the whole query against the whole reference
+};
+
+// =========
+// @class    A query translated and profiled once, for aligning against
+//             many references with Aligner::Align.
+//           Rebuilding a profile with Aligner::BuildQueryProfile reuses
+//             its buffers.
+//           [NOTICE] The profile points into the score matrix of the
+//                    aligner that built it, so it must not outlive that
+//                    aligner, or be used after the aligner is rebuilt.
+// =========
+class QueryProfile {
+ public:
+  QueryProfile(void) : profile_(NULL), query_length_(0) {};
+
+  ~QueryProfile(void);
+
+  // @function The length of the profiled query, 0 if none.
+  int Length(void) const { return query_length_; };
+
+  // @function Free the profile.
+  void Clear(void);
+
+ private:
+  friend class Aligner;
+
+  std::vector<int8_t> translated_query_;
+  struct _profile* profile_;
+  int query_length_;
+
+  QueryProfile& operator= (const QueryProfile&);
+  QueryProfile (const QueryProfile&);
+}; // class QueryProfile
+
 class Aligner {
  public:
   // =========
@@ -146,6 +202,142 @@ class Aligner {
   bool Align(const char* query, const char* ref, const int& ref_len,
              const Filter& filter, Alignment* alignment) const;
 
+  // =========
+  // @function Translate and profile a query once, to align against
+  //             many references without redoing the setup each time.
+  // @param    query     The query sequence.
+  //                     [NOTICE] It is not necessary null terminated.
+  // @param    query_len The length of the query.
+  // @param    profile   The profile to (re)build.
+  // @return   True: succeed; false: fail.
+  // =========
+  bool BuildQueryProfile(const char* query, const int& query_len,
+                         QueryProfile* profile) const;
+
+  // =========
+  // @function Align a profiled query against the reference that is set
+  //             by SetReferenceSequence.
+  // @param    profile   The query profile, built by this aligner.
+  // @param    filter    The filter for the alignment.
+  // @param    alignment The container contains the result.
+  // @return   True: succeed; false: fail.
+  // =========
+  bool Align(const QueryProfile& profile, const Filter& filter,
+             Alignment* alignment) const;
+
+  // =========
+  // @function Align a profiled query against the reference.
+  //           [NOTICE] The reference is translated into a buffer held
+  //                    by this aligner and reused from call to call, so
+  //                    use one aligner per thread. A profile can be
+  //                    shared by several threads.
+  // @param    profile   The query profile, built by this aligner.
+  // @param    ref       The reference sequence.
+  //                     [NOTICE] It is not necessary null terminated.
+  // @param    ref_len   The length of the reference sequence.
+  // @param    filter    The filter for the alignment.
+  // @param    alignment The container contains the result.
+  // @return   True: succeed; false: fail.
+  // =========
+  bool Align(const QueryProfile& profile, const char* ref, const int& ref_len,
+             const Filter& filter, Alignment* alignment);
+
+  // =========
+  // @function Align many query/reference pairs on a pool of threads.
+  //             Pairs are grouped by query, so each query is profiled
+  //             once, and the threads take whole queries in turn, each
+  //             with its own profile and reference buffers.
+  // @param    queries    The query sequences.
+  // @param    references The reference sequences.
+  // @param    pairs      The (query, reference) index pairs to align.
+  // @param    nthreads   The number of threads (1 aligns on this thread).
+  // @param    results    Resized to the number of pairs; results[i] is
+  //                      the alignment of pairs[i].
+  // @param    filter     The filter for the alignments.
+  // @return   True: succeed; false: an index is out of range (nothing is
+  //             aligned), or some query or reference is empty (those
+  //             results are left cleared).
+  // =========
+  bool AlignBatch(const std::vector<std::string>& queries,
+                  const std::vector<std::string>& references,
+                  const std::vector<AlignPair>& pairs,
+                  const int& nthreads,
+                  std::vector<Alignment>* results,
+                  const Filter& filter = Filter()) const;
+
+  // =========
+  // @function Align the whole query against the reference, filling in
+  //             only the cells within band_width diagonals of the one
+  //             through (0, ref_offset). This costs query_len *
+  //             (2 * band_width + 1) cells instead of query_len * ref_len,
+  //             for re-aligning reads around a known position.
+  //           kGlocal aligns the query end to end (no soft clips) against
+  //             any part of the reference in the band; kGlobal also aligns
+  //             the reference end to end.
+  //           The cigar is in the same form as from Align, =/X/I/D, and
+  //             can be passed to BamRecord::SetCigar as
+  //             SeqLib::Cigar(alignment->cigar).
+  //           [NOTICE] sw_score is unsigned, so a negative score is
+  //                    reported as 0. There is no next best alignment.
+  // @param    query       The query sequence.
+  //                       [NOTICE] It is not necessary null terminated.
+  // @param    query_len   The length of the query.
+  // @param    ref         The reference sequence.
+  //                       [NOTICE] It is not necessary null terminated.
+  // @param    ref_len     The length of the reference sequence.
+  // @param    mode        kGlocal or kGlobal.
+  // @param    band_width  The number of diagonals on each side.
+  // @param    ref_offset  The reference position expected for the first
+  //                       query base (0 for kGlobal).
+  // @param    alignment   The container contains the result.
+  // @return   True: succeed; false: fail, or no alignment fits in the band
+  //             (for kGlobal the band must also reach the end of both).
+  // =========
+  bool AlignBanded(const char* query, const int& query_len,
+                   const char* ref, const int& ref_len,
+                   const BandedMode& mode, const int& band_width,
+                   const int& ref_offset, Alignment* alignment) const;
+
+  // =========
+  // @function Align the sequence of a record against the reference that
+  //             is set by SetReferenceSequence, and write the result
+  //             straight into the record: the position, the cigar (M/I/D
+  //             with soft clips, as in a BAM from a read mapper) and the
+  //             NM and AS tags, with the mapped flag set. No Alignment or
+  //             cigar string is built, and the record's buffers are
+  //             reused, so one record can be recycled for many reads.
+  //           The chromosome, strand, mapping quality and mate fields
+  //             are left as they are.
+  //           [NOTICE] The query and cigar are held in buffers of this
+  //                    aligner and reused from call to call, so use one
+  //                    aligner per thread.
+  // @param    record    The record to realign. Its sequence is the query.
+  // @param    ref_pos   The 0-based position of the first reference base.
+  // @param    filter    The filter for the alignment. The cigar is always
+  //                     computed; report_cigar_string is ignored.
+  // @return   True: succeed; false: fail, or the alignment did not pass
+  //             the filter. The record is left untouched.
+  // =========
+  bool Align(SeqLib::BamRecord* record, const int32_t& ref_pos,
+             const Filter& filter = Filter());
+
+  // =========
+  // @function Align the sequence of a record against the reference, and
+  //             write the result straight into the record, as above.
+  //           [NOTICE] The reference won't replace the reference
+  //                      set by SetReferenceSequence.
+  // @param    record    The record to realign. Its sequence is the query.
+  // @param    ref       The reference sequence.
+  //                     [NOTICE] It is not necessary null terminated.
+  // @param    ref_len   The length of the reference sequence.
+  // @param    ref_pos   The 0-based position of ref[0].
+  // @param    filter    The filter for the alignment.
+  // @return   True: succeed; false: fail, or the alignment did not pass
+  //             the filter. The record is left untouched.
+  // =========
+  bool Align(SeqLib::BamRecord* record, const char* ref, const int& ref_len,
+             const int32_t& ref_pos, const Filter& filter = Filter());
+
   // @function Clear up all containers and thus the aligner is disabled.
   //             To rebuild the aligner please use Build functions.
   void Clear(void);
@@ -192,11 +384,28 @@ class Aligner {
   int8_t* translated_reference_;
   int32_t reference_length_;
 
+  // reused by Align(profile, ref, ...) and Align(record, ...)
+  std::vector<int8_t> reference_scratch_;
+  std::vector<int8_t> query_scratch_;
+  std::vector<uint32_t> cigar_scratch_;
+
   int TranslateBase(const char* bases, const int& length, int8_t* translated) const;
+  void AlignTranslated(const struct _profile* profile, const int8_t* query, const int& query_len,
+                       const int8_t* ref, const int& ref_len,
+                       const Filter& filter, Alignment* alignment) const;
+  // align a profile against ref, translated into scratch
+  bool AlignProfile(const QueryProfile& profile, const char* ref, const int& ref_len,
+                    std::vector<int8_t>* scratch,
+                    const Filter& filter, Alignment* alignment) const;
+  // align the record's sequence against a translated ref
+  bool AlignRecord(SeqLib::BamRecord* record, const int8_t* ref, const int& ref_len,
+                   const int32_t& ref_pos, const Filter& filter);
   void SetAllDefault(void);
   void BuildDefaultMatrix(void);
   void ClearMatrices(void);
 
+  friend struct BatchWorker;
+
   Aligner& operator= (const Aligner&);
   Aligner (const Aligner&);
 }; // class Aligner
@@ -2,6 +2,11 @@
 
 #define JUMPING_TEST 1
 //#define READ_TEST 1
+//#define INTERVAL_TEST 1
+//#define LOAD_TEST 1
+//#define COLUMNS_TEST 1
+//#define ASSEMBLY_TEST 1
+//#define SW_TEST 1
 
 #include "SeqLib/SeqLibUtils.h"
 
@@ -21,6 +26,75 @@
 using namespace seqan;
 #endif
 
+#ifdef LOAD_TEST
+#include <sstream>
+#include <zlib.h>
+#include "htslib/bgzf.h"
+#include "SeqLib/GenomicRegionCollection.h"
+#include "SeqLib/SeqLibThreads.h"
+
+// the gzgets + istringstream loop that ReadBED used before LineReader
+static size_t load_bed_getline(const std::string& file, const SeqLib::BamHeader& hdr) {
+  SeqLib::GRC grc;
+  gzFile fp = gzopen(file.c_str(), "r");
+  char buffer[4096];
+  while (gzgets(fp, buffer, 4096)) {
+    std::string line(buffer);
+    if (line.find("#") != std::string::npos)
+      continue;
+    std::istringstream iss_line(line);
+    std::string chr, pos1, pos2;
+    std::getline(iss_line, chr, '\t');
+    std::getline(iss_line, pos1, '\t');
+    std::getline(iss_line, pos2, '\t');
+    SeqLib::GenomicRegion gr(chr, pos1, pos2, hdr);
+    if (gr.chr >= 0)
+      grc.add(gr);
+  }
+  gzclose(fp);
+  return grc.size();
+}
+
+// time the old and new BED loaders on plain and bgzipped input
+static void load_benchmark() {
+
+  const size_t num_lines = 5000000;
+  const std::string bed = "tmp_load_test.bed";
+  const std::string bgz = "tmp_load_test.bed.gz";
+
+  std::stringstream hs;
+  for (int i = 1; i <= 22; ++i)
+    hs << "@SQ\tSN:" << i << "\tLN:250000000" << std::endl;
+  SeqLib::BamHeader hdr(hs.str());
+
+  FILE* fp = fopen(bed.c_str(), "w");
+  BGZF* bp = bgzf_open(bgz.c_str(), "w");
+  srand(42);
+  for (size_t i = 0; i < num_lines; ++i) {
+    char line[256];
+    int p = rand() % 200000000;
+    int n = sprintf(line, "%d\t%d\t%d\tfeature_%lu\t0\t+\n", rand() % 22 + 1, p, p + rand() % 1000, (unsigned long)i);
+    fwrite(line, 1, n, fp);
+    bgzf_write(bp, line, n);
+  }
+  fclose(fp);
+  bgzf_close(bp);
+
+  const std::string files[2] = { bed, bgz };
+  for (int f = 0; f < 2; ++f) {
+    double t0 = SeqLib::WallTime();
+    size_t n = load_bed_getline(files[f], hdr);
+    std::cerr << files[f] << " getline loader: " << (SeqLib::WallTime() - t0) << "s, " << SeqLib::AddCommas(n) << " regions" << std::endl;
+    for (int t = 1; t <= 4; t *= 2) {
+      SeqLib::GRC grc;
+      t0 = SeqLib::WallTime();
+      grc.ReadBED(files[f], hdr, t);
+      std::cerr << files[f] << " ReadBED, " << t << " threads: " << (SeqLib::WallTime() - t0) << "s, " << SeqLib::AddCommas(grc.size()) << " regions" << std::endl;
+    }
+  }
+}
+#endif
+
 #ifdef RUN_SEQLIB
 #include "SeqLib/BamReader.h"
 #include "SeqLib/BamWriter.h"
@@ -28,6 +102,401 @@ using namespace seqan;
 
 #define BAMTOOLS_GET_CORE 1
 
+#ifdef INTERVAL_TEST
+#include <cstdio>
+#include <unistd.h>
+#include "SeqLib/IntervalTree.h"
+#include "SeqLib/IntervalIndex.h"
+#include "SeqLib/SeqLibThreads.h"
+
+// resident set size in bytes, from /proc
+static size_t resident_bytes() {
+  long pages = 0, resident = 0;
+  FILE* f = fopen("/proc/self/statm", "r");
+  if (f) {
+    if (fscanf(f, "%ld %ld", &pages, &resident) != 2)
+      resident = 0;
+    fclose(f);
+  }
+  return resident * sysconf(_SC_PAGESIZE);
+}
+
+// compare build time, memory and query rate of the pointer-based
+// interval tree and the flat interval index on the same random intervals
+static void interval_benchmark() {
+
+  const size_t num_intervals = 5000000;
+  const size_t num_queries   = 2000000;
+  const int genome = 250000000;
+
+  typedef SeqLib::TInterval<int32_t, int32_t> ival;
+  std::vector<ival> iv;
+  iv.reserve(num_intervals);
+  srand(42);
+  for (size_t i = 0; i < num_intervals; ++i) {
+    int32_t s = rand() % genome;
+    iv.push_back(ival(s, s + rand() % 1000, i));
+  }
+  std::vector<int32_t> qs(num_queries);
+  for (size_t i = 0; i < num_queries; ++i)
+    qs[i] = rand() % genome;
+
+  size_t hits = 0;
+  double t0;
+
+  std::cerr << " **** FLAT INTERVAL INDEX **** " << std::endl;
+  {
+    size_t m0 = resident_bytes();
+    t0 = SeqLib::WallTime();
+    SeqLib::TIntervalIndex<int32_t, int32_t> idx(iv);
+    std::cerr << " build: " << (SeqLib::WallTime() - t0) << "s, memory: "
+              << SeqLib::AddCommas(resident_bytes() - m0) << " bytes" << std::endl;
+    t0 = SeqLib::WallTime();
+    std::vector<ival> out;
+    for (size_t i = 0; i < num_queries; ++i) {
+      out.clear();
+      idx.findOverlapping(qs[i], qs[i] + 500, out);
+      hits += out.size();
+    }
+    double t = SeqLib::WallTime() - t0;
+    std::cerr << " query: " << SeqLib::AddCommas((uint64_t)(num_queries / t)) << " q/s, "
+              << SeqLib::AddCommas(hits) << " hits" << std::endl;
+  }
+
+  std::cerr << " **** INTERVAL TREE **** " << std::endl;
+  hits = 0;
+  {
+    size_t m0 = resident_bytes();
+    t0 = SeqLib::WallTime();
+    SeqLib::TIntervalTree<int32_t, int32_t> tree(iv);
+    std::cerr << " build: " << (SeqLib::WallTime() - t0) << "s, memory: "
+              << SeqLib::AddCommas(resident_bytes() - m0) << " bytes" << std::endl;
+    t0 = SeqLib::WallTime();
+    std::vector<ival> out;
+    for (size_t i = 0; i < num_queries; ++i) {
+      out.clear();
+      tree.findOverlapping(qs[i], qs[i] + 500, out);
+      hits += out.size();
+    }
+    double t = SeqLib::WallTime() - t0;
+    std::cerr << " query: " << SeqLib::AddCommas((uint64_t)(num_queries / t)) << " q/s, "
+              << SeqLib::AddCommas(hits) << " hits" << std::endl;
+  }
+
+  // alternating inserts and queries: a batch of inserts, then a batch of queries
+  const size_t num_stream = 200000;
+  const size_t insert_batch = 100;
+  const size_t query_batch = 10;
+
+  std::cerr << " **** INSERT / QUERY, DYNAMIC INDEX **** " << std::endl;
+  hits = 0;
+  {
+    t0 = SeqLib::WallTime();
+    SeqLib::TDynamicIntervalIndex<int32_t, int32_t> idx;
+    for (size_t i = 0; i < num_stream; ++i) {
+      idx.insert(iv[i].start, iv[i].stop, iv[i].value);
+      if ((i + 1) % insert_batch == 0)
+        for (size_t j = 0; j < query_batch; ++j)
+          hits += idx.countOverlapping(qs[i + j], qs[i + j] + 500);
+    }
+    std::cerr << " " << (SeqLib::WallTime() - t0) << "s, " << idx.levels() << " levels, "
+              << SeqLib::AddCommas(hits) << " hits" << std::endl;
+  }
+
+  std::cerr << " **** INSERT / QUERY, REBUILD STATIC INDEX **** " << std::endl;
+  hits = 0;
+  {
+    t0 = SeqLib::WallTime();
+    std::vector<ival> added;
+    for (size_t i = 0; i < num_stream; ++i) {
+      added.push_back(iv[i]);
+      if ((i + 1) % insert_batch == 0) {
+        SeqLib::TIntervalIndex<int32_t, int32_t> idx(added);
+        for (size_t j = 0; j < query_batch; ++j)
+          hits += idx.countOverlapping(qs[i + j], qs[i + j] + 500);
+      }
+    }
+    std::cerr << " " << (SeqLib::WallTime() - t0) << "s, "
+              << SeqLib::AddCommas(hits) << " hits" << std::endl;
+  }
+}
+#endif
+
+#ifdef COLUMNS_TEST
+#include "SeqLib/GenomicRegionColumns.h"
+#include "SeqLib/SeqLibThreads.h"
+
+// sort, width and memory of a GRC against the column store, on the same random intervals
+static void columns_benchmark() {
+
+  const size_t num_intervals = 50000000;
+
+  srand(1);
+  SeqLib::GRC grc;
+  for (size_t i = 0; i < num_intervals; ++i) {
+    int p = rand() % 250000000;
+    grc.add(SeqLib::GenomicRegion(rand() % 24, p, p + 100 + rand() % 100));
+  }
+  SeqLib::GenomicRegionColumns col(grc);
+
+  std::cerr << " **** " << SeqLib::AddCommas(num_intervals) << " INTERVALS **** " << std::endl;
+
+  std::vector<SeqLib::GenomicRegion> copy(grc.begin(), grc.end());
+  double t0 = SeqLib::WallTime();
+  std::sort(copy.begin(), copy.end());
+  std::cerr << " std::sort:        " << (SeqLib::WallTime() - t0) << "s" << std::endl;
+  std::vector<SeqLib::GenomicRegion>().swap(copy);
+
+  SeqLib::GRC grc4;
+  for (size_t i = 0; i < grc.size(); ++i)
+    grc4.add(grc[i]);
+  t0 = SeqLib::WallTime();
+  grc.CoordinateSort();
+  std::cerr << " GRC radix sort:   " << (SeqLib::WallTime() - t0) << "s" << std::endl;
+  t0 = SeqLib::WallTime();
+  grc4.CoordinateSort(4);
+  std::cerr << " GRC radix sort, 4 threads: " << (SeqLib::WallTime() - t0) << "s" << std::endl;
+  t0 = SeqLib::WallTime();
+  col.CoordinateSort();
+  std::cerr << " column radix sort: " << (SeqLib::WallTime() - t0) << "s" << std::endl;
+
+  t0 = SeqLib::WallTime();
+  long long w = grc.TotalWidth();
+  std::cerr << " GRC width:        " << (SeqLib::WallTime() - t0) << "s (" << w << ")" << std::endl;
+  t0 = SeqLib::WallTime();
+  w = col.TotalWidth();
+  std::cerr << " column width:     " << (SeqLib::WallTime() - t0) << "s (" << w << ")" << std::endl;
+
+  std::cerr << " GRC bytes:        " << SeqLib::AddCommas(grc.size() * sizeof(SeqLib::GenomicRegion)) << std::endl;
+  std::cerr << " column bytes:     " << SeqLib::AddCommas(col.bytes()) << std::endl;
+  col.Compact();
+  std::cerr << " compacted bytes:  " << SeqLib::AddCommas(col.bytes()) << std::endl;
+}
+#endif
+
+#ifdef ASSEMBLY_TEST
+#include "SeqLib/BamWriter.h"
+#include "SeqLib/WindowAssembler.h"
+#include <cstdio>
+
+// windows per second of WindowAssembler against the number of assembly
+// threads, on reads sampled with errors from a random genome
+static void assembly_benchmark() {
+
+  const int genome = 2000000;
+  const int read_len = 100;
+  const int coverage = 30;
+  const int window = 2000;
+  const std::string bam = "tmp_assembly_test.bam";
+
+  srand(1);
+  const char* acgt = "ACGT";
+  std::string ref(genome, 'A');
+  for (int i = 0; i < genome; ++i)
+    ref[i] = acgt[rand() % 4];
+
+  SeqLib::HeaderSequenceVector hsv;
+  hsv.push_back(SeqLib::HeaderSequence("chr1", genome));
+  SeqLib::BamWriter w;
+  w.SetHeader(SeqLib::BamHeader(hsv));
+  w.Open(bam);
+  w.WriteHeader();
+
+  // evenly spaced reads, so they come out sorted, with 1% errors
+  const size_t num_reads = (size_t)genome / read_len * coverage;
+  const SeqLib::Cigar cig = SeqLib::cigarFromString("100M");
+  for (size_t i = 0; i < num_reads; ++i) {
+    int p = (int)(i * (uint64_t)(genome - read_len) / num_reads);
+    std::string seq = ref.substr(p, read_len);
+    for (int k = 0; k < read_len; ++k)
+      if (rand() % 100 == 0)
+	seq[k] = acgt[rand() % 4];
+    SeqLib::GenomicRegion gr(0, p, p + read_len - 1);
+    w.WriteRecord(SeqLib::BamRecord("r" + SeqLib::tostring(i), seq, &gr, cig));
+  }
+  w.Close();
+  w.BuildIndex();
+
+  SeqLib::GRC windows(window, 0, hsv);
+  std::cerr << " **** " << SeqLib::AddCommas(windows.size()) << " WINDOWS, "
+	    << SeqLib::AddCommas(num_reads) << " READS **** " << std::endl;
+
+  double base = 0;
+  for (int t = 1; t <= 16; t *= 2) {
+    SeqLib::WindowAssembler wa;
+    wa.Open(bam);
+    wa.SetWindows(windows);
+    wa.SetNumThreads(t);
+    SeqLib::WindowContigs wc;
+    while (wa.GetNextWindow(wc))
+      ;
+    double rate = wa.Stats().windows / wa.Stats().wall_time;
+    if (t == 1)
+      base = rate;
+    std::cerr << " " << t << " threads: " << rate << " windows/s (" << (base > 0 ? rate / base : 0) << "x)" << std::endl;
+  }
+  std::remove(bam.c_str());
+  std::remove((bam + ".bai").c_str());
+}
+#endif
+
+#ifdef SW_TEST
+#include "SeqLib/ssw_cpp.h"
+#include "SeqLib/ssw.h"
+#include "SeqLib/SeqLibThreads.h"
+#include "SeqLib/BamRecord.h"
+
+#include <algorithm>
+
+// GCUPS of Aligner::AlignBatch for each SIMD kernel and against the
+// number of threads, for short reads aligned to every candidate
+// haplotype of a small region
+static void sw_benchmark() {
+
+  const int num_haplotypes = 64;
+  const int hap_len = 500;
+  const int num_reads = 4000;
+  const int read_len = 150;
+
+  srand(1);
+  const char* acgt = "ACGT";
+  std::string base(hap_len, 'A');
+  for (int i = 0; i < hap_len; ++i)
+    base[i] = acgt[rand() % 4];
+
+  // haplotypes differ by a few SNVs and small indels
+  std::vector<std::string> haps;
+  for (int h = 0; h < num_haplotypes; ++h) {
+    std::string hap = base;
+    for (int v = 0; v < 5; ++v) {
+      int p = rand() % (hap_len - 10);
+      switch (rand() % 3) {
+      case 0: hap[p] = acgt[rand() % 4]; break;
+      case 1: hap.erase(p, 1 + rand() % 5); break;
+      default: hap.insert(p, std::string(1 + rand() % 5, acgt[rand() % 4]));
+      }
+    }
+    haps.push_back(hap);
+  }
+
+  // reads from the haplotypes with 1% errors
+  std::vector<std::string> reads;
+  std::vector<int> read_pos;
+  for (int i = 0; i < num_reads; ++i) {
+    const std::string& hap = haps[rand() % num_haplotypes];
+    read_pos.push_back(rand() % (hap.length() - read_len));
+    std::string r = hap.substr(read_pos.back(), read_len);
+    for (int k = 0; k < read_len; ++k)
+      if (rand() % 100 == 0)
+	r[k] = acgt[rand() % 4];
+    reads.push_back(r);
+  }
+
+  std::vector<StripedSmithWaterman::AlignPair> pairs;
+  double cells = 0;
+  for (int i = 0; i < num_reads; ++i)
+    for (int h = 0; h < num_haplotypes; ++h) {
+      pairs.push_back(StripedSmithWaterman::AlignPair(i, h));
+      cells += (double)reads[i].length() * haps[h].length();
+    }
+
+  std::cerr << " **** " << SeqLib::AddCommas(pairs.size()) << " ALIGNMENTS OF " << read_len
+	    << "bp READS TO " << hap_len << "bp HAPLOTYPES **** " << std::endl;
+
+  StripedSmithWaterman::Aligner aligner;
+  std::vector<StripedSmithWaterman::Alignment> results;
+
+  const char* simd_names[] = { "SSE2", "AVX2" };
+  for (int level = SSW_SIMD_SSE2; level <= SSW_SIMD_AVX2; ++level) {
+    if (ssw_set_simd(level) != level)
+      continue;
+    double start = SeqLib::WallTime();
+    aligner.AlignBatch(reads, haps, pairs, 1, &results);
+    std::cerr << " " << simd_names[level] << ": " << cells / (SeqLib::WallTime() - start) / 1e9 << " GCUPS" << std::endl;
+  }
+  ssw_set_simd(SSW_SIMD_AUTO);
+
+  double base_rate = 0;
+  for (int t = 1; t <= 8; t *= 2) {
+    double start = SeqLib::WallTime();
+    aligner.AlignBatch(reads, haps, pairs, t, &results);
+    double gcups = cells / (SeqLib::WallTime() - start) / 1e9;
+    if (t == 1)
+      base_rate = gcups;
+    std::cerr << " " << t << " threads: " << gcups << " GCUPS (" << (base_rate > 0 ? gcups / base_rate : 0) << "x)" << std::endl;
+  }
+
+  // re-alignment around the known read position: banded glocal against
+  // full local, on the first few hundred reads
+  const int num_banded = 500;
+  const int band = 32; // the haplotypes shift the read by up to 25bp
+  StripedSmithWaterman::Filter filter;
+  StripedSmithWaterman::Alignment al;
+  double start = SeqLib::WallTime();
+  for (int i = 0; i < num_banded; ++i)
+    for (int h = 0; h < num_haplotypes; ++h)
+      aligner.Align(reads[i].c_str(), haps[h].c_str(), haps[h].length(), filter, &al);
+  double full_rate = num_banded * num_haplotypes / (SeqLib::WallTime() - start);
+
+  size_t same = 0;
+  start = SeqLib::WallTime();
+  for (int i = 0; i < num_banded; ++i)
+    for (int h = 0; h < num_haplotypes; ++h)
+      aligner.AlignBanded(reads[i].c_str(), reads[i].length(), haps[h].c_str(), haps[h].length(),
+                          StripedSmithWaterman::kGlocal, band, read_pos[i], &al);
+  double banded_rate = num_banded * num_haplotypes / (SeqLib::WallTime() - start);
+
+  for (int i = 0; i < num_banded; ++i)
+    for (int h = 0; h < num_haplotypes; ++h) {
+      StripedSmithWaterman::Alignment local;
+      aligner.Align(reads[i].c_str(), haps[h].c_str(), haps[h].length(), filter, &local);
+      aligner.AlignBanded(reads[i].c_str(), reads[i].length(), haps[h].c_str(), haps[h].length(),
+                          StripedSmithWaterman::kGlocal, band, read_pos[i], &al);
+      same += al.sw_score == local.sw_score;
+    }
+
+  std::cerr << " full local: " << SeqLib::AddCommas((uint64_t)full_rate) << " alignments/s" << std::endl
+            << " banded glocal (band " << band << "): " << SeqLib::AddCommas((uint64_t)banded_rate)
+            << " alignments/s (" << banded_rate / full_rate << "x), same score as local for "
+            << same << " of " << num_banded * num_haplotypes << std::endl;
+
+  // realign records to a window of the first haplotype around the read:
+  // through an Alignment and a cigar string, against straight into the
+  // (recycled) record
+  const int pad = 10;
+  SeqLib::BamRecordVector recs;
+  std::vector<int> win_start;
+  for (size_t i = 0; i < reads.size(); ++i) {
+    SeqLib::GenomicRegion gr(0, 0, reads[i].length() - 1);
+    recs.push_back(SeqLib::BamRecord("read", reads[i], &gr,
+                                     SeqLib::cigarFromString(SeqLib::tostring(reads[i].length()) + "M")));
+    win_start.push_back(std::max(0, std::min(read_pos[i] - pad, hap_len - read_len - 2 * pad)));
+  }
+  const int win_len = read_len + 2 * pad;
+
+  start = SeqLib::WallTime();
+  for (size_t i = 0; i < recs.size(); ++i) {
+    aligner.Align(reads[i].c_str(), haps[0].c_str() + win_start[i], win_len, filter, &al);
+    recs[i].SetCigar(SeqLib::cigarFromString(al.cigar_string));
+    recs[i].SetPosition(win_start[i] + al.ref_begin);
+    recs[i].RemoveTag("NM");
+    recs[i].AddIntTag("NM", al.mismatches);
+    recs[i].RemoveTag("AS");
+    recs[i].AddIntTag("AS", al.sw_score);
+  }
+  double string_rate = recs.size() / (SeqLib::WallTime() - start);
+
+  start = SeqLib::WallTime();
+  for (size_t i = 0; i < recs.size(); ++i)
+    aligner.Align(&recs[i], haps[0].c_str() + win_start[i], win_len, win_start[i], filter);
+  double record_rate = recs.size() / (SeqLib::WallTime() - start);
+
+  std::cerr << " to records via strings: " << SeqLib::AddCommas((uint64_t)string_rate) << " reads/s" << std::endl
+            << " to records directly: " << SeqLib::AddCommas((uint64_t)record_rate)
+            << " reads/s (" << record_rate / string_rate << "x)" << std::endl;
+}
+#endif
+
 #ifdef RUN_BAMTOOLS
 #include "api/BamReader.h"
 #endif
@@ -49,6 +518,31 @@ int main()
   boost::timer::auto_cpu_timer t;
 #endif
 
+#ifdef INTERVAL_TEST
+  interval_benchmark();
+  return 0;
+#endif
+
+#ifdef LOAD_TEST
+  load_benchmark();
+  return 0;
+#endif
+
+#ifdef COLUMNS_TEST
+  columns_benchmark();
+  return 0;
+#endif
+
+#ifdef ASSEMBLY_TEST
+  assembly_benchmark();
+  return 0;
+#endif
+
+#ifdef SW_TEST
+  sw_benchmark();
+  return 0;
+#endif
+
 #ifdef RUN_BAMTOOLS
   std::cerr << " **** RUNNING BAMTOOLS **** " << std::endl;
   BamTools::BamReader btr;
@@ -12,6 +12,19 @@
 #include "SeqLib/FermiAssembler.h"
 #include "SeqLib/SeqPlot.h"
 #include "SeqLib/RefGenome.h"
+#include "SeqLib/FilterPipeline.h"
+#include "SeqLib/GenomicRegionMerger.h"
+#include "SeqLib/GenomicRegionColumns.h"
+#include "SeqLib/RadixSort.h"
+#include "SeqLib/GenomicMask.h"
+#include "SeqLib/OverlapCounter.h"
+#include "SeqLib/TileGenerator.h"
+#include "SeqLib/SeqLibThreads.h"
+#include "SeqLib/ReadArena.h"
+#include "SeqLib/WindowAssembler.h"
+#include "SeqLib/BFCStream.h"
+#include "SeqLib/ssw_cpp.h"
+#include "SeqLib/ssw.h"
 
 #define GZBED "test_data/test.bed.gz"
 #define GZVCF "test_data/test.vcf.gz"
@@ -29,6 +42,10 @@ using namespace SeqLib::Filter;
 using namespace SeqLib;
 
 #include <fstream>
+#include <sstream>
+#include <set>
+#include <zlib.h>
+#include "htslib/bgzf.h"
 #include "SeqLib/BFC.h"
 
 BOOST_AUTO_TEST_CASE( read_gzbed ) {
@@ -204,6 +221,616 @@ BOOST_AUTO_TEST_CASE( merge ) {
   BOOST_CHECK_EQUAL(grc[2].pos1, 10);
 }
 
+BOOST_AUTO_TEST_CASE ( streaming_merge ) {
+
+  // random intervals, some touching, some nested
+  SeqLib::GRC grc;
+  srand(42);
+  for (int i = 0; i < 20000; ++i) {
+    int p = rand() % 500000;
+    grc.add(SeqLib::GenomicRegion(rand() % 3, p, p + rand() % 100));
+  }
+  SeqLib::GRC merged; // copies of a GRC share their regions
+  for (size_t i = 0; i < grc.size(); ++i)
+    merged.add(grc[i]);
+  merged.MergeOverlappingIntervals();
+  for (size_t i = 1; i < merged.size(); ++i)
+    BOOST_CHECK(merged[i-1].chr != merged[i].chr || merged[i-1].pos2 < merged[i].pos1);
+
+  // unsorted input, spilled as several runs
+  SeqLib::GenomicRegionMerger m;
+  m.SetMaxBuffer(3000);
+  for (size_t i = 0; i < grc.size(); ++i)
+    m.Add(grc[i]);
+  BOOST_CHECK(m.NumRuns() > 1);
+  SeqLib::GenomicRegion gr;
+  BOOST_CHECK(!m.GetNextRegion(gr)); // nothing until finished
+  m.Finish();
+  BOOST_CHECK_THROW(m.Add(grc[0]), std::logic_error);
+  size_t n = 0;
+  while (m.GetNextRegion(gr)) {
+    BOOST_REQUIRE(n < merged.size());
+    BOOST_CHECK(gr == merged[n]);
+    ++n;
+  }
+  BOOST_CHECK_EQUAL(n, merged.size());
+
+  // sorted input hands back intervals as soon as they close
+  grc.CoordinateSort();
+  SeqLib::GenomicRegionMerger s;
+  s.SetSortedInput(true);
+  n = 0;
+  for (size_t i = 0; i < grc.size(); ++i) {
+    s.Add(grc[i]);
+    while (s.GetNextRegion(gr))
+      BOOST_CHECK(gr == merged[n++]);
+  }
+  BOOST_CHECK(n < merged.size());
+  s.Finish();
+  while (s.GetNextRegion(gr))
+    BOOST_CHECK(gr == merged[n++]);
+  BOOST_CHECK_EQUAL(n, merged.size());
+  BOOST_CHECK_EQUAL(s.NumRuns(), 0);
+
+  SeqLib::GenomicRegionMerger bad;
+  bad.SetSortedInput(true);
+  bad.Add(SeqLib::GenomicRegion(1, 100, 200));
+  BOOST_CHECK_THROW(bad.Add(SeqLib::GenomicRegion(0, 100, 200)), std::invalid_argument);
+  BOOST_CHECK_THROW(bad.SetSortedInput(false), std::logic_error);
+  BOOST_CHECK_THROW(bad.Add(SeqLib::GenomicRegion(1, 99, 300)), std::invalid_argument);
+
+  // sorted BAM order: equal starts with any ends, then the unmapped reads
+  SeqLib::GenomicRegionMerger bam;
+  bam.SetSortedInput(true);
+  bam.Add(SeqLib::GenomicRegion(0, 100, 300));
+  bam.Add(SeqLib::GenomicRegion(0, 100, 150));
+  bam.Add(SeqLib::GenomicRegion(0, 400, 500));
+  bam.Add(SeqLib::GenomicRegion(0, 400, 450));
+  bam.Add(SeqLib::GenomicRegion(-1, -1, -1));
+  bam.Add(SeqLib::GenomicRegion(-1, -1, -1));
+  bam.Finish();
+  BOOST_CHECK(bam.GetNextRegion(gr) && gr == SeqLib::GenomicRegion(0, 100, 300));
+  BOOST_CHECK(bam.GetNextRegion(gr) && gr == SeqLib::GenomicRegion(0, 400, 500));
+  BOOST_CHECK(!bam.GetNextRegion(gr));
+
+}
+
+BOOST_AUTO_TEST_CASE ( genomic_region_columns ) {
+
+  // radix sort is stable and orders signed keys
+  std::vector<uint64_t> keys;
+  std::vector<uint32_t> order;
+  int32_t vals[6] = { 5, -1, 300000, 5, 0, -70000 };
+  for (int i = 0; i < 6; ++i) {
+    keys.push_back(SeqLib::SignedKey(vals[i]));
+    order.push_back(i);
+  }
+  SeqLib::RadixSort(keys, order);
+  uint32_t expected[6] = { 5, 1, 4, 0, 3, 2 };
+  for (int i = 0; i < 6; ++i)
+    BOOST_CHECK_EQUAL(order[i], expected[i]);
+
+  SeqLib::GRC grc;
+  srand(7);
+  for (int i = 0; i < 30000; ++i) {
+    int p = rand() % 1000000;
+    grc.add(SeqLib::GenomicRegion(rand() % 25, p, p + rand() % 300, i % 2 ? '+' : '-'));
+  }
+
+  SeqLib::GenomicRegionColumns col(grc);
+  BOOST_CHECK_EQUAL(col.size(), grc.size());
+  BOOST_CHECK(!col.IsSorted());
+  BOOST_CHECK_EQUAL(col.TotalWidth(), grc.TotalWidth());
+
+  grc.CoordinateSort();
+  col.CoordinateSort();
+  BOOST_CHECK(col.IsSorted());
+  for (size_t i = 0; i < grc.size(); ++i)
+    BOOST_CHECK(col[i] == grc[i] && col[i].strand == grc[i].strand);
+
+  // packed columns give back the same regions in under half the room
+  col.Compact();
+  BOOST_CHECK(col.IsCompact());
+  BOOST_CHECK(col.bytes() < grc.size() * sizeof(SeqLib::GenomicRegion) / 2);
+  BOOST_CHECK_EQUAL(col.TotalWidth(), grc.TotalWidth());
+  for (size_t i = 0; i < grc.size(); i += 97)
+    BOOST_CHECK(col[i] == grc[i] && col[i].strand == grc[i].strand);
+  BOOST_CHECK_THROW(col[grc.size()], std::out_of_range);
+
+  col.Pad(10);
+  grc.Pad(10);
+  BOOST_CHECK(!col.IsCompact());
+  BOOST_CHECK_EQUAL(col.TotalWidth(), grc.TotalWidth());
+  BOOST_CHECK_THROW(col.Pad(-1000), std::out_of_range);
+  BOOST_CHECK_EQUAL(col.TotalWidth(), grc.TotalWidth());
+
+  grc.MergeOverlappingIntervals();
+  col.MergeOverlappingIntervals();
+  SeqLib::GRC back = col.AsGRC();
+  BOOST_CHECK_EQUAL(back.size(), grc.size());
+  for (size_t i = 0; i < grc.size(); ++i)
+    BOOST_CHECK(back[i] == grc[i]);
+
+}
+
+// a region type ordered by descending start
+struct ReverseRegion : public SeqLib::GenomicRegion {
+  ReverseRegion() {}
+  ReverseRegion(int32_t c, int32_t p1, int32_t p2) : SeqLib::GenomicRegion(c, p1, p2) {}
+  bool operator<(const ReverseRegion& b) const { return pos1 > b.pos1; }
+};
+
+BOOST_AUTO_TEST_CASE ( radix_sort ) {
+
+  srand(11);
+  std::vector<uint64_t> keys(300000);
+  std::vector<uint32_t> order(keys.size());
+  for (size_t i = 0; i < keys.size(); ++i) {
+    keys[i] = SeqLib::CoordinateKey(rand() % 30 - 1, rand() % 1000);
+    order[i] = i;
+  }
+  std::vector<uint64_t> keys2 = keys;
+  std::vector<uint32_t> order2 = order;
+  SeqLib::RadixSort(keys, order);
+  SeqLib::RadixSort(keys2, order2, 4);
+  BOOST_CHECK(keys == keys2);
+  BOOST_CHECK(order == order2);
+  for (size_t i = 1; i < keys.size(); ++i) {
+    BOOST_CHECK(keys[i-1] <= keys[i]);
+    if (keys[i-1] == keys[i])
+      BOOST_CHECK(order[i-1] < order[i]); // stable
+  }
+  BOOST_CHECK_THROW(SeqLib::RadixSort(keys, order, 0), std::invalid_argument);
+
+  // large enough to take the radix path
+  SeqLib::GRC grc;
+  for (int i = 0; i < 50000; ++i) {
+    int p = rand() % 2000;
+    grc.add(SeqLib::GenomicRegion(rand() % 5, p, p + rand() % 20));
+  }
+  std::vector<SeqLib::GenomicRegion> expected(grc.begin(), grc.end());
+  std::sort(expected.begin(), expected.end());
+  grc.CoordinateSort(3);
+  BOOST_CHECK(grc.IsSorted());
+  for (size_t i = 0; i < expected.size(); ++i)
+    BOOST_CHECK(grc[i] == expected[i]);
+
+  // a type with its own operator< keeps its order at any size
+  SeqLib::GenomicRegionCollection<ReverseRegion> rev;
+  for (int i = 0; i < 5000; ++i) {
+    int p = rand() % 2000;
+    rev.add(ReverseRegion(rand() % 5, p, p + 10));
+  }
+  rev.CoordinateSort(2);
+  for (size_t i = 1; i < rev.size(); ++i)
+    BOOST_CHECK(rev[i-1].pos1 >= rev[i].pos1);
+
+  // reads, including unmapped ones
+  SeqLib::BamRecordVector reads;
+  for (int i = 0; i < 1000; ++i) {
+    int p = rand() % 500;
+    SeqLib::GenomicRegion gr(rand() % 3, p, p + 9);
+    SeqLib::BamRecord r("read" + SeqLib::tostring(i), "ACGTACGTAC", &gr, SeqLib::cigarFromString("10M"));
+    if (i % 50 == 0)
+      r.SetChrID(-1);
+    r.SetChrIDMate(rand() % 3);
+    r.SetPositionMate(rand() % 500);
+    reads.push_back(r);
+  }
+  SeqLib::BamRecordVector by_pos = reads;
+  SeqLib::BamRecordSort::SortByPosition(by_pos, 2);
+  BOOST_CHECK_EQUAL(by_pos.size(), reads.size());
+  SeqLib::BamRecordSort::ByReadPosition less;
+  for (size_t i = 1; i < by_pos.size(); ++i)
+    BOOST_CHECK(!less(by_pos[i], by_pos[i-1]));
+  BOOST_CHECK_EQUAL(by_pos[0].ChrID(), -1);
+
+  SeqLib::BamRecordSort::SortByMatePosition(reads);
+  SeqLib::BamRecordSort::ByMatePosition mless;
+  for (size_t i = 1; i < reads.size(); ++i)
+    BOOST_CHECK(!mless(reads[i], reads[i-1]));
+
+}
+
+BOOST_AUTO_TEST_CASE ( genomic_mask ) {
+
+  srand(13);
+  SeqLib::GRC grc;
+  for (int i = 0; i < 2000; ++i) {
+    int p = rand() % 200000;
+    grc.add(SeqLib::GenomicRegion(rand() % 4, p, p + rand() % 500));
+  }
+  grc.add(SeqLib::GenomicRegion(6, 0, 0));
+  grc.CreateTreeMap();
+
+  SeqLib::GenomicMask runs(grc);
+  SeqLib::GenomicMask dense(grc, true);
+
+  SeqLib::GRC merged;
+  for (size_t i = 0; i < grc.size(); ++i)
+    merged.add(grc[i]);
+  merged.MergeOverlappingIntervals();
+  BOOST_CHECK_EQUAL(runs.CoveredBases(), merged.TotalWidth());
+  BOOST_CHECK_EQUAL(dense.CoveredBases(), merged.TotalWidth());
+  BOOST_CHECK(runs.NumRuns() <= merged.size());
+  BOOST_CHECK(runs.bytes() < dense.bytes());
+
+  // same answers as the interval tree, including chromosomes with no regions
+  for (int i = 0; i < 20000; ++i) {
+    int chr = rand() % 8 - 1;
+    int p = rand() % 210000 - 100;
+    int w = rand() % 200;
+    bool hit = grc.CountOverlaps(SeqLib::GenomicRegion(chr, p, p)) > 0;
+    BOOST_CHECK_EQUAL(runs.Contains(chr, p), hit);
+    BOOST_CHECK_EQUAL(dense.Contains(chr, p), hit);
+    hit = grc.CountOverlaps(SeqLib::GenomicRegion(chr, p, p + w)) > 0;
+    BOOST_CHECK_EQUAL(runs.Overlaps(chr, p, p + w), hit);
+    BOOST_CHECK_EQUAL(dense.Overlaps(SeqLib::GenomicRegion(chr, p, p + w)), hit);
+  }
+  BOOST_CHECK(runs.Contains(6, 0));
+  BOOST_CHECK(!runs.Contains(6, 1));
+  BOOST_CHECK(!runs.Overlaps(0, 10, 5));
+
+  SeqLib::GenomicMask empty;
+  BOOST_CHECK(empty.IsEmpty());
+  BOOST_CHECK(!empty.Contains(0, 0));
+
+  // region gating in a filter collection is unchanged by the mask
+  SeqLib::Filter::ReadFilter rf;
+  rf.setRegions(grc);
+  SeqLib::Filter::ReadFilterCollection tree, mask;
+  tree.AddReadFilter(rf);
+  mask.SetRegionMask(true);
+  mask.AddReadFilter(rf);
+  for (int i = 0; i < 2000; ++i) {
+    int p = rand() % 200000;
+    SeqLib::GenomicRegion gr(rand() % 5, p, p + 9);
+    SeqLib::BamRecord r("read", "ACGTACGTAC", &gr, SeqLib::cigarFromString("10M"));
+    BOOST_CHECK_EQUAL(tree.isValid(r), mask.isValid(r));
+  }
+
+}
+
+BOOST_AUTO_TEST_CASE ( grc_save_load ) {
+
+  srand(17);
+  SeqLib::GRC grc;
+  for (int i = 0; i < 5000; ++i) {
+    int p = rand() % 100000;
+    grc.add(SeqLib::GenomicRegion(rand() % 5, p, p + rand() % 400, i % 3 ? '+' : '-'));
+  }
+  BOOST_CHECK(grc.Save("tmp_grc.bin"));
+
+  SeqLib::GRC loaded;
+  loaded.add(SeqLib::GenomicRegion(9, 1, 2));
+  BOOST_CHECK(loaded.Load("tmp_grc.bin"));
+  BOOST_CHECK(loaded.IsSorted());
+
+  // same regions, in the order CreateTreeMap leaves them
+  grc.CreateTreeMap();
+  BOOST_CHECK_EQUAL(loaded.size(), grc.size());
+  for (size_t i = 0; i < grc.size(); ++i)
+    BOOST_CHECK(loaded[i] == grc[i] && loaded[i].strand == grc[i].strand);
+
+  // the saved index answers queries without CreateTreeMap
+  for (int i = 0; i < 2000; ++i) {
+    int p = rand() % 101000;
+    SeqLib::GenomicRegion q(rand() % 6, p, p + rand() % 300);
+    BOOST_CHECK_EQUAL(loaded.CountOverlaps(q), grc.CountOverlaps(q));
+    BOOST_CHECK(loaded.FindOverlappedIntervals(q, true) == grc.FindOverlappedIntervals(q, true));
+  }
+
+  // and a change to the collection rebuilds it
+  loaded.add(SeqLib::GenomicRegion(0, 200000, 200010));
+  loaded.CreateTreeMap();
+  BOOST_CHECK_EQUAL(loaded.CountOverlaps(SeqLib::GenomicRegion(0, 200005, 200005)), 1);
+
+  // empty collections round trip too
+  SeqLib::GRC empty, empty_loaded;
+  BOOST_CHECK(empty.Save("tmp_grc.bin"));
+  BOOST_CHECK(empty_loaded.Load("tmp_grc.bin"));
+  BOOST_CHECK(empty_loaded.IsEmpty());
+
+  // bad files leave the collection as it was
+  std::ofstream bad("tmp_grc.bin");
+  bad << "not a region file";
+  bad.close();
+  BOOST_CHECK(!loaded.Load("tmp_grc.bin"));
+  BOOST_CHECK(!loaded.Load("tmp_grc_missing.bin"));
+  BOOST_CHECK_EQUAL(loaded.size(), grc.size() + 1);
+
+  // as do files with a corrupt index: a node pointing past the regions
+  SeqLib::GRC three;
+  for (int i = 0; i < 3; ++i)
+    three.add(SeqLib::GenomicRegion(0, i * 10, i * 10 + 5));
+  BOOST_CHECK(three.Save("tmp_grc.bin"));
+  std::fstream node_value("tmp_grc.bin", std::ios::in | std::ios::out | std::ios::binary);
+  node_value.seekp(-4, std::ios::end); // value of the last node
+  int32_t past = 3;
+  node_value.write(reinterpret_cast<const char*>(&past), 4);
+  node_value.close();
+  BOOST_CHECK(!loaded.Load("tmp_grc.bin"));
+
+  // or the wrong tree height
+  BOOST_CHECK(three.Save("tmp_grc.bin"));
+  std::fstream height("tmp_grc.bin", std::ios::in | std::ios::out | std::ios::binary);
+  height.seekp(40 + 3 * 16 + 4); // header, regions, then the chromosome's height
+  int32_t tall = 5;
+  height.write(reinterpret_cast<const char*>(&tall), 4);
+  height.close();
+  BOOST_CHECK(!loaded.Load("tmp_grc.bin"));
+  BOOST_CHECK_EQUAL(loaded.size(), grc.size() + 1);
+  BOOST_CHECK(three.Save("tmp_grc.bin"));
+  BOOST_CHECK(loaded.Load("tmp_grc.bin"));
+  BOOST_CHECK_EQUAL(loaded.size(), 3);
+
+}
+
+BOOST_AUTO_TEST_CASE ( batch_overlap_counts ) {
+
+  srand(19);
+  SeqLib::GRC targets, reads;
+  for (int i = 0; i < 3000; ++i) {
+    int p = rand() % 100000;
+    targets.add(SeqLib::GenomicRegion(rand() % 6, p, p + rand() % 300));
+  }
+  for (int i = 0; i < 20000; ++i) {
+    int p = rand() % 100000;
+    reads.add(SeqLib::GenomicRegion(rand() % 7 - 1, p, p + 100));
+  }
+
+  // same as one CountOverlaps per target, threaded or not
+  std::vector<uint32_t> counts = targets.CountOverlapsBatch(reads);
+  std::vector<uint32_t> counts3 = targets.CountOverlapsBatch(reads, 3);
+  BOOST_CHECK(counts == counts3);
+  BOOST_CHECK_EQUAL(counts.size(), targets.size());
+  SeqLib::GRC tree;
+  for (size_t i = 0; i < reads.size(); ++i)
+    if (reads[i].chr >= 0)
+      tree.add(reads[i]);
+  tree.CreateTreeMap();
+  for (size_t i = 0; i < targets.size(); ++i)
+    BOOST_CHECK_EQUAL(counts[i], tree.CountOverlaps(targets[i]));
+  BOOST_CHECK_THROW(targets.CountOverlapsBatch(reads, 0), std::invalid_argument);
+
+  // streaming the sorted reads gives the same counts
+  reads.CoordinateSort();
+  SeqLib::OverlapCounter counter(targets);
+  for (size_t i = 0; i < reads.size(); ++i)
+    counter.Add(reads[i]);
+  BOOST_CHECK(counter.Counts() == counts);
+  BOOST_CHECK_EQUAL(counter.NumAdded(), tree.size());
+
+  // out of order input
+  counter.Reset();
+  counter.Add(SeqLib::GenomicRegion(1, 100, 200));
+  BOOST_CHECK_THROW(counter.Add(SeqLib::GenomicRegion(1, 50, 200)), std::invalid_argument);
+  counter.Add(SeqLib::GenomicRegion(2, 10, 20));
+  BOOST_CHECK_THROW(counter.Add(SeqLib::GenomicRegion(1, 500, 600)), std::invalid_argument);
+
+  // an out of order add to a copy unsorts the shared regions
+  SeqLib::GRC few, few_reads;
+  few.add(SeqLib::GenomicRegion(0, 100, 200));
+  few.add(SeqLib::GenomicRegion(0, 300, 400));
+  few.CoordinateSort();
+  SeqLib::GRC few_copy = few;
+  few_copy.add(SeqLib::GenomicRegion(0, 10, 20));
+  few_reads.add(SeqLib::GenomicRegion(0, 15, 150));
+  few_reads.add(SeqLib::GenomicRegion(0, 350, 360));
+  std::vector<uint32_t> few_counts = few.CountOverlapsBatch(few_reads);
+  BOOST_REQUIRE_EQUAL(few_counts.size(), 3);
+  BOOST_CHECK_EQUAL(few_counts[0], 1);
+  BOOST_CHECK_EQUAL(few_counts[1], 1);
+  BOOST_CHECK_EQUAL(few_counts[2], 1);
+  SeqLib::OverlapCounter few_counter(few);
+  for (size_t i = 0; i < few_reads.size(); ++i)
+    few_counter.Add(few_reads[i]);
+  BOOST_CHECK(few_counter.Counts() == few_counts);
+
+}
+
+// numbers the jobs and squares them, taking longer on some
+struct SquareStages {
+  int n, made;
+  std::vector<int> done; // jobs worked on by each thread
+  std::pair<int, int>* Read() { return made < n ? new std::pair<int, int>(made++, 0) : NULL; }
+  void Work(std::pair<int, int>* job, int thread) {
+    volatile int spin = 0;
+    for (int i = 0; i < (job->first % 7) * 1000; ++i)
+      spin += i;
+    job->second = job->first * job->first;
+    ++done[thread];
+  }
+};
+
+BOOST_AUTO_TEST_CASE ( ordered_pipeline ) {
+
+  SquareStages st;
+  st.n = 5000;
+  st.made = 0;
+  st.done.assign(4, 0);
+  SeqLib::OrderedPipeline<std::pair<int, int>, SquareStages> pipe(st, 4, 3);
+  pipe.Start();
+  std::pair<int, int>* job;
+  int k = 0;
+  while (pipe.Next(job)) {
+    BOOST_CHECK_EQUAL(job->first, k);
+    BOOST_CHECK_EQUAL(job->second, k * k);
+    ++k;
+  }
+  BOOST_CHECK_EQUAL(k, st.n);
+  BOOST_CHECK(!pipe.Next(job));
+  BOOST_CHECK(pipe.PeakInFlight() <= 2 * 3 + 4);
+  int worked = 0;
+  for (size_t i = 0; i < st.done.size(); ++i)
+    worked += st.done[i];
+  BOOST_CHECK_EQUAL(worked, st.n);
+
+  // stopping part way through frees the jobs left and stops reading
+  SquareStages big;
+  big.n = 10000000;
+  big.made = 0;
+  big.done.assign(2, 0);
+  SeqLib::OrderedPipeline<std::pair<int, int>, SquareStages> early(big, 2, 2);
+  early.Start();
+  for (k = 0; k < 10 && early.Next(job); ++k)
+    BOOST_CHECK_EQUAL(job->first, k);
+  early.Stop();
+  BOOST_CHECK(big.made < big.n);
+  BOOST_CHECK(!early.Next(job));
+
+  BOOST_CHECK_EQUAL(SeqLib::PerSecond(10, 2), 5);
+  BOOST_CHECK_EQUAL(SeqLib::PerSecond(10, 0), 0);
+}
+
+// takes tiles from a shared generator until there are none left
+struct TileWorker {
+  SeqLib::TileGenerator* tiles;
+  std::vector<std::pair<size_t, SeqLib::GenomicRegion> > got;
+  void operator()() {
+    SeqLib::GenomicRegion gr;
+    size_t num;
+    while (tiles->GetNextTile(gr, num))
+      got.push_back(std::make_pair(num, gr));
+  }
+};
+
+BOOST_AUTO_TEST_CASE ( tile_generator ) {
+
+  SeqLib::HeaderSequenceVector hsv;
+  hsv.push_back(SeqLib::HeaderSequence("1", 100000));
+  hsv.push_back(SeqLib::HeaderSequence("2", 500));
+  hsv.push_back(SeqLib::HeaderSequence("3", 25050));
+
+  // the same tiles as the GRC constructor, plus the ends it leaves off
+  SeqLib::TileGenerator tiles(1000, 100, hsv);
+  std::vector<SeqLib::GenomicRegion> serial;
+  SeqLib::GenomicRegion gr;
+  while (tiles.GetNextTile(gr))
+    serial.push_back(gr);
+  SeqLib::GRC grc(1000, 100, hsv);
+  size_t j = 0;
+  for (size_t i = 0; i < grc.size(); ++i) {
+    while (j < serial.size() && !(serial[j] == grc[i]))
+      ++j;
+    BOOST_CHECK(j < serial.size());
+  }
+  for (size_t i = 0; i < serial.size(); ++i)
+    BOOST_CHECK(serial[i].pos2 <= (int)hsv[serial[i].chr].Length);
+  BOOST_CHECK_EQUAL(serial.back().chr, 2);
+  BOOST_CHECK_EQUAL(serial.back().pos2, 25050);
+  BOOST_CHECK_EQUAL(tiles.NumServed(), serial.size());
+  BOOST_CHECK_THROW(SeqLib::TileGenerator(100, 100, hsv), std::invalid_argument);
+
+  // workers on several threads share out every tile once
+  tiles.Reset();
+  std::vector<TileWorker> workers(4);
+  for (size_t i = 0; i < workers.size(); ++i)
+    workers[i].tiles = &tiles;
+  SeqLib::RunThreads(workers);
+  std::vector<SeqLib::GenomicRegion> shared(serial.size());
+  size_t n = 0;
+  for (size_t i = 0; i < workers.size(); ++i)
+    for (size_t k = 0; k < workers[i].got.size(); ++k, ++n)
+      shared.at(workers[i].got[k].first) = workers[i].got[k].second;
+  BOOST_CHECK_EQUAL(n, serial.size());
+  for (size_t i = 0; i < serial.size(); ++i)
+    BOOST_CHECK(shared[i] == serial[i]);
+
+  // balanced tiles are narrow where the weight is high
+  std::vector<std::vector<uint64_t> > weights(3);
+  weights[0].assign(100, 1);
+  for (int i = 40; i < 50; ++i)
+    weights[0][i] = 100;
+  weights[2].assign(26, 1);
+  SeqLib::TileGenerator balanced(1000, 0, hsv);
+  balanced.BalanceByWeights(weights, 1000, 20);
+  std::vector<SeqLib::GenomicRegion> bt;
+  while (balanced.GetNextTile(gr))
+    bt.push_back(gr);
+  BOOST_CHECK_EQUAL(bt.front().pos1, 0);
+  for (size_t i = 1; i < bt.size(); ++i)
+    if (bt[i].chr == bt[i-1].chr)
+      BOOST_CHECK_EQUAL(bt[i].pos1, bt[i-1].pos2);
+  for (size_t i = 0; i < bt.size(); ++i) {
+    if (bt[i].chr == 0 && bt[i].pos1 >= 40000 && bt[i].pos2 <= 50000)
+      BOOST_CHECK(bt[i].Width() <= 1001);
+    if (bt[i].chr == 1)
+      BOOST_CHECK(bt[i].pos1 == 0 && bt[i].pos2 == 500); // no weight, one tile
+  }
+  BOOST_CHECK(bt.size() > 10 && bt.size() <= 20);
+  BOOST_CHECK_THROW(balanced.BalanceByWeights(weights, 0, 10), std::invalid_argument);
+
+  // with an overlap, each balanced tile still ends past the last, even
+  // when one window holds more than a tile's share
+  SeqLib::HeaderSequenceVector one;
+  one.push_back(SeqLib::HeaderSequence("1", 5000));
+  std::vector<std::vector<uint64_t> > heavy(1, std::vector<uint64_t>(5, 10));
+  SeqLib::TileGenerator overlapping(1000, 100, one);
+  overlapping.BalanceByWeights(heavy, 1000, 10);
+  std::vector<SeqLib::GenomicRegion> ot;
+  while (overlapping.GetNextTile(gr))
+    ot.push_back(gr);
+  BOOST_REQUIRE_EQUAL(ot.size(), 5);
+  for (size_t i = 0; i < ot.size(); ++i)
+    BOOST_CHECK_EQUAL(ot[i].pos2, (int)(i + 1) * 1000);
+  for (size_t i = 1; i < ot.size(); ++i)
+    BOOST_CHECK_EQUAL(ot[i].pos1, ot[i-1].pos2 - 100);
+
+}
+
+BOOST_AUTO_TEST_CASE ( read_arena ) {
+
+  SeqLib::ReadArena a(16);
+  char* x = a.Copy("ACGT");
+  char* y = a.Copy("TTTTTTTTTTTTTTTTTTTTTTTTTTTTTTTT"); // bigger than a block
+  char* z = a.Copy("GG", 1);
+  BOOST_CHECK_EQUAL(std::string(x), "ACGT");
+  BOOST_CHECK_EQUAL(std::string(y).length(), 32);
+  BOOST_CHECK_EQUAL(std::string(z), "G");
+  size_t cap = a.Capacity();
+  BOOST_CHECK(cap >= 16 + 33);
+
+  // clearing reuses the blocks
+  a.Clear();
+  for (int i = 0; i < 8; ++i)
+    a.Copy("ACG");
+  BOOST_CHECK_EQUAL(a.Capacity(), cap);
+  a.Release();
+  BOOST_CHECK_EQUAL(a.Capacity(), 0);
+
+  // direct decode matches the string accessors
+  SeqLib::BamReader br;
+  br.Open("test_data/small.bam");
+  SeqLib::BamRecord rec;
+  BamRecordVector brv;
+  size_t count = 0;
+  std::vector<char> buf;
+  while(br.GetNextRecord(rec) && count++ < 1000) {
+    buf.resize(rec.Length() + 1);
+    rec.SequenceTo(&buf[0]);
+    BOOST_CHECK_EQUAL(std::string(&buf[0]), rec.Sequence());
+    BOOST_CHECK_EQUAL(rec.QualitiesTo(&buf[0]), !rec.Qualities().empty());
+    BOOST_CHECK_EQUAL(std::string(&buf[0]), rec.Qualities());
+    brv.push_back(rec);
+  }
+
+  // reads stored in the arenas come back out unchanged
+  SeqLib::FermiAssembler f;
+  f.AddReads(brv);
+  SeqLib::UnalignedSequenceVector usv = f.GetSequences();
+  BOOST_CHECK_EQUAL(usv.size(), brv.size());
+  for (size_t i = 0; i < usv.size(); ++i) {
+    BOOST_CHECK_EQUAL(usv[i].Seq, brv[i].Sequence());
+    BOOST_CHECK_EQUAL(usv[i].Name, brv[i].Qname());
+  }
+  f.ClearReads();
+  BOOST_CHECK_EQUAL(f.GetSequences().size(), 0);
+  f.AddReads(usv);
+  BOOST_CHECK_EQUAL(f.GetSequences().size(), usv.size());
+
+}
+
 BOOST_AUTO_TEST_CASE ( interval_queries ) {
 
   SeqLib::GRC grc;
@@ -246,6 +873,353 @@ BOOST_AUTO_TEST_CASE ( interval_queries ) {
   
 }
 
+BOOST_AUTO_TEST_CASE ( interval_index ) {
+
+  // flat index against a brute force scan
+  std::vector<SeqLib::GenomicInterval> iv;
+  for (int i = 0; i < 1000; ++i) {
+    int32_t s = rand() % 100000 - 100;
+    iv.push_back(SeqLib::GenomicInterval(s, s + rand() % 2000, i));
+  }
+  SeqLib::GenomicIntervalTree idx(iv);
+  BOOST_CHECK_EQUAL(idx.size(), 1000);
+
+  for (int q = 0; q < 500; ++q) {
+    int32_t s = rand() % 100000 - 100;
+    int32_t e = s + rand() % 500;
+    std::set<int32_t> expected, contained;
+    for (size_t i = 0; i < iv.size(); ++i) {
+      if (iv[i].start <= e && iv[i].stop >= s)
+	expected.insert(iv[i].value);
+      if (iv[i].start >= s && iv[i].stop <= e)
+	contained.insert(iv[i].value);
+    }
+    SeqLib::GenomicIntervalVector giv = idx.findOverlapping(s, e);
+    std::set<int32_t> found;
+    for (size_t i = 0; i < giv.size(); ++i)
+      found.insert(giv[i].value);
+    BOOST_CHECK(found == expected);
+    BOOST_CHECK_EQUAL(idx.countOverlapping(s, e), expected.size());
+    BOOST_CHECK_EQUAL(idx.findContained(s, e).size(), contained.size());
+  }
+
+  // empty index
+  SeqLib::GenomicIntervalTree empty;
+  BOOST_CHECK_EQUAL(empty.countOverlapping(0, 100), 0);
+
+  // one index per chromosome from CreateTreeMap
+  SeqLib::GRC grc;
+  grc.add(SeqLib::GenomicRegion(1, 100, 200));
+  grc.add(SeqLib::GenomicRegion(0, 150, 300));
+  grc.add(SeqLib::GenomicRegion(1, 150, 160));
+  grc.CreateTreeMap();
+  BOOST_CHECK_EQUAL(grc.NumTree(), 2);
+  BOOST_CHECK_EQUAL(grc.CountOverlaps(SeqLib::GenomicRegion(1, 155, 155)), 2);
+  BOOST_CHECK_EQUAL(grc.CountOverlaps(SeqLib::GenomicRegion(0, 100, 149)), 0);
+}
+
+BOOST_AUTO_TEST_CASE ( sweep_overlaps ) {
+
+  SeqLib::GRC query, subject;
+  for (int i = 0; i < 500; ++i) {
+    int32_t p = rand() % 5000;
+    query.add(SeqLib::GenomicRegion(rand() % 3, p, p + rand() % 200));
+    p = rand() % 5000;
+    subject.add(SeqLib::GenomicRegion(rand() % 3, p, p + rand() % 200));
+  }
+  query.CoordinateSort();
+  subject.CoordinateSort();
+  BOOST_CHECK(query.IsSorted());
+
+  // adding out of order clears the sorted flag
+  SeqLib::GRC tmp;
+  tmp.add(SeqLib::GenomicRegion(1, 10, 20));
+  tmp.CoordinateSort();
+  tmp.add(SeqLib::GenomicRegion(1, 30, 40));
+  BOOST_CHECK(tmp.IsSorted());
+  tmp.add(SeqLib::GenomicRegion(0, 30, 40));
+  BOOST_CHECK(!tmp.IsSorted());
+
+  // copies share their regions, so adding to one unsorts the other too
+  SeqLib::GRC sorted_copy = query;
+  sorted_copy.add(SeqLib::GenomicRegion(0, 0, 10));
+  BOOST_CHECK(!query.IsSorted());
+  BOOST_CHECK_THROW(query.FindOverlapPairs(subject, true), std::logic_error);
+  query.CoordinateSort();
+  BOOST_CHECK(sorted_copy.IsSorted());
+
+  // sweep against brute force, reading through const references so the
+  // collections stay sorted
+  const SeqLib::GRC& cq = query;
+  const SeqLib::GRC& cs = subject;
+  std::vector<SeqLib::OverlapResult> ov = query.FindOverlapPairs(subject, true);
+  std::vector<SeqLib::OverlapResult> expected;
+  for (size_t i = 0; i < query.size(); ++i)
+    for (size_t j = 0; j < subject.size(); ++j)
+      if (cq[i].chr == cs[j].chr && cq[i].pos1 <= cs[j].pos2 && cq[i].pos2 >= cs[j].pos1)
+	expected.push_back(SeqLib::OverlapResult(i, j));
+  BOOST_CHECK(ov == expected);
+
+  // same result from the tree lookup on unsorted input
+  SeqLib::GRC unsorted;
+  for (size_t i = query.size(); i > 0; --i)
+    unsorted.add(cq[i-1]);
+  BOOST_CHECK_THROW(unsorted.FindOverlapPairs(subject, true), std::logic_error);
+  subject.CreateTreeMap();
+  BOOST_CHECK_EQUAL(unsorted.FindOverlapPairs(subject, true).size(), expected.size());
+
+  // FindOverlaps uses the sweep for sorted input
+  BOOST_CHECK(query.IsSorted() && subject.IsSorted());
+  std::vector<int32_t> qid, sid;
+  SeqLib::GRC out = query.FindOverlaps(subject, qid, sid, true);
+  BOOST_CHECK_EQUAL(out.size(), expected.size());
+  for (size_t i = 0; i < expected.size(); ++i) {
+    BOOST_CHECK_EQUAL(qid[i], expected[i].first);
+    BOOST_CHECK_EQUAL(sid[i], expected[i].second);
+  }
+}
+
+BOOST_AUTO_TEST_CASE ( shuffled_overlaps ) {
+
+  // each query overlaps one subject
+  SeqLib::GRC query, subject;
+  for (int i = 0; i < 50; ++i) {
+    query.add(SeqLib::GenomicRegion(0, i * 100, i * 100 + 50));
+    subject.add(SeqLib::GenomicRegion(0, i * 100 + 25, i * 100 + 75));
+  }
+  query.CoordinateSort();
+  subject.CreateTreeMap();
+  BOOST_CHECK(query.IsSorted() && subject.IsSorted());
+
+  // a shuffled query is looked up in the tree instead of swept
+  query.Shuffle();
+  BOOST_CHECK(!query.IsSorted());
+  BOOST_CHECK_EQUAL(query.FindOverlapPairs(subject, true).size(), 50);
+  std::vector<int32_t> qid, sid;
+  BOOST_CHECK_EQUAL(query.FindOverlaps(subject, qid, sid, true).size(), 50);
+  const SeqLib::GRC& cq = query;
+  const SeqLib::GRC& cs = subject;
+  for (size_t i = 0; i < qid.size(); ++i)
+    BOOST_CHECK_EQUAL(cq[qid[i]].pos1 + 25, cs[sid[i]].pos1);
+
+  // the tree of a shuffled subject is stale, so it is dropped
+  query.CoordinateSort();
+  subject.Shuffle();
+  BOOST_CHECK_EQUAL(subject.NumTree(), 0);
+  BOOST_CHECK_THROW(query.FindOverlapPairs(subject, true), std::logic_error);
+  subject.CoordinateSort();
+  BOOST_CHECK_EQUAL(query.FindOverlapPairs(subject, true).size(), 50);
+
+  // regions reached through the non-const accessors may be moved
+  subject[0].pos1 = 10000;
+  BOOST_CHECK(!subject.IsSorted());
+  subject.CoordinateSort();
+  subject.begin()->pos1 = 0;
+  BOOST_CHECK(!subject.IsSorted());
+}
+
+BOOST_AUTO_TEST_CASE ( parallel_overlaps ) {
+
+  SeqLib::GRC query, subject;
+  for (int i = 0; i < 2000; ++i) {
+    int32_t p = rand() % 20000;
+    query.add(SeqLib::GenomicRegion(rand() % 4, p, p + rand() % 500));
+    p = rand() % 20000;
+    subject.add(SeqLib::GenomicRegion(rand() % 4, p, p + rand() % 500));
+  }
+  query.CoordinateSort();
+  subject.CoordinateSort();
+  subject.CreateTreeMap();
+
+  // sweep, split over threads
+  std::vector<SeqLib::OverlapResult> serial = query.FindOverlapPairs(subject, true);
+  BOOST_CHECK(query.FindOverlapPairs(subject, true, 4) == serial);
+  BOOST_CHECK(query.FindOverlapPairs(subject, true, 7) == serial);
+
+  // tree lookups, split over threads
+  const SeqLib::GRC& cq = query;
+  SeqLib::GRC unsorted;
+  for (size_t i = query.size(); i > 0; --i)
+    unsorted.add(cq[i-1]);
+  BOOST_CHECK(query.IsSorted());
+  std::vector<SeqLib::OverlapResult> tserial = unsorted.FindOverlapPairs(subject, true);
+  BOOST_CHECK(unsorted.FindOverlapPairs(subject, true, 4) == tserial);
+
+  SeqLib::GRC i1 = query.Intersection(subject, true);
+  SeqLib::GRC i4 = query.Intersection(subject, true, 4);
+  BOOST_CHECK_EQUAL(i1.size(), i4.size());
+  BOOST_CHECK_EQUAL(i1.TotalWidth(), i4.TotalWidth());
+
+  BOOST_CHECK_THROW(query.FindOverlapPairs(subject, true, 0), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE ( dynamic_interval_tree ) {
+
+  SeqLib::GRC grc;
+  grc.add(SeqLib::GenomicRegion(0, 100, 200));
+  grc.SetDynamicTree(true);
+  BOOST_CHECK_EQUAL(grc.NumTree(), 1);
+
+  // interleave adds and queries, without CreateTreeMap
+  for (int i = 0; i < 3000; ++i) {
+    int32_t p = rand() % 50000;
+    grc.add(SeqLib::GenomicRegion(rand() % 3, p, p + rand() % 500));
+    if (i % 100 == 0) {
+      int32_t q = rand() % 50000;
+      SeqLib::GenomicRegion gr(rand() % 3, q, q + 300);
+      size_t expected = 0;
+      for (size_t j = 0; j < grc.size(); ++j)
+	if (grc[j].chr == gr.chr && grc[j].pos1 <= gr.pos2 && grc[j].pos2 >= gr.pos1)
+	  ++expected;
+      BOOST_CHECK_EQUAL(grc.CountOverlaps(gr), expected);
+      std::vector<int> ids = grc.FindOverlappedIntervals(gr, true);
+      BOOST_CHECK_EQUAL(ids.size(), expected);
+      for (size_t j = 0; j < ids.size(); ++j)
+	BOOST_CHECK_EQUAL(grc[ids[j]].chr, gr.chr);
+    }
+  }
+
+  // sorting keeps the tree in step with the new positions
+  grc.CoordinateSort();
+  std::vector<int> ids = grc.FindOverlappedIntervals(grc[10], true);
+  BOOST_CHECK(std::find(ids.begin(), ids.end(), 10) != ids.end());
+
+  // insert-only index
+  SeqLib::GenomicIntervalTree tree;
+  for (int i = 0; i < 1000; ++i)
+    tree.insert(i * 10, i * 10 + 5, i);
+  BOOST_CHECK_EQUAL(tree.size(), 1000);
+  BOOST_CHECK_EQUAL(tree.countOverlapping(0, 9999), 1000);
+  BOOST_CHECK_EQUAL(tree.countOverlapping(6, 9), 0);
+  BOOST_CHECK_EQUAL(tree.findContained(10, 35).size(), 3);
+  BOOST_CHECK(tree.levels() < 10);
+}
+
+BOOST_AUTO_TEST_CASE ( read_bed_vcf ) {
+
+  SeqLib::BamHeader hdr("@SQ\tSN:1\tLN:1000000\n@SQ\tSN:X\tLN:1000000\n");
+
+  // same lines as plain text, gzip and bgzip
+  std::stringstream ss;
+  ss << "#comment" << std::endl;
+  for (int i = 0; i < 50000; ++i)
+    ss << (i % 3 == 0 ? "X" : (i % 3 == 1 ? "1" : "GL000")) << "\t" << i << "\t" << i + 10 << "\tname" << i << std::endl;
+  ss << "1\t5\t7"; // no newline at end
+  const std::string text = ss.str();
+
+  std::ofstream ofile("tmp_regions.bed");
+  ofile << text;
+  ofile.close();
+  gzFile gz = gzopen("tmp_regions.bed.gz", "w");
+  gzwrite(gz, text.c_str(), text.length());
+  gzclose(gz);
+  BGZF* bz = bgzf_open("tmp_regions.bgz.bed", "w");
+  bgzf_write(bz, text.c_str(), text.length());
+  bgzf_close(bz);
+
+  SeqLib::GRC plain, gzipped, bgzipped;
+  BOOST_CHECK(plain.ReadBED("tmp_regions.bed", hdr));
+  BOOST_CHECK(gzipped.ReadBED("tmp_regions.bed.gz", hdr));
+  BOOST_CHECK(bgzipped.ReadBED("tmp_regions.bgz.bed", hdr, 3));
+  BOOST_CHECK_EQUAL(plain.size(), 33335);
+  BOOST_CHECK_EQUAL(gzipped.size(), plain.size());
+  BOOST_CHECK_EQUAL(bgzipped.size(), plain.size());
+  for (size_t i = 0; i < plain.size(); ++i) {
+    BOOST_CHECK(plain[i] == gzipped[i]);
+    BOOST_CHECK(plain[i] == bgzipped[i]);
+  }
+  BOOST_CHECK_EQUAL(plain[0].chr, 1);
+  BOOST_CHECK_EQUAL(plain[0].pos2, 10);
+  BOOST_CHECK_EQUAL(plain[plain.size() - 1].pos1, 5);
+
+  BOOST_CHECK(!plain.ReadBED("does_not_exist.bed", hdr));
+
+  std::ofstream bad("tmp_bad.bed");
+  bad << "1\tfoo\t10" << std::endl;
+  bad.close();
+  BOOST_CHECK_THROW(plain.ReadBED("tmp_bad.bed", hdr), std::invalid_argument);
+  std::ofstream backwards("tmp_backwards.bed");
+  backwards << "1\t100\t10" << std::endl;
+  backwards.close();
+  BOOST_CHECK_THROW(plain.ReadBED("tmp_backwards.bed", hdr), std::invalid_argument);
+
+  // VCF keeps the start point only
+  std::ofstream vcf("tmp_regions.vcf");
+  vcf << "##fileformat=VCFv4.1" << std::endl << "#CHROM\tPOS\tID" << std::endl;
+  vcf << "X\t100\t.\tA\tT" << std::endl << "1\t200\t.\tC\tG" << std::endl;
+  vcf.close();
+  SeqLib::GRC v;
+  BOOST_CHECK(v.ReadVCF("tmp_regions.vcf", hdr));
+  BOOST_CHECK_EQUAL(v.size(), 2);
+  BOOST_CHECK_EQUAL(v[0].chr, 1);
+  BOOST_CHECK_EQUAL(v[0].pos1, 100);
+  BOOST_CHECK_EQUAL(v[0].pos2, 100);
+}
+
+BOOST_AUTO_TEST_CASE ( region_file_reader ) {
+
+  SeqLib::BamHeader hdr("@SQ\tSN:1\tLN:1000000\n@SQ\tSN:X\tLN:1000000\n");
+
+  // sorted, so it can be tabix indexed
+  std::stringstream ss;
+  ss << "#comment" << std::endl;
+  for (int c = 0; c < 2; ++c)
+    for (int i = 0; i < 20000; ++i)
+      ss << (c ? "X" : "1") << "\t" << i * 10 << "\t" << i * 10 + 25 << std::endl;
+  const std::string text = ss.str();
+  BGZF* bz = bgzf_open("tmp_indexed.bed.gz", "w");
+  bgzf_write(bz, text.c_str(), text.length());
+  bgzf_close(bz);
+
+  // stream the whole file, one record at a time
+  SeqLib::RegionFileReader rfr;
+  BOOST_CHECK(rfr.Open("tmp_indexed.bed.gz", hdr));
+  SeqLib::GenomicRegion gr;
+  size_t n = 0;
+  while (rfr.GetNextRegion(gr))
+    ++n;
+  BOOST_CHECK_EQUAL(n, 40000);
+  BOOST_CHECK(!rfr.Failed());
+
+  // no index yet
+  BOOST_CHECK(!rfr.SetRegion(SeqLib::GenomicRegion(1, 100, 200)));
+  SeqLib::GRC none;
+  BOOST_CHECK(!none.ReadBEDRegion("tmp_indexed.bed.gz", SeqLib::GenomicRegion(1, 100, 200), hdr));
+
+  BOOST_REQUIRE_EQUAL(tbx_index_build("tmp_indexed.bed.gz", 0, &tbx_conf_bed), 0);
+
+  SeqLib::GRC all;
+  all.ReadBED("tmp_indexed.bed.gz", hdr);
+
+  SeqLib::GenomicRegion q[3] = { SeqLib::GenomicRegion(1, 1000, 1100),
+				 SeqLib::GenomicRegion(0, 0, 0),
+				 SeqLib::GenomicRegion(1, 199990, 300000) };
+  for (int k = 0; k < 3; ++k) {
+    SeqLib::GRC sub;
+    BOOST_CHECK(sub.ReadBEDRegion("tmp_indexed.bed.gz", q[k], hdr));
+    size_t expected = 0;
+    for (size_t i = 0; i < all.size(); ++i)
+      if (all[i].chr == q[k].chr && all[i].pos1 <= q[k].pos2 && all[i].pos2 >= q[k].pos1)
+	++expected;
+    BOOST_CHECK(expected > 0);
+    BOOST_CHECK_EQUAL(sub.size(), expected);
+    for (size_t i = 0; i < sub.size(); ++i)
+      BOOST_CHECK(sub[i].GetOverlap(q[k]));
+  }
+
+  // move between regions on one reader
+  BOOST_CHECK(rfr.SetRegion(q[0]));
+  n = 0;
+  while (rfr.GetNextRegion(gr))
+    ++n;
+  BOOST_CHECK_EQUAL(n, 13);
+  BOOST_CHECK(rfr.SetRegion(q[1]));
+  BOOST_CHECK(rfr.GetNextRegion(gr));
+  BOOST_CHECK_EQUAL(gr.chr, 0);
+  BOOST_CHECK_EQUAL(gr.pos1, 0);
+
+}
+
 BOOST_AUTO_TEST_CASE( json_parse_from_file ) {
 
   SeqLib::BamReader br;
@@ -522,6 +1496,55 @@ BOOST_AUTO_TEST_CASE( bam_header_id2name ) {
   BOOST_CHECK_THROW(SeqLib::BamHeader().IDtoName(1), std::out_of_range);
 }
 
+BOOST_AUTO_TEST_CASE( region_string_parsing ) {
+
+  // lots of contigs, as in a decoy/alt reference
+  std::stringstream ss;
+  for (int i = 0; i < 3000; ++i)
+    ss << "@SQ\tSN:chrUn_" << i << "_decoy\tLN:" << 1000 + i << std::endl;
+  ss << "@SQ\tSN:chr2\tLN:5000" << std::endl << "@SQ\tSN:chr2\tLN:7000" << std::endl;
+  SeqLib::BamHeader hdr(ss.str());
+
+  BOOST_CHECK_EQUAL(hdr.Name2ID("chrUn_1234_decoy"), 1234);
+  BOOST_CHECK_EQUAL(hdr.Name2ID("chr2"), 3000); // first of a repeated name
+  BOOST_CHECK_EQUAL(hdr.Name2ID("chrUn_1234"), -1);
+  BOOST_CHECK_EQUAL(hdr.Name2ID("chr2:100-200", 4), 3000);
+  BOOST_CHECK_EQUAL(hdr.Name2ID("chr", 3), -1);
+  BOOST_CHECK_EQUAL(SeqLib::BamHeader().Name2ID("chr2"), -1);
+
+  SeqLib::GenomicRegion gr("chr2:1,000-2,000", hdr);
+  BOOST_CHECK_EQUAL(gr.chr, 3000);
+  BOOST_CHECK_EQUAL(gr.pos1, 1000);
+  BOOST_CHECK_EQUAL(gr.pos2, 2000);
+
+  // whole chromosome, and open ended
+  SeqLib::GenomicRegion whole("chrUn_7_decoy", hdr);
+  BOOST_CHECK_EQUAL(whole.chr, 7);
+  BOOST_CHECK_EQUAL(whole.pos1, 1);
+  BOOST_CHECK_EQUAL(whole.pos2, 1007);
+  SeqLib::GenomicRegion open("chr2:4000", hdr);
+  BOOST_CHECK_EQUAL(open.pos1, 4000);
+  BOOST_CHECK_EQUAL(open.pos2, 5000);
+
+  BOOST_CHECK_THROW(SeqLib::GenomicRegion("chr3:1-100", hdr), std::invalid_argument);
+  BOOST_CHECK_THROW(SeqLib::GenomicRegion("chr2", SeqLib::BamHeader()), std::invalid_argument);
+
+  std::vector<std::string> regs;
+  for (int i = 0; i < 500; ++i)
+    regs.push_back("chrUn_" + SeqLib::tostring(i / 10) + "_decoy:" + SeqLib::tostring(i + 1) + "-" + SeqLib::tostring(i + 50));
+  regs.push_back("chr2");
+  SeqLib::GenomicRegionVector parsed = SeqLib::ParseRegions(regs, hdr);
+  BOOST_REQUIRE_EQUAL(parsed.size(), regs.size());
+  for (size_t i = 0; i < regs.size(); ++i)
+    BOOST_CHECK(parsed[i] == SeqLib::GenomicRegion(regs[i], hdr));
+  BOOST_CHECK_EQUAL(parsed[0].chr, 0);
+  BOOST_CHECK_EQUAL(parsed[499].chr, 49);
+  BOOST_CHECK_EQUAL(parsed[499].pos2, 549);
+
+  regs.push_back("nope:1-2");
+  BOOST_CHECK_THROW(SeqLib::ParseRegions(regs, hdr), std::invalid_argument);
+}
+
 BOOST_AUTO_TEST_CASE( genomic_ranges_string_constructor) {
   
   SeqLib::BamReader br;
@@ -1545,3 +2568,530 @@ BOOST_AUTO_TEST_CASE ( set_cigar ) {
 
 
 }
+
+BOOST_AUTO_TEST_CASE ( filter_pipeline ) {
+
+  std::string rules = "{\"global\" : {\"!anyflag\" : 1536}, \"\" : { \"rules\" : [{\"mapq\" : [10,60]}]}}";
+
+  // serial reference
+  SeqLib::BamReader br;
+  br.Open(SBAM);
+  ReadFilterCollection rfc(rules, br.Header());
+  std::vector<std::string> expected;
+  SeqLib::BamRecord rec;
+  while (br.GetNextRecord(rec))
+    if (rfc.isValid(rec))
+      expected.push_back(rec.Qname() + rec.Sequence());
+
+  // threaded pipeline, with small batches to force reordering
+  SeqLib::BamReader r;
+  r.Open(SBAM);
+  SeqLib::BamWriter w;
+  w.SetHeader(r.Header());
+  w.Open("tmp_pipeline.bam");
+  w.WriteHeader();
+
+  SeqLib::FilterPipeline fp;
+  fp.SetFilter(ReadFilterCollection(rules, r.Header()));
+  fp.SetNumThreads(4);
+  fp.SetBatchSize(37);
+  fp.SetQueueSize(3);
+  BOOST_CHECK_THROW(fp.SetNumThreads(0), std::invalid_argument);
+  BOOST_CHECK(fp.Run(r, w));
+  w.Close();
+
+  std::cerr << fp.Stats() << std::endl;
+  BOOST_CHECK_EQUAL(fp.Stats().reads_out, expected.size());
+  BOOST_CHECK(fp.Stats().filter_queue_max <= 3);
+
+  // the threads' pass counts are added back, as if filtered serially
+  BOOST_CHECK_EQUAL(fp.GetFilter().NumPassed(), rfc.NumPassed());
+  BOOST_CHECK_EQUAL(fp.GetFilter().NumSeen(), rfc.NumSeen());
+  ReadFilterCollection other(rules, r.Header());
+  other.AddCounts(fp.GetFilter());
+  BOOST_CHECK_EQUAL(other.NumPassed(), expected.size());
+  other.ResetCounts();
+  BOOST_CHECK_EQUAL(other.NumSeen(), 0);
+  BOOST_CHECK_THROW(other.AddCounts(ReadFilterCollection()), std::invalid_argument);
+
+  // output is in input order
+  SeqLib::BamReader r2;
+  r2.Open("tmp_pipeline.bam");
+  size_t i = 0;
+  while (r2.GetNextRecord(rec)) {
+    BOOST_REQUIRE(i < expected.size());
+    BOOST_CHECK_EQUAL(rec.Qname() + rec.Sequence(), expected[i++]);
+  }
+  BOOST_CHECK_EQUAL(i, expected.size());
+}
+
+BOOST_AUTO_TEST_CASE ( window_assembler ) {
+
+  SeqLib::GRC windows;
+  for (int i = 0; i < 12; ++i)
+    windows.add(SeqLib::GenomicRegion(22, 1000000 + i * 2000, 1000000 + (i + 1) * 2000));
+  windows.add(SeqLib::GenomicRegion(1, 1, 1000)); // no reads
+
+  // assemble each window in turn
+  std::vector<std::vector<std::string> > expected;
+  SeqLib::BamReader br;
+  br.Open(SBAM);
+  for (size_t i = 0; i < windows.size(); ++i) {
+    SeqLib::BamRecordVector brv;
+    SeqLib::BamRecord rec;
+    if (br.SetRegion(windows[i]))
+      while (br.GetNextRecord(rec))
+	brv.push_back(rec);
+    std::vector<std::string> c;
+    if (brv.size()) {
+      SeqLib::FermiAssembler f;
+      f.AddReads(brv);
+      f.CorrectReads();
+      f.PerformAssembly();
+      c = f.GetContigs();
+    }
+    expected.push_back(c);
+  }
+
+  SeqLib::WindowAssembler wa;
+  BOOST_CHECK(wa.Open(SBAM));
+  wa.SetWindows(windows);
+  wa.SetNumThreads(4);
+  wa.SetQueueSize(2);
+  BOOST_CHECK_THROW(wa.SetNumThreads(0), std::invalid_argument);
+  BOOST_CHECK_THROW(wa.SetQueueSize(0), std::invalid_argument);
+
+  // same contigs, in window order
+  SeqLib::WindowContigs w;
+  size_t n = 0;
+  while (wa.GetNextWindow(w)) {
+    BOOST_REQUIRE(n < windows.size());
+    BOOST_CHECK_EQUAL(w.id, n);
+    BOOST_CHECK(w.window == windows[n]);
+    BOOST_CHECK(w.contigs == expected[n]);
+    ++n;
+  }
+  BOOST_CHECK_EQUAL(n, windows.size());
+  BOOST_CHECK(!wa.GetNextWindow(w));
+  std::cerr << wa.Stats() << std::endl;
+  BOOST_CHECK_EQUAL(wa.Stats().windows, windows.size());
+  BOOST_CHECK(wa.Stats().assemble_queue_max <= 2);
+
+  // stop part way, then start again with a read limit
+  wa.Reset();
+  BOOST_CHECK(wa.GetNextWindow(w) && w.id == 0);
+  wa.SetMaxReads(10);
+  wa.Reset();
+  n = 0;
+  while (wa.GetNextWindow(w)) {
+    BOOST_CHECK_EQUAL(w.skipped, w.num_reads > 10);
+    if (w.skipped)
+      BOOST_CHECK(w.contigs.empty());
+    ++n;
+  }
+  BOOST_CHECK_EQUAL(n, windows.size());
+}
+
+BOOST_AUTO_TEST_CASE ( fermi_threads_and_phases ) {
+
+  SeqLib::BamReader br;
+  br.Open(SBAM);
+  SeqLib::BamRecord rec;
+  SeqLib::BamRecordVector brv;
+  size_t count = 0;
+  while(br.GetNextRecord(rec) && count++ < 2000)
+    brv.push_back(rec);
+
+  SeqLib::FermiAssembler f1;
+  f1.AddReads(brv);
+  f1.PerformAssembly();
+
+  // timed, multithreaded assembly gives the same contigs
+  SeqLib::FermiAssembler f;
+  BOOST_CHECK_THROW(f.SetNumThreads(0), std::invalid_argument);
+  f.SetNumThreads(2);
+  BOOST_CHECK_EQUAL(f.GetNumThreads(), 2);
+  f.SetPhaseStats(true);
+  f.AddReads(brv);
+  f.PerformAssembly();
+  BOOST_CHECK(f.GetContigs() == f1.GetContigs());
+  const SeqLib::PhaseStatsVector& p = f.GetPhaseStats();
+  BOOST_REQUIRE_EQUAL(p.size(), 4);
+  BOOST_CHECK_EQUAL(p[0].name, "correct");
+  BOOST_CHECK_EQUAL(p[1].name, "filter");
+  BOOST_CHECK_EQUAL(p[2].name, "index");
+  BOOST_CHECK_EQUAL(p[3].name, "graph");
+  for (size_t i = 0; i < p.size(); ++i) {
+    std::cerr << p[i] << std::endl;
+    BOOST_CHECK(p[i].wall_time >= 0);
+    BOOST_CHECK(p[i].peak_bytes >= p[i].resident_bytes);
+  }
+  f.ClearReads();
+  BOOST_CHECK(f.GetPhaseStats().empty());
+
+  // a small budget shortens the prefix, and the k-mer to match
+  SeqLib::BFC b;
+  b.SetNumThreads(2);
+  b.SetMemoryBudget(1 << 20);
+  b.SetPhaseStats(true);
+  b.TrainAndCorrect(brv);
+  BOOST_CHECK(b.GetPrefixLength() <= 11);
+  BOOST_CHECK(2 * b.GetTrainedKMer() - b.GetPrefixLength() <= 50);
+  BOOST_CHECK(b.GetTrainedKMer() <= b.GetKMer());
+  BOOST_REQUIRE_EQUAL(b.GetPhaseStats().size(), 2);
+  BOOST_CHECK_EQUAL(b.GetPhaseStats()[0].name, "count");
+  BOOST_CHECK_EQUAL(b.GetPhaseStats()[1].name, "correct");
+
+  // the budget only lowers k for that training
+  b.SetMemoryBudget(0);
+  b.TrainAndCorrect(brv);
+  BOOST_CHECK_EQUAL(b.GetTrainedKMer(), b.GetKMer());
+}
+
+// corrects one batch against a shared, frozen BFC table
+struct BatchCorrector {
+  const SeqLib::BFC* bfc;
+  SeqLib::UnalignedSequenceVector batch;
+  void operator()() { bfc->CorrectBatch(batch); }
+};
+
+BOOST_AUTO_TEST_CASE ( bfc_frozen_table ) {
+
+  SeqLib::BamReader br;
+  br.Open(SBAM);
+  SeqLib::BamRecord rec;
+  SeqLib::BamRecordVector train, reads;
+  size_t count = 0;
+  while(br.GetNextRecord(rec) && count++ < 8000)
+    (count <= 4000 ? train : reads).push_back(rec);
+
+  // the old way: train, then correct one batch
+  SeqLib::BFC b1;
+  b1.TrainCorrection(train);
+  b1.ErrorCorrect(reads);
+  SeqLib::UnalignedSequenceVector expected;
+  b1.GetSequences(expected);
+
+  // train in two steps and freeze
+  SeqLib::BFC b;
+  BOOST_CHECK_THROW(b.FreezeCorrection(), std::runtime_error);
+  SeqLib::UnalignedSequenceVector usv;
+  BOOST_CHECK_THROW(b.CorrectBatch(usv), std::runtime_error);
+  SeqLib::BamRecordVector half(train.begin(), train.begin() + 2000);
+  b.AddTrainingReads(half);
+  half.assign(train.begin() + 2000, train.end());
+  b.AddTrainingReads(half);
+  BOOST_CHECK(!b.IsFrozen());
+  BOOST_CHECK(!b.SaveCorrection("tmp_bfc.table"));
+  b.FreezeCorrection();
+  BOOST_CHECK(b.IsFrozen());
+  BOOST_CHECK_EQUAL(b.GetKMer(), b1.GetKMer());
+
+  for (size_t i = 0; i < reads.size(); ++i)
+    usv.push_back(SeqLib::UnalignedSequence(reads[i].Qname(), reads[i].Sequence(), reads[i].Qualities()));
+  SeqLib::UnalignedSequenceVector corrected = usv;
+  b.CorrectBatch(corrected);
+  BOOST_REQUIRE_EQUAL(corrected.size(), expected.size());
+  for (size_t i = 0; i < corrected.size(); ++i)
+    BOOST_CHECK_EQUAL(corrected[i].Seq, expected[i].Seq);
+
+  // several batches at once against the same table
+  std::vector<BatchCorrector> workers(4);
+  for (size_t i = 0; i < usv.size(); ++i)
+    workers[i % 4].batch.push_back(usv[i]);
+  for (size_t i = 0; i < workers.size(); ++i)
+    workers[i].bfc = &b;
+  SeqLib::RunThreads(workers);
+  for (size_t i = 0; i < usv.size(); ++i)
+    BOOST_CHECK_EQUAL(workers[i % 4].batch[i / 4].Seq, corrected[i].Seq);
+
+  // round trip through a file
+  BOOST_CHECK(b.SaveCorrection("tmp_bfc.table"));
+  SeqLib::BFC loaded;
+  BOOST_CHECK(!loaded.LoadCorrection("test_data/small.bam"));
+  BOOST_CHECK(loaded.LoadCorrection("tmp_bfc.table"));
+  BOOST_CHECK(loaded.IsFrozen());
+  BOOST_CHECK_EQUAL(loaded.GetKMer(), b.GetKMer());
+  SeqLib::BamRecordVector in_place = reads;
+  loaded.CorrectBatch(in_place);
+  for (size_t i = 0; i < in_place.size(); ++i)
+    BOOST_CHECK_EQUAL(in_place[i].Sequence(), corrected[i].Seq);
+}
+
+BOOST_AUTO_TEST_CASE ( bfc_stream ) {
+
+  SeqLib::BamReader br;
+  br.Open(SBAM);
+  SeqLib::BamRecord rec;
+  SeqLib::BamRecordVector reads;
+  while(br.GetNextRecord(rec))
+    reads.push_back(rec);
+
+  // train on a sample, and correct everything in one batch for reference
+  SeqLib::BFC b;
+  SeqLib::BFCStream s(b);
+  BOOST_CHECK_THROW(s.SetChunkSize(0), std::invalid_argument);
+  BOOST_CHECK_THROW(s.SetNumThreads(0), std::invalid_argument);
+  SeqLib::BamReader r;
+  SeqLib::BamWriter w;
+  BOOST_CHECK_THROW(s.Run(r, w), std::runtime_error);
+  b.AddTrainingReads(SeqLib::BamRecordVector(reads.begin(), reads.begin() + std::min(reads.size(), (size_t)4000)));
+  b.FreezeCorrection();
+  BOOST_CHECK(b.HasTable());
+  SeqLib::BamRecordVector expected = reads;
+  b.CorrectBatch(expected);
+
+  // small chunks on several threads, to force reordering
+  r.Open(SBAM);
+  w.SetHeader(r.Header());
+  w.Open("tmp_bfc_stream.bam");
+  w.WriteHeader();
+  s.SetNumThreads(4);
+  s.SetChunkSize(53);
+  s.SetQueueSize(2);
+  BOOST_CHECK(s.Run(r, w));
+  w.Close();
+
+  std::cerr << s.Stats() << std::endl;
+  BOOST_CHECK_EQUAL(s.Stats().reads_in, reads.size());
+  BOOST_CHECK_EQUAL(s.Stats().reads_out, reads.size());
+  BOOST_CHECK(s.Stats().max_chunks_in_flight <= 2 * 2 + 4);
+
+  SeqLib::BamReader r2;
+  r2.Open("tmp_bfc_stream.bam");
+  size_t i = 0;
+  while (r2.GetNextRecord(rec)) {
+    BOOST_REQUIRE(i < expected.size());
+    BOOST_CHECK_EQUAL(rec.Qname(), expected[i].Qname());
+    BOOST_CHECK_EQUAL(rec.Position(), expected[i].Position());
+    BOOST_CHECK_EQUAL(rec.Sequence(), expected[i].Sequence());
+    ++i;
+  }
+  BOOST_CHECK_EQUAL(i, expected.size());
+
+  // FASTQ in, FASTQ out
+  std::ofstream fq("tmp_bfc_stream.fq");
+  for (size_t k = 0; k < 500; ++k)
+    fq << "@" << reads[k].Qname() << "\n" << reads[k].Sequence() << "\n+\n" << reads[k].Qualities() << "\n";
+  fq.close();
+  SeqLib::FastqReader f("tmp_bfc_stream.fq");
+  std::stringstream out;
+  BOOST_CHECK(s.Run(f, out));
+  std::string name, seq, plus, qual;
+  for (size_t k = 0; k < 500; ++k) {
+    BOOST_REQUIRE(std::getline(out, name) && std::getline(out, seq) && std::getline(out, plus) && std::getline(out, qual));
+    BOOST_CHECK_EQUAL(name, "@" + reads[k].Qname());
+    BOOST_CHECK_EQUAL(seq, expected[k].Sequence());
+  }
+}
+
+BOOST_AUTO_TEST_CASE ( ssw_query_profile ) {
+
+  const std::string contig = "CAGCCTCACCCAGGAGGAGACTTGGAGCAGAGCCAGTGACCTGTTTCAGCTGCAGGAAGTAGTAGGACATAGCCTGTGCC";
+  std::vector<std::string> refs;
+  refs.push_back("TTTTTTCAGCCTCACCCAGGAGGAGACTTGGAGCAGAGCCAGTGACCTGTTTCAGCTGCAGGAAGTAGTAGGACATAGCCTGTGCCAAAAAA");
+  refs.push_back("CAGCCTCACCCAGGAGGAGACTTGAGCAGAGCCAGTGACCTGTTTCAGCTGCAGGAAGTAGTAGGACAT");
+  refs.push_back("GGAGCAGAGCCAGTGACCTGTTTCAGCTGCAGGAAGTATTTTTTTTAGTAGGACATAGCCTGTGCC");
+  refs.push_back("ACGT");
+
+  StripedSmithWaterman::Aligner aligner;
+  StripedSmithWaterman::Filter filter;
+  StripedSmithWaterman::QueryProfile profile;
+  StripedSmithWaterman::Alignment expected, al;
+  BOOST_CHECK(!aligner.Align(profile, refs[0].c_str(), refs[0].size(), filter, &al));
+  BOOST_CHECK(!aligner.BuildQueryProfile(contig.c_str(), 0, &profile));
+
+  // one contig against many references
+  BOOST_CHECK(aligner.BuildQueryProfile(contig.c_str(), contig.size(), &profile));
+  BOOST_CHECK_EQUAL(profile.Length(), (int)contig.size());
+  for (size_t i = 0; i < refs.size(); ++i) {
+    aligner.Align(contig.c_str(), refs[i].c_str(), refs[i].size(), filter, &expected);
+    BOOST_CHECK(aligner.Align(profile, refs[i].c_str(), refs[i].size(), filter, &al));
+    BOOST_CHECK_EQUAL(al.sw_score, expected.sw_score);
+    BOOST_CHECK_EQUAL(al.ref_begin, expected.ref_begin);
+    BOOST_CHECK_EQUAL(al.cigar_string, expected.cigar_string);
+    BOOST_CHECK_EQUAL(al.mismatches, expected.mismatches);
+  }
+
+  // rebuilding reuses the profile; and many profiles against one reference
+  aligner.SetReferenceSequence(refs[0].c_str(), refs[0].size());
+  for (size_t i = 1; i < refs.size(); ++i) {
+    BOOST_CHECK(aligner.BuildQueryProfile(refs[i].c_str(), refs[i].size(), &profile));
+    aligner.Align(refs[i].c_str(), filter, &expected);
+    BOOST_CHECK(aligner.Align(profile, filter, &al));
+    BOOST_CHECK_EQUAL(al.sw_score, expected.sw_score);
+    BOOST_CHECK_EQUAL(al.cigar_string, expected.cigar_string);
+  }
+}
+
+BOOST_AUTO_TEST_CASE ( ssw_align_batch ) {
+
+  std::vector<std::string> queries, refs;
+  queries.push_back("CAGCCTCACCCAGGAGGAGACTTGGAGCAGAGCCAGTG");
+  queries.push_back("ACCTGTTTCAGCTGCAGGAAGTAGTAGGACATAGCCTGTGCC");
+  queries.push_back("GGAGCAGAGCCAGTGACCTGTTTCAGCTGC");
+  refs.push_back("TTTTTTCAGCCTCACCCAGGAGGAGACTTGGAGCAGAGCCAGTGACCTGTTTCAGCTGCAGGAAGTAGTAGGACATAGCCTGTGCCAAAAAA");
+  refs.push_back("CAGCCTCACCCAGGAGGAGACTTGAGCAGAGCCAGTGACCTGTTTCAGCTGCAGGAAGTAGTAGGACAT");
+
+  // every query against every reference, interleaved
+  std::vector<StripedSmithWaterman::AlignPair> pairs;
+  for (int r = 0; r < 2; ++r)
+    for (int q = 0; q < 3; ++q)
+      pairs.push_back(StripedSmithWaterman::AlignPair(q, r));
+
+  StripedSmithWaterman::Aligner aligner;
+  StripedSmithWaterman::Filter filter;
+  std::vector<StripedSmithWaterman::Alignment> results;
+  for (int t = 1; t <= 4; t *= 2) {
+    BOOST_CHECK(aligner.AlignBatch(queries, refs, pairs, t, &results));
+    BOOST_REQUIRE_EQUAL(results.size(), pairs.size());
+    for (size_t i = 0; i < pairs.size(); ++i) {
+      StripedSmithWaterman::Alignment expected;
+      const std::string& ref = refs[pairs[i].second];
+      aligner.Align(queries[pairs[i].first].c_str(), ref.c_str(), ref.size(), filter, &expected);
+      BOOST_CHECK_EQUAL(results[i].sw_score, expected.sw_score);
+      BOOST_CHECK_EQUAL(results[i].ref_begin, expected.ref_begin);
+      BOOST_CHECK_EQUAL(results[i].cigar_string, expected.cigar_string);
+    }
+  }
+
+  // bad index
+  pairs.push_back(StripedSmithWaterman::AlignPair(3, 0));
+  BOOST_CHECK(!aligner.AlignBatch(queries, refs, pairs, 2, &results));
+}
+
+BOOST_AUTO_TEST_CASE ( ssw_banded ) {
+
+  const std::string ref = "TTTTTTCAGCCTCACCCAGGAGGAGACTTGGAGCAGAGCCAGTGACCTGTTTCAGCTGCAGGAAGTAGTAGGACATAGCCTGTGCCAAAAAA";
+  StripedSmithWaterman::Aligner aligner;
+  StripedSmithWaterman::Filter filter;
+  StripedSmithWaterman::Alignment al, local;
+
+  // exact read, same as local
+  std::string read = ref.substr(6, 60);
+  BOOST_CHECK(aligner.AlignBanded(read.c_str(), read.size(), ref.c_str(), ref.size(), StripedSmithWaterman::kGlocal, 4, 6, &al));
+  aligner.Align(read.c_str(), ref.c_str(), ref.size(), filter, &local);
+  BOOST_CHECK_EQUAL(al.sw_score, local.sw_score);
+  BOOST_CHECK_EQUAL(al.ref_begin, 6);
+  BOOST_CHECK_EQUAL(al.ref_end, 65);
+  BOOST_CHECK_EQUAL(al.cigar_string, "60=");
+
+  // a mismatch and a 2bp deletion
+  read = "CAGCCTCACCAAGGAGGAGACTTGGAGCAGAGCCAGTGACGTTTCAGCTGCAGGAAGTAG";
+  BOOST_CHECK(aligner.AlignBanded(read.c_str(), read.size(), ref.c_str(), ref.size(), StripedSmithWaterman::kGlocal, 4, 6, &al));
+  BOOST_CHECK_EQUAL(al.cigar_string, "10=1X29=2D20=");
+  BOOST_CHECK_EQUAL(al.sw_score, 112);
+  BOOST_CHECK_EQUAL(al.mismatches, 3);
+  SeqLib::Cigar cig(al.cigar);
+  BOOST_CHECK_EQUAL(cig.NumQueryConsumed(), (int)read.size());
+  BOOST_CHECK_EQUAL(cig.NumReferenceConsumed(), al.ref_end - al.ref_begin + 1);
+
+  // glocal keeps the whole read where local clips it
+  read = "GGGGG" + ref.substr(6, 40);
+  BOOST_CHECK(aligner.AlignBanded(read.c_str(), read.size(), ref.c_str(), ref.size(), StripedSmithWaterman::kGlocal, 8, 1, &al));
+  BOOST_CHECK_EQUAL(al.cigar_string, "5I40=");
+  BOOST_CHECK_EQUAL(al.ref_begin, 6);
+
+  // global, with a 2bp insertion
+  read = ref;
+  read.insert(30, "GG");
+  BOOST_CHECK(aligner.AlignBanded(read.c_str(), read.size(), ref.c_str(), ref.size(), StripedSmithWaterman::kGlobal, 4, 0, &al));
+  BOOST_CHECK_EQUAL(al.cigar_string, "29=2I63=");
+  BOOST_CHECK_EQUAL(al.ref_begin, 0);
+  BOOST_CHECK_EQUAL(al.ref_end, (int)ref.size() - 1);
+
+  // the band can't reach the end, or the reference
+  BOOST_CHECK(!aligner.AlignBanded(read.c_str(), read.size(), ref.c_str(), ref.size(), StripedSmithWaterman::kGlobal, 1, 0, &al));
+  BOOST_CHECK(!aligner.AlignBanded(read.c_str(), read.size(), ref.c_str(), ref.size(), StripedSmithWaterman::kGlocal, 4, 200, &al));
+}
+
+BOOST_AUTO_TEST_CASE ( ssw_simd_differential ) {
+
+  if (ssw_set_simd(SSW_SIMD_AVX2) != SSW_SIMD_AVX2) {
+    ssw_set_simd(SSW_SIMD_AUTO);
+    return; // nothing to compare against
+  }
+
+  // random queries against random references, half of them drawn from the
+  // reference with errors, over a range of scores and lengths (some long
+  // enough to need the 16-bit kernels), including gap open == gap extend
+  srand(42);
+  const char* acgt = "ACGT";
+  for (int it = 0; it < 500; ++it) {
+    int match = 1 + rand() % 4, mismatch = 1 + rand() % 5, gap_extend = 1 + rand() % 3;
+    StripedSmithWaterman::Aligner aligner(match, mismatch, gap_extend + rand() % 6, gap_extend);
+    StripedSmithWaterman::Filter filter;
+    std::string ref(1 + rand() % 800, 'A'), query(16 + rand() % (it % 5 ? 200 : 600), 'A');
+    for (size_t i = 0; i < ref.size(); ++i)
+      ref[i] = acgt[rand() % 4];
+    for (size_t i = 0; i < query.size(); ++i)
+      query[i] = acgt[rand() % 4];
+    if (rand() % 2 && ref.size() > query.size()) {
+      size_t off = rand() % (ref.size() - query.size() + 1);
+      for (size_t i = 0; i < query.size(); ++i)
+	query[i] = rand() % 20 ? ref[off + i] : acgt[rand() % 4];
+    }
+
+    StripedSmithWaterman::Alignment sse2, avx2;
+    ssw_set_simd(SSW_SIMD_SSE2);
+    aligner.Align(query.c_str(), ref.c_str(), ref.size(), filter, &sse2);
+    ssw_set_simd(SSW_SIMD_AVX2);
+    aligner.Align(query.c_str(), ref.c_str(), ref.size(), filter, &avx2);
+
+    BOOST_CHECK_EQUAL(sse2.sw_score, avx2.sw_score);
+    BOOST_CHECK_EQUAL(sse2.sw_score_next_best, avx2.sw_score_next_best);
+    BOOST_CHECK_EQUAL(sse2.ref_begin, avx2.ref_begin);
+    BOOST_CHECK_EQUAL(sse2.ref_end, avx2.ref_end);
+    BOOST_CHECK_EQUAL(sse2.query_begin, avx2.query_begin);
+    BOOST_CHECK_EQUAL(sse2.query_end, avx2.query_end);
+    BOOST_CHECK_EQUAL(sse2.ref_end_next_best, avx2.ref_end_next_best);
+    BOOST_CHECK_EQUAL(sse2.cigar_string, avx2.cigar_string);
+  }
+  ssw_set_simd(SSW_SIMD_AUTO);
+}
+
+BOOST_AUTO_TEST_CASE ( ssw_align_to_record ) {
+
+  const std::string ref = "TTTTTTCAGCCTCACCCAGGAGGAGACTTGGAGCAGAGCCAGTGACCTGTTTCAGCTGCAGGAAGTAGTAGGACATAGCCTGTGCCAAAAAA";
+  StripedSmithWaterman::Aligner aligner;
+  StripedSmithWaterman::Filter filter;
+  StripedSmithWaterman::Alignment al;
+
+  // a mismatch and a 2bp deletion, placed in a window starting at 1000
+  std::string read = "CAGCCTCACCAAGGAGGAGACTTGGAGCAGAGCCAGTGACGTTTCAGCTGCAGGAAGTAG";
+  SeqLib::GenomicRegion gr(0, 0, 59);
+  SeqLib::BamRecord r("read", read, &gr, SeqLib::cigarFromString("60M"));
+  BOOST_CHECK(aligner.Align(&r, ref.c_str(), ref.size(), 1000));
+  aligner.Align(read.c_str(), ref.c_str(), ref.size(), filter, &al);
+  BOOST_CHECK_EQUAL(r.Position(), 1000 + al.ref_begin);
+  BOOST_CHECK_EQUAL(r.CigarString(), "40M2D20M");
+  BOOST_CHECK_EQUAL(r.GetIntTag("NM"), al.mismatches);
+  BOOST_CHECK_EQUAL(r.GetIntTag("AS"), al.sw_score);
+  BOOST_CHECK_EQUAL(r.Sequence(), read);
+
+  // recycle the record for a read with a soft clip, against a set reference
+  read = "GGGGG" + ref.substr(6, 40);
+  r.SetSequence(read);
+  aligner.SetReferenceSequence(ref.c_str(), ref.size());
+  BOOST_CHECK(aligner.Align(&r, 1000));
+  BOOST_CHECK_EQUAL(r.Position(), 1006);
+  BOOST_CHECK_EQUAL(r.CigarString(), "5S40M");
+  BOOST_CHECK_EQUAL(r.GetIntTag("NM"), 0);
+  BOOST_CHECK_EQUAL(r.GetIntTag("AS"), 80);
+  BOOST_CHECK_EQUAL(r.Sequence(), read);
+
+  // too low a score leaves the record as it was
+  filter.score_filter = 200;
+  BOOST_CHECK(!aligner.Align(&r, ref.c_str(), ref.size(), 0, filter));
+  BOOST_CHECK_EQUAL(r.Position(), 1006);
+  BOOST_CHECK_EQUAL(r.CigarString(), "5S40M");
+
+  // the cigar without the string
+  filter = StripedSmithWaterman::Filter(true, true, 0, 32767, false);
+  StripedSmithWaterman::Alignment no_string;
+  aligner.Align(read.c_str(), filter, &no_string);
+  aligner.Align(read.c_str(), StripedSmithWaterman::Filter(), &al);
+  BOOST_CHECK(no_string.cigar_string.empty());
+  BOOST_CHECK(no_string.cigar == al.cigar);
+  BOOST_CHECK_EQUAL(al.cigar_string, "5S40=");
+}
@@ -32,11 +32,63 @@ SOFTWARE.
 
 #include "SeqLib/BFC.h"
 
+#include "SeqLib/MappedFile.h"
+
 #include <stdexcept>
 #include <algorithm>
+#include <cstdio>
+
+// layout of the khash header behind each of the 2^l_pre count tables
+// (khash_t(cnt) in fermi-lite/htab.c, which keeps it private): four
+// khint_t counts, then the flags, keys and values arrays
+struct _BFCTableHeader {
+  uint32_t n_buckets, size, n_occupied, upper_bound;
+  uint32_t* flags;
+  uint64_t* keys;
+  char* vals;
+};
+
+// fixed cost of each count table, for fitting a memory budget: the
+// table's pointer in bfc_ch_t, its header, and the four buckets khash
+// allocates for the first key (a uint32_t of flags, plus a key and a
+// value per bucket), each of the four allocations with a malloc header
+#define BFC_TABLE_BYTES (sizeof(void*) + sizeof(_BFCTableHeader) + sizeof(uint32_t) + \
+			 4 * (sizeof(uint64_t) + sizeof(char)) + 4 * 2 * sizeof(size_t))
+
+// smallest k-mer SetMemoryBudget will lower the k-mer size to
+#define BFC_MIN_BUDGET_KMER 15
+
+// SaveCorrection file layout: header, one uint32_t length per read,
+// then one byte per base (BFC_FILE_HIGH_QUAL | index in "ACGTN")
+#define BFC_FILE_MAGIC "SEQLIBBC"
+#define BFC_FILE_VERSION 1
+#define BFC_FILE_BYTE_ORDER 0x01020304u
+#define BFC_FILE_HAS_QUAL 0x80000000u
+#define BFC_FILE_HIGH_QUAL 8
+#define BFC_MAX_FILE_KMER 63
 
 namespace SeqLib {
 
+  struct _BFCFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order; // BFC_FILE_BYTE_ORDER as written
+    int32_t k;
+    int32_t q; // quality cutoff for counting
+    uint64_t num_reads;
+    uint64_t num_bases;
+  };
+
+  static inline uint8_t _bfc_base_code(char c) {
+    switch (c) {
+    case 'A': case 'a': return 0;
+    case 'C': case 'c': return 1;
+    case 'G': case 'g': return 2;
+    case 'T': case 't': return 3;
+    default: return 4;
+    }
+  }
+
   bool BFC::AllocateMemory(size_t n) {
 
     if (n <= 0)
@@ -51,65 +103,73 @@ namespace SeqLib {
     return true;
   }
 
+  bool BFC::reserve(size_t n) {
+
+    if (n_seqs + n <= m_seqs_size)
+      return m_seqs != NULL;
+
+    m_seqs_size = std::max(n_seqs + n, m_seqs_size ? 2 * m_seqs_size : 32);
+    m_seqs = (fseq1_t*)realloc(m_seqs, m_seqs_size * sizeof(fseq1_t));
+    return m_seqs != NULL;
+  }
+
   bool BFC::AddSequence(const BamRecord& r) {
 
-    //char* s = strdup(r.Sequence().c_str());
-    const char* q = bam_get_qname(r.raw());
-    //uint8_t* l = bam_get_qual(r.raw());
-    //char* qual = (char*)malloc(r.Length() + 1);
-    //if (l)
-    //  for (size_t i = 0; i < r.Length(); ++i)
-    //	qual[i] = l[i] + 33;
-    //qual[r.Length()] = '\0';
+    const int32_t len = r.Length();
+    if (len <= 0)
+      return false;
+
+    if (!reserve(1))
+      return false;
+
+    // decode straight from the record into buffers fermi-lite can free
+    fseq1_t *s = &m_seqs[n_seqs];
+    s->seq = (char*)malloc(len + 1);
+    r.SequenceTo(s->seq);
+    s->qual = (char*)malloc(len + 1);
+    if (!r.QualitiesTo(s->qual)) {
+      free(s->qual);
+      s->qual = 0;
+    }
     
-    bool ret = AddSequence(r.Sequence().c_str(), r.Qualities().c_str(), q);
+    s->l_seq = len;
+    n_seqs++;
+
+    m_names.push_back(m_name_arena.Copy(bam_get_qname(r.raw())));
 
-    //if (s)
-    //  free(s);
-    //if (qual)
-    //  free(qual);
+    assert(m_names.size() == n_seqs);
 
-    return ret;
+    return true;
 
   }
 
   bool BFC::AddSequence(const char* seq, const char* qual, const char* name) {
 
-    // do the intial allocation
-    if (n_seqs == 0 && !m_seqs) {
-      m_seqs_size = 32;
-      m_seqs = (fseq1_t*)malloc(m_seqs_size * sizeof(fseq1_t));
-    }
-    // realloc if not enough space
-    else if (n_seqs >= m_seqs_size) {
-      m_seqs_size = 2 * m_seqs_size;
-      m_seqs = (fseq1_t*)realloc(m_seqs, m_seqs_size * sizeof(fseq1_t));
-    }
-
-    if (!m_seqs)
+    if (!reserve(1))
       return false;
 
     // make sure seq and qual are even valid (if qual provided)
-    if (strlen(qual) && seq && qual) 
-      if (strlen(seq) != strlen(qual))
-	return false;
-    if (!strlen(seq))
+    const size_t len = strlen(seq);
+    const size_t qlen = strlen(qual);
+    if (qlen && len != qlen)
+      return false;
+    if (!len)
       return false;
 
     fseq1_t *s;
     
     s = &m_seqs[n_seqs];
     
-    s->seq   = strdup(seq);
+    s->seq = strdup(seq);
     s->qual = 0;
-    if (strlen(qual)) {
-      s->qual  = strdup(qual);
+    if (qlen) {
+      s->qual = strdup(qual);
     }
     
-    s->l_seq = strlen(seq);
+    s->l_seq = len;
     n_seqs++;
     
-    m_names.push_back(strdup(name));
+    m_names.push_back(m_name_arena.Copy(name));
 
     assert(m_names.size() == n_seqs);
 
@@ -123,7 +183,7 @@ namespace SeqLib {
   }
 
   bool BFC::Train() {
-    learn_correct();
+    learn_correct(n_seqs, m_seqs);
     return true;
   }
 
@@ -136,7 +196,7 @@ namespace SeqLib {
     allocate_sequences_from_reads(brv);
 
     // learn how to correct
-    learn_correct();
+    learn_correct(n_seqs, m_seqs);
 
     // do the correction
     correct_reads();
@@ -152,7 +212,7 @@ namespace SeqLib {
     allocate_sequences_from_char(v);
 
     // learn correct, set ch
-    learn_correct();
+    learn_correct(n_seqs, m_seqs);
 
 
   }
@@ -166,7 +226,7 @@ namespace SeqLib {
     allocate_sequences_from_reads(brv);
 
     // learn correct, set ch
-    learn_correct();
+    learn_correct(n_seqs, m_seqs);
   }
 
   void BFC::ErrorCorrectToTag(BamRecordVector& brv, const std::string& tag) {
@@ -244,21 +304,19 @@ namespace SeqLib {
 
   void BFC::allocate_sequences_from_char(const std::vector<char*>& v) {
 
-    m_seqs_size = v.size();
-    m_seqs = (fseq1_t*)malloc(v.size() * sizeof(fseq1_t));
+    reserve(v.size());
     
-    uint64_t size = 0;
     for (std::vector<char*>::const_iterator r = v.begin(); r != v.end(); ++r) {
-    //    for (auto& r : v) {
       fseq1_t *s;
       
       s = &m_seqs[n_seqs];
       
+      s->l_seq = strlen(*r);
       s->seq   = strdup(*r);
       s->qual  = NULL; 
       
-      s->l_seq = strlen(*r);
-      size += m_seqs[n_seqs++].l_seq;
+      m_names.push_back(NULL);
+      ++n_seqs;
     }
     return;
 
@@ -267,24 +325,31 @@ namespace SeqLib {
   void BFC::allocate_sequences_from_reads(const BamRecordVector& brv) {
       
     // alloc the memory
-    m_seqs_size = brv.size();
-    m_seqs = (fseq1_t*)malloc(brv.size() * sizeof(fseq1_t));
+    reserve(brv.size());
     
-    uint64_t size = 0;
     for (BamRecordVector::const_iterator r = brv.begin(); r != brv.end(); ++r) {
-      //    for (auto& r : brv) {
-      m_names.push_back(strdup(r->Qname().c_str()));
+      m_names.push_back(m_name_arena.Copy(bam_get_qname(r->raw())));
 
       fseq1_t *s;
       
       s = &m_seqs[n_seqs];
 
-      std::string qs = r->QualitySequence();
-      s->seq   = strdup(qs.c_str());
-      s->qual  = strdup(r->Qualities().c_str());
+      // same as QualitySequence, but decoded in place
+      const int32_t len = r->Length();
+      uint8_t* gv = bam_aux_get(r->raw(), "GV");
+      const char* gvs = gv && *gv == 'Z' ? bam_aux2Z(gv) : NULL;
+      if (gvs && gvs[0]) {
+	s->l_seq = strlen(gvs);
+	s->seq = strdup(gvs);
+      } else {
+	s->l_seq = len;
+	s->seq = (char*)malloc(len + 1);
+	r->SequenceTo(s->seq);
+      }
+      s->qual = (char*)malloc(len + 1);
+      r->QualitiesTo(s->qual);
       
-      s->l_seq = qs.length();
-      size += m_seqs[n_seqs++].l_seq;
+      ++n_seqs;
     }
     return;
   }
@@ -299,8 +364,8 @@ namespace SeqLib {
   void BFC::clear() {
     
     assert(m_names.size() == n_seqs);
+
     for (size_t i = 0; i < n_seqs; ++i) {
-      free_char(m_names[i]);
       free_char(m_seqs[i].seq);
       free_char(m_seqs[i].qual);
     }
@@ -313,29 +378,59 @@ namespace SeqLib {
     m_names.clear();
     m_seqs_size = 0;
 
+    m_name_arena.Clear();
+
   }
 
-  void BFC::learn_correct() {
+  void BFC::SetNumThreads(int n) {
+    if (n < 1)
+      throw std::invalid_argument("BFC::SetNumThreads - need at least one thread");
+    bfc_opt.n_threads = n;
+  }
+
+  void BFC::fit_memory_budget() {
+
+    int l = bfc_opt.l_pre;
+    while (l > 1 && ((uint64_t)BFC_TABLE_BYTES << l) > m_mem_budget / 8)
+      --l;
+
+    // the k-mer bits past the prefix have to fit in a key. Only this
+    // training's k is lowered, kmer keeps the size that was asked for
+    int k = bfc_opt.k;
+    while (k > BFC_MIN_BUDGET_KMER && 2 * k - l > BFC_CH_KEYBITS)
+      --k;
+    if (2 * k - l > BFC_CH_KEYBITS)
+      l = 2 * k - BFC_CH_KEYBITS;
+
+    bfc_opt.k = k;
+    bfc_opt.l_pre = l;
+  }
+
+  void BFC::learn_correct(size_t n, fseq1_t* seqs) {
     
+    PhaseTimer t("count", m_track_phases ? &m_phases : NULL, m_reset_peak);
+    m_frozen = false;
+
     // options
     fml_opt_init(&fml_opt);
     
     // if kmer is 0, fix 
     if (kmer <= 0) {
-      fml_opt_adjust(&fml_opt, n_seqs, m_seqs);
+      fml_opt_adjust(&fml_opt, n, seqs);
       kmer = fml_opt.ec_k;
     }
 
     // initialize BFC options
-    for (size_t i = 0; i < n_seqs; ++i) 
-      tot_len += m_seqs[i].l_seq; // compute total length
+    tot_len = 0;
+    for (size_t i = 0; i < n; ++i) 
+      tot_len += seqs[i].l_seq; // compute total length
     bfc_opt.l_pre = tot_len - 8 < 20? tot_len - 8 : 20;
+    bfc_opt.k = kmer;
+    if (m_mem_budget)
+      fit_memory_budget();
     
     //  setup the counting of kmers
     memset(&es, 0, sizeof(ec_step_t));
-    //kmer is learned before this
-    
-    bfc_opt.k = kmer;
     
     //es.opt = &bfc_opt, es.n_seqs = n_seqs, es.seqs = m_seqs, es.flt_uniq = flt_uniq;
     
@@ -348,7 +443,9 @@ namespace SeqLib {
     // bfc_ch_t *ch; // set in BFC.h
     
     // do the counting
-    ch = fml_count(n_seqs, m_seqs, bfc_opt.k, bfc_opt.q, bfc_opt.l_pre, bfc_opt.n_threads);
+    if (ch)
+      bfc_ch_destroy(ch);
+    ch = fml_count(n, seqs, bfc_opt.k, bfc_opt.q, bfc_opt.l_pre, bfc_opt.n_threads);
 
 #ifdef DEBUG_BFC
     // size of random hash value
@@ -360,22 +457,18 @@ namespace SeqLib {
       fprintf(stderr, "K: %d S: %d\n", i, ksize[i]);
     }
 #endif
+
+    set_coverage();
   }
 
-  void BFC::correct_reads() {
-    
-    assert(kmer > 0);
-
-    es.ch = ch;
-    es.opt = &bfc_opt;
-    es.n_seqs = n_seqs;
-    es.seqs = m_seqs;
-    es.flt_uniq = flt_uniq;
+  void BFC::set_coverage() {
 
     // make the histogram?
-    // es.ch is unchanged (const)
-    int mode = bfc_ch_hist(es.ch, hist, hist_high);
+    // ch is unchanged (const)
+    int mode = bfc_ch_hist(ch, hist, hist_high);
 
+    sum_k = 0;
+    tot_k = 0;
     for (int i = fml_opt.min_cnt; i < 256; ++i) 
       sum_k += hist[i], tot_k += i * hist[i];    
 
@@ -394,17 +487,269 @@ namespace SeqLib {
     bfc_opt.min_cov = (int)(BFC_EC_MIN_COV_COEF * kcov + .499);
     bfc_opt.min_cov = bfc_opt.min_cov < fml_opt.max_cnt? bfc_opt.min_cov : fml_opt.max_cnt;
     bfc_opt.min_cov = bfc_opt.min_cov > fml_opt.min_cnt? bfc_opt.min_cov : fml_opt.min_cnt;
+    m_mode = mode;
 
 #ifdef DEBUG_BFC
     fprintf(stderr, "kcov: %f mincov: %d  mode %d \n", kcov, bfc_opt.min_cov, mode);  
 #endif
-  
+  }
+
+  void BFC::correct_reads() {
+    
+    assert(kmer > 0);
+
+    PhaseTimer t("correct", m_track_phases ? &m_phases : NULL, m_reset_peak);
+
+    es.ch = ch;
+    es.opt = &bfc_opt;
+    es.n_seqs = n_seqs;
+    es.seqs = m_seqs;
+    es.flt_uniq = flt_uniq;
+
     // do the actual error correction
-    kmer_correct(&es, mode, ch);
+    kmer_correct(&es, m_mode, ch);
 
     return;
 
 
+  }
+
+  void BFC::AddTrainingReads(const BamRecordVector& brv) {
+
+    m_frozen = false;
+    m_train.reserve(m_train.size() + brv.size());
+    for (BamRecordVector::const_iterator r = brv.begin(); r != brv.end(); ++r) {
+      const int32_t len = r->Length();
+      if (len <= 0)
+	continue;
+      fseq1_t s;
+      s.l_seq = len;
+      s.seq = m_train_arena.Alloc(len + 1);
+      r->SequenceTo(s.seq);
+      s.qual = m_train_arena.Alloc(len + 1);
+      if (!r->QualitiesTo(s.qual))
+	s.qual = NULL;
+      m_train.push_back(s);
+    }
+  }
+
+  void BFC::AddTrainingReads(const UnalignedSequenceVector& v) {
+
+    m_frozen = false;
+    m_train.reserve(m_train.size() + v.size());
+    for (UnalignedSequenceVector::const_iterator r = v.begin(); r != v.end(); ++r) {
+      if (r->Seq.empty())
+	continue;
+      fseq1_t s;
+      s.l_seq = r->Seq.length();
+      s.seq = m_train_arena.Copy(r->Seq.c_str(), r->Seq.length());
+      s.qual = r->Qual.length() == r->Seq.length() ? m_train_arena.Copy(r->Qual.c_str(), r->Qual.length()) : NULL;
+      m_train.push_back(s);
+    }
+  }
+
+  void BFC::FreezeCorrection() {
+    if (m_train.empty())
+      throw std::runtime_error("BFC::FreezeCorrection - no training reads");
+    learn_correct(m_train.size(), &m_train[0]);
+    m_frozen = true;
+  }
+
+  void BFC::ClearTraining() {
+    m_frozen = false;
+    std::vector<fseq1_t>().swap(m_train);
+    m_train_arena.Release();
+  }
+
+  bool BFC::SaveCorrection(const std::string& file) const {
+
+    if (!m_frozen) {
+      std::cerr << "BFC::SaveCorrection - nothing to save, call FreezeCorrection first" << std::endl;
+      return false;
+    }
+
+    _BFCFileHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, BFC_FILE_MAGIC, 8);
+    h.version = BFC_FILE_VERSION;
+    h.byte_order = BFC_FILE_BYTE_ORDER;
+    h.k = bfc_opt.k;
+    h.q = bfc_opt.q;
+    h.num_reads = m_train.size();
+
+    // lengths, with the top bit set for reads with qualities, then bases
+    std::vector<uint32_t> lens(m_train.size());
+    for (size_t i = 0; i < m_train.size(); ++i) {
+      lens[i] = m_train[i].l_seq | (m_train[i].qual ? BFC_FILE_HAS_QUAL : 0);
+      h.num_bases += m_train[i].l_seq;
+    }
+    std::vector<uint8_t> bases;
+    bases.reserve(h.num_bases);
+    for (size_t i = 0; i < m_train.size(); ++i) {
+      const fseq1_t& s = m_train[i];
+      for (int j = 0; j < s.l_seq; ++j) {
+	uint8_t c = _bfc_base_code(s.seq[j]);
+	if (s.qual && s.qual[j] - 33 >= bfc_opt.q)
+	  c |= BFC_FILE_HIGH_QUAL;
+	bases.push_back(c);
+      }
+    }
+
+    const std::string tmp = file + ".tmp";
+    FILE* fp = fopen(tmp.c_str(), "wb");
+    if (!fp) {
+      std::cerr << "BFC table file not writable: " << file << std::endl;
+      return false;
+    }
+    bool ok = fwrite(&h, sizeof(h), 1, fp) == 1;
+    if (ok && !lens.empty())
+      ok = fwrite(&lens[0], sizeof(uint32_t), lens.size(), fp) == lens.size();
+    if (ok && !bases.empty())
+      ok = fwrite(&bases[0], 1, bases.size(), fp) == bases.size();
+    ok = (fclose(fp) == 0) && ok;
+    if (ok)
+      ok = rename(tmp.c_str(), file.c_str()) == 0;
+    if (!ok) {
+      remove(tmp.c_str());
+      std::cerr << "BFC table file not writable: " << file << std::endl;
+    }
+    return ok;
+  }
+
+  bool BFC::LoadCorrection(const std::string& file) {
+
+    MappedFile map;
+    if (!map.Open(file)) {
+      std::cerr << "BFC table file not readable: " << file << std::endl;
+      return false;
+    }
+
+    // check the layout before touching the table
+    const char* d = map.data();
+    const size_t sz = map.size();
+    _BFCFileHeader h;
+    bool ok = sz >= sizeof(h);
+    if (ok) {
+      memcpy(&h, d, sizeof(h));
+      ok = !memcmp(h.magic, BFC_FILE_MAGIC, 8) && h.version == BFC_FILE_VERSION &&
+	h.byte_order == BFC_FILE_BYTE_ORDER && h.k > 0 && h.k <= BFC_MAX_FILE_KMER &&
+	h.q > 0 && h.q < 94 && h.num_reads && h.num_reads <= sz && h.num_bases <= sz;
+    }
+    if (ok)
+      ok = sizeof(h) + h.num_reads * sizeof(uint32_t) + h.num_bases == sz;
+    const uint8_t* bases = NULL;
+    std::vector<uint32_t> lens;
+    if (ok) {
+      lens.resize(h.num_reads);
+      memcpy(&lens[0], d + sizeof(h), h.num_reads * sizeof(uint32_t));
+      bases = reinterpret_cast<const uint8_t*>(d + sizeof(h) + h.num_reads * sizeof(uint32_t));
+      uint64_t n = 0;
+      for (size_t i = 0; i < lens.size(); ++i)
+	n += lens[i] & ~BFC_FILE_HAS_QUAL;
+      ok = n == h.num_bases;
+    }
+    if (!ok) {
+      std::cerr << "Not a valid BFC table file: " << file << std::endl;
+      return false;
+    }
+
+    ClearTraining();
+    m_train.resize(h.num_reads);
+    const char high = 33 + h.q, low = 33;
+    for (size_t i = 0; i < lens.size(); ++i) {
+      fseq1_t& s = m_train[i];
+      s.l_seq = lens[i] & ~BFC_FILE_HAS_QUAL;
+      s.seq = m_train_arena.Alloc(s.l_seq + 1);
+      s.qual = (lens[i] & BFC_FILE_HAS_QUAL) ? m_train_arena.Alloc(s.l_seq + 1) : NULL;
+      for (int j = 0; j < s.l_seq; ++j, ++bases) {
+	s.seq[j] = "ACGTN"[*bases & 7];
+	if (s.qual)
+	  s.qual[j] = (*bases & BFC_FILE_HIGH_QUAL) ? high : low;
+      }
+      s.seq[s.l_seq] = '\0';
+      if (s.qual)
+	s.qual[s.l_seq] = '\0';
+    }
+
+    kmer = h.k;
+    bfc_opt.q = h.q;
+    FreezeCorrection();
+    return true;
+  }
+
+  void BFC::correct_batch(std::vector<fseq1_t>& seqs) const {
+
+    if (!ch)
+      throw std::runtime_error("BFC::CorrectBatch - no table, train or load one first");
+    if (seqs.empty())
+      return;
+
+    // ch and bfc_opt are only read, so batches can run side by side
+    ec_step_t e;
+    memset(&e, 0, sizeof(ec_step_t));
+    e.ch = ch;
+    e.opt = &bfc_opt;
+    e.n_seqs = seqs.size();
+    e.seqs = &seqs[0];
+    e.flt_uniq = 0;
+    kmer_correct(&e, m_mode, ch);
+  }
+
+  void BFC::CorrectBatch(UnalignedSequenceVector& v) const {
+
+    ReadArena a;
+    std::vector<fseq1_t> seqs;
+    std::vector<size_t> idx;
+    seqs.reserve(v.size());
+    for (size_t i = 0; i < v.size(); ++i) {
+      const UnalignedSequence& r = v[i];
+      if (r.Seq.empty())
+	continue;
+      fseq1_t s;
+      s.l_seq = r.Seq.length();
+      s.seq = a.Copy(r.Seq.c_str(), r.Seq.length());
+      s.qual = r.Qual.length() == r.Seq.length() ? a.Copy(r.Qual.c_str(), r.Qual.length()) : NULL;
+      seqs.push_back(s);
+      idx.push_back(i);
+    }
+
+    correct_batch(seqs);
+
+    for (size_t k = 0; k < seqs.size(); ++k) {
+      std::string str = std::string(seqs[k].seq);
+      std::transform(str.begin(), str.end(),str.begin(), ::toupper);
+      v[idx[k]].Seq = str;
+    }
+  }
+
+  void BFC::CorrectBatch(BamRecordVector& brv) const {
+
+    ReadArena a;
+    std::vector<fseq1_t> seqs;
+    std::vector<size_t> idx;
+    seqs.reserve(brv.size());
+    for (size_t i = 0; i < brv.size(); ++i) {
+      const int32_t len = brv[i].Length();
+      if (len <= 0)
+	continue;
+      fseq1_t s;
+      s.l_seq = len;
+      s.seq = a.Alloc(len + 1);
+      brv[i].SequenceTo(s.seq);
+      s.qual = a.Alloc(len + 1);
+      if (!brv[i].QualitiesTo(s.qual))
+	s.qual = NULL;
+      seqs.push_back(s);
+      idx.push_back(i);
+    }
+
+    correct_batch(seqs);
+
+    for (size_t k = 0; k < seqs.size(); ++k) {
+      std::string str = std::string(seqs[k].seq);
+      std::transform(str.begin(), str.end(),str.begin(), ::toupper);
+      brv[idx[k]].SetSequence(str);
+    }
   }
 
     void BFC::FilterUnique() {
@@ -0,0 +1,148 @@
+#include "SeqLib/BFCStream.h"
+#include "SeqLib/SeqLibThreads.h"
+
+#include <stdexcept>
+#include <iomanip>
+
+namespace SeqLib {
+
+  static bool next_read(BamReader& r, BamRecord& rec) {
+    return r.GetNextRecord(rec);
+  }
+
+  static bool next_read(FastqReader& r, UnalignedSequence& s) {
+    return r.GetNextSequence(s);
+  }
+
+  static bool write_read(BamWriter& w, const BamRecord& r) {
+    return w.WriteRecord(r);
+  }
+
+  static bool write_read(std::ostream& out, const UnalignedSequence& s) {
+    if (s.Qual.empty())
+      out << ">" << s.Name << "\n" << s.Seq << "\n";
+    else
+      out << "@" << s.Name << "\n" << s.Seq << "\n+\n" << s.Qual << "\n";
+    return out.good();
+  }
+
+  // the read and correct stages, run on chunks of consecutive reads
+  template <class R, class V>
+  struct _BFCStreamStages {
+
+    _BFCStreamStages() : reader(NULL), bfc(NULL), chunk_size(0), done(false), reads_in(0) {}
+
+    R* reader;
+    const BFC* bfc;
+    size_t chunk_size;
+    bool done;
+    uint64_t reads_in;
+
+    V* Read() {
+      if (done)
+	return NULL;
+      V* c = new V;
+      c->reserve(chunk_size);
+      typename V::value_type rec;
+      while (c->size() < chunk_size && next_read(*reader, rec))
+	c->push_back(rec);
+      reads_in += c->size();
+      done = c->size() < chunk_size;
+      if (c->empty()) {
+	delete c;
+	return NULL;
+      }
+      return c;
+    }
+
+    void Work(V* c, int) {
+      bfc->CorrectBatch(*c);
+    }
+
+  };
+
+  // run the three stages, writing on the calling thread
+  template <class R, class V, class W>
+  static bool run_stream(R& r, W& w, const BFC* bfc, int threads, size_t chunk_size,
+			 size_t queue_size, BFCStreamStats& stats) {
+
+    if (!bfc->HasTable())
+      throw std::runtime_error("BFCStream::Run - no table, train or load one first");
+
+    stats = BFCStreamStats();
+    double start = WallTime();
+
+    _BFCStreamStages<R, V> stages;
+    stages.reader = &r;
+    stages.bfc = bfc;
+    stages.chunk_size = chunk_size;
+
+    OrderedPipeline<V, _BFCStreamStages<R, V> > pipe(stages, threads, queue_size);
+    pipe.Start();
+
+    // write in input order
+    bool ok = true;
+    V* c;
+    while (ok && pipe.Next(c)) {
+      double t0 = WallTime();
+      for (typename V::const_iterator rr = c->begin(); ok && rr != c->end(); ++rr)
+	ok = write_read(w, *rr);
+      stats.write_time += WallTime() - t0;
+      if (ok)
+	stats.reads_out += c->size();
+      ++stats.chunks;
+    }
+    pipe.Stop();
+
+    stats.reads_in = stages.reads_in;
+    stats.max_chunks_in_flight = pipe.PeakInFlight();
+    stats.read_time = pipe.ReadTime();
+    stats.correct_time = pipe.WorkTime();
+    stats.wall_time = WallTime() - start;
+    stats.correct_queue_max = pipe.WorkQueue().MaxOccupancy();
+    stats.correct_queue_mean = pipe.WorkQueue().MeanOccupancy();
+
+    return ok;
+  }
+
+  void BFCStream::SetNumThreads(int n) {
+    if (n < 1)
+      throw std::invalid_argument("BFCStream::SetNumThreads - need at least one thread");
+    m_threads = n;
+  }
+
+  void BFCStream::SetChunkSize(size_t n) {
+    if (!n)
+      throw std::invalid_argument("BFCStream::SetChunkSize - chunk size must be > 0");
+    m_chunk_size = n;
+  }
+
+  void BFCStream::SetQueueSize(size_t n) {
+    if (!n)
+      throw std::invalid_argument("BFCStream::SetQueueSize - queue size must be > 0");
+    m_queue_size = n;
+  }
+
+  bool BFCStream::Run(BamReader& r, BamWriter& w) {
+    return run_stream<BamReader, BamRecordVector>(r, w, m_bfc, m_threads, m_chunk_size, m_queue_size, m_stats);
+  }
+
+  bool BFCStream::Run(FastqReader& r, std::ostream& out) {
+    return run_stream<FastqReader, UnalignedSequenceVector>(r, out, m_bfc, m_threads, m_chunk_size, m_queue_size, m_stats);
+  }
+
+  std::ostream& operator<<(std::ostream& out, const BFCStreamStats& s) {
+    out << std::fixed << std::setprecision(2)
+	<< "read:    " << AddCommas(s.reads_in) << " reads in " << s.read_time << "s ("
+	<< AddCommas((uint64_t)PerSecond(s.reads_in, s.read_time)) << " reads/s)" << std::endl
+	<< "correct: " << AddCommas(s.reads_in) << " reads in " << s.correct_time << "s of thread time ("
+	<< AddCommas((uint64_t)PerSecond(s.reads_in, s.correct_time)) << " reads/s/thread)"
+	<< " queue max " << s.correct_queue_max << " mean " << s.correct_queue_mean << std::endl
+	<< "write:   " << AddCommas(s.reads_out) << " reads in " << s.write_time << "s ("
+	<< AddCommas((uint64_t)PerSecond(s.reads_out, s.write_time)) << " reads/s)" << std::endl
+	<< "total:   " << AddCommas(s.chunks) << " chunks in " << s.wall_time << "s wall, at most "
+	<< s.max_chunks_in_flight << " in memory";
+    return out;
+  }
+
+}
@@ -4,6 +4,7 @@
 #include <sstream>
 #include <stdexcept>
 #include <iostream>
+#include <cstring>
 
 #include "htslib/khash.h"
 
@@ -75,25 +76,66 @@ BamHeader::BamHeader(const std::string& hdr)  {
 
   }
 
+  // FNV-1a hash of a sequence name
+  static inline uint32_t name_hash(const char* s, size_t len) {
+    uint32_t hh = 2166136261u;
+    for (size_t i = 0; i < len; ++i)
+      hh = (hh ^ (unsigned char)s[i]) * 16777619u;
+    return hh;
+  }
+
   void BamHeader::ConstructName2IDTable() {
 
     // create the lookup table if not already made
-    if (!n2i) {
-      n2i = SeqPointer<SeqHashMap<std::string, int> >(new SeqHashMap<std::string, int>());
-      for (int i = 0; i < h->n_targets; ++i)
-	n2i->insert(std::pair<std::string, int>(std::string(h->target_name[i]), i));
+    if (!n2i && h) {
+
+      // at most half full, power of 2 size
+      size_t cap = 16;
+      while (cap < 2 * (size_t)h->n_targets)
+	cap <<= 1;
+      NameSlot empty;
+      empty.hash = 0;
+      empty.id = -1;
+      n2i = SeqPointer<std::vector<NameSlot> >(new std::vector<NameSlot>(cap, empty));
+
+      for (int i = 0; i < h->n_targets; ++i) {
+	size_t len = strlen(h->target_name[i]);
+	if (Name2ID(h->target_name[i], len) >= 0)
+	  continue; // keep the first of a repeated name
+	uint32_t hh = name_hash(h->target_name[i], len);
+	size_t k = hh & (cap - 1);
+	while ((*n2i)[k].id >= 0)
+	  k = (k + 1) & (cap - 1);
+	(*n2i)[k].hash = hh;
+	(*n2i)[k].id = i;
+      }
     }
 
   }
 
   int BamHeader::Name2ID(const std::string& name) const {
+    return Name2ID(name.data(), name.length());
+  }
 
-    SeqHashMap<std::string, int>::const_iterator ff = n2i->find(name);
-    if (ff != n2i->end())
-      return ff->second;
-    else
+  int BamHeader::Name2ID(const char* name, size_t len) const {
+
+    if (!n2i)
       return -1;
 
+    const std::vector<NameSlot>& tab = *n2i;
+    const size_t mask = tab.size() - 1;
+    uint32_t hh = name_hash(name, len);
+    for (size_t k = hh & mask; tab[k].id >= 0; k = (k + 1) & mask)
+      if (tab[k].hash == hh) {
+	const char* t = h->target_name[tab[k].id];
+	size_t j = 0;
+	while (j < len && t[j] && t[j] == name[j])
+	  ++j;
+	if (j == len && !t[len])
+	  return tab[k].id;
+      }
+    return -1;
+
   }
 
 bam_hdr_t* BamHeader::sam_hdr_read2(const std::string& hdr) const {
@@ -6,6 +6,8 @@
 #include <stdexcept>
 
 #include "SeqLib/ssw_cpp.h"
+#include "SeqLib/RadixSort.h"
+#include "SeqLib/SeqLibThreads.h"
 
 #define TAG_DELIMITER "^"
 #define CTAG_DELIMITER '^'
@@ -64,6 +66,20 @@ namespace SeqLib {
     
   }
 
+  void BamRecord::SequenceTo(char* out) const {
+    // two bases per byte
+    const uint8_t * p = bam_get_seq(b);
+    const int32_t n = b->core.l_qseq;
+    int32_t i = 0;
+    for (; i + 1 < n; i += 2) {
+      out[i] = BASES[p[i >> 1] >> 4];
+      out[i + 1] = BASES[p[i >> 1] & 0xf];
+    }
+    if (i < n)
+      out[i] = BASES[p[i >> 1] >> 4];
+    out[n] = '\0';
+  }
+
   void BamRecord::SetCigar(const Cigar& c) {
 
     // case where they are equal, just swap them out
@@ -113,6 +129,28 @@ namespace SeqLib {
     free(new_cig);
   }
 
+  void BamRecord::SetCigar(const uint32_t* cigar, size_t n) {
+
+    const int old_len = b->core.n_cigar<<2;
+    const int new_len = n<<2;
+
+    // move the seq, qual and aux data to just past the new cigar
+    if (new_len != old_len) {
+      const int old_seqaux_spot = b->core.l_qname + old_len;
+      const int seqaux_len = b->l_data - old_seqaux_spot;
+      const int new_size = b->l_data - old_len + new_len;
+      if (new_size > (int)b->m_data) {
+	b->data = (uint8_t*)realloc(b->data, new_size);
+	b->m_data = new_size;
+      }
+      memmove(b->data + b->core.l_qname + new_len, b->data + old_seqaux_spot, seqaux_len);
+      b->l_data = new_size;
+      b->core.n_cigar = n;
+    }
+
+    memcpy(bam_get_cigar(b), cigar, new_len);
+  }
+
   BamRecord::BamRecord(const std::string& name, const std::string& seq, const std::string& ref, const GenomicRegion * gr) {
 
     StripedSmithWaterman::Aligner aligner;
@@ -615,7 +653,7 @@ namespace SeqLib {
 
     Cigar tc;
 
-    // get the ops (MIDSHPN)
+    // get the ops (MIDSHPN=X)
     std::vector<char> ops;
     for (size_t i = 0; i < cig.length(); ++i)
       if (!isdigit(cig.at(i))) {
@@ -624,7 +662,7 @@ namespace SeqLib {
     
     std::size_t prev = 0, pos;
     std::vector<std::string> lens;
-    while ((pos = cig.find_first_of("MIDSHPNX", prev)) != std::string::npos) {
+    while ((pos = cig.find_first_of("MIDSHPN=X", prev)) != std::string::npos) {
         if (pos > prev)
 	  lens.push_back(cig.substr(prev, pos-prev));
         prev = pos+1;
@@ -684,4 +722,68 @@ namespace SeqLib {
   }
 
   
+  // pull the sort keys for the reads in [begin, end)
+  struct _ReadKeyTask {
+    const BamRecordVector* reads;
+    uint64_t* keys;
+    size_t begin;
+    size_t end;
+    bool mate;
+
+    void operator()() {
+      for (size_t i = begin; i < end; ++i) {
+	const BamRecord& r = (*reads)[i];
+	keys[i] = mate ? CoordinateKey(r.MateChrID(), r.MatePosition()) : CoordinateKey(r.ChrID(), r.Position());
+      }
+    }
+  };
+
+  static void sort_reads(BamRecordVector& reads, int num_threads, bool mate) {
+
+    if (num_threads < 1)
+      throw std::invalid_argument("BamRecordSort - need at least one thread");
+    const size_t n = reads.size();
+    if (n > 0xFFFFFFFFul)
+      throw std::length_error("BamRecordSort - too many reads to sort");
+    if (n < 2)
+      return;
+
+    std::vector<uint64_t> keys(n);
+    size_t nt = std::min((size_t)num_threads, n);
+    std::vector<_ReadKeyTask> tasks(nt);
+    for (size_t t = 0; t < nt; ++t) {
+      tasks[t].reads = &reads;
+      tasks[t].keys = &keys[0];
+      tasks[t].begin = n * t / nt;
+      tasks[t].end = n * (t + 1) / nt;
+      tasks[t].mate = mate;
+    }
+    RunThreads(tasks);
+
+    std::vector<uint32_t> order(n);
+    for (size_t i = 0; i < n; ++i)
+      order[i] = i;
+    RadixSort(keys, order, num_threads);
+    std::vector<uint64_t>().swap(keys);
+
+    // reads only share their data, so this just moves pointers
+    BamRecordVector sorted;
+    sorted.reserve(n);
+    for (size_t i = 0; i < n; ++i)
+      sorted.push_back(reads[order[i]]);
+    reads.swap(sorted);
+  }
+
+  namespace BamRecordSort {
+
+    void SortByPosition(BamRecordVector& reads, int num_threads) {
+      sort_reads(reads, num_threads, false);
+    }
+
+    void SortByMatePosition(BamRecordVector& reads, int num_threads) {
+      sort_reads(reads, num_threads, true);
+    }
+
+  }
+
 }
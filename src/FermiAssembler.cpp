@@ -1,9 +1,13 @@
 #include "SeqLib/FermiAssembler.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
 #define MAG_MIN_NSR_COEF .1
 
 namespace SeqLib {
 
-  FermiAssembler::FermiAssembler()  : m_seqs(0), m(0), size(0), n_seqs(0), n_utg(0), m_utgs(0)  {
+  FermiAssembler::FermiAssembler()  : m_seqs(0), m(0), size(0), n_seqs(0), n_utg(0), m_utgs(0), m_track_phases(false), m_reset_peak(false)  {
     fml_opt_init(&opt);
   }
   
@@ -27,8 +31,34 @@ namespace SeqLib {
     m_utgs = fml_mag2utg(g, &n_utg);
   }
 
+  void FermiAssembler::reserve(size_t n) {
+    if (n_seqs + n <= m)
+      return;
+    m = std::max(n_seqs + n, m * 2);
+    m_seqs = (fseq1_t*)realloc(m_seqs, m * sizeof(fseq1_t));
+  }
+
   void FermiAssembler::AddRead(const BamRecord& r) {
-    AddRead(UnalignedSequence(r.Qname(), r.Sequence(), r.Qualities())); // probably faster way
+
+    const int32_t len = r.Length();
+    if (len <= 0)
+      return;
+    const char* name = bam_get_qname(r.raw());
+    if (!name[0])
+      return;
+
+    reserve(1);
+    m_names.push_back(m_name_arena.Copy(name));
+
+    // decode straight into buffers fermi-lite can take over
+    fseq1_t *s = &m_seqs[n_seqs];
+    s->seq = (char*)malloc(len + 1);
+    r.SequenceTo(s->seq);
+    s->qual = (char*)malloc(len + 1);
+    r.QualitiesTo(s->qual);
+
+    s->l_seq = len;
+    size += m_seqs[n_seqs++].l_seq;
   }
 
   void FermiAssembler::AddRead(const UnalignedSequence& r) {
@@ -38,66 +68,27 @@ namespace SeqLib {
     if (r.Name.empty())
       return;
 
-    // dynamically alloc the memory
-    if (m <= n_seqs)
-      m = m <= 0 ? 32 : (m*2); // if out of mem, double it
-    m_seqs = (fseq1_t*)realloc(m_seqs, m * sizeof(fseq1_t));
-    
-    // add the name
-    m_names.push_back(r.Name);
-
-    // construct the seq
-    fseq1_t *s;
-    s = &m_seqs[n_seqs];
-    s->seq   = strdup(r.Seq.c_str());
-    s->qual  = strdup(r.Qual.c_str());
-    
+    reserve(1);
+    m_names.push_back(m_name_arena.Copy(r.Name.c_str(), r.Name.length()));
+
+    fseq1_t *s = &m_seqs[n_seqs];
+    s->seq = strdup(r.Seq.c_str());
+    s->qual = strdup(r.Qual.c_str());
+
     s->l_seq = r.Seq.length();
     size += m_seqs[n_seqs++].l_seq;
-
   }
   
   void FermiAssembler::AddReads(const UnalignedSequenceVector& v) {
-
-    // alloc the memory
-    m = n_seqs + v.size();
-    m_seqs = (fseq1_t*)realloc(m_seqs, m * sizeof(fseq1_t));
-
-    for (UnalignedSequenceVector::const_iterator r = v.begin(); r != v.end(); ++r) {
-      m_names.push_back(r->Name);
-      fseq1_t *s;
-
-      s = &m_seqs[n_seqs];
-
-      s->seq   = strdup(r->Seq.c_str());
-      s->qual  = strdup(r->Qual.c_str());
-
-      s->l_seq = r->Seq.length();
-      size += m_seqs[n_seqs++].l_seq;
-    }
-
-
+    reserve(v.size());
+    for (UnalignedSequenceVector::const_iterator r = v.begin(); r != v.end(); ++r)
+      AddRead(*r);
   }
-  void FermiAssembler::AddReads(const BamRecordVector& brv) {
 
-    // alloc the memory
-    m_seqs = (fseq1_t*)realloc(m_seqs, (n_seqs + brv.size()) * sizeof(fseq1_t));
-
-    int m = 0;
-    uint64_t size = 0;
-    for (BamRecordVector::const_iterator r = brv.begin(); r != brv.end(); ++r) {
-      m_names.push_back(r->Qname());
-      fseq1_t *s;
-      
-      s = &m_seqs[n_seqs];
-      
-      s->seq   = strdup(r->Sequence().c_str());
-      s->qual  = strdup(r->Qualities().c_str());
-
-      s->l_seq = r->Sequence().length();
-      size += m_seqs[n_seqs++].l_seq;
-    }
-    
+  void FermiAssembler::AddReads(const BamRecordVector& brv) {
+    reserve(brv.size());
+    for (BamRecordVector::const_iterator r = brv.begin(); r != brv.end(); ++r)
+      AddRead(*r);
   }
 
   void FermiAssembler::ClearContigs() {
@@ -107,13 +98,11 @@ namespace SeqLib {
   }
 
   void FermiAssembler::ClearReads() {  
-    if (!m_seqs)
-      return; //already cleared
 
     for (size_t i = 0; i < n_seqs; ++i) {
       fseq1_t * s = &m_seqs[i];
       if (s->qual)
-       free(s->qual); 
+	free(s->qual); 
       s->qual = NULL;
       if (s->seq)
 	free(s->seq);
@@ -121,19 +110,59 @@ namespace SeqLib {
     }
     free(m_seqs);
     m_seqs = NULL;
-      
+    m = 0;
+    n_seqs = 0;
+    size = 0;
+
+    m_names.clear();
+    m_phases.clear();
+    m_name_arena.Clear();
   }
 
   void FermiAssembler::CorrectReads() {  
+    PhaseTimer t("correct", m_track_phases ? &m_phases : NULL, m_reset_peak);
     fml_correct(&opt, n_seqs, m_seqs);
   }
 
   void FermiAssembler::CorrectAndFilterReads() {  
+    PhaseTimer t("filter", m_track_phases ? &m_phases : NULL, m_reset_peak);
     fml_fltuniq(&opt, n_seqs, m_seqs);
   }
 
+  void FermiAssembler::SetNumThreads(int n) {
+    if (n < 1)
+      throw std::invalid_argument("FermiAssembler::SetNumThreads - need at least one thread");
+    opt.n_threads = n;
+  }
+
+  // same steps as fml_assemble in fermi-lite/misc.c, timed one by one
   void FermiAssembler::PerformAssembly() {
-    m_utgs = fml_assemble(&opt, n_seqs, m_seqs, &n_utg); // assemble!
+
+    PhaseStatsVector* phases = m_track_phases ? &m_phases : NULL;
+    fml_opt_t o = opt;
+    fml_opt_adjust(&o, n_seqs, m_seqs);
+
+    if (o.ec_k >= 0) {
+      PhaseTimer t("correct", phases, m_reset_peak);
+      fml_correct(&o, n_seqs, m_seqs);
+    }
+
+    PhaseTimer tf("filter", phases, m_reset_peak);
+    float kcov = fml_fltuniq(&o, n_seqs, m_seqs);
+    tf.Stop();
+
+    PhaseTimer ti("index", phases, m_reset_peak);
+    rld_t *e = fml_seq2fmi(&o, n_seqs, m_seqs);
+    ti.Stop();
+
+    PhaseTimer tg("graph", phases, m_reset_peak);
+    mag_t *g = fml_fmi2mag(&o, e);
+    o.mag_opt.min_ensr = o.mag_opt.min_ensr > kcov * MAG_MIN_NSR_COEF? o.mag_opt.min_ensr : (int)(kcov * MAG_MIN_NSR_COEF + .499);
+    o.mag_opt.min_ensr = o.mag_opt.min_ensr < opt.max_cnt? o.mag_opt.min_ensr : opt.max_cnt;
+    o.mag_opt.min_ensr = o.mag_opt.min_ensr > opt.min_cnt? o.mag_opt.min_ensr : opt.min_cnt;
+    o.mag_opt.min_insr = o.mag_opt.min_ensr - 1;
+    fml_mag_clean(&o, g);
+    m_utgs = fml_mag2utg(g, &n_utg);
   }
   
   std::vector<std::string> FermiAssembler::GetContigs() const {
@@ -0,0 +1,134 @@
+#include "SeqLib/FilterPipeline.h"
+#include "SeqLib/SeqLibThreads.h"
+
+#include <stdexcept>
+#include <iomanip>
+
+namespace SeqLib {
+
+  // the read and filter stages, run on batches of consecutive reads
+  struct _FilterStages {
+
+    _FilterStages() : reader(NULL), batch_size(0), done(false), reads_in(0) {}
+
+    BamReader* reader;
+    size_t batch_size;
+    bool done;
+    uint64_t reads_in;
+
+    // a copy of the filter for each filter thread
+    std::vector<Filter::ReadFilterCollection> filters;
+
+    BamRecordVector* Read() {
+      if (done)
+	return NULL;
+      BamRecordVector* b = new BamRecordVector;
+      b->reserve(batch_size);
+      BamRecord rec;
+      while (b->size() < batch_size && reader->GetNextRecord(rec))
+	b->push_back(rec);
+      reads_in += b->size();
+      done = b->size() < batch_size;
+      if (b->empty()) {
+	delete b;
+	return NULL;
+      }
+      return b;
+    }
+
+    // compact the passing reads to the front, keeping their order
+    void Work(BamRecordVector* b, int thread) {
+      Filter::ReadFilterCollection& rfc = filters[thread];
+      size_t k = 0;
+      for (size_t i = 0; i < b->size(); ++i)
+	if (rfc.isValid((*b)[i])) {
+	  if (k != i)
+	    (*b)[k] = (*b)[i];
+	  ++k;
+	}
+      b->erase(b->begin() + k, b->end());
+    }
+
+  };
+
+  void FilterPipeline::SetNumThreads(int n) {
+    if (n < 1)
+      throw std::invalid_argument("FilterPipeline::SetNumThreads - need at least one thread");
+    m_threads = n;
+  }
+
+  void FilterPipeline::SetBatchSize(size_t n) {
+    if (!n)
+      throw std::invalid_argument("FilterPipeline::SetBatchSize - batch size must be > 0");
+    m_batch_size = n;
+  }
+
+  void FilterPipeline::SetQueueSize(size_t n) {
+    if (!n)
+      throw std::invalid_argument("FilterPipeline::SetQueueSize - queue size must be > 0");
+    m_queue_size = n;
+  }
+
+  bool FilterPipeline::Run(BamReader& r, BamWriter& w) {
+
+    m_stats = FilterPipelineStats();
+    double start = WallTime();
+
+    _FilterStages stages;
+    stages.reader = &r;
+    stages.batch_size = m_batch_size;
+
+    // make sure the copies don't race to build the shared tries.
+    // each copy counts from zero, to be added back after the run
+    m_filter.BuildTries();
+    Filter::ReadFilterCollection counter = m_filter;
+    counter.ResetCounts();
+    stages.filters.assign(m_threads, counter);
+
+    OrderedPipeline<BamRecordVector, _FilterStages> pipe(stages, m_threads, m_queue_size);
+    pipe.Start();
+
+    // write on this thread, in the input order
+    bool ok = true;
+    BamRecordVector* b;
+    while (ok && pipe.Next(b)) {
+      double t0 = WallTime();
+      for (BamRecordVector::const_iterator rr = b->begin(); ok && rr != b->end(); ++rr)
+	ok = w.WriteRecord(*rr);
+      m_stats.write_time += WallTime() - t0;
+      if (ok)
+	m_stats.reads_out += b->size();
+      ++m_stats.batches;
+    }
+    pipe.Stop();
+
+    for (size_t i = 0; i < stages.filters.size(); ++i)
+      m_filter.AddCounts(stages.filters[i]);
+
+    m_stats.reads_in = stages.reads_in;
+    m_stats.read_time = pipe.ReadTime();
+    m_stats.filter_time = pipe.WorkTime();
+    m_stats.wall_time = WallTime() - start;
+    m_stats.filter_queue_max = pipe.WorkQueue().MaxOccupancy();
+    m_stats.filter_queue_mean = pipe.WorkQueue().MeanOccupancy();
+    m_stats.write_queue_max = pipe.OutputQueue().MaxOccupancy();
+    m_stats.write_queue_mean = pipe.OutputQueue().MeanOccupancy();
+
+    return ok;
+  }
+
+  std::ostream& operator<<(std::ostream& out, const FilterPipelineStats& s) {
+    out << std::fixed << std::setprecision(2)
+	<< "read:   " << AddCommas(s.reads_in) << " reads in " << s.read_time << "s ("
+	<< AddCommas((uint64_t)PerSecond(s.reads_in, s.read_time)) << " reads/s)" << std::endl
+	<< "filter: " << AddCommas(s.reads_in) << " reads in " << s.filter_time << "s of thread time ("
+	<< AddCommas((uint64_t)PerSecond(s.reads_in, s.filter_time)) << " reads/s/thread)"
+	<< " queue max " << s.filter_queue_max << " mean " << s.filter_queue_mean << std::endl
+	<< "write:  " << AddCommas(s.reads_out) << " reads in " << s.write_time << "s ("
+	<< AddCommas((uint64_t)PerSecond(s.reads_out, s.write_time)) << " reads/s)"
+	<< " queue max " << s.write_queue_max << " mean " << s.write_queue_mean << std::endl
+	<< "total:  " << AddCommas(s.batches) << " batches in " << s.wall_time << "s wall";
+    return out;
+  }
+
+}
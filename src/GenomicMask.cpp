@@ -0,0 +1,145 @@
+#include "SeqLib/GenomicMask.h"
+
+#include <algorithm>
+
+// each bin of the run index covers 2^MASK_BIN_SHIFT bases
+#define MASK_BIN_SHIFT 14
+
+namespace SeqLib {
+
+  GenomicMask::GenomicMask(const GRC& g, bool dense) : m_bases(0) {
+
+    // group by chromosome
+    std::vector<std::vector<std::pair<int32_t, int32_t> > > by_chr;
+    for (size_t j = 0; j < g.size(); ++j) {
+      const GenomicRegion* i = &g[j];
+      if (i->chr < 0)
+	continue;
+      if ((size_t)i->chr >= by_chr.size())
+	by_chr.resize(i->chr + 1);
+      by_chr[i->chr].push_back(std::make_pair(i->pos1, i->pos2));
+    }
+
+    m_chr.resize(by_chr.size());
+    for (size_t k = 0; k < by_chr.size(); ++k) {
+
+      std::vector<std::pair<int32_t, int32_t> >& v = by_chr[k];
+      if (v.empty())
+	continue;
+      std::sort(v.begin(), v.end());
+      ChrMask& c = m_chr[k];
+
+      // merge overlapping and adjacent regions into runs
+      int32_t s = v[0].first, e = v[0].second;
+      for (size_t i = 1; i <= v.size(); ++i) {
+	if (i < v.size() && (int64_t)v[i].first <= (int64_t)e + 1) {
+	  e = std::max(e, v[i].second);
+	  continue;
+	}
+	c.start.push_back(s);
+	c.end.push_back(e);
+	m_bases += (int64_t)e - s + 1;
+	if (i < v.size()) {
+	  s = v[i].first;
+	  e = v[i].second;
+	}
+      }
+      std::vector<std::pair<int32_t, int32_t> >().swap(v);
+
+      const int32_t max_end = c.end.back();
+      if (max_end < 0)
+	continue;
+
+      // first run reaching each bin
+      size_t nb = ((size_t)max_end >> MASK_BIN_SHIFT) + 1;
+      c.bins.resize(nb);
+      size_t r = 0;
+      for (size_t b = 0; b < nb; ++b) {
+	int64_t bin_start = (int64_t)b << MASK_BIN_SHIFT;
+	while (r < c.end.size() && c.end[r] < bin_start)
+	  ++r;
+	c.bins[b] = r;
+      }
+
+      // one bit per base, if no run starts before 0
+      if (dense && c.start.front() >= 0) {
+	c.bits.assign(((size_t)max_end >> 6) + 1, 0);
+	for (size_t i = 0; i < c.start.size(); ++i) {
+	  size_t a = c.start[i], z = c.end[i];
+	  size_t wa = a >> 6, wz = z >> 6;
+	  uint64_t head = ~(uint64_t)0 << (a & 63);
+	  uint64_t tail = ~(uint64_t)0 >> (63 - (z & 63));
+	  if (wa == wz) {
+	    c.bits[wa] |= head & tail;
+	  } else {
+	    c.bits[wa] |= head;
+	    for (size_t w = wa + 1; w < wz; ++w)
+	      c.bits[w] = ~(uint64_t)0;
+	    c.bits[wz] |= tail;
+	  }
+	}
+      }
+    }
+  }
+
+  size_t GenomicMask::first_run(const ChrMask& c, int32_t pos) const {
+
+    const size_t n = c.end.size();
+    if (!n || pos > c.end.back())
+      return n;
+
+    // narrow the search to the runs that can reach this bin
+    size_t lo = 0, hi = n;
+    if (pos >= 0 && !c.bins.empty()) {
+      size_t b = (size_t)pos >> MASK_BIN_SHIFT;
+      lo = c.bins[b];
+      if (b + 1 < c.bins.size())
+	hi = std::min(n, (size_t)c.bins[b+1] + 1);
+    }
+    return std::lower_bound(c.end.begin() + lo, c.end.begin() + hi, pos) - c.end.begin();
+  }
+
+  bool GenomicMask::Contains(int32_t chr, int32_t pos) const {
+
+    if (chr < 0 || (size_t)chr >= m_chr.size())
+      return false;
+    const ChrMask& c = m_chr[chr];
+
+    if (!c.bits.empty()) {
+      if (pos < 0)
+	return false;
+      size_t w = (size_t)pos >> 6;
+      return w < c.bits.size() && ((c.bits[w] >> (pos & 63)) & 1);
+    }
+
+    size_t r = first_run(c, pos);
+    return r < c.end.size() && c.start[r] <= pos;
+  }
+
+  bool GenomicMask::Overlaps(int32_t chr, int32_t pos1, int32_t pos2) const {
+
+    if (chr < 0 || (size_t)chr >= m_chr.size() || pos2 < pos1)
+      return false;
+    const ChrMask& c = m_chr[chr];
+
+    // the first run ending in or after the range must start inside it
+    size_t r = first_run(c, pos1);
+    return r < c.end.size() && c.start[r] <= pos2;
+  }
+
+  size_t GenomicMask::NumRuns() const {
+    size_t n = 0;
+    for (size_t i = 0; i < m_chr.size(); ++i)
+      n += m_chr[i].start.size();
+    return n;
+  }
+
+  size_t GenomicMask::bytes() const {
+    size_t n = m_chr.capacity() * sizeof(ChrMask);
+    for (size_t i = 0; i < m_chr.size(); ++i)
+      n += m_chr[i].start.capacity() * sizeof(int32_t) + m_chr[i].end.capacity() * sizeof(int32_t) +
+	m_chr[i].bins.capacity() * sizeof(uint32_t) + m_chr[i].bits.capacity() * sizeof(uint64_t);
+    return n;
+  }
+
+}
@@ -3,6 +3,8 @@
 #include <cassert>
 #include <stdexcept>
 #include <climits>
+#include <cctype>
+#include <cstring>
 
 // 4 billion
 #define END_MAX 4000000000
@@ -123,44 +125,111 @@ std::ostream& operator<<(std::ostream& out, const GenomicRegion& gr) {
   return out;
 }
 
-  GenomicRegion::GenomicRegion(const std::string& reg, const BamHeader& hdr) {
-  
-  if (hdr.isEmpty())
-    throw std::invalid_argument("GenomicRegion constructor - supplied empty BamHeader");
+  // read a number made of digits and commas, stopping at anything else.
+  // clamps to INT_MAX
+  static int64_t read_region_number(const char*& p, const char* e) {
+    int64_t v = 0;
+    for (; p < e && (isdigit((unsigned char)*p) || *p == ','); ++p)
+      if (*p != ',' && (v = v * 10 + (*p - '0')) > INT_MAX)
+	v = INT_MAX;
+    return v;
+  }
 
-  // scrub String
-  //std::string reg2 = SeqLib::scrubString(reg, "chr");
-
-  // use htslib region parsing code
-  int tid, beg, end;
-  const char * q = hts_parse_reg(reg.c_str(), &beg, &end);
-  if (q) {
-    char *tmp = (char*)alloca(q - reg.c_str() + 1); // stack alloc
-    strncpy(tmp, reg.c_str(), q - reg.c_str());
-    tmp[q - reg.c_str()] = 0;
-    tid = hdr.Name2ID(std::string(tmp)); //bam_name2id(h.get(), tmp);
-    if (tid < 0) {
-      std::string inv = "GenomicRegion constructor: Failed to set region for " + reg;
-      throw std::invalid_argument(inv);
+  // last chromosome name looked up, to skip the hash on runs of one chromosome
+  struct _RegionNameCache {
+    _RegionNameCache() : name(NULL), len(0), tid(-1) {}
+    const char* name;
+    size_t len;
+    int tid;
+  };
+
+  // parse a samtools-style region, with the same rules as hts_parse_reg,
+  // but reading the string in place rather than copying it
+  static void parse_region(const std::string& reg, const BamHeader& hdr, GenomicRegion& gr, _RegionNameCache* cache) {
+
+    const char* s = reg.data();
+    const size_t l = reg.length();
+
+    // the name runs to the last colon, if what follows is a valid range
+    size_t name_end = l;
+    int64_t beg = 0, end = INT_MAX;
+    const char* colon = NULL;
+    for (size_t i = l; i > 0 && !colon; --i)
+      if (s[i-1] == ':')
+	colon = s + i - 1;
+
+    if (colon) {
+      int n_hyphen = 0;
+      const char* p = colon + 1;
+      for (; p < s + l; ++p) {
+	if (*p == '-')
+	  ++n_hyphen;
+	else if (!isdigit((unsigned char)*p) && *p != ',')
+	  break;
+      }
+      if (p == s + l && n_hyphen <= 1) {
+	name_end = colon - s;
+	p = colon + 1;
+	beg = read_region_number(p, s + l) - 1;
+	if (beg < 0)
+	  beg = 0;
+	if (p < s + l) {
+	  ++p; // the hyphen
+	  end = read_region_number(p, s + l);
+	}
+	if (beg > end) {
+	  name_end = l;
+	  beg = 0;
+	  end = INT_MAX;
+	}
+      }
     }
 
-    if (end == INT_MAX) { // single chrome
-      tid = hdr.Name2ID(reg);
-      beg = 0;
-      end = hdr.GetSequenceLength(reg);
+    int tid;
+    if (cache && cache->name && cache->len == name_end && !memcmp(cache->name, s, name_end)) {
+      tid = cache->tid;
+    } else {
+      tid = hdr.Name2ID(s, name_end);
+      if (cache) {
+	cache->name = s;
+	cache->len = name_end;
+	cache->tid = tid;
+      }
     }
-  } else {
-    std::string inv = "GenomicRegion constructor: Failed to set region for " + reg;
-    throw std::invalid_argument(inv);
+    if (tid < 0)
+      throw std::invalid_argument("GenomicRegion constructor: Failed to set region for " + reg);
+
+    // no end given: run to the end of the chromosome
+    if (end == INT_MAX)
+      end = hdr.GetSequenceLength(tid);
+
+    gr.chr = tid;
+    gr.pos1 = beg + 1;
+    gr.pos2 = end;
+    gr.strand = '*';
   }
+
+  GenomicRegion::GenomicRegion(const std::string& reg, const BamHeader& hdr) {
   
-  chr = tid;
-  pos1 = beg+1;
-  pos2 = end;
-  strand = '*';
+  if (hdr.isEmpty())
+    throw std::invalid_argument("GenomicRegion constructor - supplied empty BamHeader");
+
+  parse_region(reg, hdr, *this, NULL);
 
 }
 
+  GenomicRegionVector ParseRegions(const std::vector<std::string>& regions, const BamHeader& hdr) {
+
+    if (hdr.isEmpty())
+      throw std::invalid_argument("ParseRegions - supplied empty BamHeader");
+
+    GenomicRegionVector out(regions.size());
+    _RegionNameCache cache;
+    for (size_t i = 0; i < regions.size(); ++i)
+      parse_region(regions[i], hdr, out[i], &cache);
+    return out;
+  }
+
 // constructor to take a pair of coordinates to define the genomic interval
 GenomicRegion::GenomicRegion(int32_t t_chr, int32_t t_pos1, int32_t t_pos2, char t_strand) {
 
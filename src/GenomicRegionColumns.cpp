@@ -0,0 +1,253 @@
+#include "SeqLib/GenomicRegionColumns.h"
+#include "SeqLib/RadixSort.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace SeqLib {
+
+  // reorder a column so that element i comes from order[i]
+  template<class V>
+  static void permute(std::vector<V>& v, const std::vector<uint32_t>& order) {
+    std::vector<V> t(v.size());
+    for (size_t i = 0; i < order.size(); ++i)
+      t[i] = v[order[i]];
+    v.swap(t);
+  }
+
+  void GenomicRegionColumns::reserve(size_t n) {
+    expand();
+    m_chr.reserve(n);
+    m_pos1.reserve(n);
+    m_pos2.reserve(n);
+    m_strand.reserve(n);
+  }
+
+  void GenomicRegionColumns::clear() {
+    std::vector<int32_t>().swap(m_chr);
+    std::vector<int32_t>().swap(m_pos1);
+    std::vector<int32_t>().swap(m_pos2);
+    std::vector<char>().swap(m_strand);
+    std::vector<int32_t>().swap(m_run_chr);
+    std::vector<size_t>().swap(m_run_start);
+    std::vector<uint16_t>().swap(m_width);
+    m_sorted = true;
+    m_compact = false;
+  }
+
+  void GenomicRegionColumns::add(const GenomicRegion& gr) {
+    expand();
+    size_t n = m_pos1.size();
+    // same order as GenomicRegion::operator<
+    if (m_sorted && n && (gr.chr < m_chr[n-1] || (gr.chr == m_chr[n-1] &&
+	(gr.pos1 < m_pos1[n-1] || (gr.pos1 == m_pos1[n-1] && gr.pos2 < m_pos2[n-1])))))
+      m_sorted = false;
+    m_chr.push_back(gr.chr);
+    m_pos1.push_back(gr.pos1);
+    m_pos2.push_back(gr.pos2);
+    m_strand.push_back(gr.strand);
+  }
+
+  int32_t GenomicRegionColumns::chr(size_t i) const {
+    if (!m_chr.empty())
+      return m_chr[i];
+    // last run starting at or before i
+    return m_run_chr[std::upper_bound(m_run_start.begin(), m_run_start.end(), i) - m_run_start.begin() - 1];
+  }
+
+  GenomicRegion GenomicRegionColumns::operator[](size_t i) const {
+    if (i >= size())
+      throw std::out_of_range("GenomicRegionColumns - index " + tostring(i) + " out of range");
+    return GenomicRegion(chr(i), pos1(i), pos2(i), m_strand.empty() ? '*' : m_strand[i]);
+  }
+
+  // orders two original indices by end
+  struct _ColumnEndLess {
+    const std::vector<int32_t>* pos2;
+    bool operator()(uint32_t a, uint32_t b) const { return (*pos2)[a] < (*pos2)[b]; }
+  };
+
+  void GenomicRegionColumns::CoordinateSort(int num_threads) {
+
+    expand();
+    if (m_sorted)
+      return;
+
+    const size_t n = size();
+    if (n > 0xFFFFFFFFul)
+      throw std::length_error("GenomicRegionColumns::CoordinateSort - too many regions to sort");
+
+    std::vector<uint32_t> order(n);
+    std::vector<uint64_t> keys(n);
+    for (size_t i = 0; i < n; ++i) {
+      order[i] = i;
+      keys[i] = CoordinateKey(m_chr[i], m_pos1[i]);
+    }
+    RadixSort(keys, order, num_threads);
+
+    // regions with the same start are ordered by end
+    _ColumnEndLess less;
+    less.pos2 = &m_pos2;
+    SortTies(keys, order, less);
+    std::vector<uint64_t>().swap(keys);
+
+    permute(m_chr, order);
+    permute(m_pos1, order);
+    permute(m_pos2, order);
+    permute(m_strand, order);
+    m_sorted = true;
+  }
+
+  void GenomicRegionColumns::MergeOverlappingIntervals() {
+
+    CoordinateSort();
+
+    // fold each interval into the last kept one, compacting to the front
+    size_t k = 0;
+    for (size_t i = 1; i < size(); ++i) {
+      if (m_pos2[k] >= m_pos1[i] && m_chr[k] == m_chr[i]) {
+	if (m_pos2[i] > m_pos2[k])
+	  m_pos2[k] = m_pos2[i];
+      } else if (++k != i) {
+	m_chr[k] = m_chr[i];
+	m_pos1[k] = m_pos1[i];
+	m_pos2[k] = m_pos2[i];
+	m_strand[k] = m_strand[i];
+      }
+    }
+    if (!IsEmpty()) {
+      m_chr.resize(k + 1);
+      m_pos1.resize(k + 1);
+      m_pos2.resize(k + 1);
+      m_strand.resize(k + 1);
+    }
+  }
+
+  int64_t GenomicRegionColumns::TotalWidth() const {
+    const size_t n = size();
+    int64_t w = n;
+    if (m_pos2.empty()) {
+      for (size_t i = 0; i < n; ++i)
+	w += m_width[i];
+    } else {
+      for (size_t i = 0; i < n; ++i)
+	w += (int64_t)m_pos2[i] - m_pos1[i];
+    }
+    return w;
+  }
+
+  void GenomicRegionColumns::Pad(int32_t v) {
+
+    expand();
+    const size_t n = size();
+
+    // check before changing anything
+    if (v < 0)
+      for (size_t i = 0; i < n; ++i)
+	if (-2 * (int64_t)v > (int64_t)m_pos2[i] - m_pos1[i] + 1)
+	  throw std::out_of_range("GenomicRegionColumns::Pad - negative pad values can't obliterate region " +
+				  (*this)[i].ToString() + " with pad " + tostring(v));
+
+    int32_t* p1 = n ? &m_pos1[0] : NULL;
+    int32_t* p2 = n ? &m_pos2[0] : NULL;
+    for (size_t i = 0; i < n; ++i) {
+      p1[i] -= v;
+      p2[i] += v;
+    }
+  }
+
+  void GenomicRegionColumns::Compact() {
+
+    expand();
+    const size_t n = size();
+    if (!n)
+      return;
+
+    // chromosome runs, if they take less room than the column
+    size_t runs = 1;
+    for (size_t i = 1; i < n; ++i)
+      runs += m_chr[i] != m_chr[i-1];
+    if (runs * (sizeof(int32_t) + sizeof(size_t)) < n * sizeof(int32_t)) {
+      m_run_chr.reserve(runs);
+      m_run_start.reserve(runs);
+      for (size_t i = 0; i < n; ++i)
+	if (!i || m_chr[i] != m_chr[i-1]) {
+	  m_run_chr.push_back(m_chr[i]);
+	  m_run_start.push_back(i);
+	}
+      std::vector<int32_t>().swap(m_chr);
+      m_compact = true;
+    }
+
+    // 16-bit widths
+    bool narrow = true;
+    for (size_t i = 0; i < n && narrow; ++i)
+      narrow = m_pos2[i] >= m_pos1[i] && (int64_t)m_pos2[i] - m_pos1[i] <= 0xFFFF;
+    if (narrow) {
+      m_width.resize(n);
+      for (size_t i = 0; i < n; ++i)
+	m_width[i] = m_pos2[i] - m_pos1[i];
+      std::vector<int32_t>().swap(m_pos2);
+      m_compact = true;
+    }
+
+    // strand, if it carries anything
+    if (std::count(m_strand.begin(), m_strand.end(), '*') == (std::ptrdiff_t)n) {
+      std::vector<char>().swap(m_strand);
+      m_compact = true;
+    }
+
+    // give back the slack from building
+    if (!m_chr.empty())
+      std::vector<int32_t>(m_chr).swap(m_chr);
+    if (!m_pos2.empty())
+      std::vector<int32_t>(m_pos2).swap(m_pos2);
+    if (!m_strand.empty())
+      std::vector<char>(m_strand).swap(m_strand);
+    std::vector<int32_t>(m_pos1).swap(m_pos1);
+  }
+
+  void GenomicRegionColumns::expand() {
+
+    if (!m_compact)
+      return;
+    const size_t n = size();
+
+    if (m_chr.empty()) {
+      m_chr.resize(n);
+      for (size_t r = 0; r < m_run_start.size(); ++r) {
+	size_t end = r + 1 < m_run_start.size() ? m_run_start[r+1] : n;
+	std::fill(m_chr.begin() + m_run_start[r], m_chr.begin() + end, m_run_chr[r]);
+      }
+      std::vector<int32_t>().swap(m_run_chr);
+      std::vector<size_t>().swap(m_run_start);
+    }
+
+    if (m_pos2.empty()) {
+      m_pos2.resize(n);
+      for (size_t i = 0; i < n; ++i)
+	m_pos2[i] = m_pos1[i] + m_width[i];
+      std::vector<uint16_t>().swap(m_width);
+    }
+
+    if (m_strand.empty())
+      m_strand.assign(n, '*');
+
+    m_compact = false;
+  }
+
+  size_t GenomicRegionColumns::bytes() const {
+    return m_chr.capacity() * sizeof(int32_t) + m_pos1.capacity() * sizeof(int32_t) +
+      m_pos2.capacity() * sizeof(int32_t) + m_strand.capacity() +
+      m_run_chr.capacity() * sizeof(int32_t) + m_run_start.capacity() * sizeof(size_t) +
+      m_width.capacity() * sizeof(uint16_t);
+  }
+
+  GenomicRegionCollection<GenomicRegion> GenomicRegionColumns::AsGRC() const {
+    GenomicRegionCollection<GenomicRegion> out;
+    for (size_t i = 0; i < size(); ++i)
+      out.add((*this)[i]);
+    return out;
+  }
+
+}
@@ -0,0 +1,223 @@
+#include "SeqLib/GenomicRegionMerger.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <cstdlib>
+#include <unistd.h>
+
+// intervals read back from a run at a time
+#define RUN_BLOCK 16384
+
+namespace SeqLib {
+
+  // orders the run heap so the smallest interval is on top
+  struct _RunGreater {
+    bool operator()(const std::pair<GenomicRegion, size_t>& a, const std::pair<GenomicRegion, size_t>& b) const {
+      return b.first < a.first || (b.first == a.first && b.second < a.second);
+    }
+  };
+
+  // sort and merge a buffer in place
+  static void merge_in_place(std::vector<GenomicRegion>& v) {
+    std::sort(v.begin(), v.end());
+    size_t k = 0;
+    for (size_t i = 1; i < v.size(); ++i) {
+      if (v[k].pos2 >= v[i].pos1 && v[k].chr == v[i].chr) {
+	if (v[i].pos2 > v[k].pos2)
+	  v[k].pos2 = v[i].pos2;
+      } else if (++k != i) {
+	v[k] = v[i];
+      }
+    }
+    if (!v.empty())
+      v.erase(v.begin() + k + 1, v.end());
+  }
+
+  GenomicRegionMerger::GenomicRegionMerger() : m_sorted_input(false), m_max_buffer(4000000),
+    m_finished(false), m_has_open(false) {
+    const char* tmp = getenv("TMPDIR");
+    m_tmp_dir = tmp && *tmp ? tmp : "/tmp";
+  }
+
+  GenomicRegionMerger::~GenomicRegionMerger() {
+    Clear();
+  }
+
+  void GenomicRegionMerger::Clear() {
+    for (size_t i = 0; i < m_runs.size(); ++i)
+      fclose(m_runs[i].fp);
+    m_runs.clear();
+    m_heap.clear();
+    std::vector<GenomicRegion>().swap(m_buffer);
+    m_out.clear();
+    m_has_open = false;
+    m_last = GenomicRegion();
+    m_finished = false;
+  }
+
+  void GenomicRegionMerger::SetSortedInput(bool sorted) {
+    if (m_has_open || !m_buffer.empty() || !m_runs.empty())
+      throw std::logic_error("GenomicRegionMerger::SetSortedInput - intervals already added");
+    m_sorted_input = sorted;
+  }
+
+  void GenomicRegionMerger::SetMaxBuffer(size_t n) {
+    if (!n)
+      throw std::invalid_argument("GenomicRegionMerger::SetMaxBuffer - buffer size must be > 0");
+    m_max_buffer = n;
+  }
+
+  void GenomicRegionMerger::Add(const GenomicRegion& gr) {
+
+    if (m_finished)
+      throw std::logic_error("GenomicRegionMerger::Add - called after Finish");
+
+    // unplaced, eg the unmapped reads at the end of a sorted BAM
+    if (gr.chr < 0)
+      return;
+
+    if (m_sorted_input) {
+      // sorted BAM and BED are only ordered on chr and start
+      if (m_has_open && (gr.chr < m_last.chr || (gr.chr == m_last.chr && gr.pos1 < m_last.pos1)))
+	throw std::invalid_argument("GenomicRegionMerger::Add - input not sorted at " + gr.ToString());
+      m_last = gr;
+      push(gr);
+      return;
+    }
+
+    m_buffer.push_back(gr);
+    m_buffer.back().strand = '*';
+    if (m_buffer.size() >= m_max_buffer)
+      spill();
+  }
+
+  void GenomicRegionMerger::push(const GenomicRegion& gr) {
+    if (m_has_open && m_open.chr == gr.chr && m_open.pos2 >= gr.pos1) {
+      if (gr.pos2 > m_open.pos2)
+	m_open.pos2 = gr.pos2;
+      return;
+    }
+    if (m_has_open)
+      m_out.push_back(m_open);
+    m_open = gr;
+    m_open.strand = '*';
+    m_has_open = true;
+  }
+
+  void GenomicRegionMerger::spill() {
+
+    merge_in_place(m_buffer);
+
+    std::string path = m_tmp_dir + "/seqlib_merge_XXXXXX";
+    std::vector<char> name(path.begin(), path.end());
+    name.push_back('\0');
+    int fd = mkstemp(&name[0]);
+    if (fd < 0)
+      throw std::runtime_error("GenomicRegionMerger - could not create a temporary file in " + m_tmp_dir);
+    // the file lives until it is closed
+    unlink(&name[0]);
+    FILE* fp = fdopen(fd, "w+b");
+    if (!fp) {
+      close(fd);
+      throw std::runtime_error("GenomicRegionMerger - could not open a temporary file in " + m_tmp_dir);
+    }
+
+    Run r;
+    r.fp = fp;
+    r.pos = 0;
+    m_runs.push_back(r);
+
+    // write as chr, pos1, pos2 triples
+    std::vector<int32_t> block;
+    block.reserve(3 * RUN_BLOCK);
+    for (size_t i = 0; i < m_buffer.size(); ++i) {
+      block.push_back(m_buffer[i].chr);
+      block.push_back(m_buffer[i].pos1);
+      block.push_back(m_buffer[i].pos2);
+      if (block.size() == 3 * RUN_BLOCK || i + 1 == m_buffer.size()) {
+	if (fwrite(&block[0], sizeof(int32_t), block.size(), fp) != block.size())
+	  throw std::runtime_error("GenomicRegionMerger - could not write a sorted run to " + m_tmp_dir);
+	block.clear();
+      }
+    }
+    m_buffer.clear();
+  }
+
+  bool GenomicRegionMerger::read_run(Run& r, GenomicRegion& gr) {
+    if (r.pos * 3 == r.buf.size()) {
+      r.buf.resize(3 * RUN_BLOCK);
+      size_t n = fread(&r.buf[0], 3 * sizeof(int32_t), RUN_BLOCK, r.fp);
+      if (!n && ferror(r.fp))
+	throw std::runtime_error("GenomicRegionMerger - could not read back a sorted run");
+      r.buf.resize(3 * n);
+      r.pos = 0;
+      if (!n)
+	return false;
+    }
+    gr.chr = r.buf[3 * r.pos];
+    gr.pos1 = r.buf[3 * r.pos + 1];
+    gr.pos2 = r.buf[3 * r.pos + 2];
+    ++r.pos;
+    return true;
+  }
+
+  void GenomicRegionMerger::Finish() {
+
+    if (m_finished)
+      return;
+    m_finished = true;
+
+    if (m_sorted_input)
+      return;
+
+    // all fit in memory: merge there and queue the result
+    if (m_runs.empty()) {
+      merge_in_place(m_buffer);
+      m_out.insert(m_out.end(), m_buffer.begin(), m_buffer.end());
+      std::vector<GenomicRegion>().swap(m_buffer);
+      return;
+    }
+
+    if (!m_buffer.empty())
+      spill();
+    std::vector<GenomicRegion>().swap(m_buffer);
+
+    // start the merge with the head of each run
+    GenomicRegion gr;
+    for (size_t i = 0; i < m_runs.size(); ++i) {
+      if (fseek(m_runs[i].fp, 0, SEEK_SET))
+	throw std::runtime_error("GenomicRegionMerger - could not rewind a sorted run");
+      if (read_run(m_runs[i], gr)) {
+	m_heap.push_back(std::make_pair(gr, i));
+	std::push_heap(m_heap.begin(), m_heap.end(), _RunGreater());
+      }
+    }
+  }
+
+  bool GenomicRegionMerger::GetNextRegion(GenomicRegion& gr) {
+
+    // pull from the runs until an interval is closed
+    while (m_out.empty() && !m_heap.empty()) {
+      std::pop_heap(m_heap.begin(), m_heap.end(), _RunGreater());
+      std::pair<GenomicRegion, size_t>& top = m_heap.back();
+      push(top.first);
+      if (read_run(m_runs[top.second], top.first))
+	std::push_heap(m_heap.begin(), m_heap.end(), _RunGreater());
+      else
+	m_heap.pop_back();
+    }
+
+    // the open interval is the last one
+    if (m_out.empty() && m_finished && m_has_open) {
+      m_out.push_back(m_open);
+      m_has_open = false;
+    }
+
+    if (m_out.empty())
+      return false;
+    gr = m_out.front();
+    m_out.pop_front();
+    return true;
+  }
+
+}
@@ -0,0 +1,359 @@
+#include "SeqLib/LineReader.h"
+#include "SeqLib/SeqLibThreads.h"
+
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <stdint.h>
+
+// bytes of raw input read at a time
+#define RAW_CHUNK 4194304
+// BGZF blocks inflated per fill, per thread
+#define BGZF_BLOCKS_PER_THREAD 64
+
+namespace SeqLib {
+
+  // one BGZF block, located in the raw buffer
+  struct _BgzfBlock {
+    size_t cdata; // offset of deflate data in raw buffer
+    size_t clen; // length of deflate data
+    size_t out; // offset of output in text buffer
+    uint32_t isize; // inflated length
+  };
+
+  // inflate every step'th block, starting at first
+  struct _InflateTask {
+    const char* raw;
+    char* text;
+    const std::vector<_BgzfBlock>* blocks;
+    size_t first;
+    size_t step;
+    bool ok;
+
+    void operator()() {
+      ok = true;
+      z_stream zs;
+      memset(&zs, 0, sizeof(zs));
+      if (inflateInit2(&zs, -15) != Z_OK) {
+	ok = false;
+	return;
+      }
+      for (size_t i = first; i < blocks->size() && ok; i += step) {
+	const _BgzfBlock& b = (*blocks)[i];
+	inflateReset(&zs);
+	zs.next_in = (Bytef*)(raw + b.cdata);
+	zs.avail_in = b.clen;
+	zs.next_out = (Bytef*)(text + b.out);
+	zs.avail_out = b.isize;
+	int ret = inflate(&zs, Z_FINISH);
+	ok = (ret == Z_STREAM_END && zs.total_out == b.isize);
+      }
+      inflateEnd(&zs);
+    }
+  };
+
+  LineReader::LineReader() : m_fp(NULL), m_mode(PLAIN_MODE), m_threads(1), m_eof(false),
+    m_pos(0), m_end(0), m_raw_pos(0), m_raw_end(0), m_zs_open(false) {}
+
+  LineReader::~LineReader() {
+    Close();
+  }
+
+  void LineReader::SetThreads(int n) {
+    if (n < 1)
+      throw std::invalid_argument("LineReader::SetThreads - need at least one thread");
+    m_threads = n;
+  }
+
+  void LineReader::Close() {
+    if (m_fp && m_fp != stdin)
+      fclose(m_fp);
+    m_fp = NULL;
+    if (m_zs_open)
+      inflateEnd(&m_zs);
+    m_zs_open = false;
+    m_eof = false;
+    m_error.clear();
+    m_pos = m_end = m_raw_pos = m_raw_end = 0;
+    std::vector<char>().swap(m_buf);
+    std::vector<char>().swap(m_raw);
+  }
+
+  bool LineReader::Open(const std::string& file) {
+
+    Close();
+
+    if (file.empty())
+      return false;
+    m_fp = file == "-" ? stdin : fopen(file.c_str(), "rb");
+    if (!m_fp)
+      return false;
+
+    // sniff the format from the first bytes
+    read_raw();
+    if (Failed())
+      return false;
+
+    const unsigned char* h = (const unsigned char*)(m_raw.empty() ? NULL : &m_raw[0]);
+    size_t n = m_raw_end;
+    if (n >= 18 && h[0] == 31 && h[1] == 139 && h[2] == 8 && (h[3] & 4) && h[12] == 'B' && h[13] == 'C') {
+      m_mode = BGZF_MODE;
+    } else if (n >= 2 && h[0] == 31 && h[1] == 139) {
+      m_mode = GZIP_MODE;
+      memset(&m_zs, 0, sizeof(m_zs));
+      if (inflateInit2(&m_zs, 15 + 16) != Z_OK) {
+	m_error = "LineReader::Open - could not initialize zlib";
+	return false;
+      }
+      m_zs_open = true;
+    } else {
+      m_mode = PLAIN_MODE;
+    }
+
+    return true;
+  }
+
+  bool LineReader::read_raw() {
+
+    if (m_eof || !m_fp)
+      return false;
+
+    // keep the unread bytes
+    if (m_raw_pos) {
+      memmove(&m_raw[0], &m_raw[m_raw_pos], m_raw_end - m_raw_pos);
+      m_raw_end -= m_raw_pos;
+      m_raw_pos = 0;
+    }
+    if (m_raw.size() < m_raw_end + RAW_CHUNK)
+      m_raw.resize(m_raw_end + RAW_CHUNK);
+
+    size_t n = fread(&m_raw[m_raw_end], 1, RAW_CHUNK, m_fp);
+    m_raw_end += n;
+    if (n < RAW_CHUNK) {
+      m_eof = true;
+      if (ferror(m_fp))
+	m_error = "LineReader - error reading file";
+    }
+    return n > 0;
+  }
+
+  bool LineReader::GetLine(char*& line, size_t& len) {
+
+    while (true) {
+
+      char* nl = m_pos < m_end ? (char*)memchr(&m_buf[m_pos], '\n', m_end - m_pos) : NULL;
+
+      if (!nl && !Failed() && fill())
+	continue;
+
+      if (!nl && m_pos == m_end)
+	return false;
+
+      // last line may not have a newline. fill leaves room for the NUL
+      line = &m_buf[m_pos];
+      len = nl ? nl - line : m_end - m_pos;
+      line[len] = '\0';
+      m_pos += nl ? len + 1 : len;
+      if (len && line[len-1] == '\r')
+	line[--len] = '\0';
+      return true;
+    }
+  }
+
+  bool LineReader::fill() {
+
+    // move the partial line to the front
+    if (m_pos) {
+      memmove(&m_buf[0], &m_buf[m_pos], m_end - m_pos);
+      m_end -= m_pos;
+      m_pos = 0;
+    }
+
+    switch (m_mode) {
+    case GZIP_MODE: return fill_gzip();
+    case BGZF_MODE: return fill_bgzf();
+    default: return fill_plain();
+    }
+  }
+
+  bool LineReader::fill_plain() {
+
+    if (m_raw_pos == m_raw_end && !read_raw())
+      return false;
+
+    // hand the raw bytes over as text
+    size_t n = m_raw_end - m_raw_pos;
+    if (m_buf.size() < m_end + n + 1)
+      m_buf.resize(m_end + n + 1);
+    memcpy(&m_buf[m_end], &m_raw[m_raw_pos], n);
+    m_end += n;
+    m_raw_pos = m_raw_end;
+    return true;
+  }
+
+  bool LineReader::fill_gzip() {
+
+    if (m_buf.size() < m_end + RAW_CHUNK + 1)
+      m_buf.resize(m_end + RAW_CHUNK + 1);
+
+    size_t start = m_end;
+    while (m_end == start) {
+
+      if (m_raw_pos == m_raw_end && !read_raw()) {
+	if (m_zs_open && m_zs.total_in)
+	  m_error = "LineReader - truncated gzip file";
+	return false;
+      }
+
+      m_zs.next_in = (Bytef*)&m_raw[m_raw_pos];
+      m_zs.avail_in = m_raw_end - m_raw_pos;
+      m_zs.next_out = (Bytef*)&m_buf[m_end];
+      m_zs.avail_out = m_buf.size() - m_end - 1;
+
+      int ret = inflate(&m_zs, Z_NO_FLUSH);
+      m_raw_pos = m_raw_end - m_zs.avail_in;
+      m_end = m_buf.size() - 1 - m_zs.avail_out;
+
+      if (ret == Z_STREAM_END) {
+	// gzip files can be several members back to back
+	if (m_raw_pos == m_raw_end)
+	  read_raw();
+	if (m_raw_end - m_raw_pos >= 2 && (unsigned char)m_raw[m_raw_pos] == 31 &&
+	    (unsigned char)m_raw[m_raw_pos+1] == 139) {
+	  inflateReset(&m_zs);
+	} else {
+	  inflateEnd(&m_zs);
+	  m_zs_open = false;
+	  m_raw_pos = m_raw_end; // ignore trailing bytes
+	  m_mode = PLAIN_MODE;
+	  m_eof = true;
+	  return m_end > start;
+	}
+      } else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+	m_error = "LineReader - gzip decompression failed";
+	return false;
+      }
+    }
+    return true;
+  }
+
+  bool LineReader::fill_bgzf() {
+
+    // keep enough compressed input for a full batch
+    if (m_raw_end - m_raw_pos < RAW_CHUNK / 2)
+      read_raw();
+
+    const size_t max_blocks = BGZF_BLOCKS_PER_THREAD * m_threads;
+    std::vector<_BgzfBlock> blocks;
+    size_t out = m_end;
+
+    while (true) {
+
+      size_t p = m_raw_pos;
+      while (blocks.size() < max_blocks) {
+
+	size_t avail = m_raw_end - p;
+	if (avail < 18)
+	  break;
+
+	const unsigned char* h = (const unsigned char*)&m_raw[p];
+	if (h[0] != 31 || h[1] != 139 || h[2] != 8 || !(h[3] & 4)) {
+	  m_error = "LineReader - corrupt BGZF block";
+	  return false;
+	}
+
+	// find the BC subfield, holding the block size
+	size_t xlen = h[10] | (h[11] << 8);
+	if (avail < 12 + xlen)
+	  break;
+	long bsize = -1;
+	for (size_t j = 12; j + 4 <= 12 + xlen; j += 4 + (h[j+2] | (h[j+3] << 8)))
+	  if (h[j] == 'B' && h[j+1] == 'C' && (h[j+2] | (h[j+3] << 8)) == 2 && j + 6 <= 12 + xlen)
+	    bsize = h[j+4] | (h[j+5] << 8);
+	if (bsize < 0 || (size_t)bsize + 1 < 12 + xlen + 8) {
+	  m_error = "LineReader - corrupt BGZF block";
+	  return false;
+	}
+
+	size_t blen = bsize + 1;
+	if (avail < blen)
+	  break;
+
+	_BgzfBlock b;
+	b.cdata = p + 12 + xlen;
+	b.clen = blen - 12 - xlen - 8;
+	b.isize = h[blen-4] | (h[blen-3] << 8) | (h[blen-2] << 16) | ((uint32_t)h[blen-1] << 24);
+	b.out = out;
+	out += b.isize;
+	if (b.isize) // skip the empty EOF block
+	  blocks.push_back(b);
+	p += blen;
+      }
+
+      m_raw_pos = p;
+      if (!blocks.empty())
+	break;
+
+      // nothing complete yet: read more, or stop
+      if (!read_raw()) {
+	if (m_raw_pos != m_raw_end)
+	  m_error = "LineReader - truncated BGZF file";
+	return false;
+      }
+    }
+
+    if (m_buf.size() < out + 1)
+      m_buf.resize(out + 1 + (out >> 2));
+
+    // inflate the blocks straight into place
+    size_t n = std::min(blocks.size(), (size_t)m_threads);
+    std::vector<_InflateTask> tasks(n);
+    for (size_t t = 0; t < n; ++t) {
+      tasks[t].raw = &m_raw[0];
+      tasks[t].text = &m_buf[0];
+      tasks[t].blocks = &blocks;
+      tasks[t].first = t;
+      tasks[t].step = n;
+    }
+    RunThreads(tasks);
+
+    for (size_t t = 0; t < n; ++t)
+      if (!tasks[t].ok) {
+	m_error = "LineReader - BGZF decompression failed";
+	return false;
+      }
+
+    m_end = out;
+    return true;
+  }
+
+  size_t SplitTabs(char* line, size_t len, char** fields, size_t* lens, size_t n) {
+    size_t k = 0;
+    char* end = line + len;
+    while (k < n) {
+      char* tab = (char*)memchr(line, '\t', end - line);
+      fields[k] = line;
+      lens[k] = (tab ? tab : end) - line;
+      ++k;
+      if (!tab)
+	break;
+      line = tab + 1;
+    }
+    return k;
+  }
+
+  int ParseInt32(const char* s, int32_t& v) {
+    char* end;
+    errno = 0;
+    long l = strtol(s, &end, 10);
+    if (end == s)
+      return EINVAL;
+    if (errno == ERANGE || l > INT_MAX || l < INT_MIN)
+      return ERANGE;
+    v = static_cast<int32_t>(l);
+    return 0;
+  }
+
+}
@@ -0,0 +1,90 @@
+#include "SeqLib/MappedFile.h"
+
+#include <cstdlib>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace SeqLib {
+
+  bool MappedFile::Open(const std::string& file) {
+
+    Close();
+
+    int fd = open(file.c_str(), O_RDONLY);
+    if (fd < 0)
+      return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+      close(fd);
+      return false;
+    }
+
+    // nothing to map
+    if (st.st_size == 0) {
+      close(fd);
+      return true;
+    }
+
+    if (S_ISREG(st.st_mode)) {
+      void* p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+      if (p != MAP_FAILED) {
+	close(fd);
+	m_data = static_cast<char*>(p);
+	m_size = st.st_size;
+	m_mapped = true;
+	return true;
+      }
+    }
+
+    // fall back to reading the whole file
+    size_t cap = S_ISREG(st.st_mode) ? st.st_size : 1 << 16;
+    size_t len = 0;
+    char* buf = static_cast<char*>(malloc(cap));
+    bool ok = buf != NULL;
+    while (ok) {
+      if (len == cap) {
+	char* b = static_cast<char*>(realloc(buf, cap * 2));
+	if (!b) {
+	  ok = false;
+	  break;
+	}
+	buf = b;
+	cap *= 2;
+      }
+      ssize_t r = read(fd, buf + len, cap - len);
+      if (r < 0)
+	ok = false;
+      else if (r == 0)
+	break;
+      else
+	len += r;
+    }
+    close(fd);
+    if (!ok) {
+      free(buf);
+      return false;
+    }
+
+    m_data = buf;
+    m_size = len;
+    m_mapped = false;
+    return true;
+  }
+
+  void MappedFile::Close() {
+    if (m_data) {
+      if (m_mapped)
+	munmap(m_data, m_size);
+      else
+	free(m_data);
+    }
+    m_data = NULL;
+    m_size = 0;
+    m_mapped = false;
+  }
+
+}
@@ -0,0 +1,84 @@
+#include "SeqLib/OverlapCounter.h"
+
+#include <stdexcept>
+#include <climits>
+
+namespace SeqLib {
+
+  OverlapCounter::OverlapCounter(const GRC& targets) : m_chr(-1), m_last_pos(0), m_added(0) {
+
+    if (targets.size() > 0xFFFFFFFFul)
+      throw std::length_error("OverlapCounter - too many targets");
+
+    _ChrColumns c;
+    c.fill<GenomicRegion>(targets.begin(), targets.size(), targets.IsSorted(), 1);
+    m_start.swap(c.start);
+    m_end.swap(c.end);
+    m_id.swap(c.id);
+
+    for (size_t r = 0; r < c.chr.size(); ++r) {
+      if (c.chr[r] < 0)
+	continue;
+      if ((size_t)c.chr[r] >= m_chr_begin.size()) {
+	m_chr_begin.resize(c.chr[r] + 1, 0);
+	m_chr_end.resize(c.chr[r] + 1, 0);
+      }
+      m_chr_begin[c.chr[r]] = c.run[r];
+      m_chr_end[c.chr[r]] = c.run[r+1];
+    }
+
+    m_counts.assign(targets.size(), 0);
+  }
+
+  void OverlapCounter::start_chr(int32_t chr) {
+
+    if ((size_t)chr < m_chr_done.size() && m_chr_done[chr])
+      throw std::invalid_argument("OverlapCounter::Add - input is not grouped by chromosome");
+    if (m_chr >= 0) {
+      if ((size_t)m_chr >= m_chr_done.size())
+	m_chr_done.resize(m_chr + 1, false);
+      m_chr_done[m_chr] = true;
+    }
+
+    m_chr = chr;
+    m_last_pos = INT_MIN;
+    size_t b = 0, e = 0;
+    if ((size_t)chr < m_chr_begin.size()) {
+      b = m_chr_begin[chr];
+      e = m_chr_end[chr];
+    }
+    if (b < e)
+      m_sweep.Reset(&m_start[b], &m_end[b], &m_id[b], e - b, &m_counts[0]);
+    else
+      m_sweep.Reset(NULL, NULL, NULL, 0, NULL);
+  }
+
+  void OverlapCounter::Add(int32_t chr, int32_t pos1, int32_t pos2) {
+
+    if (chr < 0)
+      return;
+    if (chr != m_chr)
+      start_chr(chr);
+    else if (pos1 < m_last_pos)
+      throw std::invalid_argument("OverlapCounter::Add - input is not sorted by position");
+
+    m_last_pos = pos1;
+    ++m_added;
+    m_sweep.Add(pos1, pos2);
+  }
+
+  void OverlapCounter::Add(const BamRecord& r) {
+    if (r.MappedFlag())
+      Add(r.ChrID(), r.Position(), r.PositionEnd());
+  }
+
+  void OverlapCounter::Reset() {
+    m_counts.assign(m_counts.size(), 0);
+    m_chr_done.clear();
+    m_chr = -1;
+    m_last_pos = 0;
+    m_added = 0;
+    m_sweep.Reset(NULL, NULL, NULL, 0, NULL);
+  }
+
+}
@@ -0,0 +1,71 @@
+#include "SeqLib/PhaseStats.h"
+#include "SeqLib/SeqLibThreads.h"
+#include "SeqLib/SeqLibUtils.h"
+
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+
+namespace SeqLib {
+
+  // read a "Field:   123 kB" line from /proc/self/status
+  static size_t proc_status_bytes(const char* field) {
+    FILE* f = fopen("/proc/self/status", "r");
+    if (!f)
+      return 0;
+    size_t len = strlen(field);
+    char line[256];
+    unsigned long kb = 0;
+    while (fgets(line, sizeof(line), f))
+      if (!strncmp(line, field, len) && line[len] == ':') {
+	if (sscanf(line + len + 1, "%lu", &kb) != 1)
+	  kb = 0;
+	break;
+      }
+    fclose(f);
+    return (size_t)kb * 1024;
+  }
+
+  size_t ResidentBytes() {
+    return proc_status_bytes("VmRSS");
+  }
+
+  size_t PeakResidentBytes() {
+    return proc_status_bytes("VmHWM");
+  }
+
+  bool ResetPeakResidentBytes() {
+    // "5" resets the peak RSS (Linux 4.0 and later)
+    FILE* f = fopen("/proc/self/clear_refs", "w");
+    if (!f)
+      return false;
+    bool ok = fputs("5", f) >= 0;
+    return fclose(f) == 0 && ok;
+  }
+
+  PhaseTimer::PhaseTimer(const std::string& name, PhaseStatsVector* v, bool reset_peak) : m_out(v), m_start(0) {
+    if (!m_out)
+      return;
+    m_stats.name = name;
+    if (reset_peak)
+      ResetPeakResidentBytes();
+    m_start = WallTime();
+  }
+
+  void PhaseTimer::Stop() {
+    if (!m_out)
+      return;
+    m_stats.wall_time = WallTime() - m_start;
+    m_stats.resident_bytes = ResidentBytes();
+    m_stats.peak_bytes = std::max(PeakResidentBytes(), m_stats.resident_bytes);
+    m_out->push_back(m_stats);
+    m_out = NULL;
+  }
+
+  std::ostream& operator<<(std::ostream& out, const PhaseStats& p) {
+    out << std::fixed << std::setprecision(3) << p.name << ": " << p.wall_time << "s, peak "
+	<< AddCommas(p.peak_bytes) << " bytes, resident " << AddCommas(p.resident_bytes) << " bytes";
+    return out;
+  }
+
+}
@@ -0,0 +1,114 @@
+#include "SeqLib/RadixSort.h"
+#include "SeqLib/SeqLibThreads.h"
+
+#include <stdexcept>
+#include <cstring>
+
+// below this many keys per thread, extra threads cost more than they save
+#define RADIX_MIN_PER_THREAD 65536
+
+namespace SeqLib {
+
+  // count the values of one byte of the keys in [begin, end)
+  struct _RadixCount {
+    const uint64_t* keys;
+    size_t begin;
+    size_t end;
+    int shift;
+    size_t counts[256];
+
+    void operator()() {
+      memset(counts, 0, sizeof(counts));
+      for (size_t i = begin; i < end; ++i)
+	++counts[(keys[i] >> shift) & 0xff];
+    }
+  };
+
+  // move the keys in [begin, end) to their place for this pass.
+  // offsets start as where this chunk's first key of each value goes
+  struct _RadixScatter {
+    const uint64_t* keys;
+    const uint32_t* order;
+    uint64_t* keys_out;
+    uint32_t* order_out;
+    size_t begin;
+    size_t end;
+    int shift;
+    size_t offsets[256];
+
+    void operator()() {
+      for (size_t i = begin; i < end; ++i) {
+	size_t dst = offsets[(keys[i] >> shift) & 0xff]++;
+	keys_out[dst] = keys[i];
+	order_out[dst] = order[i];
+      }
+    }
+  };
+
+  void RadixSort(std::vector<uint64_t>& keys, std::vector<uint32_t>& order, int num_threads) {
+
+    if (keys.size() != order.size())
+      throw std::invalid_argument("RadixSort - keys and order must be the same size");
+    if (num_threads < 1)
+      throw std::invalid_argument("RadixSort - need at least one thread");
+
+    const size_t n = keys.size();
+    if (n < 2)
+      return;
+
+    // skip passes where every key has the same byte. Any bit that
+    // differs from the first key marks a byte that needs sorting
+    uint64_t differ = 0;
+    for (size_t i = 1; i < n; ++i)
+      differ |= keys[i] ^ keys[0];
+
+    size_t nt = num_threads;
+    if (nt > n / RADIX_MIN_PER_THREAD)
+      nt = n / RADIX_MIN_PER_THREAD ? n / RADIX_MIN_PER_THREAD : 1;
+
+    std::vector<uint64_t> keys_tmp(n);
+    std::vector<uint32_t> order_tmp(n);
+
+    // contiguous chunks, one per thread, so each chunk keeps its order
+    std::vector<_RadixCount> count(nt);
+    std::vector<_RadixScatter> scatter(nt);
+    for (size_t t = 0; t < nt; ++t) {
+      count[t].begin = scatter[t].begin = n * t / nt;
+      count[t].end = scatter[t].end = n * (t + 1) / nt;
+    }
+
+    for (int b = 0; b < 8; ++b) {
+
+      const int shift = 8 * b;
+      if (!((differ >> shift) & 0xff))
+	continue;
+
+      for (size_t t = 0; t < nt; ++t) {
+	count[t].keys = &keys[0];
+	count[t].shift = shift;
+      }
+      RunThreads(count);
+
+      // a value's slot runs over all smaller values, then the earlier chunks
+      size_t sum = 0;
+      for (int v = 0; v < 256; ++v)
+	for (size_t t = 0; t < nt; ++t) {
+	  scatter[t].offsets[v] = sum;
+	  sum += count[t].counts[v];
+	}
+
+      for (size_t t = 0; t < nt; ++t) {
+	scatter[t].keys = &keys[0];
+	scatter[t].order = &order[0];
+	scatter[t].keys_out = &keys_tmp[0];
+	scatter[t].order_out = &order_tmp[0];
+	scatter[t].shift = shift;
+      }
+      RunThreads(scatter);
+
+      keys.swap(keys_tmp);
+      order.swap(order_tmp);
+    }
+  }
+
+}
@@ -0,0 +1,46 @@
+#include "SeqLib/ReadArena.h"
+
+#include <cstdlib>
+#include <new>
+
+namespace SeqLib {
+
+  char* ReadArena::Alloc(size_t n) {
+
+    // move on to the first (kept) block with room
+    while (m_cur < m_blocks.size() && m_used + n > m_blocks[m_cur].size) {
+      ++m_cur;
+      m_used = 0;
+    }
+
+    if (m_cur == m_blocks.size()) {
+      Block b;
+      b.size = n > m_block_size ? n : m_block_size;
+      b.data = static_cast<char*>(malloc(b.size));
+      if (!b.data)
+	throw std::bad_alloc();
+      m_blocks.push_back(b);
+      m_used = 0;
+    }
+
+    char* p = m_blocks[m_cur].data + m_used;
+    m_used += n;
+    return p;
+  }
+
+  void ReadArena::Release() {
+    for (size_t i = 0; i < m_blocks.size(); ++i)
+      free(m_blocks[i].data);
+    m_blocks.clear();
+    m_cur = 0;
+    m_used = 0;
+  }
+
+  size_t ReadArena::Capacity() const {
+    size_t n = 0;
+    for (size_t i = 0; i < m_blocks.size(); ++i)
+      n += m_blocks[i].size;
+    return n;
+  }
+
+}
@@ -95,6 +95,12 @@ bool ReadFilter::isReadOverlappingRegion(const BamRecord &r) const {
   if (!m_grv.size()) 
     return true;
 
+  if (m_mask) {
+    if (m_mask->Overlaps(r.ChrID(), r.Position(), r.PositionEnd()))
+      return true;
+    return m_applies_to_mate && m_mask->Overlaps(r.MateChrID(), r.MatePosition(), r.MatePosition() + r.Length());
+  }
+
   if (m_grv.CountOverlaps(GenomicRegion(r.ChrID(), r.Position(), r.PositionEnd())))
     return true;
   
@@ -150,6 +156,32 @@ bool ReadFilter::isReadOverlappingRegion(const BamRecord &r) const {
     return false;
 }
 
+  void ReadFilterCollection::ResetCounts() {
+    m_count = m_count_seen = 0;
+    for (std::vector<ReadFilter>::iterator it = m_regions.begin(); it != m_regions.end(); ++it) {
+      it->m_count = 0;
+      for (std::vector<AbstractRule>::iterator r = it->m_abstract_rules.begin(); r != it->m_abstract_rules.end(); ++r)
+	r->m_count = 0;
+    }
+  }
+
+  void ReadFilterCollection::AddCounts(const ReadFilterCollection& rfc) {
+
+    if (rfc.m_regions.size() != m_regions.size())
+      throw std::invalid_argument("ReadFilterCollection::AddCounts - collections have different filters");
+    for (size_t i = 0; i < m_regions.size(); ++i)
+      if (rfc.m_regions[i].m_abstract_rules.size() != m_regions[i].m_abstract_rules.size())
+	throw std::invalid_argument("ReadFilterCollection::AddCounts - collections have different rules");
+
+    m_count += rfc.m_count;
+    m_count_seen += rfc.m_count_seen;
+    for (size_t i = 0; i < m_regions.size(); ++i) {
+      m_regions[i].m_count += rfc.m_regions[i].m_count;
+      for (size_t j = 0; j < m_regions[i].m_abstract_rules.size(); ++j)
+	m_regions[i].m_abstract_rules[j].m_count += rfc.m_regions[i].m_abstract_rules[j].m_count;
+    }
+  }
+
   void ReadFilter::AddRule(const AbstractRule& ar) {
     m_abstract_rules.push_back(ar);
   }
@@ -157,7 +189,7 @@ bool ReadFilter::isReadOverlappingRegion(const BamRecord &r) const {
   // constructor to make a ReadFilterCollection from a rules file.
   // This will reduce each individual BED file and make the 
   // GenomicIntervalTreeMap
-  ReadFilterCollection::ReadFilterCollection(const std::string& script, const BamHeader& hdr) : m_count(0), m_count_seen(0) {
+  ReadFilterCollection::ReadFilterCollection(const std::string& script, const BamHeader& hdr) : m_count(0), m_count_seen(0), m_use_mask(false) {
 
     // if is a file, read into a string
     std::ifstream iscript(script.c_str());
@@ -277,12 +309,24 @@ bool ReadFilter::isReadOverlappingRegion(const BamRecord &r) const {
   void ReadFilter::setRegions(const GRC& g) {
     m_grv = g;
     m_grv.CreateTreeMap();
+    if (m_mask)
+      build_mask(true);
   }
 
   void ReadFilter::addRegions(const GRC& g) {
     m_grv.Concat(g);
     m_grv.MergeOverlappingIntervals();
     m_grv.CreateTreeMap();
+    if (m_mask)
+      build_mask(true);
+  }
+
+  void ReadFilter::build_mask(bool on) {
+    // a new mask rather than a change to the old, as copies share it
+    if (on)
+      m_mask = SeqPointer<GenomicMask>(new GenomicMask(m_grv));
+    else
+      m_mask = SeqPointer<GenomicMask>();
   }
 
 
@@ -321,6 +365,21 @@ std::ostream& operator<<(std::ostream &out, const ReadFilter &mr) {
 
   void ReadFilterCollection::AddReadFilter(const ReadFilter& rf) {
     m_regions.push_back(rf);
+    if (m_use_mask != (bool)m_regions.back().m_mask)
+      m_regions.back().build_mask(m_use_mask);
+  }
+
+  void ReadFilterCollection::SetRegionMask(bool on) {
+    m_use_mask = on;
+    for (std::vector<ReadFilter>::iterator it = m_regions.begin(); it != m_regions.end(); ++it)
+      it->build_mask(on);
+  }
+
+  void ReadFilterCollection::BuildTries() const {
+    rule_all.aho.Build();
+    for (std::vector<ReadFilter>::const_iterator it = m_regions.begin(); it != m_regions.end(); ++it)
+      for (std::vector<AbstractRule>::const_iterator r = it->m_abstract_rules.begin(); r != it->m_abstract_rules.end(); ++r)
+	r->aho.Build();
   }
 
   ReadFilter::~ReadFilter() {}
@@ -0,0 +1,190 @@
+#include "SeqLib/RegionFileReader.h"
+
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+namespace SeqLib {
+
+  RegionFileReader::RegionFileReader() : m_vcf(false), m_threads(1), m_hts(NULL), m_tbx(NULL),
+    m_itr(NULL), m_region_set(false), m_line_num(0), m_last_id(-1) {
+    m_str.l = m_str.m = 0;
+    m_str.s = NULL;
+  }
+
+  RegionFileReader::~RegionFileReader() {
+    Close();
+  }
+
+  void RegionFileReader::SetThreads(int n) {
+    m_reader.SetThreads(n);
+  }
+
+  void RegionFileReader::Close() {
+    m_reader.Close();
+    if (m_itr)
+      hts_itr_destroy(m_itr);
+    if (m_tbx)
+      tbx_destroy(m_tbx);
+    if (m_hts)
+      hts_close(m_hts);
+    m_itr = NULL;
+    m_tbx = NULL;
+    m_hts = NULL;
+    free(m_str.s);
+    m_str.l = m_str.m = 0;
+    m_str.s = NULL;
+    m_region_set = false;
+    m_line_num = 0;
+    m_last_chr.clear();
+    m_last_id = -1;
+    m_error.clear();
+    m_file.clear();
+  }
+
+  bool RegionFileReader::Open(const std::string& file, const BamHeader& hdr) {
+    return open(file, hdr, file.find(".vcf") != std::string::npos);
+  }
+
+  bool RegionFileReader::OpenBED(const std::string& file, const BamHeader& hdr) {
+    return open(file, hdr, false);
+  }
+
+  bool RegionFileReader::OpenVCF(const std::string& file, const BamHeader& hdr) {
+    return open(file, hdr, true);
+  }
+
+  bool RegionFileReader::open(const std::string& file, const BamHeader& hdr, bool vcf) {
+    Close();
+    if (!m_reader.Open(file))
+      return false;
+    m_file = file;
+    m_hdr = hdr;
+    m_vcf = vcf;
+    return true;
+  }
+
+  bool RegionFileReader::SetRegion(const GenomicRegion& gr) {
+
+    if (m_file.empty())
+      return false;
+
+    // load the index the first time through
+    if (!m_tbx) {
+      m_tbx = tbx_index_load(m_file.c_str());
+      if (!m_tbx)
+	return false;
+      m_hts = hts_open(m_file.c_str(), "r");
+      if (!m_hts) {
+	tbx_destroy(m_tbx);
+	m_tbx = NULL;
+	return false;
+      }
+      // the whole-file buffers aren't needed any more
+      m_reader.Close();
+    }
+
+    if (m_itr)
+      hts_itr_destroy(m_itr);
+    m_itr = NULL;
+    m_region = gr;
+    m_region_set = true;
+    m_line_num = 0;
+    m_error.clear();
+
+    int tid = tbx_name2id(m_tbx, gr.ChrName(m_hdr).c_str());
+    if (tid < 0)
+      return true; // nothing on this chromosome
+
+    // tabix works on 0-based half-open intervals, and VCF starts are
+    // shifted down by one, so ask for a little more and trim in GetNextRegion
+    int beg = gr.pos1 > 0 ? gr.pos1 - 1 : 0;
+    int end = gr.pos2 < INT_MAX ? gr.pos2 + 1 : INT_MAX;
+    m_itr = tbx_itr_queryi(m_tbx, tid, beg, end);
+    if (!m_itr)
+      m_error = "RegionFileReader::SetRegion - could not query index of " + m_file;
+    return true;
+  }
+
+  bool RegionFileReader::GetNextRegion(GenomicRegion& gr) {
+
+    if (Failed())
+      return false;
+
+    if (!m_region_set) {
+      char* line;
+      size_t len;
+      while (m_reader.GetLine(line, len)) {
+	++m_line_num;
+	if (parse(line, len, gr))
+	  return true;
+      }
+      if (m_reader.Failed())
+	m_error = m_reader.Error();
+      return false;
+    }
+
+    if (!m_itr)
+      return false;
+
+    int ret;
+    while ((ret = tbx_itr_next(m_hts, m_tbx, m_itr, &m_str)) >= 0) {
+      ++m_line_num;
+      if (parse(m_str.s, m_str.l, gr) && gr.chr == m_region.chr &&
+	  gr.pos1 <= m_region.pos2 && gr.pos2 >= m_region.pos1)
+	return true;
+    }
+    if (ret < -1)
+      m_error = "RegionFileReader - error reading " + m_file;
+    return false;
+  }
+
+  bool RegionFileReader::parse(char* line, size_t len, GenomicRegion& gr) {
+
+    if (!len || (m_vcf ? line[0] == '#' : memchr(line, '#', len) != NULL))
+      return false;
+
+    char* fields[3];
+    size_t lens[3];
+    size_t n = SplitTabs(line, len, fields, lens, 3);
+    if (n < (m_vcf ? 2u : 3u))
+      throw std::invalid_argument("RegionFileReader - need " + std::string(m_vcf ? "at least 2" : "3") +
+				  " columns on " + where());
+
+    int32_t chr = chr_id(fields[0], lens[0]);
+    if (chr < 0)
+      return false;
+
+    int32_t pos1 = parse_pos(fields[1]);
+    gr = GenomicRegion(chr, pos1, m_vcf ? pos1 : parse_pos(fields[2]));
+    return true;
+  }
+
+  int32_t RegionFileReader::chr_id(const char* name, size_t len) {
+    if (len != m_last_chr.length() || memcmp(name, m_last_chr.data(), len)) {
+      m_last_chr.assign(name, len);
+      // same rules as the GenomicRegion string constructor
+      m_last_id = m_hdr.isEmpty() ? GenomicRegion(m_last_chr, "0", "0", m_hdr).chr : m_hdr.Name2ID(m_last_chr);
+    }
+    return m_last_id;
+  }
+
+  int32_t RegionFileReader::parse_pos(const char* s) const {
+    int32_t v = 0;
+    int err = ParseInt32(s, v);
+    if (err == EINVAL)
+      throw std::invalid_argument("RegionFileReader - bad position on " + where());
+    if (err == ERANGE)
+      throw std::out_of_range("RegionFileReader - position out of range on " + where());
+    return v;
+  }
+
+  std::string RegionFileReader::where() const {
+    if (m_region_set)
+      return "record " + tostring(m_line_num) + " of region " + m_region.ToString() + " in " + m_file;
+    return "line " + tostring(m_line_num) + " of " + m_file;
+  }
+
+}
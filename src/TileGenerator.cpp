@@ -0,0 +1,161 @@
+#include "SeqLib/TileGenerator.h"
+#include "SeqLib/SeqLibThreads.h"
+#include "SeqLib/BamWalker.h"
+
+#include <stdexcept>
+#include <algorithm>
+
+// index windows are 2^TILE_WINDOW_SHIFT bases
+#define TILE_WINDOW_SHIFT 16
+
+namespace SeqLib {
+
+  TileGenerator::TileGenerator(int width, int ovlp, const HeaderSequenceVector& h)
+    : m_width(width), m_ovlp(ovlp), m_window(0), m_target(0), m_chr(0), m_pos(0), m_end(0), m_served(0) {
+
+    if (width <= ovlp || ovlp < 0)
+      throw std::invalid_argument("TileGenerator - width should be > ovlp >= 0");
+
+    for (HeaderSequenceVector::const_iterator i = h.begin(); i != h.end(); ++i)
+      m_lengths.push_back(i->Length);
+
+    pthread_mutex_init(&m_mutex, NULL);
+  }
+
+  TileGenerator::~TileGenerator() {
+    pthread_mutex_destroy(&m_mutex);
+  }
+
+  bool TileGenerator::BalanceByIndex(const std::string& file, size_t num_tiles) {
+
+    SeqPointer<htsFile> fp(hts_open(file.c_str(), "r"), htsFile_delete());
+    if (!fp || fp->format.format != bam)
+      return false;
+    SeqPointer<hts_idx_t> idx(sam_index_load(fp.get(), file.c_str()), idx_delete());
+    if (!idx)
+      return false;
+
+    const int window = 1 << TILE_WINDOW_SHIFT;
+    std::vector<std::vector<uint64_t> > weights(m_lengths.size());
+    for (size_t chr = 0; chr < m_lengths.size(); ++chr) {
+
+      uint64_t mapped = 0, unmapped = 0;
+      if (hts_idx_get_stat(idx.get(), chr, &mapped, &unmapped) == 0 && !mapped)
+	continue;
+
+      // file offset of the first reads of each window, and of the end
+      // of the last reads on the sequence
+      const size_t nw = ((size_t)m_lengths[chr] >> TILE_WINDOW_SHIFT) + 1;
+      std::vector<int64_t> start(nw, -1);
+      int64_t end = -1;
+      for (size_t w = 0; w < nw; ++w) {
+	const int beg = w << TILE_WINDOW_SHIFT;
+	const int stop = std::min<int64_t>((int64_t)beg + window, m_lengths[chr]);
+	SeqPointer<hts_itr_t> itr(sam_itr_queryi(idx.get(), chr, beg, stop), hts_itr_delete());
+	if (!itr)
+	  continue;
+	for (int k = 0; k < itr->n_off; ++k) {
+	  const int64_t u = itr->off[k].u >> 16, v = itr->off[k].v >> 16;
+	  if (start[w] < 0 || u < start[w])
+	    start[w] = u;
+	  end = std::max(end, v);
+	}
+      }
+
+      // a window holds the bytes up to the next window with reads
+      weights[chr].assign(nw, 0);
+      int64_t next = end;
+      for (size_t w = nw; w-- > 0; )
+	if (start[w] >= 0) {
+	  weights[chr][w] = next > start[w] ? next - start[w] : 0;
+	  next = start[w];
+	}
+    }
+
+    BalanceByWeights(weights, window, num_tiles);
+    return true;
+  }
+
+  void TileGenerator::BalanceByWeights(const std::vector<std::vector<uint64_t> >& weights, int window, size_t num_tiles) {
+
+    if (window <= 0 || !num_tiles)
+      throw std::invalid_argument("TileGenerator::BalanceByWeights - window and num_tiles must be > 0");
+
+    ScopedLock lock(&m_mutex);
+
+    uint64_t total = 0;
+    for (size_t c = 0; c < weights.size(); ++c)
+      for (size_t w = 0; w < weights[c].size(); ++w)
+	total += weights[c][w];
+
+    m_weights = weights;
+    m_weights.resize(m_lengths.size());
+    m_window = window;
+    m_target = std::max<uint64_t>(total / num_tiles, 1);
+    m_chr = 0;
+    m_pos = 0;
+    m_end = 0;
+    m_served = 0;
+  }
+
+  bool TileGenerator::next_tile(GenomicRegion& gr) {
+
+    if (m_chr >= m_lengths.size())
+      return false;
+
+    const int64_t len = m_lengths[m_chr];
+    int64_t end = len;
+
+    if (m_weights.empty()) {
+      end = std::min<int64_t>((int64_t)m_pos + m_width, len);
+    } else {
+      // add windows until the tile holds its share
+      const std::vector<uint64_t>& w = m_weights[m_chr];
+      uint64_t sum = 0;
+      for (size_t k = m_end / m_window; k < w.size() && (int64_t)k * m_window < len; ++k) {
+	sum += w[k];
+	if (sum >= m_target) {
+	  end = std::min<int64_t>((int64_t)(k + 1) * m_window, len);
+	  break;
+	}
+      }
+    }
+
+    gr.chr = m_chr;
+    gr.pos1 = m_pos;
+    gr.pos2 = end;
+    gr.strand = '*';
+
+    if (end >= len) {
+      ++m_chr;
+      m_pos = 0;
+      m_end = 0;
+    } else {
+      m_pos = std::max<int64_t>(end - m_ovlp, m_pos); // starts never go back
+      m_end = end;
+    }
+    return true;
+  }
+
+  bool TileGenerator::GetNextTile(GenomicRegion& gr) {
+    size_t num;
+    return GetNextTile(gr, num);
+  }
+
+  bool TileGenerator::GetNextTile(GenomicRegion& gr, size_t& num) {
+    ScopedLock lock(&m_mutex);
+    if (!next_tile(gr))
+      return false;
+    num = m_served++;
+    return true;
+  }
+
+  void TileGenerator::Reset() {
+    ScopedLock lock(&m_mutex);
+    m_chr = 0;
+    m_pos = 0;
+    m_end = 0;
+    m_served = 0;
+  }
+
+}
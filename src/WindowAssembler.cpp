@@ -0,0 +1,192 @@
+#include "SeqLib/WindowAssembler.h"
+#include "SeqLib/FermiAssembler.h"
+#include "SeqLib/SeqLibThreads.h"
+
+#include <stdexcept>
+#include <iomanip>
+
+namespace SeqLib {
+
+  // one window moving through the run
+  struct _WindowJob {
+    WindowContigs result;
+    BamRecordVector reads;
+  };
+
+  // the read and assembly stages, run on one window at a time
+  struct _WindowStages {
+
+    _WindowStages() : reader(NULL), windows(NULL), max_reads(0), correct(true), min_overlap(0), i(0) {}
+
+    BamReader* reader;
+    const GRC* windows;
+    size_t max_reads;
+    bool correct;
+    uint32_t min_overlap;
+
+    size_t i; // next window to read
+
+    _WindowJob* Read() {
+
+      if (i >= windows->size())
+	return NULL;
+
+      _WindowJob* job = new _WindowJob;
+      job->result.id = i;
+      job->result.window = windows->at(i);
+      ++i;
+
+      // keep at most one read past the limit, but count them all
+      BamRecord rec;
+      size_t n = 0;
+      if (reader->SetRegion(job->result.window))
+	while (reader->GetNextRecord(rec)) {
+	  if (!max_reads || job->reads.size() <= max_reads)
+	    job->reads.push_back(rec);
+	  ++n;
+	}
+      job->result.num_reads = n;
+      return job;
+    }
+
+    void Work(_WindowJob* job, int) {
+      WindowContigs& w = job->result;
+      if (max_reads && w.num_reads > max_reads) {
+	w.skipped = true;
+      } else if (job->reads.size()) {
+	FermiAssembler f;
+	if (min_overlap)
+	  f.SetMinOverlap(min_overlap);
+	f.AddReads(job->reads);
+	if (correct)
+	  f.CorrectReads();
+	f.PerformAssembly();
+	w.contigs = f.GetContigs();
+      }
+      BamRecordVector().swap(job->reads);
+    }
+
+  };
+
+  struct _WindowRun {
+
+    _WindowRun(int num_threads, size_t queue_size) : pipeline(stages, num_threads, queue_size), start(0) {}
+
+    _WindowStages stages;
+    OrderedPipeline<_WindowJob, _WindowStages> pipeline;
+
+    double start;
+
+  };
+
+  WindowAssembler::~WindowAssembler() {
+    stop();
+  }
+
+  bool WindowAssembler::Open(const std::string& bam) {
+    Reset();
+    return m_reader.Open(bam);
+  }
+
+  bool WindowAssembler::Open(const std::vector<std::string>& bams) {
+    Reset();
+    return m_reader.Open(bams);
+  }
+
+  void WindowAssembler::SetWindows(const GRC& windows) {
+    Reset();
+    m_windows = windows;
+  }
+
+  void WindowAssembler::SetNumThreads(int n) {
+    if (n < 1)
+      throw std::invalid_argument("WindowAssembler::SetNumThreads - need at least one thread");
+    m_threads = n;
+  }
+
+  void WindowAssembler::SetQueueSize(size_t n) {
+    if (!n)
+      throw std::invalid_argument("WindowAssembler::SetQueueSize - queue size must be > 0");
+    m_queue_size = n;
+  }
+
+  void WindowAssembler::Reset() {
+    stop();
+    m_done = false;
+  }
+
+  void WindowAssembler::start() {
+
+    m_stats = WindowAssemblerStats();
+
+    m_run = new _WindowRun(m_threads, m_queue_size);
+    m_run->stages.reader = &m_reader;
+    m_run->stages.windows = &m_windows;
+    m_run->stages.max_reads = m_max_reads;
+    m_run->stages.correct = m_correct;
+    m_run->stages.min_overlap = m_min_overlap;
+    m_run->start = WallTime();
+
+    try {
+      m_run->pipeline.Start();
+    } catch (const std::runtime_error&) {
+      delete m_run;
+      m_run = NULL;
+      throw;
+    }
+  }
+
+  void WindowAssembler::stop() {
+
+    if (!m_run)
+      return;
+
+    m_run->pipeline.Stop();
+
+    m_stats.read_time = m_run->pipeline.ReadTime();
+    m_stats.assemble_time = m_run->pipeline.WorkTime();
+    m_stats.wall_time = WallTime() - m_run->start;
+    m_stats.assemble_queue_max = m_run->pipeline.WorkQueue().MaxOccupancy();
+    m_stats.assemble_queue_mean = m_run->pipeline.WorkQueue().MeanOccupancy();
+
+    delete m_run;
+    m_run = NULL;
+  }
+
+  bool WindowAssembler::GetNextWindow(WindowContigs& w) {
+
+    if (m_done)
+      return false;
+    if (!m_run)
+      start();
+
+    // all windows are out
+    _WindowJob* job;
+    if (!m_run->pipeline.Next(job)) {
+      stop();
+      m_done = true;
+      return false;
+    }
+
+    w = job->result;
+    ++m_stats.windows;
+    m_stats.skipped += w.skipped;
+    m_stats.reads += w.num_reads;
+    m_stats.contigs += w.contigs.size();
+    return true;
+  }
+
+  std::ostream& operator<<(std::ostream& out, const WindowAssemblerStats& s) {
+    out << std::fixed << std::setprecision(2)
+	<< "read:     " << AddCommas(s.reads) << " reads in " << s.read_time << "s ("
+	<< AddCommas((uint64_t)PerSecond(s.reads, s.read_time)) << " reads/s)" << std::endl
+	<< "assemble: " << AddCommas(s.windows - s.skipped) << " windows in " << s.assemble_time << "s of thread time ("
+	<< PerSecond(s.windows - s.skipped, s.assemble_time) << " windows/s/thread), "
+	<< AddCommas(s.skipped) << " skipped"
+	<< " queue max " << s.assemble_queue_max << " mean " << s.assemble_queue_mean << std::endl
+	<< "total:    " << AddCommas(s.windows) << " windows, " << AddCommas(s.contigs) << " contigs in "
+	<< s.wall_time << "s wall (" << PerSecond(s.windows, s.wall_time) << " windows/s)";
+    return out;
+  }
+
+}
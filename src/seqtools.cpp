@@ -5,6 +5,7 @@
 #include <cassert>
 
 #include "SeqLib/BFC.h"
+#include "SeqLib/BFCStream.h"
 #include "SeqLib/FastqReader.h"
 #include "SeqLib/BamReader.h"
 #include "SeqLib/BamWriter.h"
@@ -35,6 +36,11 @@ static const char *BFC_USAGE_MESSAGE =
 "  --cram,      -C        Output stream should be a CRAM (not SAM)\n"
 "  --infasta,   -F <file> Input a FASTA insted of BAM/SAM/CRAM stream\n"
 "  --reference, -G <file> Reference genome if using BWA-MEM realignment\n"
+"  --save-table,-K <file> Count a correction table from the input, write it to <file> and exit\n"
+"  --train-reads,-N <int> Number of reads from the start of the input to count with -K, 0 for all [1000000]\n"
+"  --table,     -k <file> Stream-correct against a table from -K (no realignment, bounded memory)\n"
+"  --threads,   -t <int>  Number of correction threads when streaming [1]\n"
+"  --chunk,     -c <int>  Number of reads per chunk when streaming [10000]\n"
 "\nReport bugs to jwala@broadinstitute.org \n\n";
 
 static const char *GOFISH_USAGE_MESSAGE =
@@ -75,9 +81,14 @@ namespace opt {
   static std::string reference = "/seq/references/Homo_sapiens_assembly19/v1/Homo_sapiens_assembly19.fasta";
   static std::string fasta; // input is a fasta
   static std::string target; // input target sequence
+  static std::string table; // bfc table to stream-correct against
+  static std::string save_table; // bfc table to write
+  static int threads = 1;
+  static size_t chunk = 10000;
+  static size_t train_reads = 1000000; // reads to count a table from
 }
 
-static const char* shortopts = "hbfvCG:F:T:";
+static const char* shortopts = "hbfvCG:F:T:k:K:t:c:N:";
 static const struct option longopts[] = {
   { "help",                    no_argument, NULL, 'h' },
   { "verbose",                 no_argument, NULL, 'v' },
@@ -87,6 +98,11 @@ static const struct option longopts[] = {
   { "infasta",                 required_argument, NULL, 'F' },
   { "reference",               required_argument, NULL, 'G' },
   { "target",                  required_argument, NULL, 'T' },
+  { "table",                   required_argument, NULL, 'k' },
+  { "save-table",              required_argument, NULL, 'K' },
+  { "threads",                 required_argument, NULL, 't' },
+  { "chunk",                   required_argument, NULL, 'c' },
+  { "train-reads",             required_argument, NULL, 'N' },
   { NULL, 0, NULL, 0 }
 };
 
@@ -215,10 +231,121 @@ void runfml(int argc, char** argv) {
   
 }
 
+// count a table from the start of the input and write it out
+static void savebfctable() {
+
+  SeqLib::BFC b;
+
+  // every training read is held until the table is counted, so stop
+  // after the sample, passing it over a chunk at a time
+  size_t n = 0;
+  if (!opt::fasta.empty()) {
+    SeqLib::FastqReader f(opt::fasta);
+    SeqLib::UnalignedSequenceVector usv;
+    SeqLib::UnalignedSequence u;
+    while ((!opt::train_reads || n < opt::train_reads) && f.GetNextSequence(u)) {
+      usv.push_back(u);
+      ++n;
+      if (usv.size() == opt::chunk) {
+	b.AddTrainingReads(usv);
+	usv.clear();
+      }
+    }
+    b.AddTrainingReads(usv);
+  } else {
+    SeqLib::BamReader br;
+    if (!br.Open(opt::input)) {
+      std::cerr << "Failed to open " << opt::input << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    SeqLib::BamRecordVector brv;
+    SeqLib::BamRecord rec;
+    while ((!opt::train_reads || n < opt::train_reads) && br.GetNextRecord(rec)) {
+      brv.push_back(rec);
+      ++n;
+      if (brv.size() == opt::chunk) {
+	b.AddTrainingReads(brv);
+	brv.clear();
+      }
+    }
+    b.AddTrainingReads(brv);
+  }
+
+  if (opt::verbose)
+    std::cerr << "...read in " << SeqLib::AddCommas(n) << " training sequences" << std::endl;
+
+  b.SetNumThreads(opt::threads);
+  if (opt::verbose)
+    std::cerr << "...counting k-mers" << std::endl;
+  b.FreezeCorrection();
+  if (!b.SaveCorrection(opt::save_table)) {
+    std::cerr << "Failed to write correction table " << opt::save_table << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  if (opt::verbose)
+    std::cerr << "...wrote correction table " << opt::save_table << std::endl;
+}
+
+// correct the input chunk by chunk against a saved table
+static void streambfc() {
+
+  SeqLib::BFC b;
+  if (!b.LoadCorrection(opt::table)) {
+    std::cerr << "Failed to load correction table " << opt::table << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  SeqLib::BFCStream s(b);
+  s.SetNumThreads(opt::threads);
+  s.SetChunkSize(opt::chunk);
+
+  bool ok;
+  if (!opt::fasta.empty()) {
+    SeqLib::FastqReader f(opt::fasta);
+    ok = s.Run(f, std::cout);
+  } else {
+    SeqLib::BamReader br;
+    if (!br.Open(opt::input)) {
+      std::cerr << "Failed to open " << opt::input << std::endl;
+      exit(EXIT_FAILURE);
+    }
+
+    // the reads keep their alignments, so keep the input header
+    SeqLib::BamWriter bw(opt::mode == 'b' ? SeqLib::BAM : opt::mode == 'C' ? SeqLib::CRAM : SeqLib::SAM);
+    if (opt::mode == 'C')
+      bw.SetCramReference(opt::reference);
+    bw.SetHeader(br.Header());
+    bw.Open("-");
+    bw.WriteHeader();
+    ok = s.Run(br, bw);
+    bw.Close();
+  }
+
+  if (opt::verbose)
+    std::cerr << s.Stats() << std::endl;
+  if (!ok) {
+    std::cerr << "Failed to write corrected reads" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+}
+
 void runbfc(int argc, char** argv) {
 
   parseOptions(argc, argv, BFC_USAGE_MESSAGE);
 
+  if (opt::threads < 1 || !opt::chunk) {
+    std::cerr << "Threads and chunk size must be > 0" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  if (!opt::save_table.empty()) {
+    savebfctable();
+    return;
+  }
+  if (!opt::table.empty()) {
+    streambfc();
+    return;
+  }
+
   SeqLib::BFC b;
 
   if (!opt::fasta.empty()) {
@@ -350,6 +477,11 @@ void parseOptions(int argc, char** argv, const char* msg) {
     case 'C': opt::mode = 'C'; break;
     case 'T': arg >> opt::target; break;
     case 'G': arg >> opt::reference; break;
+    case 'k': arg >> opt::table; break;
+    case 'K': arg >> opt::save_table; break;
+    case 't': arg >> opt::threads; break;
+    case 'c': arg >> opt::chunk; break;
+    case 'N': arg >> opt::train_reads; break;
     default: die= true; 
     }
   }
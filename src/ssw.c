@@ -51,6 +51,13 @@
 #define UNLIKELY(x) (x)
 #endif
 
+/* The AVX2 kernels are compiled for AVX2 function by function, and picked at run time. */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SSW_HAVE_AVX2 1
+#include <immintrin.h>
+#define SSW_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
 /* Convert the coordinate in the scoring matrix into the coordinate in one line of the band. */
 #define set_u(u, w, i, j) { int x=(i)-(w); x=x>0?x:0; (u)=(j)-x+1; }
 
@@ -76,27 +83,45 @@ typedef struct {
 } cigar;
 
 struct _profile{
-	__m128i* profile_byte;	// 0: none
-	__m128i* profile_word;	// 0: none
+	void* profile_byte;	// 0: none; __m128i or __m256i, by simd
+	void* profile_word;	// 0: none
 	const int8_t* read;
 	const int8_t* mat;
 	int32_t readLen;
 	int32_t n;
 	uint8_t bias;
+	int simd;	// SSW_SIMD_SSE2 or SSW_SIMD_AVX2
 };
 
+/* -1 until detected or set */
+static int ssw_simd = -1;
+
+/* Number of 8-bit lanes of the kernels. */
+static int32_t simd_lanes (int simd) {
+	return simd == SSW_SIMD_AVX2 ? 32 : 16;
+}
+
+/* Zeroed memory aligned for the widest vectors. */
+static void* calloc_simd (size_t size) {
+	void* p = 0;
+	if (posix_memalign(&p, 32, size ? size : 32)) return 0;
+	memset(p, 0, size);
+	return p;
+}
+
 /* Generate query profile rearrange query sequence & calculate the weight of match/mismatch. */
-static __m128i* qP_byte (const int8_t* read_num,
+static void* qP_byte (const int8_t* read_num,
 				  const int8_t* mat,
 				  const int32_t readLen,
 				  const int32_t n,	/* the edge length of the squre matrix mat */
-				  uint8_t bias) {
+				  uint8_t bias,
+				  int32_t lanes) {	/* 16 for SSE2, 32 for AVX2 */
 
-	int32_t segLen = (readLen + 15) / 16; /* Split the 128 bit register into 16 pieces.
-								     Each piece is 8 bit. Split the read into 16 segments.
-								     Calculat 16 segments in parallel.
+	int32_t segLen = (readLen + lanes - 1) / lanes; /* Split the register into lanes pieces.
+								     Each piece is 8 bit. Split the read into lanes segments.
+								     Calculat the segments in parallel.
 								   */
-	__m128i* vProfile = (__m128i*)malloc(n * segLen * sizeof(__m128i));
+	void* vProfile = calloc_simd(n * segLen * lanes);
 	int8_t* t = (int8_t*)vProfile;
 	int32_t nt, i, j, segNum;
 
@@ -104,7 +129,7 @@ static __m128i* qP_byte (const int8_t* read_num,
 	for (nt = 0; LIKELY(nt < n); nt ++) {
 		for (i = 0; i < segLen; i ++) {
 			j = i;
-			for (segNum = 0; LIKELY(segNum < 16) ; segNum ++) {
+			for (segNum = 0; LIKELY(segNum < lanes) ; segNum ++) {
 				*t++ = j>= readLen ? bias : mat[nt * n + read_num[j]] + bias;
 				j += segLen;
 			}
@@ -342,13 +367,14 @@ static alignment_end* sw_sse2_byte (const int8_t* ref,
 	return bests;
 }
 
-static __m128i* qP_word (const int8_t* read_num,
+static void* qP_word (const int8_t* read_num,
 				  const int8_t* mat,
 				  const int32_t readLen,
-				  const int32_t n) {
+				  const int32_t n,
+				  int32_t lanes) {	/* 8 for SSE2, 16 for AVX2 */
 
-	int32_t segLen = (readLen + 7) / 8;
-	__m128i* vProfile = (__m128i*)malloc(n * segLen * sizeof(__m128i));
+	int32_t segLen = (readLen + lanes - 1) / lanes;
+	void* vProfile = calloc_simd(n * segLen * lanes * sizeof(int16_t));
 	int16_t* t = (int16_t*)vProfile;
 	int32_t nt, i, j;
 	int32_t segNum;
@@ -357,7 +383,7 @@ static __m128i* qP_word (const int8_t* read_num,
 	for (nt = 0; LIKELY(nt < n); nt ++) {
 		for (i = 0; i < segLen; i ++) {
 			j = i;
-			for (segNum = 0; LIKELY(segNum < 8) ; segNum ++) {
+			for (segNum = 0; LIKELY(segNum < lanes) ; segNum ++) {
 				*t++ = j>= readLen ? 0 : mat[nt * n + read_num[j]];
 				j += segLen;
 			}
@@ -544,6 +570,430 @@ end:
 	return bests;
 }
 
+#ifdef SSW_HAVE_AVX2
+
+/* Shift the whole 256-bit value left by n bytes, carrying across the two 128-bit lanes. */
+#define avx2_slli(v, n) _mm256_alignr_epi8((v), _mm256_permute2x128_si256((v), (v), 0x08), 16 - (n))
+
+/* The read is padded to a multiple of the lane count, and the padding rows score 0 on
+   the diagonal, so they carry scores on to later columns. Mark the rows inside the
+   padding SSE2 would use (sse2_len rows); the kernels hold the others at 0, so that
+   both paths fill in the same matrix. */
+static void* avx2_row_mask (int32_t segLen, int32_t lanes, int32_t sse2_len) {
+	int32_t size = 32 / lanes, i, j;
+	uint8_t* m = (uint8_t*) calloc_simd(segLen * 32);
+	for (j = 0; j < segLen; ++j)
+		for (i = 0; i < lanes; ++i)
+			if (j + i * segLen < sse2_len) memset(m + (j * lanes + i) * size, 0xff, size);
+	return m;
+}
+
+/* Same as sw_sse2_byte, with 32 segments of the read in parallel. */
+SSW_TARGET_AVX2
+static alignment_end* sw_avx2_byte (const int8_t* ref,
+							 int8_t ref_dir,	// 0: forward ref; 1: reverse ref
+							 int32_t refLen,
+							 int32_t readLen,
+							 const uint8_t weight_gapO, /* will be used as - */
+							 const uint8_t weight_gapE, /* will be used as - */
+							 const __m256i* vProfile,
+							 uint8_t terminate,
+	 						 uint8_t bias,  /* Shift 0 point to a positive value. */
+							 int32_t maskLen) {
+
+#define max32(m, vm) { __m128i vx = _mm_max_epu8(_mm256_castsi256_si128(vm), _mm256_extracti128_si256((vm), 1)); \
+					  vx = _mm_max_epu8(vx, _mm_srli_si128(vx, 8)); \
+					  vx = _mm_max_epu8(vx, _mm_srli_si128(vx, 4)); \
+					  vx = _mm_max_epu8(vx, _mm_srli_si128(vx, 2)); \
+					  vx = _mm_max_epu8(vx, _mm_srli_si128(vx, 1)); \
+					  (m) = _mm_extract_epi16(vx, 0); }
+
+	uint8_t max = 0;		                     /* the max alignment score */
+	int32_t end_read = readLen - 1;
+	int32_t end_ref = -1; /* 0_based best alignment ending point; Initialized as isn't aligned -1. */
+	int32_t segLen = (readLen + 31) / 32; /* number of segment */
+
+	/* array to record the largest score of each reference position */
+	uint8_t* maxColumn = (uint8_t*) calloc(refLen, 1);
+
+	__m256i vZero = _mm256_setzero_si256();
+
+	__m256i* pvHStore = (__m256i*) calloc_simd(segLen * sizeof(__m256i));
+	__m256i* pvHLoad = (__m256i*) calloc_simd(segLen * sizeof(__m256i));
+	__m256i* pvE = (__m256i*) calloc_simd(segLen * sizeof(__m256i));
+	__m256i* pvHmax = (__m256i*) calloc_simd(segLen * sizeof(__m256i));
+	__m256i* pvMask = (__m256i*) avx2_row_mask(segLen, 32, (readLen + 15) / 16 * 16);
+
+	int32_t i, j;
+	__m256i vGapO = _mm256_set1_epi8(weight_gapO);
+	__m256i vGapE = _mm256_set1_epi8(weight_gapE);
+	__m256i vBias = _mm256_set1_epi8(bias);
+
+	__m256i vMaxScore = vZero; /* Trace the highest score of the whole SW matrix. */
+	__m256i vMaxMark = vZero; /* Trace the highest score till the previous column. */
+	__m256i vTemp;
+	int32_t edge, begin = 0, end = refLen, step = 1;
+
+	/* outer loop to process the reference sequence */
+	if (ref_dir == 1) {
+		begin = refLen - 1;
+		end = -1;
+		step = -1;
+	}
+	for (i = begin; LIKELY(i != end); i += step) {
+		uint32_t cmp;
+		__m256i e, vF = vZero, vMaxColumn = vZero;
+
+		__m256i vH = pvHStore[segLen - 1];
+		vH = avx2_slli(vH, 1);
+		const __m256i* vP = vProfile + ref[i] * segLen; /* Right part of the vProfile */
+
+		/* Swap the 2 H buffers. */
+		__m256i* pv = pvHLoad;
+		pvHLoad = pvHStore;
+		pvHStore = pv;
+
+		/* inner loop to process the query sequence */
+		for (j = 0; LIKELY(j < segLen); ++j) {
+			vH = _mm256_adds_epu8(vH, _mm256_load_si256(vP + j));
+			vH = _mm256_subs_epu8(vH, vBias); /* vH will be always > 0 */
+
+			/* Get max from vH, vE and vF. */
+			e = _mm256_load_si256(pvE + j);
+			vH = _mm256_max_epu8(vH, e);
+			vH = _mm256_max_epu8(vH, vF);
+			vH = _mm256_and_si256(vH, _mm256_load_si256(pvMask + j));
+			vMaxColumn = _mm256_max_epu8(vMaxColumn, vH);
+
+			/* Save vH values. */
+			_mm256_store_si256(pvHStore + j, vH);
+
+			/* Update vE value. */
+			vH = _mm256_subs_epu8(vH, vGapO); /* saturation arithmetic, result >= 0 */
+			e = _mm256_subs_epu8(e, vGapE);
+			e = _mm256_max_epu8(e, vH);
+			_mm256_store_si256(pvE + j, e);
+
+			/* Update vF value. */
+			vF = _mm256_subs_epu8(vF, vGapE);
+			vF = _mm256_max_epu8(vF, vH);
+
+			/* Load the next vH. */
+			vH = _mm256_load_si256(pvHLoad + j);
+		}
+
+		/* Lazy_F loop, as in sw_sse2_byte */
+		j = 0;
+		vH = _mm256_load_si256 (pvHStore + j);
+		vF = _mm256_and_si256 (avx2_slli (vF, 1), _mm256_load_si256 (pvMask + j));
+		vTemp = _mm256_subs_epu8 (vH, vGapO);
+		vTemp = _mm256_subs_epu8 (vF, vTemp);
+		vTemp = _mm256_cmpeq_epi8 (vTemp, vZero);
+		cmp = _mm256_movemask_epi8 (vTemp);
+
+		while (cmp != 0xffffffffu) {
+			vH = _mm256_max_epu8 (vH, vF);
+			vMaxColumn = _mm256_max_epu8(vMaxColumn, vH);
+			_mm256_store_si256 (pvHStore + j, vH);
+			vF = _mm256_subs_epu8 (vF, vGapE);
+			j++;
+			if (j >= segLen) {
+				j = 0;
+				vF = avx2_slli (vF, 1);
+			}
+			vF = _mm256_and_si256 (vF, _mm256_load_si256 (pvMask + j));
+			vH = _mm256_load_si256 (pvHStore + j);
+
+			vTemp = _mm256_subs_epu8 (vH, vGapO);
+			vTemp = _mm256_subs_epu8 (vF, vTemp);
+			vTemp = _mm256_cmpeq_epi8 (vTemp, vZero);
+			cmp = _mm256_movemask_epi8 (vTemp);
+		}
+
+		vMaxScore = _mm256_max_epu8(vMaxScore, vMaxColumn);
+		vTemp = _mm256_cmpeq_epi8(vMaxMark, vMaxScore);
+		cmp = _mm256_movemask_epi8(vTemp);
+		if (cmp != 0xffffffffu) {
+			uint8_t temp;
+			vMaxMark = vMaxScore;
+			max32(temp, vMaxScore);
+			vMaxScore = vMaxMark;
+
+			if (LIKELY(temp > max)) {
+				max = temp;
+				if (max + bias >= 255) break;	//overflow
+				end_ref = i;
+
+				/* Store the column with the highest alignment score in order to trace the alignment ending position on read. */
+				for (j = 0; LIKELY(j < segLen); ++j) pvHmax[j] = pvHStore[j];
+			}
+		}
+
+		/* Record the max score of current column. */
+		max32(maxColumn[i], vMaxColumn);
+		if (maxColumn[i] == terminate) break;
+	}
+
+	/* Trace the alignment ending position on read. */
+	uint8_t *t = (uint8_t*)pvHmax;
+	int32_t column_len = segLen * 32;
+	for (i = 0; LIKELY(i < column_len); ++i, ++t) {
+		int32_t temp;
+		if (*t == max) {
+			temp = i / 32 + i % 32 * segLen;
+			if (temp < end_read) end_read = temp;
+		}
+	}
+
+	free(pvMask);
+	free(pvHmax);
+	free(pvE);
+	free(pvHLoad);
+	free(pvHStore);
+
+	/* Find the most possible 2nd best alignment. */
+	alignment_end* bests = (alignment_end*) calloc(2, sizeof(alignment_end));
+	bests[0].score = max + bias >= 255 ? 255 : max;
+	bests[0].ref = end_ref;
+	bests[0].read = end_read;
+
+	bests[1].score = 0;
+	bests[1].ref = 0;
+	bests[1].read = 0;
+
+	edge = (end_ref - maskLen) > 0 ? (end_ref - maskLen) : 0;
+	for (i = 0; i < edge; i ++) {
+		if (maxColumn[i] > bests[1].score) {
+			bests[1].score = maxColumn[i];
+			bests[1].ref = i;
+		}
+	}
+	edge = (end_ref + maskLen) > refLen ? refLen : (end_ref + maskLen);
+	for (i = edge + 1; i < refLen; i ++) {
+		if (maxColumn[i] > bests[1].score) {
+			bests[1].score = maxColumn[i];
+			bests[1].ref = i;
+		}
+	}
+
+	free(maxColumn);
+	return bests;
+}
+
+/* Same as sw_sse2_word, with 16 segments of the read in parallel. */
+SSW_TARGET_AVX2
+static alignment_end* sw_avx2_word (const int8_t* ref,
+							 int8_t ref_dir,	// 0: forward ref; 1: reverse ref
+							 int32_t refLen,
+							 int32_t readLen,
+							 const uint8_t weight_gapO, /* will be used as - */
+							 const uint8_t weight_gapE, /* will be used as - */
+							 const __m256i* vProfile,
+							 uint16_t terminate,
+							 int32_t maskLen) {
+
+#define max16w(m, vm) { __m128i vx = _mm_max_epi16(_mm256_castsi256_si128(vm), _mm256_extracti128_si256((vm), 1)); \
+					vx = _mm_max_epi16(vx, _mm_srli_si128(vx, 8)); \
+					vx = _mm_max_epi16(vx, _mm_srli_si128(vx, 4)); \
+					vx = _mm_max_epi16(vx, _mm_srli_si128(vx, 2)); \
+					(m) = _mm_extract_epi16(vx, 0); }
+
+	uint16_t max = 0;		                     /* the max alignment score */
+	int32_t end_read = readLen - 1;
+	int32_t end_ref = 0; /* 1_based best alignment ending point; Initialized as isn't aligned - 0. */
+	int32_t segLen = (readLen + 15) / 16; /* number of segment */
+
+	/* array to record the largest score of each reference position */
+	uint16_t* maxColumn = (uint16_t*) calloc(refLen, 2);
+
+	__m256i vZero = _mm256_setzero_si256();
+
+	__m256i* pvHStore = (__m256i*) calloc_simd(segLen * sizeof(__m256i));
+	__m256i* pvHLoad = (__m256i*) calloc_simd(segLen * sizeof(__m256i));
+	__m256i* pvE = (__m256i*) calloc_simd(segLen * sizeof(__m256i));
+	__m256i* pvHmax = (__m256i*) calloc_simd(segLen * sizeof(__m256i));
+	__m256i* pvMask = (__m256i*) avx2_row_mask(segLen, 16, (readLen + 7) / 8 * 8);
+
+	int32_t i, j, k;
+	__m256i vGapO = _mm256_set1_epi16(weight_gapO);
+	__m256i vGapE = _mm256_set1_epi16(weight_gapE);
+
+	__m256i vMaxScore = vZero; /* Trace the highest score of the whole SW matrix. */
+	__m256i vMaxMark = vZero; /* Trace the highest score till the previous column. */
+	__m256i vTemp;
+	int32_t edge, begin = 0, end = refLen, step = 1;
+
+	/* outer loop to process the reference sequence */
+	if (ref_dir == 1) {
+		begin = refLen - 1;
+		end = -1;
+		step = -1;
+	}
+	for (i = begin; LIKELY(i != end); i += step) {
+		uint32_t cmp;
+		__m256i e, vF = vZero;
+		__m256i vH = pvHStore[segLen - 1];
+		vH = avx2_slli (vH, 2);
+
+		/* Swap the 2 H buffers. */
+		__m256i* pv = pvHLoad;
+
+		__m256i vMaxColumn = vZero; /* vMaxColumn is used to record the max values of column i. */
+
+		const __m256i* vP = vProfile + ref[i] * segLen; /* Right part of the vProfile */
+		pvHLoad = pvHStore;
+		pvHStore = pv;
+
+		/* inner loop to process the query sequence */
+		for (j = 0; LIKELY(j < segLen); j ++) {
+			vH = _mm256_adds_epi16(vH, _mm256_load_si256(vP + j));
+
+			/* Get max from vH, vE and vF. */
+			e = _mm256_load_si256(pvE + j);
+			vH = _mm256_max_epi16(vH, e);
+			vH = _mm256_max_epi16(vH, vF);
+			vH = _mm256_and_si256(vH, _mm256_load_si256(pvMask + j));
+			vMaxColumn = _mm256_max_epi16(vMaxColumn, vH);
+
+			/* Save vH values. */
+			_mm256_store_si256(pvHStore + j, vH);
+
+			/* Update vE value. */
+			vH = _mm256_subs_epu16(vH, vGapO); /* saturation arithmetic, result >= 0 */
+			e = _mm256_subs_epu16(e, vGapE);
+			e = _mm256_max_epi16(e, vH);
+			_mm256_store_si256(pvE + j, e);
+
+			/* Update vF value. */
+			vF = _mm256_subs_epu16(vF, vGapE);
+			vF = _mm256_max_epi16(vF, vH);
+
+			/* Load the next vH. */
+			vH = _mm256_load_si256(pvHLoad + j);
+		}
+
+		/* Lazy_F loop, as in sw_sse2_word */
+		for (k = 0; LIKELY(k < 16); ++k) {
+			vF = avx2_slli (vF, 2);
+			for (j = 0; LIKELY(j < segLen); ++j) {
+				vF = _mm256_and_si256(vF, _mm256_load_si256(pvMask + j));
+				vH = _mm256_load_si256(pvHStore + j);
+				vH = _mm256_max_epi16(vH, vF);
+				vMaxColumn = _mm256_max_epi16(vMaxColumn, vH);
+				_mm256_store_si256(pvHStore + j, vH);
+				vH = _mm256_subs_epu16(vH, vGapO);
+				vF = _mm256_subs_epu16(vF, vGapE);
+				if (UNLIKELY(! _mm256_movemask_epi8(_mm256_cmpgt_epi16(vF, vH)))) goto end;
+			}
+		}
+
+end:
+		vMaxScore = _mm256_max_epi16(vMaxScore, vMaxColumn);
+		vTemp = _mm256_cmpeq_epi16(vMaxMark, vMaxScore);
+		cmp = _mm256_movemask_epi8(vTemp);
+		if (cmp != 0xffffffffu) {
+			uint16_t temp;
+			vMaxMark = vMaxScore;
+			max16w(temp, vMaxScore);
+			vMaxScore = vMaxMark;
+
+			if (LIKELY(temp > max)) {
+				max = temp;
+				end_ref = i;
+				for (j = 0; LIKELY(j < segLen); ++j) pvHmax[j] = pvHStore[j];
+			}
+		}
+
+		/* Record the max score of current column. */
+		max16w(maxColumn[i], vMaxColumn);
+		if (maxColumn[i] == terminate) break;
+	}
+
+	/* Trace the alignment ending position on read. */
+	uint16_t *t = (uint16_t*)pvHmax;
+	int32_t column_len = segLen * 16;
+	for (i = 0; LIKELY(i < column_len); ++i, ++t) {
+		int32_t temp;
+		if (*t == max) {
+			temp = i / 16 + i % 16 * segLen;
+			if (temp < end_read) end_read = temp;
+		}
+	}
+
+	free(pvMask);
+	free(pvHmax);
+	free(pvE);
+	free(pvHLoad);
+	free(pvHStore);
+
+	/* Find the most possible 2nd best alignment. */
+	alignment_end* bests = (alignment_end*) calloc(2, sizeof(alignment_end));
+	bests[0].score = max;
+	bests[0].ref = end_ref;
+	bests[0].read = end_read;
+
+	bests[1].score = 0;
+	bests[1].ref = 0;
+	bests[1].read = 0;
+
+	edge = (end_ref - maskLen) > 0 ? (end_ref - maskLen) : 0;
+	for (i = 0; i < edge; i ++) {
+		if (maxColumn[i] > bests[1].score) {
+			bests[1].score = maxColumn[i];
+			bests[1].ref = i;
+		}
+	}
+	edge = (end_ref + maskLen) > refLen ? refLen : (end_ref + maskLen);
+	for (i = edge; i < refLen; i ++) {
+		if (maxColumn[i] > bests[1].score) {
+			bests[1].score = maxColumn[i];
+			bests[1].ref = i;
+		}
+	}
+
+	free(maxColumn);
+	return bests;
+}
+
+#endif	// SSW_HAVE_AVX2
+
+/* Run the byte kernel a profile was built for. */
+static alignment_end* sw_byte (int simd, const int8_t* ref, int8_t ref_dir, int32_t refLen, int32_t readLen,
+							 const uint8_t weight_gapO, const uint8_t weight_gapE, const void* vProfile,
+							 uint8_t terminate, uint8_t bias, int32_t maskLen) {
+#ifdef SSW_HAVE_AVX2
+	if (simd == SSW_SIMD_AVX2)
+		return sw_avx2_byte(ref, ref_dir, refLen, readLen, weight_gapO, weight_gapE, (const __m256i*)vProfile, terminate, bias, maskLen);
+#endif
+	return sw_sse2_byte(ref, ref_dir, refLen, readLen, weight_gapO, weight_gapE, (const __m128i*)vProfile, terminate, bias, maskLen);
+}
+
+/* Run the word kernel a profile was built for. */
+static alignment_end* sw_word (int simd, const int8_t* ref, int8_t ref_dir, int32_t refLen, int32_t readLen,
+							 const uint8_t weight_gapO, const uint8_t weight_gapE, const void* vProfile,
+							 uint16_t terminate, int32_t maskLen) {
+#ifdef SSW_HAVE_AVX2
+	if (simd == SSW_SIMD_AVX2)
+		return sw_avx2_word(ref, ref_dir, refLen, readLen, weight_gapO, weight_gapE, (const __m256i*)vProfile, terminate, maskLen);
+#endif
+	return sw_sse2_word(ref, ref_dir, refLen, readLen, weight_gapO, weight_gapE, (const __m128i*)vProfile, terminate, maskLen);
+}
+
+int ssw_set_simd (int level) {
+	ssw_simd = SSW_SIMD_SSE2;
+#ifdef SSW_HAVE_AVX2
+	if (level != SSW_SIMD_SSE2 && __builtin_cpu_supports("avx2"))
+		ssw_simd = SSW_SIMD_AVX2;
+#else
+	(void)level;
+#endif
+	return ssw_simd;
+}
+
+int ssw_get_simd (void) {
+	return ssw_simd < 0 ? ssw_set_simd(SSW_SIMD_AUTO) : ssw_simd;
+}
+
 static cigar* banded_sw (const int8_t* ref,
 				 const int8_t* read,
 				 int32_t refLen,
@@ -628,7 +1078,7 @@ static cigar* banded_sw (const int8_t* ref,
 			for (j = 1; j <= u; j ++) h_b[j] = h_c[j];
 		}
 		band_width *= 2;
-	} while (LIKELY(max < score));
+	} while (LIKELY(max < score) && band_width / 2 < (readLen > refLen ? readLen : refLen)); // stop once the band covers the whole matrix
 	band_width /= 2;
 
 	// trace back
@@ -751,6 +1201,7 @@ s_profile* ssw_init (const int8_t* read, const int32_t readLen, const int8_t* ma
 	p->profile_byte = 0;
 	p->profile_word = 0;
 	p->bias = 0;
+	p->simd = ssw_get_simd();
 
 	if (score_size == 0 || score_size == 2) {
 		/* Find the bias to use in the substitution matrix */
@@ -759,9 +1210,9 @@ s_profile* ssw_init (const int8_t* read, const int32_t readLen, const int8_t* ma
 		bias = abs(bias);
 
 		p->bias = bias;
-		p->profile_byte = qP_byte (read, mat, readLen, n, bias);
+		p->profile_byte = qP_byte (read, mat, readLen, n, bias, simd_lanes(p->simd));
 	}
-	if (score_size == 1 || score_size == 2) p->profile_word = qP_word (read, mat, readLen, n);
+	if (score_size == 1 || score_size == 2) p->profile_word = qP_word (read, mat, readLen, n, simd_lanes(p->simd) / 2);
 	p->read = read;
 	p->mat = mat;
 	p->readLen = readLen;
@@ -786,11 +1237,14 @@ s_align* ssw_align (const s_profile* prof,
 					const int32_t maskLen) {
 
 	alignment_end* bests = 0, *bests_reverse = 0;
-	__m128i* vP = 0;
+	void* vP = 0;
 	int32_t word = 0, band_width = 0, readLen = prof->readLen;
 	int8_t* read_reverse = 0;
 	cigar* path;
 	s_align* r = (s_align*)calloc(1, sizeof(s_align));
+	int simd = prof->simd;
+	void* profile_byte = prof->profile_byte, *profile_word = prof->profile_word;
+	void* sse2_byte = 0, *sse2_word = 0;
 	r->ref_begin1 = -1;
 	r->read_begin1 = -1;
 	r->cigar = 0;
@@ -799,20 +1253,31 @@ s_align* ssw_align (const s_profile* prof,
 		fprintf(stderr, "When maskLen < 15, the function ssw_align doesn't return 2nd best alignment information.\n");
 	}
 
+	/* The lazy-F loop stops once F <= H - gapO in every lane, so when gap open is not above gap
+	   extension the result depends on the striping. Use the SSE2 kernels then, so the AVX2 build
+	   gives the same alignments. */
+	if (simd != SSW_SIMD_SSE2 && weight_gapO <= weight_gapE) {
+		simd = SSW_SIMD_SSE2;
+		if (profile_byte) profile_byte = sse2_byte = qP_byte(prof->read, prof->mat, readLen, prof->n, prof->bias, simd_lanes(simd));
+		if (profile_word) profile_word = sse2_word = qP_word(prof->read, prof->mat, readLen, prof->n, simd_lanes(simd) / 2);
+	}
+
 	// Find the alignment scores and ending positions
-	if (prof->profile_byte) {
-		bests = sw_sse2_byte(ref, 0, refLen, readLen, weight_gapO, weight_gapE, prof->profile_byte, -1, prof->bias, maskLen);
-		if (prof->profile_word && bests[0].score == 255) {
+	if (profile_byte) {
+		bests = sw_byte(simd, ref, 0, refLen, readLen, weight_gapO, weight_gapE, profile_byte, -1, prof->bias, maskLen);
+		if (profile_word && bests[0].score == 255) {
 			free(bests);
-			bests = sw_sse2_word(ref, 0, refLen, readLen, weight_gapO, weight_gapE, prof->profile_word, -1, maskLen);
+			bests = sw_word(simd, ref, 0, refLen, readLen, weight_gapO, weight_gapE, profile_word, -1, maskLen);
 			word = 1;
 		} else if (bests[0].score == 255) {
 			fprintf(stderr, "Please set 2 to the score_size parameter of the function ssw_init, otherwise the alignment results will be incorrect.\n");
+			free(bests);
 			free(r);
-			return NULL;
+			r = NULL;
+			goto end;
 		}
-	}else if (prof->profile_word) {
-		bests = sw_sse2_word(ref, 0, refLen, readLen, weight_gapO, weight_gapE, prof->profile_word, -1, maskLen);
+	}else if (profile_word) {
+		bests = sw_word(simd, ref, 0, refLen, readLen, weight_gapO, weight_gapE, profile_word, -1, maskLen);
 		word = 1;
 	}else {
 		fprintf(stderr, "Please call the function ssw_init before ssw_align.\n");
@@ -836,11 +1301,11 @@ s_align* ssw_align (const s_profile* prof,
 	// Find the beginning position of the best alignment.
 	read_reverse = seq_reverse(prof->read, r->read_end1);
 	if (word == 0) {
-		vP = qP_byte(read_reverse, prof->mat, r->read_end1 + 1, prof->n, prof->bias);
-		bests_reverse = sw_sse2_byte(ref, 1, r->ref_end1 + 1, r->read_end1 + 1, weight_gapO, weight_gapE, vP, r->score1, prof->bias, maskLen);
+		vP = qP_byte(read_reverse, prof->mat, r->read_end1 + 1, prof->n, prof->bias, simd_lanes(simd));
+		bests_reverse = sw_byte(simd, ref, 1, r->ref_end1 + 1, r->read_end1 + 1, weight_gapO, weight_gapE, vP, r->score1, prof->bias, maskLen);
 	} else {
-		vP = qP_word(read_reverse, prof->mat, r->read_end1 + 1, prof->n);
-		bests_reverse = sw_sse2_word(ref, 1, r->ref_end1 + 1, r->read_end1 + 1, weight_gapO, weight_gapE, vP, r->score1, maskLen);
+		vP = qP_word(read_reverse, prof->mat, r->read_end1 + 1, prof->n, simd_lanes(simd) / 2);
+		bests_reverse = sw_word(simd, ref, 1, r->ref_end1 + 1, r->read_end1 + 1, weight_gapO, weight_gapE, vP, r->score1, maskLen);
 	}
 	free(vP);
 	free(read_reverse);
@@ -865,6 +1330,8 @@ s_align* ssw_align (const s_profile* prof,
 	}
 
 end:
+	free(sse2_byte);
+	free(sse2_word);
 	return r;
 }
 
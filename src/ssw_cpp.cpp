@@ -1,7 +1,10 @@
 #include "SeqLib/ssw_cpp.h"
+#include "SeqLib/BamRecord.h"
 #include "SeqLib/ssw.h"
+#include "SeqLib/SeqLibThreads.h"
 
 #include <sstream>
+#include <climits>
 
 namespace {
 
@@ -62,48 +65,74 @@ void ConvertAlignment(const s_align& s_al,
   al->cigar_string.clear();
 
   if (s_al.cigarLen > 0) {
-    std::ostringstream cigar_string;
     if (al->query_begin > 0) {
       uint32_t cigar = to_cigar_int(al->query_begin, 'S');
       al->cigar.push_back(cigar);
-      cigar_string << al->query_begin << 'S';
     }
 
-    for (int i = 0; i < s_al.cigarLen; ++i) {
+    for (int i = 0; i < s_al.cigarLen; ++i)
       al->cigar.push_back(s_al.cigar[i]);
-      cigar_string << cigar_int_to_len(s_al.cigar[i]) << cigar_int_to_op(s_al.cigar[i]);
-    }
 
     int end = query_len - al->query_end - 1;
     if (end > 0) {
       uint32_t cigar = to_cigar_int(end, 'S');
       al->cigar.push_back(cigar);
-      cigar_string << end << 'S';
     }
-
-    al->cigar_string = cigar_string.str();
   } // end if
 }
 
+// @Function:
+//     Write the cigar as a string, e.g. 5S40=1X10=.
+void CigarToString(const std::vector<uint32_t>& cigar, std::string* cigar_string) {
+  std::ostringstream ss;
+  for (size_t i = 0; i < cigar.size(); ++i)
+    ss << cigar_int_to_len(cigar[i]) << cigar_int_to_op(cigar[i]);
+  *cigar_string = ss.str();
+}
+
+// @Function:
+//     Count the mismatched and inserted/deleted bases of an M/I/D
+//     cigar, as CalculateNumberMismatch does, without rewriting it.
+// @Return:
+//     The edit distance, for the NM tag.
+int CountEdits(const uint32_t* cigar, const int& cigar_len,
+               int8_t const *ref, int8_t const *query) {
+  int edits = 0;
+  for (int i = 0; i < cigar_len; ++i) {
+    const char op = cigar_int_to_op(cigar[i]);
+    const uint32_t length = cigar_int_to_len(cigar[i]);
+    if (op == 'M') {
+      for (uint32_t j = 0; j < length; ++j)
+        edits += ref[j] != query[j];
+      ref += length;
+      query += length;
+    } else if (op == 'I') {
+      query += length;
+      edits += length;
+    } else if (op == 'D') {
+      ref += length;
+      edits += length;
+    }
+  }
+  return edits;
+}
+
 // @Function:
 //     Calculate the length of the previous cigar operator
-//     and store it in new_cigar and new_cigar_string.
+//     and store it in new_cigar.
 //     Clean up in_M (false), in_X (false), length_M (0), and length_X(0).
 void CleanPreviousMOperator(
     bool* in_M,
     bool* in_X,
     uint32_t* length_M,
     uint32_t* length_X,
-    std::vector<uint32_t>* new_cigar,
-    std::ostringstream* new_cigar_string) {
+    std::vector<uint32_t>* new_cigar) {
   if (*in_M) {
     uint32_t match = to_cigar_int(*length_M, '=');
     new_cigar->push_back(match);
-    (*new_cigar_string) << *length_M << '=';
   } else if (*in_X){ //in_X
     uint32_t match = to_cigar_int(*length_X, 'X');
     new_cigar->push_back(match);
-    (*new_cigar_string) << *length_X << 'X';
   }
 
   // Clean up
@@ -131,12 +160,10 @@ int CalculateNumberMismatch(
   int mismatch_length = 0;
 
   std::vector<uint32_t> new_cigar;
-  std::ostringstream new_cigar_string;
 
   if (al->query_begin > 0) {
     uint32_t cigar = to_cigar_int(al->query_begin, 'S');
     new_cigar.push_back(cigar);
-    new_cigar_string << al->query_begin << 'S';
   }
 
   bool in_M = false; // the previous is match
@@ -154,7 +181,6 @@ int CalculateNumberMismatch(
           if (in_M) { // the previous is match; however the current one is mismatche
 	    uint32_t match = to_cigar_int(length_M, '=');
 	    new_cigar.push_back(match);
-	    new_cigar_string << length_M << '=';
 	  }
 	  length_M = 0;
 	  ++length_X;
@@ -164,7 +190,6 @@ int CalculateNumberMismatch(
 	  if (in_X) { // the previous is mismatch; however the current one is matche
 	    uint32_t match = to_cigar_int(length_X, 'X');
 	    new_cigar.push_back(match);
-	    new_cigar_string << length_X << 'X';
 	  }
 	  ++length_M;
 	  length_X = 0;
@@ -177,35 +202,193 @@ int CalculateNumberMismatch(
     } else if (op == 'I') {
       query += length;
       mismatch_length += length;
-      CleanPreviousMOperator(&in_M, &in_X, &length_M, &length_X, &new_cigar, &new_cigar_string);
+      CleanPreviousMOperator(&in_M, &in_X, &length_M, &length_X, &new_cigar);
       new_cigar.push_back(al->cigar[i]);
-      new_cigar_string << length << 'I';
     } else if (op == 'D') {
       ref += length;
       mismatch_length += length;
-      CleanPreviousMOperator(&in_M, &in_X, &length_M, &length_X, &new_cigar, &new_cigar_string);
+      CleanPreviousMOperator(&in_M, &in_X, &length_M, &length_X, &new_cigar);
       new_cigar.push_back(al->cigar[i]);
-      new_cigar_string << length << 'D';
     }
   }
 
-  CleanPreviousMOperator(&in_M, &in_X, &length_M, &length_X, &new_cigar, &new_cigar_string);
+  CleanPreviousMOperator(&in_M, &in_X, &length_M, &length_X, &new_cigar);
 
   int end = query_len - al->query_end - 1;
   if (end > 0) {
     uint32_t cigar = to_cigar_int(end, 'S');
     new_cigar.push_back(cigar);
-    new_cigar_string << end << 'S';
   }
 
-  al->cigar_string.clear();
-  al->cigar.clear();
-  al->cigar_string = new_cigar_string.str();
-  al->cigar = new_cigar;
+  al->cigar.swap(new_cigar);
 
   return mismatch_length;
 }
 
+// Traceback bits of a cell of the banded DP: where H came from, and
+// whether the gap ending at the cell was extended rather than opened
+enum {
+  kFromDiagonal = 0,
+  kFromDeletion = 1,
+  kFromInsertion = 2,
+  kDeletionExtended = 4,
+  kInsertionExtended = 8
+};
+
+// H and the insertion score of a cell of the banded DP
+struct BandCell {
+  int h;
+  int ins;
+};
+
+// @Function:
+//     Banded Gotoh DP of the whole query against the reference.
+//     Row i of the band holds the cells (i, j) with
+//     j = i + ref_offset - band_width + k, k in [0, 2 * band_width],
+//     so the diagonal, up and left neighbours of cell k are cell k of
+//     the previous row, cell k + 1 of the previous row and cell k - 1.
+//     Sets the score, ref_begin, ref_end, query_begin, query_end and an
+//     M/I/D cigar.
+// @Return:
+//     False if no alignment fits in the band.
+bool BandedAlignTranslated(
+    const int8_t* query, const int query_len,
+    const int8_t* ref, const int ref_len,
+    const int8_t* matrix, const int matrix_size,
+    const int gap_open, const int gap_extend,
+    const bool global, const int band_width, const int ref_offset,
+    int* score, StripedSmithWaterman::Alignment* al) {
+
+  const int kNeg = INT_MIN / 2;
+  const int width = 2 * band_width + 1;
+  const int first = ref_offset - band_width; // j of cell 0 in row 0
+  if (global && (first > 0 || first + width <= 0)) return false;
+
+  // score of each query base against reference base j - 1, so the
+  // diagonal term is a single load
+  const int cols = ref_len + 1;
+  std::vector<int8_t> ref_profile(matrix_size * cols, 0);
+  for (int c = 0; c < matrix_size; ++c)
+    for (int j = 1; j < cols; ++j)
+      ref_profile[c * cols + j] = matrix[c * matrix_size + ref[j - 1]];
+
+  // previous and current rows; cells off the reference, and the extra
+  // cell past the band, are kNeg
+  BandCell neg = { kNeg, kNeg };
+  std::vector<BandCell> prev(width + 1, neg), cur(width + 1, neg);
+  std::vector<uint8_t> trace((query_len + 1) * width, 0);
+
+  // row 0: free start for glocal, a leading deletion for global
+  for (int k = 0; k < width; ++k) {
+    const int j = first + k;
+    if (j < 0 || j > ref_len) continue;
+    if (!global || j == 0) {
+      prev[k].h = 0;
+    } else {
+      prev[k].h = -gap_open - (j - 1) * gap_extend;
+      trace[k] = kFromDeletion | (j > 1 ? kDeletionExtended : 0);
+    }
+  }
+
+  for (int i = 1; i <= query_len; ++i) {
+    const int j0 = i + first; // j of cell 0
+    const int lo = j0 < 0 ? -j0 : 0;
+    const int hi = ref_len - j0 < width - 1 ? ref_len - j0 : width - 1;
+    // at j == 0 the diagonal cell is off the reference, so kNeg
+    const int8_t* diag_score = &ref_profile[query[i - 1] * cols];
+    const BandCell* in = &prev[0];
+    BandCell* out = &cur[0];
+    uint8_t* t = &trace[i * width];
+
+    for (int k = 0; k < width; ++k) {
+      if (k == lo && lo <= hi) k = hi + 1;
+      if (k < width) out[k] = neg;
+    }
+
+    int del = kNeg, left = kNeg; // the deletion score and H of cell k - 1
+    for (int k = lo; k <= hi; ++k) {
+
+      // deletion: gap in the query, from the left
+      const int del_open = left - gap_open;
+      const int del_ext = del - gap_extend;
+      const int del_extended = del_ext > del_open;
+      del = del_extended ? del_ext : del_open;
+
+      // insertion: gap in the reference, from above
+      const int ins_open = in[k + 1].h - gap_open;
+      const int ins_ext = in[k + 1].ins - gap_extend;
+      const int ins_extended = ins_ext > ins_open;
+      const int ins = ins_extended ? ins_ext : ins_open;
+
+      // only the max is needed for the next cell; the traceback
+      // prefers the diagonal, then the deletion, on ties
+      const int diag = in[k].h + diag_score[j0 + k];
+      const int up = diag > ins ? diag : ins;
+      const int h = up > del ? up : del;
+      const int gap = h != diag;
+
+      left = out[k].h = h;
+      out[k].ins = ins;
+      t[k] = (gap + (gap & (h != del))) | del_extended * kDeletionExtended | ins_extended * kInsertionExtended;
+    }
+    prev.swap(cur);
+  }
+
+  // the end cell: the best in the last row, or the corner for global
+  int end_k = -1;
+  if (global) {
+    end_k = ref_len - query_len - first;
+    if (end_k < 0 || end_k >= width) return false;
+  } else {
+    for (int k = 0; k < width; ++k) {
+      const int j = query_len + first + k;
+      if (j >= 0 && j <= ref_len && (end_k < 0 || prev[k].h > prev[end_k].h))
+        end_k = k;
+    }
+    if (end_k < 0) return false;
+  }
+  if (prev[end_k].h <= kNeg / 2) return false;
+  *score = prev[end_k].h;
+
+  // trace back, collecting the ops from the end
+  std::vector<char> ops;
+  int i = query_len, k = end_k, state = kFromDiagonal;
+  const int end_j = query_len + first + end_k;
+  while (i > 0 || (global && i + first + k > 0)) {
+    const uint8_t t = trace[i * width + k];
+    if (state == kFromDiagonal) {
+      state = t & 3;
+      if (state == kFromDiagonal) {
+        ops.push_back('M');
+        --i;
+      }
+    } else if (state == kFromDeletion) {
+      ops.push_back('D');
+      --k;
+      if (!(t & kDeletionExtended)) state = kFromDiagonal;
+    } else {
+      ops.push_back('I');
+      --i;
+      ++k;
+      if (!(t & kInsertionExtended)) state = kFromDiagonal;
+    }
+  }
+
+  al->ref_begin = first + k;
+  al->ref_end = end_j - 1;
+  al->query_begin = 0;
+  al->query_end = query_len - 1;
+  al->cigar.clear();
+  for (size_t n = ops.size(); n > 0; ) {
+    const char op = ops[n - 1];
+    uint32_t len = 0;
+    for (; n > 0 && ops[n - 1] == op; --n) ++len;
+    al->cigar.push_back(to_cigar_int(len, op));
+  }
+
+  return true;
+}
+
 void SetFlag(const StripedSmithWaterman::Filter& filter, uint8_t* flag) {
   if (filter.report_begin_position) *flag |= 0x08;
   if (filter.report_cigar) *flag |= 0x0f;
@@ -323,6 +506,27 @@ int Aligner::TranslateBase(const char* bases, const int& length,
 }
 
 
+void Aligner::AlignTranslated(const s_profile* profile,
+                              const int8_t* query, const int& query_len,
+                              const int8_t* ref, const int& ref_len,
+                              const Filter& filter, Alignment* alignment) const
+{
+  uint8_t flag = 0;
+  SetFlag(filter, &flag);
+  s_align* s_al = ssw_align(profile, ref, ref_len,
+                                 static_cast<int>(gap_opening_penalty_),
+				 static_cast<int>(gap_extending_penalty_),
+				 flag, filter.score_filter, filter.distance_filter, query_len);
+
+  alignment->Clear();
+  ConvertAlignment(*s_al, query_len, alignment);
+  alignment->mismatches = CalculateNumberMismatch(&*alignment, ref, query, query_len);
+  if (filter.report_cigar_string)
+    CigarToString(alignment->cigar, &alignment->cigar_string);
+
+  align_destroy(s_al);
+}
+
 bool Aligner::Align(const char* query, const Filter& filter,
                     Alignment* alignment) const
 {
@@ -338,21 +542,11 @@ bool Aligner::Align(const char* query, const Filter& filter,
   s_profile* profile = ssw_init(translated_query, query_len, score_matrix_,
                                 score_matrix_size_, score_size);
 
-  uint8_t flag = 0;
-  SetFlag(filter, &flag);
-  s_align* s_al = ssw_align(profile, translated_reference_, reference_length_,
-                                 static_cast<int>(gap_opening_penalty_),
-				 static_cast<int>(gap_extending_penalty_),
-				 flag, filter.score_filter, filter.distance_filter, query_len);
-
-  alignment->Clear();
-  ConvertAlignment(*s_al, query_len, alignment);
-  alignment->mismatches = CalculateNumberMismatch(&*alignment, translated_reference_, translated_query, query_len);
-
+  AlignTranslated(profile, translated_query, query_len,
+                  translated_reference_, reference_length_, filter, alignment);
 
   // Free memory
   delete [] translated_query;
-  align_destroy(s_al);
   init_destroy(profile);
 
   return true;
@@ -382,26 +576,293 @@ bool Aligner::Align(const char* query, const char* ref, const int& ref_len,
   s_profile* profile = ssw_init(translated_query, query_len, score_matrix_,
                                 score_matrix_size_, score_size);
 
-  uint8_t flag = 0;
-  SetFlag(filter, &flag);
-  s_align* s_al = ssw_align(profile, translated_ref, valid_ref_len,
-                                 static_cast<int>(gap_opening_penalty_),
-				 static_cast<int>(gap_extending_penalty_),
-				 flag, filter.score_filter, filter.distance_filter, query_len);
-
-  alignment->Clear();
-  ConvertAlignment(*s_al, query_len, alignment);
-  alignment->mismatches = CalculateNumberMismatch(&*alignment, translated_ref, translated_query, query_len);
+  AlignTranslated(profile, translated_query, query_len,
+                  translated_ref, valid_ref_len, filter, alignment);
 
   // Free memory
   delete [] translated_query;
   delete [] translated_ref;
-  align_destroy(s_al);
   init_destroy(profile);
 
   return true;
 }
 
+bool Aligner::BuildQueryProfile(const char* query, const int& query_len,
+                                QueryProfile* profile) const
+{
+  if (!translation_matrix_) return false;
+  if (query_len <= 0) return false;
+
+  // keep the translation buffer, but the profile depends on the length
+  profile->Clear();
+  profile->translated_query_.resize(query_len);
+  TranslateBase(query, query_len, &profile->translated_query_[0]);
+
+  const int8_t score_size = 2;
+  profile->profile_ = ssw_init(&profile->translated_query_[0], query_len, score_matrix_,
+                               score_matrix_size_, score_size);
+  profile->query_length_ = query_len;
+
+  return true;
+}
+
+bool Aligner::Align(const QueryProfile& profile, const Filter& filter,
+                    Alignment* alignment) const
+{
+  if (!profile.profile_) return false;
+  if (reference_length_ == 0) return false;
+
+  AlignTranslated(profile.profile_, &profile.translated_query_[0], profile.query_length_,
+                  translated_reference_, reference_length_, filter, alignment);
+
+  return true;
+}
+
+bool Aligner::Align(const QueryProfile& profile, const char* ref, const int& ref_len,
+                    const Filter& filter, Alignment* alignment)
+{
+  return AlignProfile(profile, ref, ref_len, &reference_scratch_, filter, alignment);
+}
+
+bool Aligner::AlignProfile(const QueryProfile& profile, const char* ref, const int& ref_len,
+                           std::vector<int8_t>* scratch,
+                           const Filter& filter, Alignment* alignment) const
+{
+  if (!translation_matrix_) return false;
+  if (!profile.profile_) return false;
+  if (ref_len <= 0) return false;
+
+  if (scratch->size() < static_cast<size_t>(ref_len))
+    scratch->resize(ref_len);
+  TranslateBase(ref, ref_len, &(*scratch)[0]);
+
+  AlignTranslated(profile.profile_, &profile.translated_query_[0], profile.query_length_,
+                  &(*scratch)[0], ref_len, filter, alignment);
+
+  return true;
+}
+
+// Queries of an AlignBatch call, shared by the threads
+struct BatchQueue {
+  const std::vector<std::string>* queries;
+  const std::vector<std::string>* references;
+  const std::vector<AlignPair>* pairs;
+  const Filter* filter;
+  std::vector<Alignment>* results;
+
+  // pair indices grouped by query: query q owns order[start[q], start[q+1])
+  std::vector<int> order;
+  std::vector<int> start;
+
+  pthread_mutex_t mutex;
+  int next_query;
+  bool failed;
+};
+
+// One thread of AlignBatch, with its own profile and reference buffers
+struct BatchWorker {
+  const Aligner* aligner;
+  BatchQueue* queue;
+
+  void operator()() {
+    QueryProfile profile;
+    std::vector<int8_t> ref;
+    const int num_queries = static_cast<int>(queue->start.size()) - 1;
+    bool failed = false;
+
+    for (;;) {
+      int q;
+      {
+        SeqLib::ScopedLock lock(&queue->mutex);
+        q = queue->next_query++;
+      }
+      if (q >= num_queries) break;
+      if (queue->start[q] == queue->start[q + 1]) continue;
+
+      const std::string& query = (*queue->queries)[q];
+      if (!aligner->BuildQueryProfile(query.c_str(), query.length(), &profile)) {
+        failed = true;
+        continue;
+      }
+
+      for (int i = queue->start[q]; i < queue->start[q + 1]; ++i) {
+        const int p = queue->order[i];
+        const std::string& r = (*queue->references)[(*queue->pairs)[p].second];
+        if (!aligner->AlignProfile(profile, r.c_str(), r.length(), &ref,
+                                   *queue->filter, &(*queue->results)[p]))
+          failed = true;
+      }
+    }
+
+    if (failed) {
+      SeqLib::ScopedLock lock(&queue->mutex);
+      queue->failed = true;
+    }
+  }
+};
+
+bool Aligner::AlignBatch(const std::vector<std::string>& queries,
+                         const std::vector<std::string>& references,
+                         const std::vector<AlignPair>& pairs,
+                         const int& nthreads,
+                         std::vector<Alignment>* results,
+                         const Filter& filter) const
+{
+  if (!translation_matrix_) return false;
+
+  const int num_queries = static_cast<int>(queries.size());
+  const int num_refs = static_cast<int>(references.size());
+  for (size_t i = 0; i < pairs.size(); ++i)
+    if (pairs[i].first < 0 || pairs[i].first >= num_queries ||
+        pairs[i].second < 0 || pairs[i].second >= num_refs)
+      return false;
+
+  results->assign(pairs.size(), Alignment());
+  for (size_t i = 0; i < results->size(); ++i) (*results)[i].Clear();
+
+  // counting sort of the pairs by query, keeping their order
+  BatchQueue queue;
+  queue.queries = &queries;
+  queue.references = &references;
+  queue.pairs = &pairs;
+  queue.filter = &filter;
+  queue.results = results;
+  queue.start.assign(num_queries + 1, 0);
+  for (size_t i = 0; i < pairs.size(); ++i) ++queue.start[pairs[i].first + 1];
+  for (int q = 0; q < num_queries; ++q) queue.start[q + 1] += queue.start[q];
+  queue.order.resize(pairs.size());
+  std::vector<int> fill(queue.start.begin(), queue.start.end() - 1);
+  for (size_t i = 0; i < pairs.size(); ++i) queue.order[fill[pairs[i].first]++] = i;
+  queue.next_query = 0;
+  queue.failed = false;
+
+  pthread_mutex_init(&queue.mutex, NULL);
+  BatchWorker w;
+  w.aligner = this;
+  w.queue = &queue;
+  std::vector<BatchWorker> workers(nthreads < 1 ? 1 : nthreads, w);
+  try {
+    SeqLib::RunThreads(workers);
+  } catch (...) {
+    pthread_mutex_destroy(&queue.mutex);
+    throw;
+  }
+  pthread_mutex_destroy(&queue.mutex);
+
+  return !queue.failed;
+}
+
+bool Aligner::AlignBanded(const char* query, const int& query_len,
+                          const char* ref, const int& ref_len,
+                          const BandedMode& mode, const int& band_width,
+                          const int& ref_offset, Alignment* alignment) const
+{
+  if (!translation_matrix_) return false;
+  if (query_len <= 0 || ref_len <= 0 || band_width < 0) return false;
+
+  std::vector<int8_t> translated_query(query_len), translated_ref(ref_len);
+  TranslateBase(query, query_len, &translated_query[0]);
+  TranslateBase(ref, ref_len, &translated_ref[0]);
+
+  alignment->Clear();
+  int score = 0;
+  if (!BandedAlignTranslated(&translated_query[0], query_len, &translated_ref[0], ref_len,
+                             score_matrix_, score_matrix_size_,
+                             static_cast<int>(gap_opening_penalty_),
+                             static_cast<int>(gap_extending_penalty_),
+                             mode == kGlobal, band_width, ref_offset, &score, alignment)) {
+    alignment->Clear();
+    return false;
+  }
+
+  alignment->sw_score = score < 0 ? 0 : (score > 65535 ? 65535 : score);
+  alignment->mismatches = CalculateNumberMismatch(alignment, &translated_ref[0],
+                                                  &translated_query[0], query_len);
+  CigarToString(alignment->cigar, &alignment->cigar_string);
+
+  return true;
+}
+
+bool Aligner::Align(SeqLib::BamRecord* record, const int32_t& ref_pos,
+                    const Filter& filter)
+{
+  if (reference_length_ == 0) return false;
+  return AlignRecord(record, translated_reference_, reference_length_, ref_pos, filter);
+}
+
+bool Aligner::Align(SeqLib::BamRecord* record, const char* ref, const int& ref_len,
+                    const int32_t& ref_pos, const Filter& filter)
+{
+  if (!translation_matrix_) return false;
+  if (ref_len <= 0) return false;
+
+  if (reference_scratch_.size() < static_cast<size_t>(ref_len))
+    reference_scratch_.resize(ref_len);
+  TranslateBase(ref, ref_len, &reference_scratch_[0]);
+
+  return AlignRecord(record, &reference_scratch_[0], ref_len, ref_pos, filter);
+}
+
+bool Aligner::AlignRecord(SeqLib::BamRecord* record, const int8_t* ref, const int& ref_len,
+                          const int32_t& ref_pos, const Filter& filter)
+{
+  if (!translation_matrix_) return false;
+
+  bam1_t* b = record->raw();
+  const int query_len = b->core.l_qseq;
+  if (query_len <= 0) return false;
+
+  // translate straight from the 4-bit encoding
+  int8_t nt16[16];
+  for (int i = 0; i < 16; ++i)
+    nt16[i] = translation_matrix_[static_cast<int>(seq_nt16_str[i])];
+  if (query_scratch_.size() < static_cast<size_t>(query_len))
+    query_scratch_.resize(query_len);
+  const uint8_t* seq = bam_get_seq(b);
+  for (int i = 0; i < query_len; ++i)
+    query_scratch_[i] = nt16[bam_seqi(seq, i)];
+
+  const int8_t score_size = 2;
+  s_profile* profile = ssw_init(&query_scratch_[0], query_len, score_matrix_,
+                                score_matrix_size_, score_size);
+  s_align* s_al = ssw_align(profile, ref, ref_len,
+                            static_cast<int>(gap_opening_penalty_),
+                            static_cast<int>(gap_extending_penalty_),
+                            0x0f, filter.score_filter, filter.distance_filter, query_len);
+  init_destroy(profile);
+
+  if (!s_al || s_al->cigarLen <= 0) {
+    if (s_al) align_destroy(s_al);
+    return false;
+  }
+
+  // soft clip the unaligned ends, as ConvertAlignment does
+  cigar_scratch_.clear();
+  if (s_al->read_begin1 > 0)
+    cigar_scratch_.push_back(to_cigar_int(s_al->read_begin1, 'S'));
+  cigar_scratch_.insert(cigar_scratch_.end(), s_al->cigar, s_al->cigar + s_al->cigarLen);
+  const int end = query_len - s_al->read_end1 - 1;
+  if (end > 0)
+    cigar_scratch_.push_back(to_cigar_int(end, 'S'));
+
+  const int edits = CountEdits(s_al->cigar, s_al->cigarLen, ref + s_al->ref_begin1,
+                               &query_scratch_[0] + s_al->read_begin1);
+  const int32_t score = s_al->score1;
+
+  record->SetCigar(&cigar_scratch_[0], cigar_scratch_.size());
+  b->core.pos = ref_pos + s_al->ref_begin1;
+  b->core.flag &= ~BAM_FUNMAP;
+  b->core.bin = hts_reg2bin(b->core.pos, bam_endpos(b), 14, 5);
+  align_destroy(s_al);
+
+  record->RemoveTag("NM");
+  record->AddIntTag("NM", edits);
+  record->RemoveTag("AS");
+  record->AddIntTag("AS", score);
+
+  return true;
+}
+
 void Aligner::Clear(void) {
   ClearMatrices();
   CleanReferenceSequence();
@@ -474,4 +935,13 @@ void Aligner::ClearMatrices(void) {
   delete [] translation_matrix_;
   translation_matrix_ = NULL;
 }
+QueryProfile::~QueryProfile(void) {
+  Clear();
+}
+
+void QueryProfile::Clear(void) {
+  if (profile_) init_destroy(profile_);
+  profile_ = NULL;
+  query_length_ = 0;
+}
 } // namespace StripedSmithWaterman